@@ -0,0 +1,138 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Memory.hpp>
+
+#include <sys/time.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace atom;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    /**
+     * Creates a linked list of [index, next] object arrays, returns its head.
+     */
+    Ref buildChain(Memory& mem, int length)
+    {
+        RefHandle head(zeroRef(), &mem);
+
+        for(int i = length - 1; i >= 0; --i)
+        {
+            ObjectArray* node = mem.createObjectArray(2);
+
+            node->atPut(0, word2ref(i));
+            node->atPut(1, head.ref());
+            head.ref(ptr2ref(node));
+        }
+
+        return head.ref();
+    }
+
+    /**
+     * Creates an array of width two element leaf arrays whose first slot points to
+     * another small array. Leaves are allocated interleaved so allocation order does
+     * not match traversal order.
+     */
+    Ref buildWide(Memory& mem, int width)
+    {
+        PtrHandle<ObjectArray> root(mem.createObjectArray(width), &mem);
+
+        for(int i = 0; i < width; ++i)
+        {
+            root->atPut((int) ((i * 7919LL) % width), ptr2ref(mem.createObjectArray(2)));
+        }
+
+        for(int i = 0; i < width; ++i)
+        {
+            ObjectArray* inner = mem.createObjectArray(1);
+            inner->atPut(0, word2ref(i));
+            cast<ObjectArray>(root->at(i))->atPut(0, ptr2ref(inner));
+        }
+
+        return ptr2ref(root.ptr());
+    }
+
+    long walkChain(Ref r)
+    {
+        long sum = 0;
+
+        while(r != zeroRef())
+        {
+            ObjectArray* node = cast<ObjectArray>(r);
+            sum += int_val(node->at(0));
+            r = node->at(1);
+        }
+
+        return sum;
+    }
+
+    long walkWide(Ref r)
+    {
+        ObjectArray* root = cast<ObjectArray>(r);
+        long sum = 0;
+
+        for(int i = 0; i < root->size(); ++i)
+        {
+            sum += int_val(cast<ObjectArray>(cast<ObjectArray>(root->at(i))->at(0))->at(0));
+        }
+
+        return sum;
+    }
+
+    void bench(char const* name, Ref (*build)(Memory&, int), long (*walk)(Ref), int n, bool hierarchical)
+    {
+        const int rounds = 10;
+        Memory mem(n * 8 + 4096);
+
+        mem.hierarchicalCopy_ = hierarchical;
+
+        RefHandle root(build(mem, n), &mem);
+        double gcTime = 0;
+        double walkTime = 0;
+        long check = 0;
+
+        for(int i = 0; i < rounds; ++i)
+        {
+            double start = now();
+            mem.flipSpaces();
+            gcTime += now() - start;
+
+            start = now();
+            check += walk(root.ref());
+            walkTime += now() - start;
+        }
+
+        std::cout << name << (hierarchical ? " hierarchical" : " breadth-first") << ": "
+                  << gcTime * 1000 / rounds << " ms/collection, "
+                  << walkTime * 1000 / rounds << " ms/traversal (" << check << ")\n";
+    }
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    for(int h = 0; h < 2; ++h)
+    {
+        bench("deep chain", &buildChain, &walkChain, n, h == 1);
+        bench("wide array", &buildWide, &walkWide, n, h == 1);
+    }
+
+    return 0;
+}
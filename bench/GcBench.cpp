@@ -0,0 +1,307 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Thread.hpp>
+#include <vm/Opcode.hpp>
+
+#include <sys/time.h>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+using namespace atom;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void report(char const* name, double seconds, double count, char const* unit)
+    {
+        std::cout << name << ": " << seconds * 1000 << " ms, " << count / seconds << " " << unit << "/s\n";
+    }
+
+    /**
+     * Builds a two level tree of object arrays (width x 16 leaves) and returns the root.
+     */
+    Ref buildTree(Memory& mem, int width)
+    {
+        PtrHandle<ObjectArray> root(mem.createObjectArray(width), &mem);
+
+        for(int i = 0; i < width; ++i)
+        {
+            PtrHandle<ObjectArray> node(mem.createObjectArray(16), &mem);
+
+            for(int j = 0; j < 16; ++j)
+            {
+                node->atPut(j, ptr2ref(mem.createObjectArray(2)));
+            }
+
+            root->atPut(i, ptr2ref(node.ptr()));
+        }
+
+        return ptr2ref(root.ptr());
+    }
+
+    /**
+     * Times full collections of a heap with width * 17 live objects and handleCount extra roots.
+     */
+    void benchCollect(int width, int handleCount, int rounds)
+    {
+        Memory mem(width * 17 * 8 + 4096);
+        RefHandle root(buildTree(mem, width), &mem);
+        std::vector<RefHandle> handles;
+
+        handles.reserve(handleCount);
+
+        for(int i = 0; i < handleCount; ++i)
+        {
+            handles.push_back(RefHandle(cast<ObjectArray>(root.ref())->at(i % width), &mem));
+        }
+
+        double start = now();
+
+        for(int i = 0; i < rounds; ++i)
+        {
+            mem.flipSpaces();
+        }
+
+        double elapsed = now() - start;
+
+        std::cout << "collect (" << width * 17 << " objects, " << handleCount << " handles): "
+                  << elapsed * 1000 / rounds << " ms/collection\n";
+    }
+
+    /**
+     * Times creating and destroying handles while liveCount other handles are registered.
+     */
+    void benchHandles(int liveCount, int iterations)
+    {
+        Memory mem(4096);
+        RefHandle target(ptr2ref(mem.createObjectArray(0)), &mem);
+        std::vector<RefHandle> live(liveCount, target);
+
+        double start = now();
+
+        for(int i = 0; i < iterations; ++i)
+        {
+            RefHandle h(target.ref(), &mem);
+            PtrHandle<ObjectArray> p(cast<ObjectArray>(h.ref()), &mem);
+        }
+
+        report("handle create/destroy", now() - start, iterations, "pairs");
+    }
+
+    /**
+     * Creates count short strings in a heap with a nursery keeping the last 1024 of every 16th
+     * one alive, then times reading and collecting count / 16 live strings.
+     */
+    void benchStrings(int count)
+    {
+        Memory mem(count, 1 << 14);
+        PtrHandle<ObjectArray> recent(mem.createObjectArray(1024), &mem);
+
+        double start = now();
+
+        for(int i = 0; i < count; ++i)
+        {
+            Ref str = mem.createByteArrayFromString("a short string");
+
+            if(i % 16 == 0)
+            {
+                recent->atPut((i / 16) % 1024, str);
+            }
+        }
+
+        report("create string", now() - start, count, "strings");
+
+        PtrHandle<ObjectArray> kept(mem.createObjectArray(count / 16), &mem);
+
+        for(int i = 0; i < count / 16; ++i)
+        {
+            Ref str = mem.createByteArrayFromString("a short string");
+            kept->atPut(i, str);
+        }
+
+        mem.flipSpaces();
+
+        start = now();
+        long bytes = 0;
+
+        for(int i = 0; i < count / 16; ++i)
+        {
+            bytes += cast<ByteArray>(kept->at(i))->data()[i % 14];
+        }
+
+        report("read string", now() - start, count / 16, "strings");
+
+        if(bytes == 0)
+        {
+            std::cout << "  strings are empty\n";
+        }
+
+        start = now();
+
+        for(int i = 0; i < 20; ++i)
+        {
+            mem.flipSpaces();
+        }
+
+        std::cout << "collect (" << count / 16 << " strings): " << (now() - start) * 1000 / 20 << " ms/collection\n";
+    }
+
+    /**
+     * Times full collections of a heap holding a large array of the given number of slots
+     * and a small tree, with objects of at least largeSize slots in the large object space.
+     */
+    void benchLargeArray(int slots, word largeSize)
+    {
+        HeapPolicy policy(slots * 2 + 65536);
+        policy.largeSize = largeSize;
+
+        Memory mem(policy);
+        PtrHandle<ObjectArray> large(mem.createObjectArray(slots), &mem);
+        RefHandle tree(buildTree(mem, 100), &mem);
+
+        for(int i = 0; i < slots; ++i)
+        {
+            large->atPut(i, word2ref(i));
+        }
+
+        large->atPut(0, tree.ref());
+
+        double start = now();
+
+        for(int i = 0; i < 20; ++i)
+        {
+            mem.flipSpaces();
+        }
+
+        std::cout << "collect (" << slots << " slot array, " << (largeSize > 0 ? "large object space" : "copied") << "): "
+                  << (now() - start) * 1000 / 20 << " ms/collection, " << mem.large_.savedSlots_ * sizeof(Ref) << " bytes not copied\n";
+    }
+
+    /**
+     * Runs count steps of a numeric loop keeping its state in a heap array, the way
+     * interpreted code keeps floats in temps. When boxed is set every result is stored in a
+     * new FloatObject, otherwise Memory::createFloat decides.
+     */
+    void benchFloats(int count, bool boxed)
+    {
+        Memory mem(1 << 20, 1 << 17);
+        PtrHandle<ObjectArray> state(mem.createObjectArray(2), &mem);
+
+        state->atPut(0, mem.createFloat(1.0));
+        state->atPut(1, mem.createFloat(0.0));
+
+        const long allocations = mem.allocations_;
+        double start = now();
+
+        for(int i = 0; i < count; ++i)
+        {
+            // x = x * 1.0000001, sum = sum + x
+            const double x = float_val(state->at(0)) * 1.0000001;
+            const double sum = float_val(state->at(1)) + x;
+
+            if(boxed)
+            {
+                FloatObject* fx = mem.createObject<FloatObject>();
+                fx->value_ = x;
+                state->atPut(0, ptr2ref(fx));
+
+                FloatObject* fsum = mem.createObject<FloatObject>();
+                fsum->value_ = sum;
+                state->atPut(1, ptr2ref(fsum));
+            }
+            else
+            {
+                state->atPut(0, mem.createFloat(x));
+                state->atPut(1, mem.createFloat(sum));
+            }
+        }
+
+        report(boxed ? "float loop (boxed)" : "float loop (immediate)", now() - start, count, "iterations");
+        std::cout << "  sum: " << float_val(state->at(1)) << ", allocations: " << mem.allocations_ - allocations
+                  << ", minor collections: " << mem.minorCollections_ << "\n";
+    }
+
+    void add1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) + 1));
+    }
+
+    /**
+     * Runs a loop sending to a native and a simple function and creating a small array
+     * at each iteration. Measures Thread::step throughput.
+     */
+    void benchStep(long steps)
+    {
+        // retres $0
+        static const byte identityBytes[] = {Opcode::RETURN_RESULT, 0};
+
+        // 0: send $1 to $2 > $1
+        // 4: send $1 to $4 > $1
+        // 8: croa ($1 $1) > $5
+        // 13: jmp $3
+        static const byte loopBytes[] = {
+            Opcode::SEND_VAL_TO_VAL_WRES, 1, 2, 1,
+            Opcode::SEND_VAL_TO_VAL_WRES, 1, 4, 1,
+            Opcode::CREATE_OBJECT_ARRAY, 2, 1, 1, 5,
+            Opcode::JUMP, 3
+        };
+
+        Memory mem(1 << 20, 1 << 17);
+        Thread thread(&mem);
+
+        PtrHandle<SimpleFunction> identity(mem.createObject<SimpleFunction>(1 + 2), &mem);
+        identity->atPut(0, mem.createUnmanagedByteArray((byte*) identityBytes, sizeof(identityBytes)));
+        identity->atPut(1, word2ref(0));
+
+        PtrHandle<SimpleFunction> loop(mem.createObject<SimpleFunction>(1 + 5), &mem);
+        loop->atPut(0, mem.createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+        loop->atPut(1, word2ref(1));
+        loop->atPut(2, mem.createNativeFunction(&add1));
+        loop->atPut(3, word2ref(0));
+        loop->atPut(4, ptr2ref(identity.ptr()));
+
+        thread.prepareInitialSend(RefHandle(ptr2ref(loop.ptr()), &mem), RefHandle(word2ref(0), &mem));
+
+        double start = now();
+
+        for(long i = 0; i < steps; ++i)
+        {
+            thread.step();
+        }
+
+        report("Thread::step", now() - start, steps, "steps");
+        std::cout << "  minor collections: " << mem.minorCollections_ << ", major collections: " << mem.majorCollections_ << "\n";
+    }
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+    int scale = argc > 1 ? std::atoi(argv[1]) : 1;
+
+    benchCollect(1000 * scale, 0, 20);
+    benchCollect(1000 * scale, 1000, 20);
+    benchHandles(10000, 100000 * scale);
+    benchStrings(1000000 * scale);
+    benchLargeArray(1000000 * scale, 0);
+    benchLargeArray(1000000 * scale, HeapPolicy().largeSize);
+    benchFloats(10000000 * scale, true);
+    benchFloats(10000000 * scale, false);
+    benchStep(5000000L * scale);
+
+    return 0;
+}
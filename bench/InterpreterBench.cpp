@@ -0,0 +1,333 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Thread.hpp>
+#include <vm/Opcode.hpp>
+
+#include <sys/time.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace atom;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void add1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) + 1));
+    }
+
+    void sub1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) - 1));
+    }
+
+    void lessThan(Thread* thread, int resultTmp, Ref message)
+    {
+        ObjectArray* args = cast<ObjectArray>(message);
+        thread->setResult(resultTmp, word2ref(int_val(args->at(0)) < int_val(args->at(1)) ? 1 : 0));
+    }
+
+    void addInts(Thread* thread, int resultTmp, Ref message)
+    {
+        ObjectArray* args = cast<ObjectArray>(message);
+        thread->setResult(resultTmp, word2ref(int_val(args->at(0)) + int_val(args->at(1))));
+    }
+
+    void lessThanDirect(Thread* thread, int resultTmp, Ref const* args)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) < int_val(args[1]) ? 1 : 0));
+    }
+
+    void addIntsDirect(Thread* thread, int resultTmp, Ref const* args)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) + int_val(args[1])));
+    }
+
+    // Temps: $2 add1, $3 loop ip, $4 limit, $5 lessThan, $6 array, $7 0, $8 identity,
+    //        $9 counter, $10 tmp, $11 cond, $12 pair
+    const byte loopBytes[] = {
+        Opcode::SET_LOCAL, 9, 7,                        //  0: set $9 $7
+        Opcode::SEND_VAL_TO_VAL_WRES, 9, 2, 9,          //  3: send $9 to $2 > $9
+        Opcode::ARRAY_AT_PUT, 6, 7, 9,                  //  7: aput $6 $7 $9
+        Opcode::ARRAY_AT, 6, 7, 10,                     // 11: aat $6 $7 > $10
+        Opcode::SET_LOCAL, 10, 9,                       // 15: set $10 $9
+        Opcode::ARRAY_LENGTH, 6, 11,                    // 18: alen $6 > $11
+        Opcode::CREATE_OBJECT_ARRAY, 2, 10, 4, 12,      // 21: croa ($10 $4) > $12
+        Opcode::SEND_VAL_TO_VAL_WRES, 12, 5, 11,        // 26: send $12 to $5 > $11
+        Opcode::CONDITIONAL_ONE, 11,                    // 30: if1 $11
+        Opcode::JUMP, 3,                                // 32: jmp $3
+        Opcode::HALT                                    // 34: halt
+    };
+
+    // A loop dominated by sends to a simple function.
+    const byte callLoopBytes[] = {
+        Opcode::SET_LOCAL, 9, 7,                        //  0: set $9 $7
+        Opcode::SEND_VAL_TO_VAL_WRES, 9, 2, 9,          //  3: send $9 to $2 > $9
+        Opcode::SEND_VAL_TO_VAL_WRES, 9, 8, 10,         //  7: send $9 to $8 > $10
+        Opcode::SEND_VAL_TO_VAL_WRES, 10, 8, 10,        // 11: send $10 to $8 > $10
+        Opcode::SEND_VAL_TO_VAL_WRES, 10, 8, 10,        // 15: send $10 to $8 > $10
+        Opcode::CREATE_OBJECT_ARRAY, 2, 10, 4, 12,      // 19: croa ($10 $4) > $12
+        Opcode::SEND_VAL_TO_VAL_WRES, 12, 5, 11,        // 24: send $12 to $5 > $11
+        Opcode::CONDITIONAL_ONE, 11,                    // 28: if1 $11
+        Opcode::JUMP, 3,                                // 30: jmp $3
+        Opcode::HALT                                    // 32: halt
+    };
+
+    const byte identityBytes[] = {
+        Opcode::RETURN_RESULT, 0                        //  0: retres $0
+    };
+
+    // Temps: $2 object, $3 loop ip, $4 limit, $5 counter
+    const byte metaLoopBytes[] = {
+        Opcode::SET_LOCAL, 5, 4,                        //  0: set $5 $4
+        Opcode::SEND_VAL_TO_VAL_WRES, 5, 2, 5,          //  3: send $5 to $2 > $5
+        Opcode::CONDITIONAL_NOT_ONE, 5,                 //  7: ifnot1 $5
+        Opcode::JUMP, 3,                                //  9: jmp $3
+        Opcode::HALT                                    // 11: halt
+    };
+
+    // Metaobjects decrementing the real message. Temps: $2 2, $3 sub1, $4 and $5 locals.
+    const byte metaMessageBytes[] = {
+        Opcode::ARRAY_AT, 0, 2, 4,                      //  0: aat $0 $2 > $4
+        Opcode::SEND_VAL_TO_VAL_WRES, 4, 3, 4,          //  4: send $4 to $3 > $4
+        Opcode::RETURN_RESULT, 4                        //  8: retres $4
+    };
+
+    const byte metaArgsBytes[] = {
+        Opcode::META_ARGS, 4, 5,                        //  0: margs $4 $5
+        Opcode::SEND_VAL_TO_VAL_WRES, 5, 3, 5,          //  3: send $5 to $3 > $5
+        Opcode::RETURN_RESULT, 5                        //  7: retres $5
+    };
+
+    // Counting loops. Temps: $2 addInts, $3 loop ip, $4 limit, $5 lessThan, $6 1, $7 counter,
+    //        $8 pair, $9 cond
+    const byte sendCountBytes[] = {
+        Opcode::CREATE_OBJECT_ARRAY, 2, 7, 6, 8,        //  0: croa ($7 $6) > $8
+        Opcode::SEND_VAL_TO_VAL_WRES, 8, 2, 7,          //  5: send $8 to $2 > $7
+        Opcode::CREATE_OBJECT_ARRAY, 2, 7, 4, 8,        //  9: croa ($7 $4) > $8
+        Opcode::SEND_VAL_TO_VAL_WRES, 8, 5, 9,          // 14: send $8 to $5 > $9
+        Opcode::CONDITIONAL_ONE, 9,                     // 18: if1 $9
+        Opcode::JUMP, 3,                                // 20: jmp $3
+        Opcode::HALT                                    // 22: halt
+    };
+
+    const byte opcodeCountBytes[] = {
+        Opcode::ADD, 7, 6, 2, 7,                        //  0: add $7 $6 with $2 > $7
+        Opcode::LESS_THAN, 7, 4, 5, 9,                  //  5: lt $7 $4 with $5 > $9
+        Opcode::CONDITIONAL_ONE, 9,                     // 10: if1 $9
+        Opcode::JUMP, 3,                                // 12: jmp $3
+        Opcode::HALT                                    // 14: halt
+    };
+
+    const byte callCountBytes[] = {
+        Opcode::CALL_NATIVE, 2, 2, 7, 6, 7,             //  0: call $2 [$7, $6] > $7
+        Opcode::CALL_NATIVE, 2, 5, 7, 4, 9,             //  6: call $5 [$7, $4] > $9
+        Opcode::CONDITIONAL_ONE, 9,                     // 12: if1 $9
+        Opcode::JUMP, 3,                                // 14: jmp $3
+        Opcode::HALT                                    // 16: halt
+    };
+
+    enum CountLoop
+    {
+        SEND_COUNT,
+        OPCODE_COUNT,
+        CALL_COUNT
+    };
+
+    /**
+     * Creates a simple function running one of the loops above limit times.
+     */
+    Ref createLoop(Memory& mem, word limit, bool calls)
+    {
+        PtrHandle<SimpleFunction> identity(mem.createObject<SimpleFunction>(1 + 2), &mem);
+        Ref identityCode = mem.createUnmanagedByteArray((byte*) identityBytes, sizeof(identityBytes));
+        identity->atPut(0, identityCode);
+        identity->atPut(1, word2ref(0));
+
+        PtrHandle<SimpleFunction> fn(mem.createObject<SimpleFunction>(1 + 9), &mem);
+        Ref bytecodes = calls ? mem.createUnmanagedByteArray((byte*) callLoopBytes, sizeof(callLoopBytes))
+                              : mem.createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes));
+
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(4));
+
+        Ref add1Fn = mem.createNativeFunction(&add1);
+        fn->atPut(2, add1Fn);
+        fn->atPut(3, word2ref(3));
+        fn->atPut(4, word2ref(limit));
+
+        Ref lessThanFn = mem.createNativeFunction(&lessThan);
+        fn->atPut(5, lessThanFn);
+
+        Ref array = ptr2ref(mem.createObjectArray(1), true);
+        fn->atPut(6, array);
+        fn->atPut(7, word2ref(0));
+        fn->atPut(8, ptr2ref(identity.ptr()));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    /**
+     * Creates a simple function sending limit - 1 messages to an object whose metaobject is
+     * a simple function.
+     */
+    Ref createMetaLoop(Memory& mem, word limit, bool metaArgs)
+    {
+        PtrHandle<SimpleFunction> mo(mem.createObject<SimpleFunction>(1 + 4), &mem);
+        Ref moCode = metaArgs ? mem.createUnmanagedByteArray((byte*) metaArgsBytes, sizeof(metaArgsBytes))
+                              : mem.createUnmanagedByteArray((byte*) metaMessageBytes, sizeof(metaMessageBytes));
+        mo->atPut(0, moCode);
+        mo->atPut(1, word2ref(2));
+        mo->atPut(2, word2ref(2));
+
+        Ref sub1Fn = mem.createNativeFunction(&sub1);
+        mo->atPut(3, sub1Fn);
+
+        PtrHandle<Object> target(mem.createObject<Object>(2), &mem);
+        target->atPut(0, ptr2ref(mo.ptr()));
+
+        PtrHandle<SimpleFunction> fn(mem.createObject<SimpleFunction>(1 + 5), &mem);
+        Ref bytecodes = mem.createUnmanagedByteArray((byte*) metaLoopBytes, sizeof(metaLoopBytes));
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(1));
+        fn->atPut(2, ptr2ref(target.ptr()));
+        fn->atPut(3, word2ref(3));
+        fn->atPut(4, word2ref(limit));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    /**
+     * Creates a simple function counting to limit with sends to natives, with arithmetic
+     * instructions that fall back to the same natives or with native calls to direct natives.
+     */
+    Ref createCountLoop(Memory& mem, word limit, CountLoop kind)
+    {
+        PtrHandle<SimpleFunction> fn(mem.createObject<SimpleFunction>(1 + 7), &mem);
+        Ref bytecodes = kind == OPCODE_COUNT ? mem.createUnmanagedByteArray((byte*) opcodeCountBytes, sizeof(opcodeCountBytes))
+                      : kind == CALL_COUNT ? mem.createUnmanagedByteArray((byte*) callCountBytes, sizeof(callCountBytes))
+                                           : mem.createUnmanagedByteArray((byte*) sendCountBytes, sizeof(sendCountBytes));
+
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(3));
+
+        uword signature;
+        NativeSignature::parse("ii", signature);
+
+        Ref addIntsFn = kind == CALL_COUNT ? mem.createDirectNativeFunction(&addIntsDirect, signature) : mem.createNativeFunction(&addInts);
+        fn->atPut(2, addIntsFn);
+        fn->atPut(3, word2ref(0));
+        fn->atPut(4, word2ref(limit));
+
+        Ref lessThanFn = kind == CALL_COUNT ? mem.createDirectNativeFunction(&lessThanDirect, signature) : mem.createNativeFunction(&lessThan);
+        fn->atPut(5, lessThanFn);
+        fn->atPut(6, word2ref(1));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    void benchCounting(char const* name, word limit, CountLoop kind)
+    {
+        Memory mem(1 << 20, 1 << 17);
+        Thread thread(&mem);
+
+        mem.setThread(&thread);
+        thread.prepareInitialSend(RefHandle(createCountLoop(mem, limit, kind), &mem), RefHandle(zeroRef(), &mem));
+
+        long allocations = mem.allocations_;
+        double start = now();
+
+        thread.execute();
+
+        double elapsed = now() - start;
+
+        std::cout << name << ": " << limit / elapsed << " iterations/s, " << thread.sendCount_ << " sends, "
+                  << (mem.allocations_ - allocations) / (double) limit << " allocations per iteration\n";
+    }
+
+    void benchMetaSends(char const* name, word limit, bool metaArgs)
+    {
+        Memory mem(1 << 20, 1 << 17);
+        Thread thread(&mem);
+
+        mem.setThread(&thread);
+        thread.prepareInitialSend(RefHandle(createMetaLoop(mem, limit, metaArgs), &mem), RefHandle(zeroRef(), &mem));
+
+        long allocations = mem.allocations_;
+        double start = now();
+
+        thread.execute();
+
+        double elapsed = now() - start;
+        double metaSends = limit - 1;
+
+        std::cout << name << ": " << metaSends / elapsed << " meta sends/s, "
+                  << (mem.allocations_ - allocations) / metaSends << " allocations per meta send\n";
+    }
+
+    void bench(char const* name, word limit, bool stepwise, bool calls)
+    {
+        Memory mem(1 << 20, 1 << 17);
+        Thread thread(&mem);
+
+        mem.setThread(&thread);
+        thread.prepareInitialSend(RefHandle(createLoop(mem, limit, calls), &mem), RefHandle(zeroRef(), &mem));
+
+        double start = now();
+
+        if(stepwise)
+        {
+            while(!thread.halted())
+            {
+                thread.step();
+            }
+        }
+        else
+        {
+            thread.execute();
+        }
+
+        double elapsed = now() - start;
+
+        std::cout << name << (calls ? " (calls)" : "") << ": " << thread.bytecodeCount_ << " bytecodes in " << elapsed * 1000 << " ms, "
+                  << thread.bytecodeCount_ / elapsed << " bytecodes/s\n";
+    }
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+    word limit = argc > 1 ? std::atol(argv[1]) : 2000000;
+
+#if defined ATOM_DISPATCH_THREADED
+    char const* engine = "Thread::run (computed goto)";
+#else
+    char const* engine = "Thread::run (switch)";
+#endif
+
+    bench("Thread::step", limit, true, false);
+    bench(engine, limit, false, false);
+    bench("Thread::step", limit, true, true);
+    bench(engine, limit, false, true);
+    benchMetaSends("Meta sends (meta message)", limit, false);
+    benchMetaSends("Meta sends (META_ARGS)", limit, true);
+    benchCounting("Counting (croa and send)", limit, SEND_COUNT);
+    benchCounting("Counting (add and lt)", limit, OPCODE_COUNT);
+    benchCounting("Counting (call)", limit, CALL_COUNT);
+
+    return 0;
+}
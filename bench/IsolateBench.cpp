@@ -0,0 +1,220 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Isolate.hpp>
+#include <vm/Opcode.hpp>
+
+#include <sys/time.h>
+#include <unistd.h>
+#include <iostream>
+#include <cstdlib>
+
+using namespace atom;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    void addInts(Thread* thread, int resultTmp, Ref message)
+    {
+        ObjectArray* args = cast<ObjectArray>(message);
+        thread->setResult(resultTmp, word2ref(int_val(args->at(0)) + int_val(args->at(1))));
+    }
+
+    void lessThan(Thread* thread, int resultTmp, Ref message)
+    {
+        ObjectArray* args = cast<ObjectArray>(message);
+        thread->setResult(resultTmp, word2ref(int_val(args->at(0)) < int_val(args->at(1)) ? 1 : 0));
+    }
+
+    // Temps: $2 addInts, $3 loop ip, $4 limit, $5 lessThan, $6 1, $7 counter, $8 pair, $9 cond
+    const byte countBytes[] = {
+        Opcode::ADD, 7, 6, 2, 7,                        //  0: add $7 $6 with $2 > $7
+        Opcode::LESS_THAN, 7, 4, 5, 9,                  //  5: lt $7 $4 with $5 > $9
+        Opcode::CONDITIONAL_ONE, 9,                     // 10: if1 $9
+        Opcode::JUMP, 3,                                // 12: jmp $3
+        Opcode::HALT                                    // 14: halt
+    };
+
+    /**
+     * Entry of the counting isolates, runs the loop above to the limit pointed by arg.
+     */
+    void count(Isolate* isolate, void* arg)
+    {
+        Memory* mem = &isolate->memory_;
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 7), mem);
+
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) countBytes, sizeof(countBytes)));
+        fn->atPut(1, word2ref(3));
+        fn->atPut(2, mem->createNativeFunction(&addInts));
+        fn->atPut(3, word2ref(0));
+        fn->atPut(4, word2ref(*(word*) arg));
+        fn->atPut(5, mem->createNativeFunction(&lessThan));
+        fn->atPut(6, word2ref(1));
+
+        isolate->thread_.prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+        isolate->scheduler_.add(&isolate->thread_);
+        isolate->scheduler_.run();
+    }
+
+    struct SendArgs
+    {
+        word count;
+        int width;
+    };
+
+    /**
+     * Entry of the sending isolates, sends count [index, i, [1, ..., width]] messages to the
+     * isolate at index 0.
+     */
+    void send(Isolate* isolate, void* arg)
+    {
+        SendArgs* args = (SendArgs*) arg;
+        Memory* mem = &isolate->memory_;
+        Channel* inbox = &(*isolate->peers_)[0]->inbox_;
+
+        for(word i = 0; i < args->count; ++i)
+        {
+            PtrHandle<ObjectArray> payload(mem->createObjectArray(args->width), mem);
+
+            for(int j = 0; j < args->width; ++j)
+            {
+                payload->atPut(j, word2ref(j + 1));
+            }
+
+            ObjectArray* message = mem->createObjectArray(3);
+            message->atPut(0, word2ref(isolate->index_));
+            message->atPut(1, word2ref(i));
+            message->atPut(2, ptr2ref(payload.ptr(), true));
+
+            inbox->send(Parcel::pack(mem, RefHandle(ptr2ref(message, true), mem)));
+        }
+    }
+
+    void benchCounting(int isolateCount, word limit, double& base)
+    {
+        IsolateVec isolates;
+
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            isolates.push_back(new Isolate(HeapPolicy(1 << 20, 1 << 17), &isolates, i));
+        }
+
+        double start = now();
+
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            isolates[i]->start(&count, &limit);
+        }
+
+        long bytecodes = 0;
+
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            isolates[i]->join();
+            bytecodes += isolates[i]->thread_.bytecodeCount_;
+        }
+
+        double elapsed = now() - start;
+        double rate = isolateCount * limit / elapsed;
+
+        if(isolateCount == 1)
+        {
+            base = rate;
+        }
+
+        std::cout << "Counting, " << isolateCount << " isolates: " << rate << " iterations/s, "
+                  << bytecodes / elapsed << " bytecodes/s, speedup " << rate / base << "\n";
+
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            delete isolates[i];
+        }
+    }
+
+    void benchMessages(int senderCount, word count, int width)
+    {
+        IsolateVec isolates;
+
+        for(int i = 0; i <= senderCount; ++i)
+        {
+            isolates.push_back(new Isolate(HeapPolicy(1 << 20, 1 << 17), &isolates, i));
+        }
+
+        SendArgs args = {count, width};
+        Memory* mem = &isolates[0]->memory_;
+        const word total = senderCount * count;
+        word received = 0;
+        word sum = 0;
+
+        double start = now();
+
+        for(int i = 1; i <= senderCount; ++i)
+        {
+            isolates[i]->start(&send, &args);
+        }
+
+        // Received on this OS thread, the owner of isolate 0.
+        while(received < total)
+        {
+            Parcel* parcel = isolates[0]->inbox_.receive();
+
+            if(parcel == 0)
+            {
+                continue;
+            }
+
+            ObjectArray* message = cast<ObjectArray>(parcel->unpack(mem));
+            sum += cast<ObjectArray>(message->at(2))->size();
+            ++received;
+
+            delete parcel;
+        }
+
+        double elapsed = now() - start;
+
+        for(int i = 1; i <= senderCount; ++i)
+        {
+            isolates[i]->join();
+        }
+
+        std::cout << "Messages, " << senderCount << " senders, " << width << " elements: "
+                  << total / elapsed << " messages/s, " << sum / total << " elements per message\n";
+
+        for(int i = 0; i <= senderCount; ++i)
+        {
+            delete isolates[i];
+        }
+    }
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+    word limit = argc > 1 ? std::atol(argv[1]) : 20000000;
+    word messages = argc > 2 ? std::atol(argv[2]) : 200000;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+
+    for(int isolateCount = 1; isolateCount <= cores; isolateCount *= 2)
+    {
+        benchCounting(isolateCount, limit, base);
+    }
+
+    benchMessages(1, messages, 1);
+    benchMessages(1, messages, 16);
+    benchMessages(cores > 2 ? 3 : 1, messages, 16);
+
+    return 0;
+}
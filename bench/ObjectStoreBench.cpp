@@ -0,0 +1,112 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <os/ObjectStore.hpp>
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace atom;
+
+namespace
+{
+    double now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    }
+
+    /**
+     * Builds a graph of count object arrays and returns its root. Each node refers to the
+     * previously created one, so the graph is as deep as it is large, and to an earlier node
+     * chosen pseudo randomly. Every 64th node also holds a byte array.
+     */
+    Ref buildGraph(Memory& mem, word count)
+    {
+        PtrHandle<ObjectArray> nodes(mem.createObjectArray(count), &mem);
+
+        for(word i = 0; i < count; ++i)
+        {
+            ObjectArray* node = mem.createObjectArray(4);
+
+            node->atPut(0, word2ref(i));
+            node->atPut(1, i > 0 ? nodes->at(i - 1) : zeroRef());
+            node->atPut(2, i > 0 ? nodes->at((i * 7919) % i) : zeroRef());
+            node->atPut(3, zeroRef());
+            nodes->atPut(i, ptr2ref(node, true));
+
+            if(i % 64 == 0)
+            {
+                Ref bytes = mem.createByteArrayFromString("object store bench");
+                cast<ObjectArray>(nodes->at(i))->atPut(3, bytes);
+            }
+        }
+
+        return nodes->at(count - 1);
+    }
+} // namespace <anonymous>
+
+int main(int argc, char** argv)
+{
+    word count = argc > 1 ? std::atol(argv[1]) : 1000000;
+    char const* filename = argc > 2 ? argv[2] : "objectStoreBench.os";
+
+    Memory mem(count * 16 + 4096);
+    RefHandle root(buildGraph(mem, count), &mem);
+
+    double start = now();
+
+    {
+        ObjectStoreWriter osw(filename);
+        osw.addObject(root.ref());
+        osw.flush();
+    }
+
+    double elapsed = now() - start;
+    std::cout << "ObjectStoreWriter::flush: " << count << " nodes in " << elapsed * 1000 << " ms, " << count / elapsed << " nodes/s\n";
+
+    root = RefHandle(zeroRef(), &mem);
+    mem.flipSpaces();
+
+    start = now();
+
+    ObjectStoreReader osr(filename, &mem);
+    word loaded = osr.readAll()->size();
+
+    elapsed = now() - start;
+    std::cout << "ObjectStoreReader::readAll: " << loaded << " objects in " << elapsed * 1000 << " ms, " << loaded / elapsed << " objects/s\n";
+
+    mem.flipSpaces();
+
+    // A program that uses a small part of the store only loads that part lazily.
+    const word walked = std::min(count, (word) 1000);
+    Ref* heapTop = mem.toSpace_->free_;
+
+    start = now();
+
+    ObjectStoreReader lazyReader(filename, &mem);
+    RefHandle node(lazyReader.readObject(0), &mem);
+
+    for(word i = 1; i < walked; ++i)
+    {
+        node = RefHandle(cast<ObjectArray>(mem.resolve(node.ref()))->at(1), &mem);
+    }
+
+    elapsed = now() - start;
+    std::cout << "ObjectStoreReader::readObject: walked " << walked << " nodes in " << elapsed * 1000 << " ms, "
+              << mem.toSpace_->free_ - heapTop << " heap slots used\n";
+
+    remove(filename);
+    return 0;
+}
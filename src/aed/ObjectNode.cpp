@@ -149,6 +149,11 @@ std::string IntRefNode::getNodeName()
 }
 
 // ---- FloatRefNode methods -----------------------------------------------------------------------------------------
+std::string FloatRefNode::getAddressStr()
+{
+    return is_immediate_float(object_) ? "" : RefNode::getAddressStr();
+}
+
 std::string FloatRefNode::getValueStr()
 {
     return toStr(float_val(object_));
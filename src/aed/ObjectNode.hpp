@@ -146,6 +146,7 @@ public:
     {
     }
 
+    virtual std::string getAddressStr();
     virtual std::string getNodeName();
     virtual std::string getValueStr();
     virtual void createChildren();
@@ -1,8 +1,14 @@
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
 
 #include <vm/Thread.hpp>
+#include <vm/Isolate.hpp>
+#include <vm/Profiler.hpp>
 #include <os/ObjectStore.hpp>
 
 using namespace atom;
@@ -36,42 +42,342 @@ void printCString(Thread* thread, int resultTmp, Ref message)
     }
 }
 
-void proceed(char const* osFileName, int objectIndex)
+// Formats of the --stats option.
+enum StatsFormat
 {
-    Memory mem(1048576);
-    Thread thread(&mem);
-    mem.setThread(&thread);
-
-    ObjectStoreReader osr(osFileName, &mem);
-    PtrHandle<Object> objects(osr.readAll(), &mem);
-
-    thread.prepareInitialSend(RefHandle(objects->at(objectIndex), &mem), RefHandle(mem.createStartupMessage(mem.createNativeFunction(&printCString)), &mem));
-    thread.execute();
-    
-    std::cerr << "Number of message sends executed: " << thread.sendCount_ << "\n";
-    std::cerr << "Number of bytecodes executed: " << thread.bytecodeCount_ << "\n";
+    COUNTS_ONLY,
+    STATS_TEXT,
+    STATS_JSON
+};
+
+struct RunSettings
+{
+    char const* osFileName;
+    int objectIndex;
+    bool lazy;
+
+    // Profilers of the isolates by their indexes, 0 if they are not profiled.
+    Profiler** profilers;
+};
+
+/**
+ * Entry of an isolate, loads the object store and sends the startup message to the object.
+ */
+void runObject(Isolate* isolate, void* arg)
+{
+    RunSettings const* settings = (RunSettings const*) arg;
+    Memory& mem = isolate->memory_;
+
+    Profiler* profiler = settings->profilers != 0 ? settings->profilers[isolate->index_] : 0;
+
+    ObjectStoreReader osr(settings->osFileName, &mem);
+    RefHandle target(zeroRef(), &mem);
+
+    // A lazy load creates only the objects the program reaches.
+    if(settings->lazy)
+    {
+        target.ref(osr.readObject(settings->objectIndex));
+
+        for(uword i = 0; profiler != 0 && i < osr.rootCount(); ++i)
+        {
+            if(!osr.rootName(i).empty())
+            {
+                profiler->name(RefHandle(osr.readRoot(i), &mem), osr.rootName(i));
+            }
+        }
+    }
+    else
+    {
+        Object* all = osr.readAll();
+
+        target.ref(all->at(settings->objectIndex));
+
+        for(uword i = 0; profiler != 0 && i < osr.rootCount(); ++i)
+        {
+            if(!osr.rootName(i).empty())
+            {
+                profiler->name(RefHandle(osr.rootAt(all, i), &mem), osr.rootName(i));
+            }
+        }
+    }
+
+    isolate->thread_.prepareInitialSend(target, RefHandle(mem.createStartupMessage(mem.createNativeFunction(&printCString)), &mem));
+    isolate->scheduler_.add(&isolate->thread_);
+
+    if(profiler == 0)
+    {
+        isolate->scheduler_.run();
+        return;
+    }
+
+    profiler->start();
+
+    try
+    {
+        isolate->scheduler_.run();
+    }
+    catch(...)
+    {
+        profiler->stop();
+        throw;
+    }
+
+    profiler->stop();
+}
+
+void proceed(HeapPolicy const& policy, RunSettings settings, int isolateCount, bool sendStats, StatsFormat statsFormat,
+             char const* profileFileName, int profileRate, bool profileIps)
+{
+    IsolateVec isolates;
+    std::vector<Profiler*> profilers;
+    std::string error;
+
+    for(int i = 0; i < isolateCount; ++i)
+    {
+        isolates.push_back(new Isolate(policy, &isolates, i));
+    }
+
+    if(profileFileName != 0)
+    {
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            profilers.push_back(new Profiler(&isolates[i]->memory_, profileRate, profileIps));
+        }
+
+        settings.profilers = &profilers[0];
+    }
+
+    // A single isolate runs on the main thread.
+    try
+    {
+        if(isolateCount == 1)
+        {
+            runObject(isolates[0], (void*) &settings);
+        }
+        else
+        {
+            for(int i = 0; i < isolateCount; ++i)
+            {
+                isolates[i]->start(&runObject, (void*) &settings);
+            }
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = e.what();
+    }
+
+    long sendCount = 0;
+    long bytecodeCount = 0;
+    ThreadStats stats;
+
+    for(int i = 0; i < isolateCount; ++i)
+    {
+        try
+        {
+            isolates[i]->join();
+        }
+        catch(std::exception const& e)
+        {
+            error = e.what();
+        }
+
+        sendCount += isolates[i]->thread_.sendCount_;
+        bytecodeCount += isolates[i]->thread_.bytecodeCount_;
+        stats.add(isolates[i]->thread_.stats_);
+    }
+
+    if(error.empty())
+    {
+        if(statsFormat == STATS_JSON)
+        {
+            std::cerr << "{\"sends\": " << sendCount << ", \"bytecodes\": " << bytecodeCount << ", \"stats\": ";
+            stats.printJson(std::cerr);
+            std::cerr << "}\n";
+        }
+        else
+        {
+            std::cerr << "Number of message sends executed: " << sendCount << "\n";
+            std::cerr << "Number of bytecodes executed: " << bytecodeCount << "\n";
+        }
+
+        if(statsFormat == STATS_TEXT)
+        {
+            stats.print(std::cerr);
+        }
+
+        for(int i = 0; sendStats && i < isolateCount; ++i)
+        {
+            isolates[i]->memory_.codeCache_.printSendStats(std::cerr);
+        }
+    }
+
+    if(!profilers.empty())
+    {
+        Profiler* total = profilers[0];
+
+        for(int i = 1; i < isolateCount; ++i)
+        {
+            total->add(*profilers[i]);
+        }
+
+        std::ofstream out(profileFileName);
+        total->writeCollapsed(out);
+
+        if(!out)
+        {
+            error = std::string("cannot write the profile to ") + profileFileName;
+        }
+        else if(error.empty())
+        {
+            std::cerr << "Profile samples: " << total->samples_ << ", dropped: " << total->dropped_ << "\n";
+        }
+
+        for(int i = 0; i < isolateCount; ++i)
+        {
+            delete profilers[i];
+        }
+    }
+
+    for(int i = 0; i < isolateCount; ++i)
+    {
+        delete isolates[i];
+    }
+
+    if(!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+}
+
+/**
+ * Applies a --heap-initial, --heap-max, --nursery or --stack option to the policy. Returns false if
+ * the argument is not one of them or its value is not valid.
+ */
+bool readHeapOption(char const* arg, HeapPolicy& policy)
+{
+    static char const* const options[][2] = {
+        {"--heap-initial=", "initial="},
+        {"--heap-max=", "max="},
+        {"--nursery=", "nursery="},
+        {"--stack=", "stack="}
+    };
+
+    for(unsigned int i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+    {
+        std::size_t len = std::strlen(options[i][0]);
+
+        if(std::strncmp(arg, options[i][0], len) == 0)
+        {
+            return policy.set((std::string(options[i][1]) + (arg + len)).c_str());
+        }
+    }
+
+    return false;
 }
 
 int main(int argc, char* argv[])
 {
     try
     {
-        if(argc != 3)
+        // Maximum heap size is left unspecified (zero) until the settings are read.
+        HeapPolicy policy(1048576, 131072);
+        policy.maxSize = 0;
+
+        if(!policy.parseEnvironment())
+        {
+            std::cerr << "Invalid ATOM_HEAP environment variable.\n";
+            return 1;
+        }
+
+        int argi = 1;
+        bool sendStats = false;
+        bool lazy = false;
+        int isolateCount = 1;
+        StatsFormat statsFormat = COUNTS_ONLY;
+        char const* profileFileName = 0;
+        int profileRate = Profiler::DEFAULT_RATE;
+        bool profileIps = false;
+
+        for(; argi < argc && std::strncmp(argv[argi], "--", 2) == 0; ++argi)
+        {
+            if(std::strcmp(argv[argi], "--send-stats") == 0)
+            {
+                sendStats = true;
+            }
+            else if(std::strcmp(argv[argi], "--lazy") == 0)
+            {
+                lazy = true;
+            }
+            else if(std::strcmp(argv[argi], "--stats=text") == 0)
+            {
+                statsFormat = STATS_TEXT;
+            }
+            else if(std::strcmp(argv[argi], "--stats=json") == 0)
+            {
+                statsFormat = STATS_JSON;
+            }
+            else if(std::strncmp(argv[argi], "--profile=", 10) == 0)
+            {
+                profileFileName = argv[argi] + 10;
+            }
+            else if(std::strncmp(argv[argi], "--profile-rate=", 15) == 0)
+            {
+                if(!readFromStr(argv[argi] + 15, profileRate) || profileRate < 1 || profileRate > 1000000)
+                {
+                    std::cerr << "Invalid profile rate: " << argv[argi] + 15 << "\n";
+                    return 1;
+                }
+            }
+            else if(std::strcmp(argv[argi], "--profile-ips") == 0)
+            {
+                profileIps = true;
+            }
+            else if(std::strncmp(argv[argi], "--isolates=", 11) == 0)
+            {
+                if(!readFromStr(argv[argi] + 11, isolateCount) || isolateCount < 1)
+                {
+                    std::cerr << "Invalid isolate count: " << argv[argi] + 11 << "\n";
+                    return 1;
+                }
+            }
+            else if(!readHeapOption(argv[argi], policy))
+            {
+                std::cerr << "Invalid option: " << argv[argi] << "\n";
+                return 1;
+            }
+        }
+
+        if(argc - argi != 2)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--heap-initial=slots] [--heap-max=slots] [--nursery=slots] [--stack=slots] [--send-stats] [--stats=text|json] [--lazy] [--isolates=count] [--profile=file] [--profile-rate=hz] [--profile-ips] object_store_file runnable_object_index\n"
+                      << "A profile is written as collapsed stacks, one line per stack with its sample count, for flame graph tools.\n"
+                      << "Heap settings apply to each isolate and may also be given as ATOM_HEAP=initial=1M,max=16M,nursery=128K,stack=1M,grow=0.5,shrink=0.125\n";
+            return 1;
+        }
+
+        if(policy.maxSize == 0)
+        {
+            policy.maxSize = std::max(policy.initialSize, (word) 16 * 1048576);
+        }
+
+        if(!policy.valid())
         {
-            std::cerr << "Usage: " << argv[0] << " object_store_file runnable_object_index\n";
+            std::cerr << "Inconsistent heap settings.\n";
             return 1;
         }
 
-        char const* osFileName = argv[1];
+        char const* osFileName = argv[argi];
         int objectIndex;
 
-        if(!readFromStr(argv[2], objectIndex))
+        if(!readFromStr(argv[argi + 1], objectIndex))
         {
             std::cerr << "Given object index is not a valid positive integer.\n";
             return 1;
         }
 
-        proceed(osFileName, objectIndex);
+        RunSettings settings = {osFileName, objectIndex, lazy, 0};
+        proceed(policy, settings, isolateCount, sendStats, statsFormat, profileFileName, profileRate, profileIps);
     }
     catch(std::exception const& e)
     {
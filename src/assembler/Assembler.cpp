@@ -29,6 +29,24 @@ inline bool isa(Node* n)
     return dynamic_cast<T*>(n) != 0;
 }
 
+int arithmeticOpcode(TokenType::type operation)
+{
+    switch(operation)
+    {
+        case TokenType::Add: return Opcode::ADD;
+        case TokenType::Sub: return Opcode::SUBTRACT;
+        case TokenType::Mul: return Opcode::MULTIPLY;
+        case TokenType::Div: return Opcode::DIVIDE;
+        case TokenType::Mod: return Opcode::MODULO;
+        case TokenType::LessThan: return Opcode::LESS_THAN;
+        case TokenType::GreaterThan: return Opcode::GREATER_THAN;
+        case TokenType::EqualTo: return Opcode::EQUAL;
+        default: break;
+    }
+
+    throw std::runtime_error("Unexpected arithmetic operation: " + std::string(TokenType::toStr(operation)));
+}
+
 inline int max(int x, int y)
 {
     if(x > y)
@@ -220,6 +238,25 @@ int Assembler::countInlineDefsInSimpleFunction(SimpleFnDefNode* sfd)
             inlineDefsInsideInstructions += !sfd->isTempVarRef(n->index());
             inlineDefsInsideInstructions += !sfd->isTempVarRef(n->value());
         }
+        else if(isa<ArithmeticNode>(in))
+        {
+            ArithmeticNode* n = (ArithmeticNode*) in;
+
+            inlineDefsInsideInstructions += !sfd->isTempVarRef(n->lhs());
+            inlineDefsInsideInstructions += !sfd->isTempVarRef(n->rhs());
+            inlineDefsInsideInstructions += !sfd->isTempVarRef(n->handler());
+        }
+        else if(isa<CallNode>(in))
+        {
+            CallNode* n = (CallNode*) in;
+
+            inlineDefsInsideInstructions += !sfd->isTempVarRef(n->function());
+
+            for(NodeVec::iterator it = n->arguments().begin(); it != n->arguments().end(); ++it)
+            {
+                inlineDefsInsideInstructions += !sfd->isTempVarRef(*it);
+            }
+        }
         else if(isa<CroNode>(in))
         {
             CroNode* n = (CroNode*) in;
@@ -270,7 +307,7 @@ int Assembler::countInlineDefsInSimpleFunction(SimpleFnDefNode* sfd)
         {
             inlineDefsInsideInstructions += 1;
         }
-        else if(isa<HaltNode>(in) || isa<LabelNode>(in))
+        else if(isa<HaltNode>(in) || isa<LabelNode>(in) || isa<MetaArgsNode>(in))
         {
             // Do nothing.
         }        
@@ -351,6 +388,31 @@ IntVec Assembler::generateBytecodes(SimpleFnDefNode* sfd)
             bc.push_back(checkForTempRefOrAssembleNode(sfd, n->index()));
             bc.push_back(checkForTempRefOrAssembleNode(sfd, n->value()));
         }
+        else if(isa<ArithmeticNode>(in))
+        {
+            ArithmeticNode* n = (ArithmeticNode*) in;
+
+            bc.push_back(arithmeticOpcode(n->operation()));
+            bc.push_back(checkForTempRefOrAssembleNode(sfd, n->lhs()));
+            bc.push_back(checkForTempRefOrAssembleNode(sfd, n->rhs()));
+            bc.push_back(checkForTempRefOrAssembleNode(sfd, n->handler()));
+            bc.push_back(checkForTemp(sfd, n->result()));
+        }
+        else if(isa<CallNode>(in))
+        {
+            CallNode* n = (CallNode*) in;
+
+            bc.push_back(Opcode::CALL_NATIVE);
+            bc.push_back(n->arguments().size());
+            bc.push_back(checkForTempRefOrAssembleNode(sfd, n->function()));
+
+            for(NodeVec::iterator it = n->arguments().begin(); it != n->arguments().end(); ++it)
+            {
+                bc.push_back(checkForTempRefOrAssembleNode(sfd, *it));
+            }
+
+            bc.push_back(checkForTemp(sfd, n->result()));
+        }
         else if(isa<ConditionalNode>(in))
         {
             ConditionalNode* n = (ConditionalNode*) in;
@@ -438,6 +500,14 @@ IntVec Assembler::generateBytecodes(SimpleFnDefNode* sfd)
             bc.push_back(checkForTemp(sfd, n->target()));
             bc.push_back(checkForTempRefOrAssembleNode(sfd, n->value()));
         }
+        else if(isa<MetaArgsNode>(in))
+        {
+            MetaArgsNode* n = (MetaArgsNode*) in;
+            
+            bc.push_back(Opcode::META_ARGS);
+            bc.push_back(checkForTemp(sfd, n->target()));
+            bc.push_back(checkForTemp(sfd, n->realMsg()));
+        }
         else if(isa<LabelNode>(in))
         {
             LabelNode* n = (LabelNode*) in;
@@ -563,7 +633,7 @@ Ref Assembler::assembleSimpleFunction(SimpleFnDefNode* sfd)
         ba->atPut(i, word2ref(bc[i]));
     }
 
-    sf->bytecodes_ = ptr2ref(ba);
+    sf->setSlot(sf->bytecodes_, ptr2ref(ba));
 
     return ptr2ref(sf);
 }
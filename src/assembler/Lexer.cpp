@@ -290,6 +290,16 @@ namespace
         keywords["!raise"] = TokenType::Raise;
         keywords["!jmp"] = TokenType::Jmp;
         keywords["!set"] = TokenType::Set;
+        keywords["!margs"] = TokenType::MetaArgs;
+        keywords["!add"] = TokenType::Add;
+        keywords["!sub"] = TokenType::Sub;
+        keywords["!mul"] = TokenType::Mul;
+        keywords["!div"] = TokenType::Div;
+        keywords["!mod"] = TokenType::Mod;
+        keywords["!lt"] = TokenType::LessThan;
+        keywords["!gt"] = TokenType::GreaterThan;
+        keywords["!eq"] = TokenType::EqualTo;
+        keywords["!call"] = TokenType::Call;
 
         if(keywords.find(id) != keywords.end())
         {
@@ -61,9 +61,10 @@ int main(int argc, char* argv[])
 
     ObjectStoreWriter osw(argv[2]);
 
+    // Names of the top level definitions are kept as symbols, see ObjectStoreFormat.
     for(unsigned int i = 0; i < oa->size(); ++i)
     {
-        osw.addObject(oa->at(i));
+        osw.addObject(oa->at(i), parser.toplevelNodes()[i]->name());
     }
 
     osw.flush();
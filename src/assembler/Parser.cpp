@@ -83,6 +83,16 @@ SetNode* parseSet(Parser& parser, Lexer& lexer)
     return n;
 }
 
+MetaArgsNode* parseMetaArgs(Parser& parser, Lexer& lexer)
+{
+    MetaArgsNode* n = new MetaArgsNode();
+    
+    n->target(parser.parseSymbolicRef());
+    n->realMsg(parser.parseSymbolicRef());
+    
+    return n;
+}
+
 CroaNode* parseCroa(Parser& parser, Lexer& lexer)
 {
     CroaNode* n = new CroaNode();
@@ -153,6 +163,39 @@ AputNode* parseAput(Parser& parser, Lexer& lexer)
     return ap;
 }
 
+ArithmeticNode* parseArithmetic(Parser& parser, Lexer& lexer, TokenType::type operation)
+{
+    ArithmeticNode* n = new ArithmeticNode();
+
+    n->operation(operation);
+    n->lhs(parser.parseSymbolicRefOrObjectDef());
+    n->rhs(parser.parseSymbolicRefOrObjectDef());
+    lexer.discardToken(TokenType::With);
+    n->handler(parser.parseSymbolicRefOrObjectDef());
+    lexer.discardToken(TokenType::Gt);
+    n->result(parser.parseSymbolicRef());
+
+    return n;
+}
+
+CallNode* parseCall(Parser& parser, Lexer& lexer)
+{
+    CallNode* n = new CallNode();
+
+    n->function(parser.parseSymbolicRefOrObjectDef());
+
+    lexer.discardToken(TokenType::LSquare);
+    lexer.ungetToken(Token(TokenType::Comma, -1));
+
+    parser.parseCommaSeparatedNodes(n->arguments(), TokenType::RSquare);
+
+    lexer.discardToken(TokenType::Gt);
+
+    n->result(parser.parseSymbolicRef());
+
+    return n;
+}
+
 SendNode* parseSend(Parser& parser, Lexer& lexer)
 {
     SendNode* sn = new SendNode();
@@ -436,6 +479,19 @@ SimpleFnDefNode* Parser::parseSimpleFnBody()
         {
             sfn->instructions().push_back(parseSet(*this, in_));
         }
+        else if (token.isMetaArgs())
+        {
+            sfn->instructions().push_back(parseMetaArgs(*this, in_));
+        }
+        else if (token.isAdd() || token.isSub() || token.isMul() || token.isDiv() || token.isMod() ||
+                 token.isLessThan() || token.isGreaterThan() || token.isEqualTo())
+        {
+            sfn->instructions().push_back(parseArithmetic(*this, in_, token.getType()));
+        }
+        else if (token.isCall())
+        {
+            sfn->instructions().push_back(parseCall(*this, in_));
+        }
         else if (token.isIdentifier() && in_.getNextToken().isColon())
         {           
             LabelNode* ln = new LabelNode();
@@ -316,6 +316,140 @@ private:
     SymbolicRef* target_;
 };
 
+class MetaArgsNode : public InstructionNode
+{
+public:
+    inline SymbolicRef* const& target() const
+    {
+        return target_;
+    }
+
+    inline void target(SymbolicRef* target)
+    {
+        target_ = target;
+    }
+    
+    inline SymbolicRef* const& realMsg() const
+    {
+        return realMsg_;
+    }
+
+    inline void realMsg(SymbolicRef* realMsg)
+    {
+        realMsg_ = realMsg;
+    }
+    
+private:
+    SymbolicRef* target_;
+    SymbolicRef* realMsg_;
+};
+
+class ArithmeticNode : public InstructionNode
+{
+public:
+    inline ArithmeticNode()
+    : operation_(TokenType::Invalid), lhs_(0), rhs_(0), handler_(0), result_(0)
+    {
+    }
+
+    // The keyword token of the instruction.
+    inline TokenType::type operation() const
+    {
+        return operation_;
+    }
+
+    inline void operation(TokenType::type operation)
+    {
+        operation_ = operation;
+    }
+
+    inline Node* const& lhs() const
+    {
+        return lhs_;
+    }
+
+    inline void lhs(Node* lhs)
+    {
+        lhs_ = lhs;
+    }
+
+    inline Node* const& rhs() const
+    {
+        return rhs_;
+    }
+
+    inline void rhs(Node* rhs)
+    {
+        rhs_ = rhs;
+    }
+
+    inline Node* const& handler() const
+    {
+        return handler_;
+    }
+
+    inline void handler(Node* handler)
+    {
+        handler_ = handler;
+    }
+
+    inline SymbolicRef* const& result() const
+    {
+        return result_;
+    }
+
+    inline void result(SymbolicRef* result)
+    {
+        result_ = result;
+    }
+
+private:
+    TokenType::type operation_;
+    Node* lhs_;
+    Node* rhs_;
+    Node* handler_;
+    SymbolicRef* result_;
+};
+
+class CallNode : public InstructionNode
+{
+public:
+    inline CallNode()
+    : function_(0), result_(0)
+    {
+    }
+
+    inline Node* const& function() const
+    {
+        return function_;
+    }
+
+    inline void function(Node* function)
+    {
+        function_ = function;
+    }
+
+    inline NodeVec& arguments()
+    {
+        return arguments_;
+    }
+
+    inline SymbolicRef* const& result() const
+    {
+        return result_;
+    }
+
+    inline void result(SymbolicRef* result)
+    {
+        result_ = result;
+    }
+
+private:
+    Node* function_;
+    NodeVec arguments_;
+    SymbolicRef* result_;
+};
+
 class AlenNode : public ArrayOpNode
 {
 };
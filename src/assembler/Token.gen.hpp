@@ -198,3 +198,53 @@
         return TokenType::Set == type_;
     }
 
+    inline bool isMetaArgs() const
+    {
+        return TokenType::MetaArgs == type_;
+    }
+
+    inline bool isAdd() const
+    {
+        return TokenType::Add == type_;
+    }
+
+    inline bool isSub() const
+    {
+        return TokenType::Sub == type_;
+    }
+
+    inline bool isMul() const
+    {
+        return TokenType::Mul == type_;
+    }
+
+    inline bool isDiv() const
+    {
+        return TokenType::Div == type_;
+    }
+
+    inline bool isMod() const
+    {
+        return TokenType::Mod == type_;
+    }
+
+    inline bool isLessThan() const
+    {
+        return TokenType::LessThan == type_;
+    }
+
+    inline bool isGreaterThan() const
+    {
+        return TokenType::GreaterThan == type_;
+    }
+
+    inline bool isEqualTo() const
+    {
+        return TokenType::EqualTo == type_;
+    }
+
+    inline bool isCall() const
+    {
+        return TokenType::Call == type_;
+    }
+
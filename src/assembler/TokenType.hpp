@@ -61,6 +61,16 @@ namespace TokenType
         Raise,
         Jmp,
         Set,
+        MetaArgs,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+        LessThan,
+        GreaterThan,
+        EqualTo,
+        Call,
     };
 
     inline char const* toStr(type t)
@@ -107,6 +117,16 @@ namespace TokenType
             case Raise: return "Raise";
             case Jmp: return "Jmp";
             case Set: return "Set";
+            case MetaArgs: return "MetaArgs";
+            case Add: return "Add";
+            case Sub: return "Sub";
+            case Mul: return "Mul";
+            case Div: return "Div";
+            case Mod: return "Mod";
+            case LessThan: return "LessThan";
+            case GreaterThan: return "GreaterThan";
+            case EqualTo: return "EqualTo";
+            case Call: return "Call";
             default: return "<INVALID TOKEN TYPE>";
         }
     }
@@ -0,0 +1,124 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_DEBUGGER_IMAGE_FORMAT_HPP_INCLUDED
+#define ATOM_DEBUGGER_IMAGE_FORMAT_HPP_INCLUDED
+
+#include <string.h>
+
+#include <vm/Object.hpp>
+
+namespace atom
+{
+
+namespace debugger {
+
+/**
+ * Layout of VM images. An image is a snapshot of the heap and the frame stack of a thread
+ * taken right after a full collection. It starts with an ImageHeader followed by these
+ * sections, each starting at a word aligned offset:
+ *
+ * - natives: nativeCount entries naming the native functions, each the library path and the
+ *   symbol name as NUL terminated strings, the section is nativesSize bytes.
+ * - roots: FIXED_ROOT_COUNT references in the order of the RootIndex enumeration followed by
+ *   rootCount references added to the saver.
+ * - heap: heapSlots slots holding the live objects, the large objects after the others.
+ * - frames: frameSlots slots holding the contexts and temps of the thread.
+ * - payloads: payloadSize bytes of byte array contents, each padded to a word boundary.
+ *
+ * Objects keep their in-memory layout, so images are only read by the VM build that wrote
+ * them. References are encoded as slot offsets in place of addresses, frames follow the heap
+ * in the offset space. The data of a byte array is INLINE_PAYLOAD for contents following the
+ * array, the offset of its contents in payloads or OPAQUE_MEMORY. The data of a native
+ * function is its index in natives.
+ */
+namespace ImageFormat
+{
+    enum
+    {
+        VERSION = 2
+    };
+
+    enum RootIndex
+    {
+        OBJECT_ARRAY_MO,
+        INTEGER_MO,
+        BYTE_ARRAY_MO,
+        FLOAT_MO,
+        START_BALL_ROLLING_BYTECODES,
+        EXEC_ERROR_BA,
+        PROCESS_EXCEPTION_BA,
+        NULL_ARRAY,
+        FIXED_ROOT_COUNT
+    };
+
+    // Data of an opaque handle to the memory of the VM, other opaque handles are not saved.
+    static const uword OPAQUE_MEMORY = ~(uword) 0;
+
+    // Data of a byte array whose contents follow it in the heap.
+    static const uword INLINE_PAYLOAD = ~(uword) 1;
+
+    struct ImageHeader
+    {
+        char magic[8];
+        atom_uint32_t version;
+        atom_uint8_t wordSize;
+        atom_uint8_t littleEndian;
+        atom_uint16_t halted;
+
+        uword nativesSize;
+        uword nativeCount;
+        uword rootCount;
+        uword heapSlots;
+        uword frameSlots;
+        uword payloadSize;
+
+        // Thread state, currentContext is the encoded innermost context or zero.
+        uword sendCount;
+        uword bytecodeCount;
+        Ref currentContext;
+    };
+
+    inline void initHeader(ImageHeader& header)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "ATOMIMAG", sizeof(header.magic));
+        header.version = VERSION;
+        header.wordSize = sizeof(word);
+        header.littleEndian = 1;
+        header.currentContext = zeroRef();
+    }
+
+    inline bool hasMagic(void const* data, uword size)
+    {
+        return size >= sizeof(ImageHeader) && memcmp(data, "ATOMIMAG", 8) == 0;
+    }
+
+    inline uword alignToWord(uword size)
+    {
+        return (size + sizeof(word) - 1) & ~(uword) (sizeof(word) - 1);
+    }
+
+    inline Ref encode(uword offset, bool arrayAccess)
+    {
+        return ptr2ref((void*) (offset << 2), arrayAccess);
+    }
+
+    inline uword decode(Ref ref)
+    {
+        return (uword) ref.data_;
+    }
+}
+
+} // namespace debugger
+
+} // namespace atom
+
+#endif /* ATOM_DEBUGGER_IMAGE_FORMAT_HPP_INCLUDED */
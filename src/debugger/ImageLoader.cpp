@@ -0,0 +1,415 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <limits>
+#include <stdexcept>
+
+#include <vm/SharedLibrary.hpp>
+#include <vm/Scheduler.hpp>
+#include <vm/Isolate.hpp>
+
+#include "ImageLoader.hpp"
+
+using namespace atom;
+using namespace atom::debugger;
+using namespace atom::debugger::ImageFormat;
+
+namespace
+{
+    /**
+     * Read only mapping of an image file, unmapped when destroyed.
+     */
+    struct MappedImage
+    {
+        byte const* data_;
+        uword size_;
+
+        explicit MappedImage(char const* filename)
+        : data_(0), size_(0)
+        {
+            int fd = open(filename, O_RDONLY);
+
+            if(fd == -1)
+            {
+                throw std::runtime_error("cannot open image file for reading");
+            }
+
+            struct stat st;
+
+            if(fstat(fd, &st) == -1)
+            {
+                close(fd);
+                throw std::runtime_error("cannot read from file");
+            }
+
+            size_ = st.st_size;
+
+            if(size_ > 0)
+            {
+                void* data = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if(data == MAP_FAILED)
+                {
+                    close(fd);
+                    throw std::runtime_error("cannot map image file");
+                }
+
+                data_ = (byte const*) data;
+            }
+
+            close(fd);
+        }
+
+        ~MappedImage()
+        {
+            if(data_ != 0)
+            {
+                munmap((void*) data_, size_);
+            }
+        }
+
+        /**
+         * Returns the section of count items of the given size at offset and advances the
+         * offset past it.
+         */
+        byte const* take(uword& offset, uword count, uword itemSize) const
+        {
+            if(count > (size_ - offset) / itemSize)
+            {
+                throw std::runtime_error("image file is truncated");
+            }
+
+            byte const* result = data_ + offset;
+            offset += count * itemSize;
+
+            return result;
+        }
+    };
+
+    inline void checkImage(bool condition)
+    {
+        if(!condition)
+        {
+            throw std::runtime_error("invalid image file");
+        }
+    }
+
+    /**
+     * Checks the structure of the objects in the encoded slots, starts receives the offsets
+     * at which objects start.
+     */
+    void checkObjects(Ref const* slots, uword begin, uword end, bool frames, ImageHeader const& header, std::vector<bool>& starts)
+    {
+        for(uword offset = begin; offset < end; )
+        {
+            ObjectHeader const* oh = (ObjectHeader const*) &slots[offset];
+            const int type = oh->objtype;
+
+            checkImage(ObjectType::isValid(type) && oh->size >= 1 && oh->size <= end - offset);
+            checkImage(!frames || type == ObjectType::OBJECT_ARRAY);
+
+            if(type == ObjectType::BYTE_ARRAY)
+            {
+                ByteArray const* ba = (ByteArray const*) oh;
+                const uword data = (uword) ba->data_;
+
+                if(data == INLINE_PAYLOAD)
+                {
+                    checkImage(!frames && ba->managed_ && oh->size == sizeof(ByteArray) / sizeof(Ref) + (ba->size_ + sizeof(Ref) - 1) / sizeof(Ref));
+                }
+                else if(ba->managed_)
+                {
+                    checkImage(oh->size == sizeof(ByteArray) / sizeof(Ref));
+                    checkImage(data <= header.payloadSize && ba->size_ <= header.payloadSize - data);
+                }
+                else
+                {
+                    checkImage(oh->size == sizeof(ByteArray) / sizeof(Ref));
+                    checkImage(ba->size_ == 0 && (data == 0 || data == OPAQUE_MEMORY));
+                }
+            }
+            else if(type == ObjectType::NATIVE_FUNCTION)
+            {
+                checkImage(oh->size == sizeof(NativeFunction) / sizeof(Ref) && (uword) ((NativeFunction const*) oh)->data_ < header.nativeCount);
+            }
+            else if(type == ObjectType::FLOAT)
+            {
+                checkImage(oh->size == sizeof(FloatObject) / sizeof(Ref));
+            }
+
+            starts[offset] = true;
+            offset += oh->size;
+        }
+    }
+
+    inline bool isValidRef(Ref ref, std::vector<bool> const& starts)
+    {
+        return is_immediate(ref) || (decode(ref) < starts.size() && starts[decode(ref)]);
+    }
+
+    /**
+     * Returns the loaded address of an encoded reference.
+     */
+    inline Ref relocate(Ref ref, Ref* heap, Ref* frames, uword heapSlots)
+    {
+        if(is_immediate(ref))
+        {
+            return ref;
+        }
+
+        const uword offset = decode(ref);
+        return ptr2ref(offset < heapSlots ? heap + offset : frames + (offset - heapSlots), array_access(ref));
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+
+namespace debugger {
+
+ImageLoader::ImageLoader(Thread* thread)
+: thread_(thread), mem_(thread->memory_)
+{
+    // Natives created by the VM itself are not exported, they are known by name.
+    nameNative("memoryControllerFn", (void*) &Memory::memoryControllerFn);
+    nameNative("fn_loadLibrary", (void*) &fn_loadLibrary);
+    nameNative("fn_resolveFunction", (void*) &fn_resolveFunction);
+    nameNative("fn_resolveAllFunctions", (void*) &fn_resolveAllFunctions);
+    nameNative("fn_spawnThread", (void*) &fn_spawnThread);
+    nameNative("fn_yieldThread", (void*) &fn_yieldThread);
+    nameNative("fn_joinThread", (void*) &fn_joinThread);
+    nameNative("fn_sendToIsolate", (void*) &fn_sendToIsolate);
+    nameNative("fn_receiveMessage", (void*) &fn_receiveMessage);
+}
+
+void ImageLoader::nameNative(std::string const& name, void* fn)
+{
+    functions_[name] = fn;
+}
+
+void* ImageLoader::resolveNative(char const* library, char const* symbol)
+{
+    if(library[0] == '\0')
+    {
+        FunctionMap::const_iterator it = functions_.find(symbol);
+
+        if(it == functions_.end())
+        {
+            throw std::runtime_error(std::string("unknown native function: ") + symbol);
+        }
+
+        return it->second;
+    }
+
+    void* result = dlsym(RTLD_DEFAULT, symbol);
+
+    if(result == 0)
+    {
+        void* handle = dlopen(library, RTLD_LAZY);
+
+        if(handle != 0)
+        {
+            result = dlsym(handle, symbol);
+        }
+    }
+
+    if(result == 0)
+    {
+        throw std::runtime_error(std::string("cannot resolve native function: ") + symbol);
+    }
+
+    return result;
+}
+
+void ImageLoader::load(char const* filename)
+{
+    MappedImage image(filename);
+
+    if(!hasMagic(image.data_, image.size_))
+    {
+        throw std::runtime_error("not an image file");
+    }
+
+    ImageHeader header;
+    memcpy(&header, image.data_, sizeof(header));
+
+    if(header.version != VERSION || header.wordSize != sizeof(word) || header.littleEndian != 1)
+    {
+        throw std::runtime_error("unsupported image version");
+    }
+
+    uword offset = sizeof(header);
+
+    char const* natives = (char const*) image.take(offset, header.nativesSize, 1);
+    checkImage(header.nativesSize % sizeof(word) == 0);
+
+    Ref const* roots = (Ref const*) image.take(offset, FIXED_ROOT_COUNT, sizeof(Ref));
+    Ref const* userRoots = (Ref const*) image.take(offset, header.rootCount, sizeof(Ref));
+
+    checkImage(header.heapSlots <= std::numeric_limits<uword>::max() - header.frameSlots);
+    const uword totalSlots = header.heapSlots + header.frameSlots;
+    Ref const* slots = (Ref const*) image.take(offset, totalSlots, sizeof(Ref));
+    byte const* payloads = image.take(offset, header.payloadSize, 1);
+
+    // Natives are resolved before anything changes, an unknown function leaves the VM as is.
+    std::vector<void*> functions;
+    uword nativeOffset = 0;
+
+    while(functions.size() < header.nativeCount)
+    {
+        char const* strings[2];
+
+        for(int i = 0; i < 2; ++i)
+        {
+            char const* end = (char const*) memchr(natives + nativeOffset, '\0', header.nativesSize - nativeOffset);
+            checkImage(end != 0);
+
+            strings[i] = natives + nativeOffset;
+            nativeOffset = end + 1 - natives;
+        }
+
+        functions.push_back(resolveNative(strings[0], strings[1]));
+    }
+
+    std::vector<bool> starts(totalSlots, false);
+
+    checkObjects(slots, 0, header.heapSlots, false, header, starts);
+    checkObjects(slots, header.heapSlots, totalSlots, true, header, starts);
+
+    for(uword offset = 0; offset < totalSlots; )
+    {
+        ObjectHeader const* oh = (ObjectHeader const*) &slots[offset];
+
+        if(ObjectType::containsSlots(oh->objtype))
+        {
+            for(uword i = 1; i < oh->size; ++i)
+            {
+                checkImage(isValidRef(slots[offset + i], starts));
+            }
+        }
+
+        offset += oh->size;
+    }
+
+    for(uword i = 0; i < FIXED_ROOT_COUNT; ++i)
+    {
+        checkImage(isValidRef(roots[i], starts));
+    }
+
+    for(uword i = 0; i < header.rootCount; ++i)
+    {
+        checkImage(isValidRef(userRoots[i], starts));
+    }
+
+    const Ref cc = header.currentContext;
+
+    checkImage(isValidRef(cc, starts));
+    checkImage(is_int(cc) || (!is_immediate(cc) && decode(cc) >= header.heapSlots && ((ObjectHeader const*) &slots[decode(cc)])->size == sizeof(CallContext) / sizeof(Ref)));
+
+    if(header.heapSlots > (uword) std::numeric_limits<int>::max())
+    {
+        throw memory_exhausted_error();
+    }
+
+    // Nothing else is allocated until every object is relocated, so the chunk is never seen
+    // by a collection in a partially filled state.
+    Ref* heap = header.heapSlots > 0 ? mem_->allocOld(header.heapSlots) : 0;
+    Ref* frames = thread_->frames_.reset(header.frameSlots);
+
+    for(uword offset = 0; offset < totalSlots; )
+    {
+        ObjectHeader const* oh = (ObjectHeader const*) &slots[offset];
+        const bool frame = offset >= header.heapSlots;
+        Ref* target = frame ? frames + (offset - header.heapSlots) : heap + offset;
+        ObjectBase* ob = (ObjectBase*) target;
+
+        memcpy(target, oh, oh->size * sizeof(Ref));
+
+        // Verification results are not trusted, functions are verified again when called.
+        ob->header_.init(oh->objtype, oh->size);
+        ob->header_.frame = frame;
+        ob->header_.remembered = frame;
+
+        if(oh->objtype == ObjectType::BYTE_ARRAY)
+        {
+            ByteArray* ba = (ByteArray*) ob;
+            const uword data = (uword) ba->data_;
+
+            if(data == INLINE_PAYLOAD)
+            {
+                ba->data_ = ba->inlineData();
+            }
+            else if(ba->managed_)
+            {
+                ba->data_ = new byte[ba->size_];
+                memcpy(ba->data_, payloads + data, ba->size_);
+                mem_->registerExternalPayload(ba);
+            }
+            else
+            {
+                ba->data_ = data == OPAQUE_MEMORY ? (void*) mem_ : 0;
+            }
+        }
+        else if(oh->objtype == ObjectType::NATIVE_FUNCTION)
+        {
+            NativeFunction* nf = (NativeFunction*) ob;
+            nf->data_ = functions[(uword) nf->data_];
+        }
+        else if(ObjectType::containsSlots(oh->objtype))
+        {
+            for(uword i = 1; i < oh->size; ++i)
+            {
+                target[i] = relocate(target[i], heap, frames, header.heapSlots);
+            }
+        }
+
+        offset += oh->size;
+    }
+
+    Ref decoded[FIXED_ROOT_COUNT];
+
+    for(uword i = 0; i < FIXED_ROOT_COUNT; ++i)
+    {
+        decoded[i] = relocate(roots[i], heap, frames, header.heapSlots);
+    }
+
+    mem_->objectArrayMo_ = RefHandle(decoded[OBJECT_ARRAY_MO], mem_);
+    mem_->integerMo_ = RefHandle(decoded[INTEGER_MO], mem_);
+    mem_->byteArrayMo_ = RefHandle(decoded[BYTE_ARRAY_MO], mem_);
+    mem_->floatMo_ = RefHandle(decoded[FLOAT_MO], mem_);
+
+    thread_->startBallRollingBytecodes_ = RefHandle(decoded[START_BALL_ROLLING_BYTECODES], mem_);
+    thread_->execErrorBa_ = RefHandle(decoded[EXEC_ERROR_BA], mem_);
+    thread_->processExceptionBa_ = RefHandle(decoded[PROCESS_EXCEPTION_BA], mem_);
+    thread_->nullArray_ = RefHandle(decoded[NULL_ARRAY], mem_);
+
+    thread_->cc_ = is_int(cc) ? 0 : cast<CallContext>(relocate(cc, heap, frames, header.heapSlots));
+    thread_->halt_ = header.halted != 0;
+    thread_->sendCount_ = header.sendCount;
+    thread_->bytecodeCount_ = header.bytecodeCount;
+
+    roots_.clear();
+
+    for(uword i = 0; i < header.rootCount; ++i)
+    {
+        roots_.push_back(RefHandle(relocate(userRoots[i], heap, frames, header.heapSlots), mem_));
+    }
+}
+
+} // namespace debugger
+
+} // namespace atom
@@ -0,0 +1,74 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_DEBUGGER_IMAGE_LOADER_HPP_INCLUDED
+#define ATOM_DEBUGGER_IMAGE_LOADER_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <vm/Thread.hpp>
+
+#include "ImageFormat.hpp"
+
+namespace atom
+{
+
+namespace debugger {
+
+/**
+ * Restores an image written by ImageSaver into a thread and its memory. The image is
+ * mapped and checked first, then its heap is placed in a single old space allocation and
+ * its frames at the bottom of the frame stack of the thread, and every object is copied
+ * and relocated in one pass. The thread and memory state saved in the image replaces the
+ * current state, objects created before the load stay alive only if they are referenced
+ * from handles.
+ *
+ * Native functions are found by the names given with nameNative() first, then by their
+ * symbol in the loaded libraries and at last in the library they were saved from.
+ */
+class ImageLoader
+{
+    typedef std::map<std::string, void*> FunctionMap;
+
+    Thread* thread_;
+    Memory* mem_;
+    FunctionMap functions_;
+    std::vector<RefHandle> roots_;
+
+    void* resolveNative(char const* library, char const* symbol);
+
+public:
+    explicit ImageLoader(Thread* thread);
+
+    void nameNative(std::string const& name, void* fn);
+
+    void load(char const* filename);
+
+    inline uword rootCount() const
+    {
+        return roots_.size();
+    }
+
+    /**
+     * Returns the root added to the saver at the given index.
+     */
+    inline Ref rootAt(uword index) const
+    {
+        return roots_.at(index).ref();
+    }
+};
+
+} // namespace debugger
+
+} // namespace atom
+
+#endif /* ATOM_DEBUGGER_IMAGE_LOADER_HPP_INCLUDED */
@@ -0,0 +1,365 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include <stdexcept>
+
+#include <vm/SharedLibrary.hpp>
+#include <vm/Scheduler.hpp>
+#include <vm/Isolate.hpp>
+
+#include "ImageSaver.hpp"
+
+using namespace atom;
+using namespace atom::debugger;
+using namespace atom::debugger::ImageFormat;
+
+namespace
+{
+    typedef std::vector<byte> ByteVec;
+
+    void appendBytes(ByteVec& buffer, void const* data, uword size)
+    {
+        byte const* bytes = (byte const*) data;
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    void appendString(ByteVec& buffer, std::string const& str)
+    {
+        appendBytes(buffer, str.c_str(), str.length() + 1);
+    }
+
+    void padToWord(ByteVec& buffer)
+    {
+        buffer.resize(alignToWord(buffer.size()), 0);
+    }
+
+    void writeBytes(FILE* file, void const* data, uword size)
+    {
+        if(size > 0 && fwrite(data, size, 1, file) != 1)
+        {
+            fclose(file);
+            throw std::runtime_error("cannot write to image file");
+        }
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+
+namespace debugger {
+
+ImageSaver::ImageSaver(Thread* thread)
+: thread_(thread), mem_(thread->memory_)
+{
+    // Natives created by the VM itself are not exported, they are known by name.
+    nameNative((void*) &Memory::memoryControllerFn, "memoryControllerFn");
+    nameNative((void*) &fn_loadLibrary, "fn_loadLibrary");
+    nameNative((void*) &fn_resolveFunction, "fn_resolveFunction");
+    nameNative((void*) &fn_resolveAllFunctions, "fn_resolveAllFunctions");
+    nameNative((void*) &fn_spawnThread, "fn_spawnThread");
+    nameNative((void*) &fn_yieldThread, "fn_yieldThread");
+    nameNative((void*) &fn_joinThread, "fn_joinThread");
+    nameNative((void*) &fn_sendToIsolate, "fn_sendToIsolate");
+    nameNative((void*) &fn_receiveMessage, "fn_receiveMessage");
+}
+
+void ImageSaver::nameNative(void* fn, std::string const& name)
+{
+    names_[fn] = name;
+}
+
+void ImageSaver::addRoot(Ref ref)
+{
+    roots_.push_back(RefHandle(ref, mem_));
+}
+
+void ImageSaver::loadStubs()
+{
+    if(mem_->loader_ == 0)
+    {
+        return;
+    }
+
+    // Loaded objects are allocated in the old space after the scanned ones and are scanned
+    // too. Only a major collection moves the scanned objects, the scan starts over then.
+    Ref* current = mem_->toSpace_->start_;
+    long collections = mem_->majorCollections_;
+
+    while(current != mem_->toSpace_->free_)
+    {
+        ObjectBase* ob = (ObjectBase*) current;
+
+        if(ob->header_.stub)
+        {
+            mem_->resolve(ptr2ref(ob));
+
+            if(collections != mem_->majorCollections_)
+            {
+                current = mem_->toSpace_->start_;
+                collections = mem_->majorCollections_;
+                continue;
+            }
+        }
+
+        current += ob->header_.size;
+    }
+}
+
+Ref ImageSaver::encode(Ref ref) const
+{
+    if(is_immediate(ref))
+    {
+        return ref;
+    }
+
+    Ref* ptr = (Ref*) ptr_val(ref);
+    MemSpace* heap = mem_->toSpace_;
+
+    if(ptr >= heap->start_ && ptr < heap->free_)
+    {
+        return ImageFormat::encode(ptr - heap->start_, array_access(ref));
+    }
+
+    std::map<Ref*, uword>::const_iterator large = largeOffsets_.find(ptr);
+
+    if(large != largeOffsets_.end())
+    {
+        return ImageFormat::encode(large->second, array_access(ref));
+    }
+
+    FrameStack const& frames = thread_->frames_;
+
+    for(size_t i = 0; i < segmentOffsets_.size(); ++i)
+    {
+        FrameStack::Segment const& segment = frames.segments_[i];
+
+        if(ptr >= segment.start_ && ptr < segment.free_)
+        {
+            return ImageFormat::encode(segmentOffsets_[i] + (ptr - segment.start_), array_access(ref));
+        }
+    }
+
+    throw std::runtime_error("cannot save a reference to an object outside of the heap");
+}
+
+Ref* ImageSaver::original(uword offset) const
+{
+    MemSpace* heap = mem_->toSpace_;
+
+    if(offset < (uword) heap->freeSize())
+    {
+        return heap->start_ + offset;
+    }
+
+    for(std::map<Ref*, uword>::const_iterator it = largeOffsets_.begin(); it != largeOffsets_.end(); ++it)
+    {
+        if(it->second == offset)
+        {
+            return it->first;
+        }
+    }
+
+    return 0;
+}
+
+void ImageSaver::save(char const* filename)
+{
+    loadStubs();
+
+    // Nothing is allocated after the collection, so objects stay where they are.
+    mem_->flipSpaces();
+
+    MemSpace* heap = mem_->toSpace_;
+    LargeObjectSpace::BlockSet const& largeBlocks = mem_->large_.blocks_;
+    FrameStack const& frames = thread_->frames_;
+    uword heapSlots = heap->freeSize();
+    uword frameSlots = 0;
+
+    // Large objects follow the old space objects in the heap section, the loader places
+    // them in its old space.
+    largeOffsets_.clear();
+
+    for(LargeObjectSpace::BlockSet::const_iterator it = largeBlocks.begin(); it != largeBlocks.end(); ++it)
+    {
+        ObjectBase* ob = (*it)->object();
+
+        largeOffsets_[(Ref*) ob] = heapSlots;
+        heapSlots += ob->header_.size;
+    }
+
+    segmentOffsets_.clear();
+
+    for(size_t i = 0; i <= frames.current_; ++i)
+    {
+        segmentOffsets_.push_back(heapSlots + frameSlots);
+        frameSlots += frames.segments_[i].free_ - frames.segments_[i].start_;
+    }
+
+    // Heap and frames are encoded into one buffer in offset order.
+    std::vector<Ref> slots;
+    slots.reserve(heapSlots + frameSlots);
+    slots.insert(slots.end(), heap->start_, heap->free_);
+
+    for(LargeObjectSpace::BlockSet::const_iterator it = largeBlocks.begin(); it != largeBlocks.end(); ++it)
+    {
+        Ref* ob = (Ref*) (*it)->object();
+        slots.insert(slots.end(), ob, ob + ((ObjectBase*) ob)->header_.size);
+    }
+
+    for(size_t i = 0; i <= frames.current_; ++i)
+    {
+        slots.insert(slots.end(), frames.segments_[i].start_, frames.segments_[i].free_);
+    }
+
+    ByteVec natives;
+    ByteVec payloads;
+    std::map<void*, uword> nativeIndexes;
+
+    for(uword offset = 0; offset < slots.size(); )
+    {
+        ObjectBase* ob = (ObjectBase*) &slots[offset];
+        const uword size = ob->header_.size;
+
+        ob->header_.mark = 0;
+        ob->header_.young = 0;
+        ob->header_.remembered = 0;
+        ob->header_.frame = 0;
+        ob->header_.large = 0;
+
+        if(ob->header_.objtype == ObjectType::BYTE_ARRAY)
+        {
+            ByteArray* ba = (ByteArray*) ob;
+
+            if(((ByteArray*) original(offset))->hasInlineData())
+            {
+                ba->data_ = (void*) INLINE_PAYLOAD;
+            }
+            else if(!ba->managed_ && ba->size_ == 0)
+            {
+                // Handles to libraries and other native resources do not survive the process.
+                ba->data_ = (void*) (ba->data_ == mem_ ? OPAQUE_MEMORY : 0);
+            }
+            else
+            {
+                const uword payloadOffset = payloads.size();
+
+                appendBytes(payloads, ba->data_, ba->size_);
+                padToWord(payloads);
+
+                ba->managed_ = 1;
+                ba->data_ = (void*) payloadOffset;
+            }
+        }
+        else if(ob->header_.objtype == ObjectType::NATIVE_FUNCTION)
+        {
+            NativeFunction* nf = (NativeFunction*) ob;
+            std::map<void*, uword>::iterator it = nativeIndexes.find(nf->data_);
+
+            if(it == nativeIndexes.end())
+            {
+                NameMap::const_iterator name = names_.find(nf->data_);
+                Dl_info info;
+
+                if(name != names_.end())
+                {
+                    appendString(natives, "");
+                    appendString(natives, name->second);
+                }
+                else if(dladdr(nf->data_, &info) != 0 && info.dli_sname != 0)
+                {
+                    appendString(natives, info.dli_fname);
+                    appendString(natives, info.dli_sname);
+                }
+                else
+                {
+                    throw std::runtime_error("cannot find the name of a native function");
+                }
+
+                it = nativeIndexes.insert(std::make_pair(nf->data_, (uword) nativeIndexes.size())).first;
+            }
+
+            nf->data_ = (void*) it->second;
+        }
+        else if(ObjectType::containsSlots(ob->header_.objtype))
+        {
+            for(uword i = 1; i < size; ++i)
+            {
+                slots[offset + i] = encode(slots[offset + i]);
+            }
+        }
+
+        offset += size;
+    }
+
+    padToWord(natives);
+
+    Ref roots[FIXED_ROOT_COUNT] = {
+        encode(mem_->objectArrayMo_.ref()),
+        encode(mem_->integerMo_.ref()),
+        encode(mem_->byteArrayMo_.ref()),
+        encode(mem_->floatMo_.ref()),
+        encode(thread_->startBallRollingBytecodes_.ref()),
+        encode(thread_->execErrorBa_.ref()),
+        encode(thread_->processExceptionBa_.ref()),
+        encode(thread_->nullArray_.ref())
+    };
+
+    std::vector<Ref> userRoots;
+
+    for(std::vector<RefHandle>::const_iterator it = roots_.begin(); it != roots_.end(); ++it)
+    {
+        userRoots.push_back(encode(it->ref()));
+    }
+
+    ImageHeader header;
+    initHeader(header);
+
+    header.halted = thread_->halt_;
+    header.nativesSize = natives.size();
+    header.nativeCount = nativeIndexes.size();
+    header.rootCount = userRoots.size();
+    header.heapSlots = heapSlots;
+    header.frameSlots = frameSlots;
+    header.payloadSize = payloads.size();
+    header.sendCount = thread_->sendCount_;
+    header.bytecodeCount = thread_->bytecodeCount_;
+    header.currentContext = thread_->cc_ != 0 ? encode(ptr2ref(thread_->cc_)) : zeroRef();
+
+    FILE* file = fopen(filename, "wb");
+
+    if(file == 0)
+    {
+        throw std::runtime_error("cannot open image file for writing");
+    }
+
+    writeBytes(file, &header, sizeof(header));
+    writeBytes(file, natives.empty() ? 0 : &natives[0], natives.size());
+    writeBytes(file, roots, sizeof(roots));
+    writeBytes(file, userRoots.empty() ? 0 : &userRoots[0], userRoots.size() * sizeof(Ref));
+    writeBytes(file, slots.empty() ? 0 : &slots[0], slots.size() * sizeof(Ref));
+    writeBytes(file, payloads.empty() ? 0 : &payloads[0], payloads.size());
+
+    if(fclose(file) != 0)
+    {
+        throw std::runtime_error("cannot write to image file");
+    }
+}
+
+} // namespace debugger
+
+} // namespace atom
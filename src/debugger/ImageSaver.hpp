@@ -0,0 +1,79 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_DEBUGGER_IMAGE_SAVER_HPP_INCLUDED
+#define ATOM_DEBUGGER_IMAGE_SAVER_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <vm/Thread.hpp>
+
+#include "ImageFormat.hpp"
+
+namespace atom
+{
+
+namespace debugger {
+
+/**
+ * Saves the whole state of a VM as an image, see ImageFormat.hpp. The image holds every
+ * object alive after a full collection, the implicit metaobjects of the memory and the
+ * handles, frames and counters of the thread, so a prepared or interrupted execution can
+ * be resumed after the image is loaded by ImageLoader.
+ *
+ * Native functions are saved by name. Names given with nameNative() are used first, other
+ * functions are named after their symbol and library found by dladdr.
+ */
+class ImageSaver
+{
+    typedef std::map<void*, std::string> NameMap;
+
+    Thread* thread_;
+    Memory* mem_;
+    NameMap names_;
+    std::vector<RefHandle> roots_;
+
+    // Offset of each used frame segment in the encoded offset space.
+    std::vector<uword> segmentOffsets_;
+
+    // Offset of each large object in the encoded offset space.
+    std::map<Ref*, uword> largeOffsets_;
+
+    void loadStubs();
+    Ref encode(Ref ref) const;
+
+    // Returns the address of the heap object saved at the given offset.
+    Ref* original(uword offset) const;
+
+public:
+    explicit ImageSaver(Thread* thread);
+
+    void nameNative(void* fn, std::string const& name);
+
+    /**
+     * Adds an object to the roots of the image, loaders find the objects by the order they
+     * are added.
+     */
+    void addRoot(Ref ref);
+
+    /**
+     * Collects the memory and writes the image. Objects of lazily loaded stores are loaded
+     * first, an image never contains stubs.
+     */
+    void save(char const* filename);
+};
+
+} // namespace debugger
+
+} // namespace atom
+
+#endif /* ATOM_DEBUGGER_IMAGE_SAVER_HPP_INCLUDED */
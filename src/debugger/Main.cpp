@@ -22,6 +22,8 @@
 #include <os/ObjectStore.hpp>
 
 #include "LineReader.hpp"
+#include "ImageSaver.hpp"
+#include "ImageLoader.hpp"
 #include "Prims.hpp"
 
 using namespace atom;
@@ -60,7 +62,18 @@ void memoryStatusSummary(Memory& mem)
 {
     std::cout << "Memory status summary:\n"
               << "    Object memory size               : " << mem.toSpace_->size() << "\n"
-              << "    Object memory allocated slots    : " << mem.toSpace_->freeSize() << "\n";
+              << "    Object memory allocated slots    : " << mem.toSpace_->freeSize() << "\n"
+              << "    Object memory maximum size       : " << mem.policy_.maxSize << "\n";
+
+    if(mem.nursery_ != 0)
+    {
+        std::cout << "    Nursery size                     : " << mem.nursery_->size() << "\n"
+                  << "    Nursery allocated slots          : " << mem.nursery_->freeSize() << "\n";
+    }
+
+    std::cout << "    Large objects                    : " << mem.large_.objectCount() << "\n"
+              << "    Large object slots               : " << mem.large_.slots_ << "\n"
+              << "    Bytes saved from copying         : " << mem.large_.savedSlots_ * sizeof(Ref) << "\n";
 }
 
 void printPrimObjectHeader(PrimDataObject* rp)
@@ -110,6 +123,10 @@ void dumpObject(Ref ref, VoidPtrVec& dumped)
     {
         std::cout << int_val(ref);
     }
+    else if(is_immediate_float(ref))
+    {
+        std::cout << "float: " << float_val(ref);
+    }
     else
     {
         if(array_access(ref))
@@ -287,6 +304,25 @@ void dumpBytecodes(Ref baRef)
 
                 std::cout << "$" << (int) ba[i] << "\n";
             }
+            else if(ba[i] == Opcode::CALL_NATIVE)
+            {
+                std::cout << "call ";
+                ++i;
+
+                int length = ba[i];
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << " [";
+                ++i;
+
+                for(int x = 0; x < length; ++x)
+                {
+                    std::cout << (x > 0 ? ", $" : "$") << (int) ba[i];
+                    ++i;
+                }
+
+                std::cout << "] > $" << (int) ba[i] << "\n";
+            }
             else if(ba[i] == 4)
             {
                 std::cout << "return\n";
@@ -353,6 +389,34 @@ void dumpBytecodes(Ref baRef)
                 
                 std::cout << "$" << (int) ba[i] << "\n";                
             }
+            else if(ba[i] == Opcode::META_ARGS)
+            {
+                std::cout << "margs ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << " ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << "\n";
+            }
+            else if(Opcode::isArithmetic(ba[i]))
+            {
+                static char const* const names[] = {"add", "sub", "mul", "div", "mod", "lt", "gt", "eq"};
+
+                std::cout << names[ba[i] - Opcode::ADD] << " ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << " ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << " with ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << " > ";
+                ++i;
+
+                std::cout << "$" << (int) ba[i] << "\n";
+            }
             else
             {
                 std::cout << (int) ba[i] << '\n';
@@ -407,6 +471,7 @@ void readRefs(std::istream& iss, std::vector<Ref>& refs)
 }
 
 #define NEW_FN(fn) { natives[(void*) &fn] = #fn; nativesRefs[#fn] = mem.createNativeFunction(&fn); }
+#define NEW_DIRECT_FN(fn) { uword sig; NativeSignature::parse(fn##_signature, sig); natives[(void*) &fn] = #fn; nativesRefs[#fn] = mem.createDirectNativeFunction(&fn, sig); }
 
 int main()
 {
@@ -419,6 +484,8 @@ int main()
     commands.push_back("dump-byte-array");
     commands.push_back("load-object-store");
     commands.push_back("save-object-store");
+    commands.push_back("save-image");
+    commands.push_back("load-image");
     commands.push_back("set-elem");
     commands.push_back("prepare-send");
     commands.push_back("create-cstring");
@@ -432,11 +499,20 @@ int main()
     commands.push_back("step");
     commands.push_back("run");
     commands.push_back("gc");
+    commands.push_back("stats");
 
     LineReader input("(zdb) ", commands);
     std::string line;
 
-    Memory mem(10240);
+    HeapPolicy policy(10240);
+
+    if(!policy.parseEnvironment() || !policy.valid())
+    {
+        std::cerr << "Invalid ATOM_HEAP environment variable, using defaults.\n";
+        policy = HeapPolicy(10240);
+    }
+
+    Memory mem(policy);
     Thread thread(&mem);
     mem.setThread(&thread);
     
@@ -444,19 +520,19 @@ int main()
     NEW_FN(fn_printCString);
     NEW_FN(fn_addOne);
     NEW_FN(fn_exitVm);
-    NEW_FN(fn_multInt);
-    NEW_FN(fn_divInt);
-    NEW_FN(fn_addInt);
-    NEW_FN(fn_subInt);
-    NEW_FN(fn_modInt);
-    NEW_FN(fn_eqInt);
+    NEW_DIRECT_FN(fn_multInt);
+    NEW_DIRECT_FN(fn_divInt);
+    NEW_DIRECT_FN(fn_addInt);
+    NEW_DIRECT_FN(fn_subInt);
+    NEW_DIRECT_FN(fn_modInt);
+    NEW_DIRECT_FN(fn_eqInt);
     NEW_FN(fn_readInt);
     NEW_FN(fn_is_object);
     NEW_FN(fn_is_int_object);
-    NEW_FN(fn_intLessThan);
-    NEW_FN(fn_intGreaterThan);
+    NEW_DIRECT_FN(fn_intLessThan);
+    NEW_DIRECT_FN(fn_intGreaterThan);
     NEW_FN(fn_is_byte_array);
-    NEW_FN(fn_arrayCopy);
+    NEW_DIRECT_FN(fn_arrayCopy);
 
     while(true)
     try
@@ -521,6 +597,47 @@ int main()
                 ObjectStoreReader(osFile.c_str(), &mem).readAll();
             }
         }
+        else if(cmd == "save-image")
+        {
+            std::string imageFile;
+            iss >> imageFile;
+
+            std::vector<Ref> refs;
+            readRefs(iss, refs);
+
+            ImageSaver saver(&thread);
+
+            for(std::map<void*, std::string>::iterator it = natives.begin(); it != natives.end(); ++it)
+            {
+                saver.nameNative(it->first, it->second);
+            }
+
+            for(unsigned int i = 0; i < refs.size(); ++i)
+            {
+                saver.addRoot(refs.at(i));
+            }
+
+            saver.save(imageFile.c_str());
+        }
+        else if(cmd == "load-image")
+        {
+            std::string imageFile;
+            iss >> imageFile;
+
+            ImageLoader loader(&thread);
+
+            for(std::map<void*, std::string>::iterator it = natives.begin(); it != natives.end(); ++it)
+            {
+                loader.nameNative(it->second, it->first);
+            }
+
+            loader.load(imageFile.c_str());
+
+            for(uword i = 0; i < loader.rootCount(); ++i)
+            {
+                std::cout << "root " << i << ": " << ptr_val(loader.rootAt(i)) << "\n";
+            }
+        }
         else if(cmd == "prepare-send")
         {
             RefHandle target(readPtr(iss), &mem);
@@ -533,6 +650,26 @@ int main()
         {
             mem.flipSpaces();
         }
+        else if(cmd == "stats")
+        {
+            std::string format;
+            iss >> format;
+
+            if(format == "reset")
+            {
+                thread.stats_.reset();
+            }
+            else if(format == "json")
+            {
+                thread.stats_.printJson(std::cout);
+                std::cout << "\n";
+            }
+            else
+            {
+                std::cout << "sends: " << thread.sendCount_ << ", bytecodes: " << thread.bytecodeCount_ << "\n";
+                thread.stats_.print(std::cout);
+            }
+        }
         else if(cmd == "step")
         {
             try 
@@ -9,20 +9,29 @@ extern "C"
 void fn_printCString(atom::Thread*, int, atom::Ref);
 void fn_println(atom::Thread*, int, atom::Ref);
 void fn_readInt(atom::Thread*, int, atom::Ref);
-void fn_addInt(atom::Thread*, int, atom::Ref);
-void fn_eqInt(atom::Thread*, int, atom::Ref);
-void fn_modInt(atom::Thread*, int, atom::Ref);
-void fn_intLessThan(atom::Thread*, int, atom::Ref);
-void fn_intGreaterThan(atom::Thread*, int, atom::Ref);
-void fn_subInt(atom::Thread*, int, atom::Ref);
-void fn_multInt(atom::Thread*, int, atom::Ref);
-void fn_divInt(atom::Thread*, int, atom::Ref);
+void fn_addInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_addInt_signature[];
+void fn_eqInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_eqInt_signature[];
+void fn_modInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_modInt_signature[];
+void fn_intLessThan(atom::Thread*, int, atom::Ref const*);
+extern char const fn_intLessThan_signature[];
+void fn_intGreaterThan(atom::Thread*, int, atom::Ref const*);
+extern char const fn_intGreaterThan_signature[];
+void fn_subInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_subInt_signature[];
+void fn_multInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_multInt_signature[];
+void fn_divInt(atom::Thread*, int, atom::Ref const*);
+extern char const fn_divInt_signature[];
 void fn_addOne(atom::Thread*, int, atom::Ref);
 void fn_is_object(atom::Thread*, int, atom::Ref);
 void fn_is_byte_array(atom::Thread*, int, atom::Ref);
 void fn_is_int_object(atom::Thread*, int, atom::Ref);
 void fn_exitVm(atom::Thread*, int, atom::Ref);
-void fn_arrayCopy(atom::Thread*, int, atom::Ref);
+void fn_arrayCopy(atom::Thread*, int, atom::Ref const*);
+extern char const fn_arrayCopy_signature[];
 
 } // extern "C"
 
@@ -10,7 +10,12 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <limits>
 
 #include "ObjectStore.hpp"
 
@@ -24,9 +29,90 @@
 
 
 using namespace atom;
+using namespace atom::ObjectStoreFormat;
+
+namespace
+{
+    inline uword paddedSize(uword size)
+    {
+        return (size + WORD_BYTE_COUNT - 1) / WORD_BYTE_COUNT * WORD_BYTE_COUNT;
+    }
+
+    /**
+     * Returns the number of bytes the record of the object occupies in the objects section.
+     */
+    uword recordLength(Ref ref)
+    {
+        if(is_byte_array(ref))
+        {
+            return sizeof(RecordHeader) + sizeof(uword);
+        }
+        else if(is_float(ref))
+        {
+            return sizeof(RecordHeader) + sizeof(double);
+        }
+
+        return sizeof(RecordHeader) + (cast<ObjectHeader>(ref)->size - 1) * sizeof(Ref);
+    }
+
+    /**
+     * Returns the number of slots the object occupies in the heap once loaded.
+     */
+    uword heapSize(Ref ref)
+    {
+        if(is_byte_array(ref))
+        {
+            return ByteArray::heapSlots(cast<ByteArray>(ref)->size());
+        }
+
+        return cast<ObjectHeader>(ref)->size;
+    }
+} // namespace <anonymous>
 
 namespace atom
 {
+    ObjectIndexMap::ObjectIndexMap()
+    : count_(0)
+    {
+        clear();
+    }
+
+    void ObjectIndexMap::insert(void* object, uword index)
+    {
+        if(2 * (count_ + 1) > entries_.size())
+        {
+            grow();
+        }
+
+        Entry& entry = entries_[slotFor(object)];
+        entry.object = object;
+        entry.index = index;
+
+        ++count_;
+    }
+
+    void ObjectIndexMap::grow()
+    {
+        EntryVec old(entries_.size() * 2);
+        old.swap(entries_);
+
+        for(EntryVec::const_iterator it = old.begin(); it != old.end(); ++it)
+        {
+            if(it->object != 0)
+            {
+                entries_[slotFor(it->object)] = *it;
+            }
+        }
+    }
+
+    void ObjectIndexMap::clear()
+    {
+        Entry empty = {0, 0};
+
+        entries_.assign(16, empty);
+        count_ = 0;
+    }
+
     ObjectStoreWriter::ObjectStoreWriter(char const* filename)
     {
         out_ = fopen(filename, "wb");
@@ -51,6 +137,13 @@ namespace atom
     void ObjectStoreWriter::addObject(Ref ref)
     {
         objects_.push_back(ref);
+        names_.push_back(std::string());
+    }
+
+    void ObjectStoreWriter::addObject(Ref ref, std::string const& name)
+    {
+        objects_.push_back(ref);
+        names_.push_back(name);
     }
 
     inline uword ref_as_uword(Ref r)
@@ -60,21 +153,19 @@ namespace atom
     
     uword ObjectStoreWriter::idForObject(Ref ref)
     {
-        if(is_int(ref))
+        if(is_immediate(ref))
         {
             return ref_as_uword(ref);
         }
 
-        uword idx = 0;
-        for(RefVec::const_iterator it = objectTable_.begin(); it != objectTable_.end(); ++it, ++idx)
+        uword idx;
+
+        if(!objectIndexes_.find(ptr_val(ref), idx))
         {
-            if(*it == ref)
-            {
-                return ref_as_uword(ptr2ref((void*) (idx << 2), array_access(ref)));
-            }
+            throw std::runtime_error("possible bug. cannot find object in object table");
         }
 
-        throw std::runtime_error("possible bug. cannot find object in object table");
+        return ref_as_uword(ptr2ref((void*) (idx << 2), array_access(ref)));
     }
 
     void ObjectStoreWriter::storeObjectArray(Object* oa)
@@ -85,9 +176,15 @@ namespace atom
         }
     }
 
-    void ObjectStoreWriter::storeObjectHeader(ObjectHeader* oh)
+    void ObjectStoreWriter::storeRecordHeader(int type, uword size)
     {
-        writeItem(*oh);
+        RecordHeader rh;
+
+        rh.mark = 0;
+        rh.objtype = type;
+        rh.size = size;
+
+        writeItem(rh);
     }
 
     void ObjectStoreWriter::storeFloat(FloatObject* f)
@@ -95,15 +192,16 @@ namespace atom
         writeItem(f->value_);
     }
 
-    void ObjectStoreWriter::storeByteArray(ByteArray* ba)
+    void ObjectStoreWriter::storeByteArray(ByteArray* ba, uword& payloadOffset)
     {
-        ObjectHeader oh;
+        storeRecordHeader(ObjectType::BYTE_ARRAY, ba->size());
+        writeItem(payloadOffset);
 
-        oh.objtype = ObjectType::BYTE_ARRAY;
-        oh.size = ba->size();
-
-        storeObjectHeader(&oh);
+        payloadOffset += paddedSize(ba->size());
+    }
 
+    void ObjectStoreWriter::storeByteArrayContents(ByteArray* ba)
+    {
         writeBytes(ba->data(), ba->size());
 
         char buf[WORD_BYTE_COUNT];
@@ -115,57 +213,80 @@ namespace atom
         }
     }
 
-    void ObjectStoreWriter::writeObject(Ref ref)
+    void ObjectStoreWriter::writeObject(Ref ref, uword& payloadOffset)
     {
-        if(is_int(ref))
+        if(is_immediate(ref))
         {
             return;
         }
 
+        // The slots of a stub are not the slots of the object it stands for.
+        if(is_stub(ref))
+        {
+            throw std::runtime_error("cannot store an object that is not loaded");
+        }
+
         if(is_byte_array(ref))
         {
-            storeByteArray(cast<ByteArray>(ref));
+            storeByteArray(cast<ByteArray>(ref), payloadOffset);
         }
         else if(is_float(ref))
         {
-            storeObjectHeader(static_cast<ObjectHeader*>(ptr_val(ref)));
+            storeRecordHeader(ObjectType::FLOAT, cast<ObjectHeader>(ref)->size);
             storeFloat(cast<FloatObject>(ref));
         }
         else
         {
             // We can treat all other objects as Object's
-            storeObjectHeader(static_cast<ObjectHeader*>(ptr_val(ref)));
+            storeRecordHeader(obj_type(ref), cast<ObjectHeader>(ref)->size);
             storeObjectArray(static_cast<Object*>(ptr_val(ref)));
         }
     }
 
-    void ObjectStoreWriter::populateObjectTableWith(Ref ref)
+    bool ObjectStoreWriter::addToObjectTable(Ref ref)
     {
-        if(std::find(objectTable_.begin(), objectTable_.end(), ref) != objectTable_.end())
-        {
-            return;
-        }
+        uword idx;
 
-        if(is_int(ref))
+        // References with and without array access share the entry of the object.
+        if(is_immediate(ref) || objectIndexes_.find(ptr_val(ref), idx))
         {
-            // Do nothing
+            return false;
         }
-        else if(is_byte_array(ref) || is_float(ref))
+
+        objectIndexes_.insert(ptr_val(ref), objectTable_.size());
+        objectTable_.push_back(ref);
+
+        return !is_byte_array(ref) && !is_float(ref);
+    }
+
+    void ObjectStoreWriter::populateObjectTableWith(Ref ref)
+    {
+        if(!addToObjectTable(ref))
         {
-            objectTable_.push_back(ref);
+            return;
         }
-        else
+
+        // Objects are added in depth first order using an explicit stack, so deep graphs
+        // such as long lists do not overflow the native stack. We can cast to Object because
+        // physical structure of all objects are same and we are in C++ land.
+        SlotCursorVec stack;
+        stack.push_back(SlotCursor(static_cast<Object*>(ptr_val(ref)), 0));
+
+        while(!stack.empty())
         {
-            objectTable_.push_back(ref);
+            SlotCursor& top = stack.back();
 
-            // We can cast to Object because physical structure of all objects are same
-            // and we are in C++ land.
-            Object* oh = static_cast<Object*>(ptr_val(ref));
-            int sz = oh->size();
+            if(top.second == top.first->size())
+            {
+                stack.pop_back();
+                continue;
+            }
 
-            for(int i = 0; i < sz; ++i)
+            Ref child = top.first->at(top.second++);
+
+            if(addToObjectTable(child))
             {
-                populateObjectTableWith(oh->at(i));
+                stack.push_back(SlotCursor(static_cast<Object*>(ptr_val(child)), 0));
             }
         }
     }
@@ -173,6 +294,7 @@ namespace atom
     void ObjectStoreWriter::populateObjectTable()
     {
         objectTable_.clear();
+        objectIndexes_.clear();
 
         for(RefVec::const_iterator it = objects_.begin(); it != objects_.end(); ++it)
         {
@@ -193,144 +315,617 @@ namespace atom
 
         populateObjectTable();
 
+        std::vector<IndexEntry> index(objectTable_.size());
+        uword objectsLength = 0;
+        uword payloadsLength = 0;
+        uword slotCount = 0;
+
+        for(uword i = 0; i < objectTable_.size(); ++i)
+        {
+            Ref ref = objectTable_[i];
+
+            index[i].recordOffset = objectsLength;
+            index[i].heapOffset = slotCount;
+
+            objectsLength += recordLength(ref);
+            slotCount += heapSize(ref);
+
+            if(is_byte_array(ref))
+            {
+                payloadsLength += paddedSize(cast<ByteArray>(ref)->size());
+            }
+        }
+
+        uword symbolCount = 0;
+        uword symbolsLength = sizeof(uword);
+
+        for(std::vector<std::string>::const_iterator it = names_.begin(); it != names_.end(); ++it)
+        {
+            if(!it->empty())
+            {
+                ++symbolCount;
+                symbolsLength += 2 * sizeof(uword) + paddedSize(it->size());
+            }
+        }
+
+        SectionEntry sections[5] = {
+            {OBJECTS_SECTION, 0, objectsLength},
+            {PAYLOADS_SECTION, 0, payloadsLength},
+            {INDEX_SECTION, 0, index.size() * sizeof(IndexEntry)},
+            {ROOTS_SECTION, 0, (1 + objects_.size()) * sizeof(uword)},
+            {SYMBOLS_SECTION, 0, symbolsLength}
+        };
+
+        // Stores without names are written without the symbols section.
+        const int sectionCount = symbolCount != 0 ? 5 : 4;
+        uword offset = sizeof(StoreHeader) + sectionCount * sizeof(SectionEntry);
+
+        for(int i = 0; i < sectionCount; ++i)
+        {
+            sections[i].offset = offset;
+            offset += sections[i].length;
+        }
+
+        StoreHeader header;
+        initHeader(header);
+
+        header.sectionCount = sectionCount;
+        header.objectCount = objectTable_.size();
+        header.slotCount = slotCount;
+
+        writeItem(header);
+        writeBytes(sections, sectionCount * sizeof(SectionEntry));
+
+        uword payloadOffset = 0;
+
         for(RefVec::const_iterator it = objectTable_.begin(); it != objectTable_.end(); ++it)
         {
-            writeObject(*it);
+            writeObject(*it, payloadOffset);
+        }
+
+        for(RefVec::const_iterator it = objectTable_.begin(); it != objectTable_.end(); ++it)
+        {
+            if(is_byte_array(*it))
+            {
+                storeByteArrayContents(cast<ByteArray>(*it));
+            }
+        }
+
+        if(!index.empty())
+        {
+            writeBytes(&index[0], index.size() * sizeof(IndexEntry));
+        }
+
+        writeItem((uword) objects_.size());
+
+        for(RefVec::const_iterator it = objects_.begin(); it != objects_.end(); ++it)
+        {
+            writeItem(idForObject(*it));
+        }
+
+        if(symbolCount != 0)
+        {
+            writeItem(symbolCount);
+
+            for(uword i = 0; i < names_.size(); ++i)
+            {
+                std::string const& name = names_[i];
+
+                if(!name.empty())
+                {
+                    const uword padding = paddedSize(name.size()) - name.size();
+
+                    writeItem(i);
+                    writeItem((uword) name.size());
+                    writeBytes(name.data(), name.size());
+
+                    if(padding != 0)
+                    {
+                        writeBytes("\0\0\0\0\0\0\0", padding);
+                    }
+                }
+            }
         }
     }
 
     ObjectStoreReader::ObjectStoreReader(char const* filename, Memory* mem)
+    : data_(0), size_(0), mem_(mem), versioned_(false), inlinePayloads_(true), payloads_(0), payloadsSize_(0), objects_(0), index_(0), objectCount_(0),
+      invalidOffset_(false)
     {
-        in_ = fopen(filename, "rb");
+        fd_ = open(filename, O_RDONLY);
 
-        if(in_ == 0)
+        if(fd_ == -1)
         {
             throw std::runtime_error("cannot open object store file for reading");
         }
 
-        mem_ = mem;
+        struct stat st;
+
+        if(fstat(fd_, &st) == -1)
+        {
+            close(fd_);
+            throw std::runtime_error("cannot read from file");
+        }
+
+        size_ = st.st_size;
+
+        // Empty files cannot be mapped.
+        if(size_ > 0)
+        {
+            void* data = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+
+            if(data == MAP_FAILED)
+            {
+                close(fd_);
+                throw std::runtime_error("cannot map object store file");
+            }
+
+            data_ = (byte const*) data;
+            versioned_ = hasMagic(data_, size_);
+        }
+    }
+
+    ObjectStoreReader::~ObjectStoreReader()
+    {
+        if(mem_->loader_ == this)
+        {
+            mem_->loader_ = 0;
+        }
+
+        if(data_ != 0)
+        {
+            munmap((void*) data_, size_);
+        }
+
+        close(fd_);
+    }
+
+    uword ObjectStoreReader::measureRecord(RecordHeader const* oh, uword& length) const
+    {
+        if(oh->objtype == ObjectType::BYTE_ARRAY)
+        {
+            length = sizeof(RecordHeader) + (versioned_ ? sizeof(uword) : paddedSize(oh->size));
+            return inlinePayloads_ ? ByteArray::heapSlots(oh->size) : sizeof(ByteArray) / sizeof(Ref);
+        }
+        else if(oh->objtype == ObjectType::FLOAT)
+        {
+            length = sizeof(RecordHeader) + sizeof(double);
+            return sizeof(FloatObject) / sizeof(Ref);
+        }
+        else if(ObjectType::isValid(oh->objtype))
+        {
+            if(oh->size < 1)
+            {
+                throw std::runtime_error("invalid object size read");
+            }
+
+            length = sizeof(RecordHeader) + (oh->size - 1) * sizeof(Ref);
+            return oh->size;
+        }
+
+        throw std::runtime_error("unknown object type read");
     }
 
-    Ref ObjectStoreReader::readRef()
+    uword ObjectStoreReader::indexRecords()
     {
-        Ref ref;
+        uword slots = 0;
+        uword offset = 0;
 
-        if(!readItem(ref))
+        while(offset < size_)
         {
-            throw std::runtime_error("eof");
+            ensureWithin(offset, sizeof(RecordHeader), size_);
+
+            uword length;
+            uword heapSize = measureRecord((RecordHeader const*) (data_ + offset), length);
+
+            ensureWithin(offset, length, size_);
+
+            recordOffsets_.push_back(offset);
+            heapOffsets_.push_back(slots);
+
+            offset += length;
+            slots += heapSize;
+        }
+
+        return slots;
+    }
+
+    SectionEntry const* ObjectStoreReader::findSection(uword type) const
+    {
+        StoreHeader const* header = (StoreHeader const*) data_;
+        SectionEntry const* sections = (SectionEntry const*) (header + 1);
+
+        for(uword i = 0; i < header->sectionCount; ++i)
+        {
+            if(sections[i].type == type)
+            {
+                return &sections[i];
+            }
         }
 
-        return ref;
+        return 0;
     }
 
-    void ObjectStoreReader::readByteArray(ObjectHeader const& oh)
+    void ObjectStoreReader::openVersioned()
     {
-        RefHandle bufRef(mem_->createManagedByteArray(oh.size), mem_);
-        byte* buf = cast<ByteArray>(bufRef.ref())->data();
+        StoreHeader const* header = (StoreHeader const*) data_;
+
+        if((header->version != VERSION && header->version != INLINE_PAYLOADS_VERSION - 1) || header->wordSize != sizeof(word) || header->littleEndian != 1)
+        {
+            throw std::runtime_error("unsupported object store format");
+        }
+
+        ensureWithin(sizeof(StoreHeader), header->sectionCount * sizeof(SectionEntry), size_);
+
+        SectionEntry const* sections = (SectionEntry const*) (header + 1);
+
+        for(uword i = 0; i < header->sectionCount; ++i)
+        {
+            ensureWithin(sections[i].offset, sections[i].length, size_);
+
+            if(sections[i].offset % WORD_BYTE_COUNT != 0)
+            {
+                throw std::runtime_error("invalid object store section");
+            }
+        }
+
+        SectionEntry const* objects = findSection(OBJECTS_SECTION);
+        SectionEntry const* payloads = findSection(PAYLOADS_SECTION);
+        SectionEntry const* index = findSection(INDEX_SECTION);
+        SectionEntry const* roots = findSection(ROOTS_SECTION);
+        SectionEntry const* symbols = findSection(SYMBOLS_SECTION);
+
+        if(objects == 0 || index == 0 || index->length / sizeof(IndexEntry) != header->objectCount)
+        {
+            throw std::runtime_error("invalid object store index");
+        }
+
+        inlinePayloads_ = header->version >= INLINE_PAYLOADS_VERSION;
+        objects_ = objects;
+        index_ = (IndexEntry const*) (data_ + index->offset);
+        objectCount_ = header->objectCount;
+        payloads_ = payloads != 0 ? data_ + payloads->offset : 0;
+        payloadsSize_ = payloads != 0 ? payloads->length : 0;
+
+        if(roots != 0)
+        {
+            uword const* words = (uword const*) (data_ + roots->offset);
+
+            ensureWithin(0, sizeof(uword), roots->length);
 
-        byte junk[WORD_BYTE_COUNT];
+            // The count is checked before it is scaled, a crafted count could wrap the size.
+            if(words[0] > (roots->length - sizeof(uword)) / sizeof(uword))
+            {
+                throw std::runtime_error("invalid object store roots");
+            }
+
+            for(uword i = 1; i <= words[0]; ++i)
+            {
+                Ref root = *(Ref const*) &words[i];
+
+                if(!is_immediate(root) && (uword) root.data_ >= objectCount_)
+                {
+                    throw std::runtime_error("Invalid object table offset.");
+                }
 
-        if(!readBytes(buf, oh.size))
+                roots_.push_back(root);
+            }
+        }
+
+        rootNames_.assign(roots_.size(), std::string());
+
+        if(symbols != 0)
         {
-            throw std::runtime_error("eof");
+            byte const* start = data_ + symbols->offset;
+            uword offset = sizeof(uword);
+
+            ensureWithin(0, sizeof(uword), symbols->length);
+
+            for(uword i = 0; i < *(uword const*) start; ++i)
+            {
+                ensureWithin(offset, 2 * sizeof(uword), symbols->length);
+
+                uword const* symbol = (uword const*) (start + offset);
+
+                ensureWithin(offset + 2 * sizeof(uword), symbol[1], symbols->length);
+
+                if(symbol[0] >= roots_.size())
+                {
+                    throw std::runtime_error("invalid object store symbol");
+                }
+
+                rootNames_[symbol[0]].assign((char const*) (symbol + 2), symbol[1]);
+                offset += 2 * sizeof(uword) + paddedSize(symbol[1]);
+            }
         }
+    }
+
+    RecordHeader const* ObjectStoreReader::versionedRecord(uword index, uword& heapSize) const
+    {
+        uword offset = index_[index].recordOffset;
+
+        ensureWithin(offset, sizeof(RecordHeader), objects_->length);
+
+        RecordHeader const* oh = (RecordHeader const*) (data_ + objects_->offset + offset);
+        uword length;
 
-        if((oh.size % WORD_BYTE_COUNT) != 0)
+        heapSize = measureRecord(oh, length);
+        ensureWithin(offset, length, objects_->length);
+
+        if(oh->objtype == ObjectType::BYTE_ARRAY)
         {
-            readBytes(junk, WORD_BYTE_COUNT - (oh.size % WORD_BYTE_COUNT));
+            ensureWithin(*(uword const*) (oh + 1), oh->size, payloadsSize_);
         }
 
-        objects_.push_back(bufRef);
+        return oh;
     }
 
-    void ObjectStoreReader::readObject(ObjectHeader const& oh)
+    uword ObjectStoreReader::indexVersionedRecords()
     {
-        if(!ObjectType::isValid(oh.objtype))
+        openVersioned();
+
+        uword slots = 0;
+
+        for(uword i = 0; i < objectCount_; ++i)
         {
-            throw std::runtime_error("unknown object type read");
+            // Records are not required to be contiguous but their loaded forms are.
+            if(index_[i].heapOffset != slots)
+            {
+                throw std::runtime_error("invalid object store index");
+            }
+
+            uword heapSize;
+            RecordHeader const* oh = versionedRecord(i, heapSize);
+
+            recordOffsets_.push_back((byte const*) oh - data_);
+            heapOffsets_.push_back(slots);
+
+            slots += heapSize;
         }
 
-        PtrHandle<Object> oa((Object*) ptr_val(mem_->createObject(oh.size, oh.objtype)), mem_);
-        objects_.push_back(RefHandle(ptr2ref(oa.ptr()), mem_));
+        if(slots != ((StoreHeader const*) data_)->slotCount)
+        {
+            throw std::runtime_error("invalid object store index");
+        }
+
+        return slots;
+    }
 
-        for(uword i = 0; i < (oh.size - 1); ++i)
+    inline Ref ObjectStoreReader::relocate(Ref item, Ref* base)
+    {
+        if(is_immediate(item))
         {
-            Ref item = readRef();
+            return item;
+        }
 
-            if(is_int(item))
+        uword objectTableIndex = item.data_;
+
+        // Throwing here would leave the rest of the chunk without headers, the error is
+        // reported once every object is initialized.
+        if(objectTableIndex >= heapOffsets_.size())
+        {
+            invalidOffset_ = true;
+            return zeroRef();
+        }
+
+        return ptr2ref(base + heapOffsets_[objectTableIndex], array_access(item));
+    }
+
+    void ObjectStoreReader::copyRecord(RecordHeader const* oh, Ref* target, Ref* base)
+    {
+        byte const* payload = (byte const*) (oh + 1);
+
+        if(oh->objtype == ObjectType::BYTE_ARRAY)
+        {
+            ByteArray* ba = (ByteArray*) target;
+
+            if(versioned_)
             {
-                oa->atPut(i, item);
+                payload = payloads_ + *(uword const*) payload;
+            }
+
+            ba->managed_ = true;
+            ba->size_ = oh->size;
+
+            if(inlinePayloads_ && oh->size <= ByteArray::MAX_INLINE_SIZE)
+            {
+                mem_->initHeader(&ba->header_, ObjectType::BYTE_ARRAY, ByteArray::heapSlots(oh->size));
+                ba->data_ = ba->inlineData();
             }
             else
             {
-                bool arracc = array_access(item);
-                int objectTableIndex = item.data_;
+                mem_->initHeader(&ba->header_, ObjectType::BYTE_ARRAY, sizeof(ByteArray) / sizeof(Ref));
+                ba->data_ = new byte[oh->size];
+                mem_->registerExternalPayload(ba);
+            }
+
+            memcpy(ba->data_, payload, oh->size);
+        }
+        else if(oh->objtype == ObjectType::FLOAT)
+        {
+            FloatObject* fo = (FloatObject*) target;
+
+            mem_->initHeader(&fo->header_, ObjectType::FLOAT, sizeof(FloatObject) / sizeof(Ref));
+            memcpy(&fo->value_, payload, sizeof(double));
+        }
+        else
+        {
+            Object* ob = (Object*) target;
+            Ref const* slots = (Ref const*) payload;
+            Ref* elements = ob->elements();
+
+            mem_->initHeader(&ob->header_, oh->objtype, oh->size);
 
-                fixups_.push_back(FixupRecord(objectTableIndex, i, oa, arracc));
+            // The objects are fresh and allocated together, no write barrier is needed.
+            for(uword i = 0; i < oh->size - 1; ++i)
+            {
+                elements[i] = relocate(slots[i], base);
             }
         }
     }
 
-    bool ObjectStoreReader::readFloat()
+    Object* ObjectStoreReader::readAll()
     {
-        double d;
+        recordOffsets_.clear();
+        heapOffsets_.clear();
+        roots_.clear();
+        invalidOffset_ = false;
+
+        const uword objectSlots = versioned_ ? indexVersionedRecords() : indexRecords();
+        const uword count = heapOffsets_.size();
+        const uword totalSlots = objectSlots + 1 + count;
 
-        if(!readItem(d))
+        if(totalSlots > (uword) std::numeric_limits<int>::max())
         {
-            return false;
+            throw memory_exhausted_error();
+        }
+
+        // Nothing else is allocated until every header is initialized, so the chunk is never
+        // seen by a collection in a partially filled state. The chunk holds many objects, it
+        // goes to the old space even if it is as large as a large object.
+        Ref* base = mem_->allocOld(totalSlots);
+
+        for(uword i = 0; i < count; ++i)
+        {
+            copyRecord((RecordHeader const*) (data_ + recordOffsets_[i]), base + heapOffsets_[i], base);
         }
 
-        objects_.push_back(RefHandle(mem_->createFloat(d), mem_));
-        return true;
+        Object* all = (Object*) (base + objectSlots);
+        mem_->initHeader(&all->header_, Object::type, 1 + count);
+
+        for(uword i = 0; i < count; ++i)
+        {
+            all->elements()[i] = ptr2ref(base + heapOffsets_[i]);
+        }
+
+        if(invalidOffset_)
+        {
+            throw std::runtime_error("Invalid object table offset.");
+        }
+
+        return all;
     }
 
-    bool ObjectStoreReader::readNextObject()
+    RecordHeader const* ObjectStoreReader::lazyRecord(uword index) const
     {
-        ObjectHeader oh;
+        if(index >= objectCount_)
+        {
+            throw std::runtime_error("Invalid object table offset.");
+        }
 
-        if(!readItem(oh))
+        if(versioned_)
         {
-            return false;
+            uword heapSize;
+            return versionedRecord(index, heapSize);
         }
 
-        if(oh.objtype == ObjectType::BYTE_ARRAY)
+        return (RecordHeader const*) (data_ + recordOffsets_[index]);
+    }
+
+    Ref ObjectStoreReader::createLazily(uword index)
+    {
+        LoadedMap::iterator it = loaded_.find(index);
+
+        if(it != loaded_.end())
         {
-            readByteArray(oh);
+            return it->second;
         }
-        else if(oh.objtype == ObjectType::FLOAT)
+
+        RecordHeader const* oh = lazyRecord(index);
+        uword length;
+        uword heapSize = measureRecord(oh, length);
+
+        // Loaded objects are old, so filling stubs never creates old to young references.
+        Ref* target = mem_->allocOld(heapSize);
+
+        if(oh->objtype != ObjectType::BYTE_ARRAY && oh->objtype != ObjectType::FLOAT && oh->size > 1)
         {
-            return readFloat();
+            Object* stub = (Object*) target;
+
+            mem_->initHeader(&stub->header_, oh->objtype, oh->size);
+            stub->header_.stub = 1;
+            stub->elements()[0] = word2ref(index);
         }
         else
         {
-            readObject(oh);
+            // Objects without references are loaded right away, natives read byte arrays and
+            // floats without resolving them.
+            copyRecord(oh, target, 0);
         }
 
-        return true;
+        return loaded_[index] = ptr2ref(target);
     }
 
-    Object* ObjectStoreReader::readAll()
+    Ref ObjectStoreReader::readRoot(uword index)
     {
-        while(readNextObject());
-        applyFixups();
+        Ref root = roots_[index];
 
-        PtrHandle<Object> all(mem_->createObject<Object>(objects_.size() + 1), mem_);
+        if(is_immediate(root))
+        {
+            return root;
+        }
 
-        int index = 0;
-        for(RefVec::const_iterator it = objects_.begin(); it != objects_.end(); ++it, ++index)
+        Ref object = readObject(root.data_);
+        return array_access(root) ? set_array_access(object) : object;
+    }
+
+    Ref ObjectStoreReader::readObject(uword index)
+    {
+        if(mem_->loader_ != this)
         {
-            all->atPut(index, it->ref());
+            recordOffsets_.clear();
+            heapOffsets_.clear();
+            roots_.clear();
+
+            if(versioned_)
+            {
+                openVersioned();
+            }
+            else
+            {
+                indexRecords();
+                objectCount_ = recordOffsets_.size();
+            }
+
+            mem_->loader_ = this;
+        }
+
+        return createLazily(index);
+    }
+
+    Ref ObjectStoreReader::load(Ref stub)
+    {
+        PtrHandle<Object> ob(cast<Object>(stub), mem_);
+
+        RecordHeader const* oh = lazyRecord(int_val(ob->elements()[0]));
+        Ref const* slots = (Ref const*) (oh + 1);
+        const uword count = oh->size - 1;
+
+        // Creating the referenced objects may move the stub, it is filled afterwards.
+        for(uword i = 0; i < count; ++i)
+        {
+            if(!is_immediate(slots[i]))
+            {
+                createLazily((uword) slots[i].data_);
+            }
         }
 
-        return all.ptr();
+        Ref* elements = ob->elements();
+
+        for(uword i = 0; i < count; ++i)
+        {
+            elements[i] = is_immediate(slots[i]) ? slots[i] : ptr2ref(ptr_val(loaded_[(uword) slots[i].data_]), array_access(slots[i]));
+        }
+
+        ob->header_.stub = 0;
+        return ptr2ref(ob.ptr(), array_access(stub));
     }
 
-    void ObjectStoreReader::applyFixups()
+    void ObjectStoreReader::evacuateRoots(MemSpace* space, bool hierarchical)
     {
-        for(FixupRecordVec::iterator it = fixups_.begin(); it != fixups_.end(); ++it)
+        for(LoadedMap::iterator it = loaded_.begin(); it != loaded_.end(); ++it)
         {
-            it->fixUp(objects_);
+            it->second = space->evacuate(it->second, false, hierarchical);
         }
     }
 } // namespace atom
-
@@ -12,6 +12,7 @@
 #define ATOM_OBJECT_STORE_HPP_INCLUDED
 
 #include <stdio.h>
+#include <string.h>
 
 #include <map>
 #include <vector>
@@ -23,99 +24,366 @@
 
 namespace atom
 {
-    class ObjectStoreReader
+    /**
+     * Layout of versioned object stores. A store starts with a StoreHeader followed by a table
+     * of sectionCount SectionEntry records locating the sections by byte offset from the start
+     * of the store. Every section starts at a word aligned offset and all fields are words of
+     * the writing VM unless stated otherwise.
+     *
+     * - OBJECTS: the object records in object table order. A record is an object header
+     *   followed by the slots of the object, the value of a float, or, for byte arrays whose
+     *   header size is their byte count, the offset of their contents in PAYLOADS. References
+     *   to objects are encoded as object table indexes in place of addresses.
+     * - PAYLOADS: byte array contents, each padded to a word boundary.
+     * - INDEX: an IndexEntry per object giving the offset of its record in OBJECTS and its
+     *   offset in slots from the start of the loaded objects, so objects can be located and
+     *   decoded independently of each other. Loaded byte arrays occupy
+     *   ByteArray::heapSlots() slots, version 2 stores predate inline byte array contents
+     *   and load every byte array with separately allocated contents.
+     * - ROOTS: the count of the objects added to the writer followed by their encoded
+     *   references.
+     * - SYMBOLS: optional names of roots, for tools such as profilers. The count of named
+     *   roots followed by, for each, its index in ROOTS, the byte count of its name and the
+     *   name padded to a word boundary.
+     *
+     * Unknown sections are ignored. Stores written before versioning are a bare sequence of
+     * records with inline byte array contents and are told apart by the magic: the first byte
+     * of a legacy store holds the clear mark bit of a RecordHeader while 'A' has it set.
+     */
+    namespace ObjectStoreFormat
     {
-        typedef std::vector<RefHandle> RefVec;
+        enum
+        {
+            VERSION = 3,
+            INLINE_PAYLOADS_VERSION = 3
+        };
 
-        struct FixupRecord
+        enum
         {
-            uword objectTableIndex;
-            uword arrayIndex;
-            PtrHandle<Object> ptr;
-            bool arracc;
+            OBJECTS_SECTION  = 1,
+            PAYLOADS_SECTION = 2,
+            INDEX_SECTION    = 3,
+            ROOTS_SECTION    = 4,
+            SYMBOLS_SECTION  = 5
+        };
 
-            inline FixupRecord(uword pobjectTableIndex, uword parrayIndex, PtrHandle<Object> const& pptr, bool parracc)
-            : objectTableIndex(pobjectTableIndex), arrayIndex(parrayIndex), ptr(pptr), arracc(parracc)
-            {
-            }
+        struct StoreHeader
+        {
+            char magic[8];
+            atom_uint32_t version;
+            atom_uint8_t wordSize;
+            atom_uint8_t littleEndian;
+            atom_uint16_t sectionCount;
+            uword objectCount;
 
-            void fixUp(RefVec const& objects)
-            {
-                if(objectTableIndex >= objects.size())
-                {
-                    throw std::runtime_error("Invalid object table offset.");
-                }
-
-                if(arracc)
-                {
-                    ptr->atPut(arrayIndex, set_array_access(objects[objectTableIndex].ref()));
-                }
-                else
-                {
-                    ptr->atPut(arrayIndex, objects[objectTableIndex].ref());
-                }
-            }
+            // Slots the objects occupy in the heap once loaded.
+            uword slotCount;
+        };
+
+        /**
+         * Header of a record. Records keep the object header layout that predates the
+         * collector bits of ObjectHeader, so stores do not change with the in-memory layout.
+         */
+        struct RecordHeader
+        {
+            atom_uint64_t mark    : 1;
+#if defined ATOM_VM_64BITS
+            atom_uint64_t objtype : 3;
+            atom_uint64_t size    : 60;
+#endif
+#if defined ATOM_VM_32BITS
+            atom_uint64_t objtype : 3;
+            atom_uint64_t size    : 28;
+#endif
         };
 
-        typedef std::vector<FixupRecord> FixupRecordVec;
+        struct SectionEntry
+        {
+            uword type;
+            uword offset;
+            uword length;
+        };
+
+        struct IndexEntry
+        {
+            uword recordOffset;
+            uword heapOffset;
+        };
+
+        inline void initHeader(StoreHeader& header)
+        {
+            memcpy(header.magic, "ATOMSTOR", sizeof(header.magic));
+            header.version = VERSION;
+            header.wordSize = sizeof(word);
+            header.littleEndian = 1;
+            header.sectionCount = 0;
+            header.objectCount = 0;
+            header.slotCount = 0;
+        }
+
+        inline bool hasMagic(void const* data, uword size)
+        {
+            return size >= sizeof(StoreHeader) && memcmp(data, "ATOMSTOR", 8) == 0;
+        }
+    }
+
+    /**
+     * Loads an object store of either format. The store is mapped into memory and indexed
+     * first, then all of its objects are created in a single heap allocation and their
+     * references are relocated while the slots are copied, so loading makes a single pass
+     * over the object data.
+     *
+     * Alternatively objects are read one at a time with readObject(), which creates the
+     * objects they refer to as stubs and loads the contents of a stub when it is first used,
+     * so only the objects a program reaches are loaded. The records of versioned stores are
+     * located through their index, legacy stores are scanned once.
+     */
+    class ObjectStoreReader : public LazyLoader
+    {
+        typedef std::vector<uword> OffsetVec;
+        typedef std::vector<Ref> RefVec;
+        typedef std::map<uword, Ref> LoadedMap;
 
-        FILE* in_;
+        int fd_;
+        byte const* data_;
+        uword size_;
         Memory* mem_;
-        RefVec objects_;
-        FixupRecordVec fixups_;
 
-        template <typename T>
-        inline bool readItem(T& t)
+        // Set for stores with a StoreHeader, byte array contents are in the payloads
+        // section of such stores instead of following their headers.
+        bool versioned_;
+
+        // Set unless the store predates inline byte array contents.
+        bool inlinePayloads_;
+        byte const* payloads_;
+        uword payloadsSize_;
+
+        // Sections of versioned stores and the number of objects in the store.
+        ObjectStoreFormat::SectionEntry const* objects_;
+        ObjectStoreFormat::IndexEntry const* index_;
+        uword objectCount_;
+
+        // Encoded references to the roots, legacy stores have none.
+        RefVec roots_;
+
+        // Names of the roots from the symbols section, empty for unnamed ones.
+        std::vector<std::string> rootNames_;
+
+        // Objects and stubs created by readObject() by their indexes. They are never
+        // released so that every store object is loaded once.
+        LoadedMap loaded_;
+
+        // Byte offset in the store and slot offset in the loaded chunk of each object, in
+        // store order.
+        OffsetVec recordOffsets_;
+        OffsetVec heapOffsets_;
+
+        // Set if a reference refers past the last object.
+        bool invalidOffset_;
+
+        /**
+         * Checks that length bytes starting at offset are within the first limit bytes.
+         */
+        static inline void ensureWithin(uword offset, uword length, uword limit)
+        {
+            if(length > limit || offset > limit - length)
+            {
+                throw std::runtime_error("eof");
+            }
+        }
+
+        /**
+         * Returns the number of slots the object of the record occupies in the heap and sets
+         * length to the number of bytes the record occupies in the store.
+         */
+        uword measureRecord(ObjectStoreFormat::RecordHeader const* oh, uword& length) const;
+
+        /**
+         * Checks the records and fills the offset tables, from a scan of the records of legacy
+         * stores and from the index section of versioned ones.
+         *
+         * @return the number of slots the objects occupy in the heap
+         */
+        uword indexRecords();
+        uword indexVersionedRecords();
+
+        /**
+         * Checks the header and the section table of a versioned store and reads its roots.
+         */
+        void openVersioned();
+
+        /**
+         * Checks the record of the object at the given index of a versioned store and returns
+         * it. Sets heapSize as measureRecord() does.
+         */
+        ObjectStoreFormat::RecordHeader const* versionedRecord(uword index, uword& heapSize) const;
+        ObjectStoreFormat::SectionEntry const* findSection(uword type) const;
+        Ref relocate(Ref item, Ref* base);
+
+        /**
+         * Initializes the object at target from the record. References are relocated
+         * relative to base, see readAll().
+         */
+        void copyRecord(ObjectStoreFormat::RecordHeader const* oh, Ref* target, Ref* base);
+
+        ObjectStoreFormat::RecordHeader const* lazyRecord(uword index) const;
+
+        /**
+         * Returns the object at the given index, creating it if it is not created yet.
+         * Objects with references are created as stubs, others are loaded.
+         */
+        Ref createLazily(uword index);
+
+    public:
+        ObjectStoreReader(char const* filename, Memory* mem);
+        ~ObjectStoreReader();
+
+        /**
+         * Returns an object holding all objects of the store in store order.
+         */
+        Object* readAll();
+
+        /**
+         * Returns the object at the given index in store order, without loading the rest of
+         * the store. The reader becomes the loader of the memory and must outlive the use of
+         * the objects read.
+         */
+        Ref readObject(uword index);
+
+        virtual Ref load(Ref stub);
+        virtual void evacuateRoots(MemSpace* space, bool hierarchical);
+
+        inline uword rootCount() const
         {
-            return readBytes(&t, sizeof(T));
+            return roots_.size();
         }
 
-        inline bool readBytes(void* buf, int size)
+        /**
+         * Returns the name of a root, empty if the store does not name it. Roots are known
+         * once readAll() or readObject() opens the store.
+         */
+        inline std::string const& rootName(uword index) const
+        {
+            return rootNames_[index];
+        }
+
+        /**
+         * Returns a root of the store like readObject() does, after readObject() opens
+         * the store.
+         */
+        Ref readRoot(uword index);
+
+        /**
+         * Returns a root of the store given the object returned by readAll().
+         */
+        inline Ref rootAt(Object* all, uword index) const
         {
-            if(fread(buf, size, 1, in_) == 0)
+            Ref root = roots_[index];
+
+            if(is_immediate(root))
             {
-                if(feof(in_))
-                {
-                    return false;
-                }
+                return root;
+            }
+
+            Ref object = all->at(root.data_);
+            return array_access(root) ? set_array_access(object) : object;
+        }
+    };
 
-                throw std::runtime_error("cannot read from file");
+    /**
+     * Maps objects to their indexes in the object table of an ObjectStoreWriter. An open
+     * addressing hash table keyed by the object address, lookups take constant time.
+     */
+    class ObjectIndexMap
+    {
+        struct Entry
+        {
+            void* object;
+            uword index;
+        };
+
+        typedef std::vector<Entry> EntryVec;
+
+        // Capacity is a power of two and at least twice the count.
+        EntryVec entries_;
+        uword count_;
+
+        inline uword slotFor(void* object) const
+        {
+            uword mask = entries_.size() - 1;
+            uword slot = ((((uword) object) >> 3) * 0x9e3779b1UL) & mask;
+
+            while(entries_[slot].object != 0 && entries_[slot].object != object)
+            {
+                slot = (slot + 1) & mask;
             }
 
-            return true;
+            return slot;
         }
 
-        bool readNextObject();
-        Ref readRef();
-        void applyFixups();
-        void readByteArray(ObjectHeader const& oh);
-        void readObject(ObjectHeader const& oh);
-        bool readFloat();
+        void grow();
 
     public:
-        ObjectStoreReader(char const* filename, Memory* mem);
-        Object* readAll();
+        ObjectIndexMap();
+
+        /**
+         * Returns true and sets index if the object is in the map.
+         */
+        inline bool find(void* object, uword& index) const
+        {
+            Entry const& entry = entries_[slotFor(object)];
+            index = entry.index;
+
+            return entry.object != 0;
+        }
+
+        /**
+         * @pre the object is not in the map
+         */
+        void insert(void* object, uword index);
+
+        void clear();
     };
 
+    /**
+     * Writes the added objects and all objects reachable from them as a versioned store, see
+     * ObjectStoreFormat. The added objects are recorded as the roots of the store.
+     */
     class ObjectStoreWriter
     {
         typedef std::vector<Ref> RefVec;
 
+        // An object whose slots are being added to the object table and the next slot to add.
+        typedef std::pair<Object*, word> SlotCursor;
+        typedef std::vector<SlotCursor> SlotCursorVec;
+
         FILE* out_;
         RefVec objects_;
+
+        // Names of the added objects, empty for unnamed ones.
+        std::vector<std::string> names_;
         RefVec objectTable_;
+        ObjectIndexMap objectIndexes_;
         bool flushed_;
 
-        void writeObject(Ref ref);
+        void writeObject(Ref ref, uword& payloadOffset);
         void storeObjectArray(Object* oa);
-        void storeByteArray(ByteArray* ba);
-        void storeObjectHeader(ObjectHeader* oh);
+        void storeByteArray(ByteArray* ba, uword& payloadOffset);
+        void storeByteArrayContents(ByteArray* ba);
+        void storeRecordHeader(int type, uword size);
         void storeFloat(FloatObject* fo);
 
         uword idForObject(Ref ref);
         void populateObjectTable();
         void populateObjectTableWith(Ref ref);
 
+        /**
+         * Appends the object to the object table unless it is an integer or already there.
+         *
+         * @return true if the object is appended and its slots must be added too
+         */
+        bool addToObjectTable(Ref ref);
+
         template <typename T>
         inline void writeItem(T const& t)
         {
@@ -135,6 +403,11 @@ namespace atom
         ~ObjectStoreWriter();
 
         void addObject(Ref ref);
+
+        /**
+         * Adds an object and records its name in the symbols section.
+         */
+        void addObject(Ref ref, std::string const& name);
         void flush();
     };
 
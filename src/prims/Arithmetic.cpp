@@ -9,43 +9,15 @@ using namespace std;
 namespace
 {
 
-bool checkTwoIntArray(Ref message, char const* diff)
+/**
+ * Reports a zero divisor, the VM sends one to the handler of DIVIDE and MODULO instead of
+ * dividing. The primitives answer zero then.
+ */
+bool checkDivisor(Ref divisor, char const* diff)
 {
-    if(!is_object_array(message))
+    if(int_val(divisor) == 0)
     {
-        std::cerr << diff << ": Message must be an object array.\n";
-        return false;
-    }
-
-    ObjectArray* oa = cast<ObjectArray>(message);
-
-    if(oa->size() < 2)
-    {
-        std::cerr << diff << ": Array must contain at least two elements.\n";
-        return false;
-    }
-   
-    if(!is_int(oa->at(0)) || !is_int(oa->at(1)))
-    {
-        if(!is_int(oa->at(0)))
-        {
-            std::cerr << diff << ": First element is not integer. ";
-        }
-        else
-        {
-            std::cerr << "first element:[" << int_val(oa->at(0)) << "] ";
-        }
-
-        if(!is_int(oa->at(1)))
-        {
-            std::cerr << diff << ": Second element is not integer. ";
-        }
-        else
-        {
-            std::cerr << "second element:[" << int_val(oa->at(1)) << "] ";
-        }
-
-        std::cerr << diff << ": Both elements must be integers.\n";
+        std::cerr << diff << ": Division by zero.\n";
         return false;
     }
 
@@ -57,75 +29,75 @@ bool checkTwoIntArray(Ref message, char const* diff)
 extern "C"
 {
 
-void fn_addInt(Thread* thread, int resultTmp, Ref message)
+// Integer primitives are direct natives, the VM checks their arguments against the
+// exported signatures, see NativeSignature.
+extern char const fn_addInt_signature[] = "ii";
+
+void fn_addInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "addInt"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) + int_val(oa->at(1))));
-    }
+    thread->setResult(resultTmp, word2ref(int_val(args[0]) + int_val(args[1])));
 }
 
-void fn_eqInt(Thread* thread, int resultTmp, Ref message)
+extern char const fn_eqInt_signature[] = "ii";
+
+void fn_eqInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "eqInt"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, int_val(oa->at(0)) == int_val(oa->at(1)) ? word2ref(1L) : zeroRef());
-    }
+    thread->setResult(resultTmp, int_val(args[0]) == int_val(args[1]) ? word2ref(1L) : zeroRef());
 }
 
-void fn_modInt(Thread* thread, int resultTmp, Ref message)
+extern char const fn_modInt_signature[] = "ii";
+
+void fn_modInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "modInt"))
+    if(checkDivisor(args[1], "modInt"))
+    {
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) % int_val(args[1])));
+    }
+    else
     {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) % int_val(oa->at(1))));
+        thread->setResult(resultTmp, zeroRef());
     }
 }
 
-void fn_intLessThan(Thread* thread, int resultTmp, Ref message)
+extern char const fn_intLessThan_signature[] = "ii";
+
+void fn_intLessThan(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "lessThan"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) < int_val(oa->at(1)) ? 1 : 0));
-    }
+    thread->setResult(resultTmp, word2ref(int_val(args[0]) < int_val(args[1]) ? 1 : 0));
 }
 
-void fn_intGreaterThan(Thread* thread, int resultTmp, Ref message)
+extern char const fn_intGreaterThan_signature[] = "ii";
+
+void fn_intGreaterThan(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "greaterThan"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) > int_val(oa->at(1)) ? 1 : 0));
-    }
+    thread->setResult(resultTmp, word2ref(int_val(args[0]) > int_val(args[1]) ? 1 : 0));
 }
 
-void fn_subInt(Thread* thread, int resultTmp, Ref message)
+extern char const fn_subInt_signature[] = "ii";
+
+void fn_subInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "subInt"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) - int_val(oa->at(1))));
-    }
+    thread->setResult(resultTmp, word2ref(int_val(args[0]) - int_val(args[1])));
 }
 
-void fn_multInt(Thread* thread, int resultTmp, Ref message)
+extern char const fn_multInt_signature[] = "ii";
+
+void fn_multInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "multInt"))
-    {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) * int_val(oa->at(1))));
-    }
+    thread->setResult(resultTmp, word2ref(int_val(args[0]) * int_val(args[1])));
 }
 
-void fn_divInt(Thread* thread, int resultTmp, Ref message)
+extern char const fn_divInt_signature[] = "ii";
+
+void fn_divInt(Thread* thread, int resultTmp, Ref const* args)
 {
-    if(checkTwoIntArray(message, "divInt"))
+    if(checkDivisor(args[1], "divInt"))
+    {
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) / int_val(args[1])));
+    }
+    else
     {
-        ObjectArray* oa = cast<ObjectArray>(message);
-        thread->setResult(resultTmp, word2ref(int_val(oa->at(0)) / int_val(oa->at(1))));
+        thread->setResult(resultTmp, zeroRef());
     }
 }
 
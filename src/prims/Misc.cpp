@@ -43,34 +43,22 @@ void fn_exitVm(Thread* thread, int resultTmp,  Ref message)
     exit(0);
 }
 
-void fn_arrayCopy(Thread* thread, int resultTmp, Ref message)
-{
-    if(!is_object(message))
-    {
-        std::cerr << "Message must be an object array.\n";
-        return;
-    }
-
-    Object* oa = cast<Object>(message);
+extern char const fn_arrayCopy_signature[] = "ririi";
 
-    if(oa->size() != 5)
-    {
-        std::cerr << "Array must contain at least 5 elements.\n";
-        return;
-    }
-
-    if(!isArrayLike(oa->at(0)) || !is_int(oa->at(1)) || !isArrayLike(oa->at(2)) || !is_int(oa->at(3)) || !is_int(oa->at(4)))
+void fn_arrayCopy(Thread* thread, int resultTmp, Ref const* args)
+{
+    if(!isArrayLike(args[0]) || !isArrayLike(args[2]))
     {
         return;
     }
 
-    Object* src = cast<Object>(oa->at(0));
-    int srcBegin = int_val(oa->at(1));
+    Object* src = cast<Object>(args[0]);
+    int srcBegin = int_val(args[1]);
 
-    Object* target = cast<Object>(oa->at(2));
-    int targetBegin = int_val(oa->at(3));
+    Object* target = cast<Object>(args[2]);
+    int targetBegin = int_val(args[3]);
 
-    int len = int_val(oa->at(4));
+    int len = int_val(args[4]);
 
     for(int i = 0; i < len; ++i)
     {
@@ -78,29 +66,17 @@ void fn_arrayCopy(Thread* thread, int resultTmp, Ref message)
     }
 }
 
-void fn_cstreq(Thread* thread, int resulttmp, Ref message)
+extern char const fn_cstreq_signature[] = "bb";
+
+void fn_cstreq(Thread* thread, int resulttmp, Ref const* args)
 {
     if(resulttmp == -1)
     {
         return;
     }
     
-    if(!is_object_array(message) || !array_access(message))
-    {
-        thread->raiseError(RefHandle(thread->memory_->createByteArrayFromString("message must be an object array with access enabled"), thread->memory_));
-        return;
-    }
-    
-    ObjectArray* oa = cast<ObjectArray>(message);
-    
-    if(oa->size() < 2 || !is_byte_array(oa->at(0)) || !is_byte_array(oa->at(1)))
-    {
-        thread->raiseError(RefHandle(thread->memory_->createByteArrayFromString("message must contain two byte array's"), thread->memory_));
-        return;
-    }
-    
-    ByteArray* first = cast<ByteArray>(oa->at(0));
-    ByteArray* second = cast<ByteArray>(oa->at(1));
+    ByteArray* first = cast<ByteArray>(args[0]);
+    ByteArray* second = cast<ByteArray>(args[1]);
     
     if(first->size() != second->size())
     {
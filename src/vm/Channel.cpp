@@ -0,0 +1,378 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "Channel.hpp"
+#include "Exceptions.hpp"
+
+#include <os/ObjectStore.hpp>
+
+#include <string.h>
+
+#include <limits>
+
+using namespace atom;
+
+namespace
+{
+    typedef std::vector<Ref> RefVec;
+
+    // Data of a byte array in a parcel whose contents follow it.
+    const uword INLINE_PAYLOAD = ~(uword) 1;
+
+    // Data of an opaque handle to the sending memory.
+    const uword OPAQUE_MEMORY = ~(uword) 0;
+
+    inline bool isOpaqueHandle(ByteArray* ba)
+    {
+        return !ba->managed_ && ba->size_ == 0;
+    }
+
+    inline Ref encode(uword offset, bool arrayAccess)
+    {
+        return ptr2ref((void*) (offset << 2), arrayAccess);
+    }
+
+    inline uword decode(Ref ref)
+    {
+        return (uword) ref.data_;
+    }
+
+    /**
+     * Appends the objects reachable from root that are not in the map yet to objects in the
+     * order they are found. The slots of stubs are not followed.
+     */
+    void collect(Ref root, RefVec& objects, ObjectIndexMap& indexes)
+    {
+        uword index;
+
+        if(is_immediate(root) || indexes.find(ptr_val(root), index))
+        {
+            return;
+        }
+
+        indexes.insert(ptr_val(root), objects.size());
+        objects.push_back(root);
+
+        for(uword i = objects.size() - 1; i < objects.size(); ++i)
+        {
+            Ref ref = objects[i];
+
+            if(is_stub(ref) || !ObjectType::containsSlots(obj_type(ref)))
+            {
+                continue;
+            }
+
+            Object* ob = cast<Object>(ref);
+
+            for(word j = 0; j < ob->size(); ++j)
+            {
+                Ref slot = ob->elements()[j];
+
+                if(!is_immediate(slot) && !indexes.find(ptr_val(slot), index))
+                {
+                    indexes.insert(ptr_val(slot), objects.size());
+                    objects.push_back(slot);
+                }
+            }
+        }
+    }
+
+    /**
+     * Loads the stubs reachable from root. Loading allocates and may move the objects, so
+     * the graph is walked again after each round until no stub is left.
+     */
+    void loadStubs(Memory* mem, RefHandle const& root)
+    {
+        while(true)
+        {
+            RefVec objects;
+            ObjectIndexMap indexes;
+            std::vector<RefHandle> stubs;
+
+            collect(root.ref(), objects, indexes);
+
+            for(RefVec::const_iterator it = objects.begin(); it != objects.end(); ++it)
+            {
+                if(is_stub(*it))
+                {
+                    stubs.push_back(RefHandle(*it, mem));
+                }
+            }
+
+            if(stubs.empty())
+            {
+                return;
+            }
+
+            for(std::vector<RefHandle>::const_iterator it = stubs.begin(); it != stubs.end(); ++it)
+            {
+                mem->resolve(it->ref());
+            }
+        }
+    }
+
+    /**
+     * Returns the slot count of an object in a parcel.
+     */
+    uword parcelSlots(Ref ref)
+    {
+        if(is_byte_array(ref))
+        {
+            ByteArray* ba = cast<ByteArray>(ref);
+            return ByteArray::heapSlots(isOpaqueHandle(ba) ? 0 : ba->size());
+        }
+
+        return cast<ObjectHeader>(ref)->size;
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    Parcel::Parcel()
+    : next_(0), root_(zeroRef())
+    {
+    }
+
+    Parcel* Parcel::pack(Memory* mem, RefHandle root)
+    {
+        if(mem->loader_ != 0)
+        {
+            loadStubs(mem, root);
+        }
+
+        // Nothing is allocated in the memory from here on.
+        RefVec objects;
+        ObjectIndexMap indexes;
+
+        collect(root.ref(), objects, indexes);
+
+        std::vector<uword> offsets(objects.size());
+        uword total = 0;
+
+        for(uword i = 0; i < objects.size(); ++i)
+        {
+            offsets[i] = total;
+            total += parcelSlots(objects[i]);
+        }
+
+        Parcel* parcel = new Parcel();
+        parcel->slots_.resize(total);
+
+        for(uword i = 0; i < objects.size(); ++i)
+        {
+            Ref ref = objects[i];
+            Ref* target = &parcel->slots_[offsets[i]];
+            const int type = obj_type(ref);
+            const uword size = parcelSlots(ref);
+
+            ((ObjectHeader*) target)->init(type, size);
+
+            if(ObjectType::containsSlots(type))
+            {
+                Ref const* slots = cast<Object>(ref)->elements();
+
+                for(uword j = 1; j < size; ++j)
+                {
+                    Ref slot = slots[j - 1];
+                    uword index;
+
+                    if(is_immediate(slot))
+                    {
+                        target[j] = slot;
+                    }
+                    else
+                    {
+                        indexes.find(ptr_val(slot), index);
+                        target[j] = encode(offsets[index], array_access(slot));
+                    }
+                }
+            }
+            else if(type == ObjectType::FLOAT)
+            {
+                ((FloatObject*) target)->copy(cast<FloatObject>(ref));
+            }
+            else if(type == ObjectType::NATIVE_FUNCTION)
+            {
+                ((PrimDataObject*) target)->copy(cast<PrimDataObject>(ref));
+            }
+            else
+            {
+                ByteArray* source = cast<ByteArray>(ref);
+                ByteArray* ba = (ByteArray*) target;
+
+                ba->size_ = source->size_;
+
+                if(isOpaqueHandle(source))
+                {
+                    ba->managed_ = 0;
+                    ba->data_ = source->data_ == mem ? (void*) OPAQUE_MEMORY : source->data_;
+                }
+                else if(source->size() <= ByteArray::MAX_INLINE_SIZE)
+                {
+                    ba->managed_ = 1;
+                    ba->data_ = (void*) INLINE_PAYLOAD;
+                    memcpy(ba->inlineData(), source->data(), source->size());
+                }
+                else
+                {
+                    ba->managed_ = 1;
+                    ba->data_ = (void*) parcel->payloads_.size();
+                    parcel->payloads_.insert(parcel->payloads_.end(), source->data(), source->data() + source->size());
+                }
+            }
+        }
+
+        parcel->root_ = root.ref();
+
+        if(!is_immediate(root.ref()))
+        {
+            // The root is the first object found.
+            parcel->root_ = encode(0, array_access(root.ref()));
+        }
+
+        return parcel;
+    }
+
+    Ref Parcel::unpack(Memory* mem) const
+    {
+        if(slots_.empty())
+        {
+            return root_;
+        }
+
+        if(slots_.size() > (uword) std::numeric_limits<int>::max())
+        {
+            throw memory_exhausted_error();
+        }
+
+        // Like ObjectStoreReader::readAll, the objects are placed in one old space chunk that
+        // is not seen by a collection before every header is initialized.
+        Ref* base = mem->allocOld(slots_.size());
+
+        memcpy(base, &slots_[0], slots_.size() * sizeof(Ref));
+
+        for(uword offset = 0; offset < slots_.size(); )
+        {
+            ObjectBase* ob = (ObjectBase*) (base + offset);
+            const int type = ob->header_.objtype;
+            const uword size = ob->header_.size;
+
+            mem->initHeader(&ob->header_, type, size);
+
+            if(ObjectType::containsSlots(type))
+            {
+                Ref* slots = base + offset;
+
+                // The objects are fresh and allocated together, no write barrier is needed.
+                for(uword i = 1; i < size; ++i)
+                {
+                    if(!is_immediate(slots[i]))
+                    {
+                        slots[i] = ptr2ref(base + decode(slots[i]), array_access(slots[i]));
+                    }
+                }
+            }
+            else if(type == ObjectType::BYTE_ARRAY)
+            {
+                ByteArray* ba = (ByteArray*) ob;
+
+                if(!ba->managed_)
+                {
+                    if((uword) ba->data_ == OPAQUE_MEMORY)
+                    {
+                        ba->data_ = mem;
+                    }
+                }
+                else if((uword) ba->data_ == INLINE_PAYLOAD)
+                {
+                    ba->data_ = ba->inlineData();
+                }
+                else
+                {
+                    byte* data = new byte[ba->size()];
+
+                    memcpy(data, &payloads_[(uword) ba->data_], ba->size());
+                    ba->data_ = data;
+                    mem->registerExternalPayload(ba);
+                }
+            }
+
+            offset += size;
+        }
+
+        return is_immediate(root_) ? root_ : ptr2ref(base + decode(root_), array_access(root_));
+    }
+
+    Channel::Channel()
+    : head_(&stub_), tail_(&stub_)
+    {
+    }
+
+    Channel::~Channel()
+    {
+        Parcel* parcel;
+
+        while((parcel = receive()) != 0)
+        {
+            delete parcel;
+        }
+    }
+
+    void Channel::send(Parcel* parcel)
+    {
+        parcel->next_ = 0;
+
+        Parcel* previous = __atomic_exchange_n(&head_, parcel, __ATOMIC_ACQ_REL);
+
+        // Until this store the receiver sees the queue end at previous.
+        __atomic_store_n(&previous->next_, parcel, __ATOMIC_RELEASE);
+    }
+
+    Parcel* Channel::receive()
+    {
+        Parcel* tail = tail_;
+        Parcel* next = __atomic_load_n(&tail->next_, __ATOMIC_ACQUIRE);
+
+        if(tail == &stub_)
+        {
+            if(next == 0)
+            {
+                return 0;
+            }
+
+            tail_ = next;
+            tail = next;
+            next = __atomic_load_n(&next->next_, __ATOMIC_ACQUIRE);
+        }
+
+        if(next != 0)
+        {
+            tail_ = next;
+            return tail;
+        }
+
+        if(tail != __atomic_load_n(&head_, __ATOMIC_ACQUIRE))
+        {
+            return 0;
+        }
+
+        // The last parcel is only returned once the stub follows it.
+        send(&stub_);
+        next = __atomic_load_n(&tail->next_, __ATOMIC_ACQUIRE);
+
+        if(next != 0)
+        {
+            tail_ = next;
+            return tail;
+        }
+
+        return 0;
+    }
+} // namespace atom
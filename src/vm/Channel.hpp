@@ -0,0 +1,106 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_CHANNEL_HPP_INCLUDED
+#define ATOM_CHANNEL_HPP_INCLUDED
+
+#include "Memory.hpp"
+
+#include <vector>
+
+namespace atom
+{
+    /**
+     * A copy of an object graph that belongs to no memory, so it can be passed to another OS
+     * thread and unpacked into the memory of another isolate.
+     *
+     * The objects are laid out as they are placed in the receiving memory, in one chunk like
+     * the objects read by ObjectStoreReader::readAll. References among them are encoded as slot
+     * offsets in the chunk. Byte arrays keep their contents after them up to
+     * ByteArray::MAX_INLINE_SIZE bytes, larger contents are kept in payloads. Natives and opaque
+     * handles keep their pointers, which are valid in the whole process, except the handle to
+     * the sending memory, which becomes a handle to the receiving one.
+     */
+    class Parcel
+    {
+        friend class Channel;
+
+        // Link of the channel the parcel is sent to.
+        Parcel* next_;
+
+        std::vector<Ref> slots_;
+        std::vector<byte> payloads_;
+        Ref root_;
+
+        Parcel();
+
+    public:
+        /**
+         * Copies the objects reachable from root. Stubs among them are loaded first.
+         */
+        static Parcel* pack(Memory* mem, RefHandle root);
+
+        /**
+         * Creates the objects of the parcel in the given memory and returns the root.
+         */
+        Ref unpack(Memory* mem) const;
+
+        /**
+         * Returns the number of slots the objects take.
+         */
+        inline uword slotCount() const
+        {
+            return slots_.size();
+        }
+    };
+
+    /**
+     * A queue of parcels with any number of senders and a single receiver, the isolate owning
+     * it. Senders never wait for each other or for the receiver: a send is an atomic exchange
+     * of the head followed by a link store (the intrusive MPSC queue of Dmitry Vyukov).
+     */
+    class Channel
+    {
+        // Parcel that keeps the queue non-empty, it is never returned.
+        Parcel stub_;
+
+        // Last sent parcel, modified by the senders.
+        Parcel* head_;
+
+        // Next parcel to receive, modified by the receiver only.
+        Parcel* tail_;
+
+        Channel(Channel const&);
+        Channel& operator=(Channel const&);
+
+    public:
+        Channel();
+
+        /**
+         * Deletes the parcels that were not received.
+         */
+        ~Channel();
+
+        /**
+         * Appends a parcel, which is owned by the channel afterwards. May be called from any
+         * OS thread.
+         */
+        void send(Parcel* parcel);
+
+        /**
+         * Removes the first parcel and passes its ownership to the caller. Returns zero if the
+         * channel is empty or the first parcel is still being linked by its sender. Must only
+         * be called from the receiving OS thread.
+         */
+        Parcel* receive();
+    };
+} // namespace atom
+
+#endif /* ATOM_CHANNEL_HPP_INCLUDED */
@@ -27,4 +27,17 @@
 
 #define ATOM_DEBUG
 
+// Thread::run dispatches bytecodes with computed goto where the compiler supports it.
+// Define ATOM_DISPATCH_SWITCH (or configure with -DATOM_SWITCH_DISPATCH=ON) to use the
+// portable switch based loop instead.
+//#define ATOM_DISPATCH_SWITCH
+
+#if defined __GNUC__ && !defined ATOM_DISPATCH_SWITCH
+#define ATOM_DISPATCH_THREADED
+#endif
+
+// Define ATOM_STATS (or configure with -DATOM_STATS=ON) to collect per instruction counts
+// and cycles, sends by target kind and allocation counts in Thread::stats_.
+//#define ATOM_STATS
+
 #endif
@@ -0,0 +1,231 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "DecodedCode.hpp"
+#include "Memory.hpp"
+#include "LargeObjectSpace.hpp"
+
+using namespace atom;
+
+namespace
+{
+    /**
+     * Locations of the objects of a space after the collection evacuated it, dead objects
+     * are not forwarded.
+     */
+    struct EvacuatedSpace
+    {
+        MemSpace* space;
+
+        explicit EvacuatedSpace(MemSpace* s)
+        : space(s)
+        {
+        }
+
+        inline bool contains(void* p) const
+        {
+            return space->containsPtr(p);
+        }
+
+        // Returns the new location of the object or 0 if it is dead.
+        inline void* survivor(void* p) const
+        {
+            ForwardedObjectHeader* foh = (ForwardedObjectHeader*) p;
+            return foh->isForwarded() ? foh->getRealPtr() : 0;
+        }
+    };
+
+    /**
+     * Large objects do not move, the unmarked ones are about to be freed.
+     */
+    struct SweptSpace
+    {
+        LargeObjectSpace const* space;
+
+        explicit SweptSpace(LargeObjectSpace const* s)
+        : space(s)
+        {
+        }
+
+        inline bool contains(void* p) const
+        {
+            return space->contains(p);
+        }
+
+        inline void* survivor(void* p) const
+        {
+            return space->isMarked(p) ? p : 0;
+        }
+    };
+
+    /**
+     * Updates the keys of the send cache after the given space is collected.
+     */
+    template <typename Space>
+    void updateSendCache(SendCache& cache, Space const& space)
+    {
+        int count = 0;
+
+        for(int i = 0; i < cache.count_; ++i)
+        {
+            SendCache::Entry entry = cache.entries_[i];
+
+            if(!is_immediate(entry.key) && space.contains(ptr_val(entry.key)))
+            {
+                void* key = space.survivor(ptr_val(entry.key));
+
+                if(key == 0)
+                {
+                    continue;
+                }
+
+                entry.key = ptr2ref(key, array_access(entry.key));
+            }
+
+            cache.entries_[count++] = entry;
+        }
+
+        cache.count_ = count;
+    }
+
+    template <typename Space>
+    void updateEntries(CodeCache::CodeMap& entries, Space const& space)
+    {
+        CodeCache::CodeMap updated;
+
+        for(CodeCache::CodeMap::iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            ByteArray* key = it->first;
+
+            if(space.contains(key))
+            {
+                key = (ByteArray*) space.survivor(key);
+
+                if(key == 0)
+                {
+                    delete it->second;
+                    continue;
+                }
+            }
+
+            // Modified bytecodes never become verified again.
+            if(!key->header_.verified)
+            {
+                delete it->second;
+                continue;
+            }
+
+            for(std::vector<SendCache>::iterator sc = it->second->sendCaches_.begin(); sc != it->second->sendCaches_.end(); ++sc)
+            {
+                updateSendCache(*sc, space);
+            }
+
+            updated[key] = it->second;
+        }
+
+        entries.swap(updated);
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    void SendCache::remove(Ref key)
+    {
+        for(int i = 0; i < count_; ++i)
+        {
+            if(entries_[i].key == key)
+            {
+                entries_[i] = entries_[--count_];
+                return;
+            }
+        }
+    }
+
+    DecodedCode::DecodedCode(ByteArray* bytecodes, void* const* handlers)
+    : indexes_(bytecodes->size() + 1, -1)
+    {
+        byte const* code = bytecodes->data();
+        const word codeSize = bytecodes->size();
+        word ip = 0;
+
+        while(ip <= codeSize)
+        {
+            DecodedInstruction inst;
+            int isize = 1;
+
+            inst.ip = ip;
+            inst.opcode = ip < codeSize ? code[ip] : DecodedInstruction::END_OF_CODE;
+            inst.handler = handlers != 0 ? handlers[inst.opcode] : 0;
+
+            if(ip < codeSize)
+            {
+                isize = Opcode::instructionSize(code[ip], ip + 1 < codeSize ? code[ip + 1] : 0);
+            }
+
+            for(int i = 0; i < 4; ++i)
+            {
+                inst.operands[i] = i + 1 < isize ? code[ip + 1 + i] : 0;
+            }
+
+            inst.cache = -1;
+
+            if(inst.opcode == Opcode::SEND_VAL_TO_VAL || inst.opcode == Opcode::SEND_VAL_TO_VAL_WRES)
+            {
+                inst.cache = sendCaches_.size();
+                sendCaches_.push_back(SendCache());
+            }
+
+            indexes_[ip] = instructions_.size();
+            instructions_.push_back(inst);
+            ip += isize;
+        }
+    }
+
+    CodeCache::~CodeCache()
+    {
+        for(CodeMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            delete it->second;
+        }
+    }
+
+    void CodeCache::update(MemSpace* space)
+    {
+        updateEntries(entries_, EvacuatedSpace(space));
+        lastKey_ = 0;
+        lastCode_ = 0;
+    }
+
+    void CodeCache::update(LargeObjectSpace const& space)
+    {
+        updateEntries(entries_, SweptSpace(&space));
+        lastKey_ = 0;
+        lastCode_ = 0;
+    }
+
+    void CodeCache::printSendStats(std::ostream& os) const
+    {
+        for(CodeMap::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            std::vector<DecodedInstruction> const& instructions = it->second->instructions_;
+
+            for(std::vector<DecodedInstruction>::const_iterator inst = instructions.begin(); inst != instructions.end(); ++inst)
+            {
+                if(inst->cache != -1)
+                {
+                    SendCache const& cache = it->second->sendCaches_[inst->cache];
+
+                    os << "send at " << (void*) it->first << ":" << inst->ip << ": " << cache.hits_ << " hits, "
+                       << cache.misses_ << " misses, " << cache.count_ << (cache.count_ == 1 ? " entry\n" : " entries\n");
+                }
+            }
+        }
+    }
+} // namespace atom
@@ -0,0 +1,214 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_DECODEDCODE_HPP_INCLUDED
+#define ATOM_DECODEDCODE_HPP_INCLUDED
+
+#include "Object.hpp"
+#include "Opcode.hpp"
+
+#include <map>
+#include <vector>
+#include <ostream>
+
+namespace atom
+{
+    struct MemSpace;
+    struct LargeObjectSpace;
+
+    /**
+     * Inline cache of a send instruction. A send resolves its target to the function that
+     * handles it: functions handle their own messages, other targets are handled by their
+     * metaobject. The cache remembers the functions resolved for the last few metaobjects,
+     * so repeated sends skip the type checks on the function and, for simple functions,
+     * the structure checks and verification.
+     */
+    struct SendCache
+    {
+        enum
+        {
+            SIZE = 4
+        };
+
+        enum
+        {
+            NATIVE_FUNCTION,
+            SIMPLE_FUNCTION,
+
+            // A simple function entered with Thread::enterMetaFunction when it is a metaobject.
+            META_ARGS_FUNCTION
+        };
+
+        struct Entry
+        {
+            // The target itself if it is a function, its metaobject otherwise.
+            Ref key;
+            int kind;
+        };
+
+        // Entries in order of addition, a cache with SIZE entries is megamorphic and is not
+        // extended further.
+        Entry entries_[SIZE];
+        int count_;
+
+        long hits_;
+        long misses_;
+
+        SendCache()
+        : count_(0), hits_(0), misses_(0)
+        {
+        }
+
+        inline Entry const* find(Ref key) const
+        {
+            for(int i = 0; i < count_; ++i)
+            {
+                if(entries_[i].key == key)
+                {
+                    return &entries_[i];
+                }
+            }
+
+            return 0;
+        }
+
+        inline void add(Ref key, int kind)
+        {
+            if(count_ < SIZE)
+            {
+                entries_[count_].key = key;
+                entries_[count_].kind = kind;
+                ++count_;
+            }
+        }
+
+        void remove(Ref key);
+    };
+
+    /**
+     * A fixed width instruction decoded from bytecodes. Operands are the bytes following the
+     * opcode, variable length instructions are executed from the bytecodes instead.
+     */
+    struct DecodedInstruction
+    {
+        // Opcode of the pseudo instruction placed after the last instruction.
+        enum
+        {
+            END_OF_CODE = Opcode::MAX_OPCODE + 1
+        };
+
+        // Address of the handler in the threaded interpreter, 0 for the switch interpreter.
+        void* handler;
+
+        // Offset of the instruction in the bytecodes.
+        int ip;
+
+        byte opcode;
+        byte operands[4];
+
+        // Index of the send cache of a send instruction, -1 for other instructions.
+        int cache;
+    };
+
+    /**
+     * Decoded form of verified bytecodes. Instructions are stored in bytecode order, so the
+     * instruction following the one at index i is at index i + 1.
+     */
+    struct DecodedCode
+    {
+        std::vector<DecodedInstruction> instructions_;
+
+        // Index of the instruction starting at each bytecode offset, -1 for offsets inside
+        // instructions. The additional last entry refers to the END_OF_CODE instruction.
+        std::vector<int> indexes_;
+
+        std::vector<SendCache> sendCaches_;
+
+        /**
+         * Decodes the bytecodes, handlers are indexed by opcode and may be 0.
+         *
+         * @pre the bytecodes are verified, see Verifier.hpp
+         */
+        DecodedCode(ByteArray* bytecodes, void* const* handlers);
+
+        /**
+         * @pre ip is the offset of an instruction or the size of the bytecodes
+         */
+        inline DecodedInstruction const* at(word ip) const
+        {
+            return &instructions_[indexes_[ip]];
+        }
+    };
+
+    /**
+     * Side table holding the decoded form of bytecode arrays. Entries are keyed by the byte
+     * array objects, Memory updates the keys when it moves the arrays and the entries of dead
+     * or modified arrays are dropped at the next collection.
+     */
+    struct CodeCache
+    {
+        typedef std::map<ByteArray*, DecodedCode*> CodeMap;
+
+        CodeMap entries_;
+
+        // The most recently requested entry, consecutive requests mostly ask for the same code.
+        ByteArray* lastKey_;
+        DecodedCode* lastCode_;
+
+        CodeCache()
+        : lastKey_(0), lastCode_(0)
+        {
+        }
+
+        ~CodeCache();
+
+        /**
+         * Returns the decoded form of the bytecodes, decoding them on the first request.
+         *
+         * @pre the bytecodes are verified, see Verifier.hpp
+         */
+        inline DecodedCode* get(ByteArray* bytecodes, void* const* handlers)
+        {
+            if(bytecodes != lastKey_)
+            {
+                CodeMap::iterator it = entries_.find(bytecodes);
+
+                lastKey_ = bytecodes;
+                lastCode_ = it != entries_.end() ? it->second : (entries_[bytecodes] = new DecodedCode(bytecodes, handlers));
+            }
+
+            return lastCode_;
+        }
+
+        /**
+         * Called by a collection after the live objects of the given space are evacuated.
+         * Rekeys the moved arrays and drops the entries of dead and no longer verified ones.
+         * Send caches forget the dead metaobjects and follow the moved ones.
+         */
+        void update(MemSpace* space);
+
+        /**
+         * Called by a major collection before the unmarked large objects are freed.
+         */
+        void update(LargeObjectSpace const& space);
+
+        /**
+         * Prints the hit and miss counts of the send caches.
+         */
+        void printSendStats(std::ostream& os) const;
+
+        inline word size() const
+        {
+            return entries_.size();
+        }
+    };
+} // namespace atom
+
+#endif /* ATOM_DECODEDCODE_HPP_INCLUDED */
@@ -37,7 +37,9 @@ namespace atom
             MEMORY_EXHAUSTED,
             CANNOT_CAST_INTREF_TO_POINTER,
             NON_INTEGER_JUMP_OFFSET,
-            JUMP_OFFSET_NOT_IN_BOUNDS
+            JUMP_OFFSET_NOT_IN_BOUNDS,
+            INVALID_META_MESSAGE,
+            INVALID_NATIVE_ARGUMENTS
         };
     }
     
@@ -226,6 +228,24 @@ namespace atom
         {
         }
     };
+    
+    class invalid_meta_message_error : public vm_error
+    {
+    public:
+        inline invalid_meta_message_error()
+        : vm_error(VmErrorCode::INVALID_META_MESSAGE, "message is not a meta message")
+        {
+        }
+    };
+
+    class invalid_native_arguments_error : public vm_error
+    {
+    public:
+        inline invalid_native_arguments_error()
+        : vm_error(VmErrorCode::INVALID_NATIVE_ARGUMENTS, "arguments do not match the signature of the native function")
+        {
+        }
+    };
 }
 
 #endif
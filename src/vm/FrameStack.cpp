@@ -0,0 +1,169 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "FrameStack.hpp"
+
+using namespace atom;
+
+namespace
+{
+    FrameStack::Segment createSegment(word size)
+    {
+        FrameStack::Segment segment;
+
+        segment.start_ = new Ref[size];
+        segment.free_ = segment.start_;
+        segment.end_ = segment.start_ + size;
+
+        return segment;
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    const word FrameStack::SEGMENT_SIZE;
+    const word FrameStack::SMALL_SEGMENT_SIZE;
+
+    FrameStack::FrameStack(word maxSize, word initialSize)
+    : current_(0), maxSize_(maxSize), reservedSize_(0)
+    {
+        replaceSegment(0, 1, initialSize);
+    }
+
+    FrameStack::~FrameStack()
+    {
+        for(SegmentVec::iterator it = segments_.begin(); it != segments_.end(); ++it)
+        {
+            delete[] it->start_;
+        }
+    }
+
+    ObjectBase* FrameStack::alloc(int type, word size)
+    {
+        if(segments_[current_].end_ - segments_[current_].free_ < size)
+        {
+            const size_t next = current_ + 1;
+
+            if(next == segments_.size() || segments_[next].end_ - segments_[next].start_ < size)
+            {
+                const word previousSize = segments_[current_].end_ - segments_[current_].start_;
+
+                replaceSegment(next, size, previousSize < SEGMENT_SIZE / 2 ? previousSize * 2 : SEGMENT_SIZE);
+            }
+
+            current_ = next;
+        }
+
+        Ref* result = segments_[current_].free_;
+        segments_[current_].free_ += size;
+
+        for(word i = 1; i < size; ++i)
+        {
+            result[i] = zeroRef();
+        }
+
+        ObjectBase* ob = (ObjectBase*) result;
+
+        ob->header_.init(type, size);
+        ob->header_.frame = 1;
+
+        // Frames are scanned by every collection, they never need to be remembered.
+        ob->header_.remembered = 1;
+
+        return ob;
+    }
+
+    void FrameStack::release(void* obj)
+    {
+        while(!segments_[current_].containsPtr(obj))
+        {
+            segments_[current_].free_ = segments_[current_].start_;
+            --current_;
+        }
+
+        segments_[current_].free_ = (Ref*) obj;
+    }
+
+    void FrameStack::clear()
+    {
+        for(SegmentVec::iterator it = segments_.begin(); it != segments_.end(); ++it)
+        {
+            it->free_ = it->start_;
+        }
+
+        current_ = 0;
+    }
+
+    Ref* FrameStack::reset(word size)
+    {
+        clear();
+
+        if(segments_[0].end_ - segments_[0].start_ < size)
+        {
+            replaceSegment(0, size, size);
+        }
+
+        segments_[0].free_ += size;
+        return segments_[0].start_;
+    }
+
+    void FrameStack::trim()
+    {
+        while(segments_.size() > current_ + 1)
+        {
+            reservedSize_ -= segments_.back().end_ - segments_.back().start_;
+            delete[] segments_.back().start_;
+            segments_.pop_back();
+        }
+    }
+
+    void FrameStack::replaceSegment(size_t index, word size, word minimumSize)
+    {
+        const word replaced = index < segments_.size() ? segments_[index].end_ - segments_[index].start_ : 0;
+        word segmentSize = size > minimumSize ? size : minimumSize;
+
+        // Near the limit a smaller segment holding the object will do.
+        if(maxSize_ != 0 && reservedSize_ - replaced + segmentSize > maxSize_)
+        {
+            segmentSize = maxSize_ - (reservedSize_ - replaced);
+
+            if(segmentSize < size)
+            {
+                throw memory_exhausted_error();
+            }
+        }
+
+        Segment segment = createSegment(segmentSize);
+
+        if(index < segments_.size())
+        {
+            delete[] segments_[index].start_;
+            segments_[index] = segment;
+        }
+        else
+        {
+            segments_.push_back(segment);
+        }
+
+        reservedSize_ += segmentSize - replaced;
+    }
+
+    word FrameStack::usedSize() const
+    {
+        word result = 0;
+
+        for(size_t i = 0; i <= current_; ++i)
+        {
+            result += segments_[i].free_ - segments_[i].start_;
+        }
+
+        return result;
+    }
+} // namespace atom
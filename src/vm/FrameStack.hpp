@@ -0,0 +1,128 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_FRAMESTACK_HPP_INCLUDED
+#define ATOM_FRAMESTACK_HPP_INCLUDED
+
+#include "Object.hpp"
+
+#include <vector>
+
+namespace atom
+{
+    /**
+     * Contiguous storage for the call contexts of a thread and the temps of the simple
+     * functions they run. Contexts never escape their thread and are strictly nested, so
+     * the storage is released in reverse order of allocation.
+     *
+     * Objects in a frame stack have the frame bit set. Collections update their slots like
+     * roots but never move them, see Memory::evacuateRoots, and the write barrier ignores
+     * them.
+     */
+    struct FrameStack
+    {
+        // Slot count of a segment, larger objects get a segment of their own. Stacks may
+        // start with a smaller segment, each new segment is then twice the size of the
+        // previous one until this size is reached.
+        static const word SEGMENT_SIZE = 16 * 1024;
+
+        // Slot count of the first segment of the stacks of spawned threads.
+        static const word SMALL_SEGMENT_SIZE = 256;
+
+        struct Segment
+        {
+            Ref* start_;
+            Ref* free_;
+            Ref* end_;
+
+            inline bool containsPtr(void* p) const
+            {
+                Ref* rp = (Ref*) p;
+                return rp >= start_ && rp < end_;
+            }
+        };
+
+        typedef std::vector<Segment> SegmentVec;
+
+        // Segments after the current one are empty.
+        SegmentVec segments_;
+        size_t current_;
+
+        // Slots the segments may hold together, zero for no limit.
+        word maxSize_;
+
+        // Slots the segments hold together.
+        word reservedSize_;
+
+        /**
+         * Creates a frame stack whose segments hold at most maxSize slots together, zero for
+         * no limit, starting with a segment of initialSize slots.
+         */
+        explicit FrameStack(word maxSize = 0, word initialSize = SEGMENT_SIZE);
+        ~FrameStack();
+
+        /**
+         * Allocates an object of the given type and slot count whose slots are zero.
+         *
+         * @throw memory_exhausted_error if the object does not fit in the maximum size
+         */
+        ObjectBase* alloc(int type, word size);
+
+        template <typename T>
+        inline T* alloc()
+        {
+            return (T*) alloc(T::type, sizeof(T) / sizeof(Ref));
+        }
+
+        inline ObjectArray* allocObjectArray(word size)
+        {
+            return (ObjectArray*) alloc(ObjectArray::type, sizeof(ObjectHeader) / sizeof(Ref) + size);
+        }
+
+        /**
+         * Releases the given object and all objects allocated after it.
+         */
+        void release(void* obj);
+
+        /**
+         * Releases all objects.
+         */
+        void clear();
+
+        /**
+         * Releases all objects and returns size contiguous slots at the bottom of the stack.
+         * The caller fills them with frame objects, which can be released individually
+         * afterwards.
+         *
+         * @throw memory_exhausted_error if the slots do not fit in the maximum size
+         */
+        Ref* reset(word size);
+
+        /**
+         * Frees the segments after the current one, which hold no objects.
+         */
+        void trim();
+
+        /**
+         * Returns the number of slots in use.
+         */
+        word usedSize() const;
+
+    private:
+        /**
+         * Replaces the segment at the given index, or appends one if the index is the
+         * segment count, with an empty segment of at least size slots and at least
+         * minimumSize slots unless the maximum size does not leave that many.
+         */
+        void replaceSegment(size_t index, word size, word minimumSize);
+    };
+} // namespace atom
+
+#endif /* ATOM_FRAMESTACK_HPP_INCLUDED */
@@ -0,0 +1,175 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "HeapPolicy.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+
+using namespace atom;
+
+namespace
+{
+    bool readSize(std::string const& str, word& size)
+    {
+        std::istringstream iss(str);
+        word value;
+        
+        iss >> value;
+        
+        if(iss.fail() || value < 0)
+        {
+            return false;
+        }
+        
+        char suffix;
+        
+        if(iss >> suffix)
+        {
+            if(suffix == 'K' || suffix == 'k')
+            {
+                value *= 1024;
+            }
+            else if(suffix == 'M' || suffix == 'm')
+            {
+                value *= 1024 * 1024;
+            }
+            else
+            {
+                return false;
+            }
+            
+            if(iss >> suffix)
+            {
+                return false;
+            }
+        }
+        
+        size = value;
+        return true;
+    }
+    
+    bool readRatio(std::string const& str, double& ratio)
+    {
+        std::istringstream iss(str);
+        double value;
+        
+        iss >> value;
+        
+        if(iss.fail() || !iss.eof() || value <= 0 || value >= 1)
+        {
+            return false;
+        }
+        
+        ratio = value;
+        return true;
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    word HeapPolicy::targetSize(word live, word currentSize) const
+    {
+        word target = currentSize;
+        
+        while(live > target * growRatio && target < maxSize)
+        {
+            target *= 2;
+        }
+        
+        while(live < target * shrinkRatio && target / 2 >= initialSize)
+        {
+            target /= 2;
+        }
+        
+        if(target > maxSize)
+        {
+            target = maxSize;
+        }
+        
+        return target < initialSize ? initialSize : target;
+    }
+    
+    bool HeapPolicy::set(char const* setting)
+    {
+        std::string str(setting);
+        std::string::size_type eq = str.find('=');
+        
+        if(eq == std::string::npos)
+        {
+            return false;
+        }
+        
+        std::string name = str.substr(0, eq);
+        std::string value = str.substr(eq + 1);
+        
+        if(name == "initial")
+        {
+            return readSize(value, initialSize);
+        }
+        else if(name == "max")
+        {
+            return readSize(value, maxSize);
+        }
+        else if(name == "nursery")
+        {
+            return readSize(value, nurserySize);
+        }
+        else if(name == "large")
+        {
+            return readSize(value, largeSize);
+        }
+        else if(name == "stack")
+        {
+            return readSize(value, stackSize);
+        }
+        else if(name == "grow")
+        {
+            return readRatio(value, growRatio);
+        }
+        else if(name == "shrink")
+        {
+            return readRatio(value, shrinkRatio);
+        }
+        
+        return false;
+    }
+    
+    bool HeapPolicy::parse(char const* spec)
+    {
+        std::istringstream iss(spec);
+        std::string setting;
+        
+        while(std::getline(iss, setting, ','))
+        {
+            if(!setting.empty() && !set(setting.c_str()))
+            {
+                return false;
+            }
+        }
+        
+        return true;
+    }
+    
+    bool HeapPolicy::parseEnvironment()
+    {
+        char const* spec = std::getenv("ATOM_HEAP");
+        
+        return spec == 0 || parse(spec);
+    }
+    
+    bool HeapPolicy::valid() const
+    {
+        // Halving the heap doubles the occupancy, which must not trigger growth again.
+        return initialSize > 0 && maxSize >= initialSize && nurserySize >= 0 && shrinkRatio * 2 < growRatio;
+    }
+} // namespace atom
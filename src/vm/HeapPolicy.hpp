@@ -0,0 +1,78 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_HEAP_POLICY_HPP_INCLUDED
+#define ATOM_HEAP_POLICY_HPP_INCLUDED
+
+#include "Ref.hpp"
+
+namespace atom
+{
+    /**
+     * Sizing policy of the old space semispaces. All sizes are in slots.
+     *
+     * After each full collection the semispaces are resized so that the survivors occupy
+     * at most growRatio of a semispace (doubling as needed, up to maxSize) and they are
+     * halved (down to initialSize) while survivors occupy less than shrinkRatio of them.
+     * Objects of at least largeSize slots are allocated in the large object space instead,
+     * zero disables it. The frame stack of each thread holds at most stackSize slots, zero
+     * for no limit.
+     */
+    struct HeapPolicy
+    {
+        word initialSize;
+        word maxSize;
+        word nurserySize;
+        word largeSize;
+        word stackSize;
+        double growRatio;
+        double shrinkRatio;
+
+        /**
+         * Creates a policy for a heap fixed at the given size.
+         */
+        HeapPolicy(word size = 1048576, word nursery = 0)
+        : initialSize(size), maxSize(size), nurserySize(nursery), largeSize(1024), stackSize(1048576), growRatio(0.5), shrinkRatio(0.125)
+        {
+        }
+
+        /**
+         * Returns the semispace size to use when live slots survived a collection of a
+         * semispace of currentSize slots.
+         */
+        word targetSize(word live, word currentSize) const;
+
+        /**
+         * Sets a single setting given as name=value where name is one of initial, max,
+         * nursery, large, stack, grow or shrink. Sizes may have a K or M suffix. Returns false
+         * if the setting is not valid.
+         */
+        bool set(char const* setting);
+
+        /**
+         * Parses a comma separated list of settings, e.g. "initial=1M,max=64M,nursery=128K".
+         * Returns false if any of the settings is not valid.
+         */
+        bool parse(char const* spec);
+
+        /**
+         * Applies the settings in the ATOM_HEAP environment variable, if defined.
+         * Returns false if the variable is not valid.
+         */
+        bool parseEnvironment();
+
+        /**
+         * Returns true if the settings are consistent with each other.
+         */
+        bool valid() const;
+    };
+} // namespace atom
+
+#endif /* ATOM_HEAP_POLICY_HPP_INCLUDED */
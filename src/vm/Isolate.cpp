@@ -0,0 +1,142 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "Isolate.hpp"
+
+#include <string.h>
+
+#include <stdexcept>
+
+using namespace atom;
+
+namespace atom
+{
+    Isolate::Isolate(HeapPolicy const& policy, IsolateVec const* peers, uword index)
+    : memory_(policy), thread_(&memory_), scheduler_(&memory_), peers_(peers), index_(index),
+      started_(false), entry_(0), arg_(0)
+    {
+        memory_.isolate_ = this;
+        memory_.setThread(&thread_);
+    }
+
+    Isolate::~Isolate()
+    {
+        if(started_)
+        {
+            pthread_join(osThread_, 0);
+        }
+    }
+
+    void* Isolate::main(void* isolate)
+    {
+        Isolate* self = (Isolate*) isolate;
+
+        CurrentMemoryScope current(&self->memory_);
+
+        try
+        {
+            self->entry_(self, self->arg_);
+        }
+        catch(std::exception const& e)
+        {
+            self->error_ = e.what();
+        }
+
+        return 0;
+    }
+
+    void Isolate::start(EntryFn entry, void* arg)
+    {
+        entry_ = entry;
+        arg_ = arg;
+
+        const int error = pthread_create(&osThread_, 0, &Isolate::main, this);
+
+        if(error != 0)
+        {
+            throw std::runtime_error(std::string("cannot start isolate: ") + strerror(error));
+        }
+
+        started_ = true;
+    }
+
+    void Isolate::join()
+    {
+        if(started_)
+        {
+            pthread_join(osThread_, 0);
+            started_ = false;
+        }
+
+        if(!error_.empty())
+        {
+            throw std::runtime_error(error_);
+        }
+    }
+
+void fn_sendToIsolate(Thread* thread, int resultTmp, Ref message)
+{
+    Isolate* isolate = thread->memory_->isolate_;
+
+    if(isolate == 0 || !is_object_array(message) || cast<ObjectArray>(message)->size() != 2)
+    {
+        DEBUG("sendToIsolate: message must be an object array of an isolate index and a message sent by an isolate\n");
+        thread->setResult(resultTmp, word2ref(1L));
+        return;
+    }
+
+    ObjectArray* oa = cast<ObjectArray>(message);
+    Ref index = oa->at(0);
+
+    if(!is_int(index) || int_val(index) < 0 || (uword) int_val(index) >= isolate->peers_->size())
+    {
+        DEBUG("sendToIsolate: invalid isolate index\n");
+        thread->setResult(resultTmp, word2ref(1L));
+        return;
+    }
+
+    Parcel* parcel = Parcel::pack(thread->memory_, RefHandle(oa->at(1), thread->memory_));
+
+    (*isolate->peers_)[int_val(index)]->inbox_.send(parcel);
+    thread->setResult(resultTmp, zeroRef());
+}
+
+void fn_receiveMessage(Thread* thread, int resultTmp, Ref message)
+{
+    Isolate* isolate = thread->memory_->isolate_;
+    Parcel* parcel = isolate != 0 ? isolate->inbox_.receive() : 0;
+
+    if(parcel == 0)
+    {
+        thread->setResult(resultTmp, zeroRef());
+        return;
+    }
+
+    RefHandle received(zeroRef(), thread->memory_);
+
+    try
+    {
+        received.ref(parcel->unpack(thread->memory_));
+    }
+    catch(...)
+    {
+        delete parcel;
+        throw;
+    }
+
+    delete parcel;
+
+    ObjectArray* oa = thread->memory_->createObjectArray(1);
+    oa->atPut(0, received.ref());
+
+    thread->setResult(resultTmp, ptr2ref(oa, true));
+}
+
+} // namespace atom
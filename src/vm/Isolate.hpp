@@ -0,0 +1,109 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_ISOLATE_HPP_INCLUDED
+#define ATOM_ISOLATE_HPP_INCLUDED
+
+#include "Scheduler.hpp"
+#include "Channel.hpp"
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+namespace atom
+{
+    class Isolate;
+
+    typedef std::vector<Isolate*> IsolateVec;
+
+    /**
+     * A memory with its threads, run by an OS thread of its own. Memories and threads are not
+     * safe to share between OS threads, so isolates share nothing but their inboxes: objects
+     * are passed between them as parcels, see Channel.hpp.
+     */
+    class Isolate
+    {
+    public:
+        /**
+         * Function run by the OS thread of an isolate.
+         */
+        typedef void (*EntryFn)(Isolate* isolate, void* arg);
+
+        Memory memory_;
+
+        // Main thread of the isolate, set as the thread of the memory.
+        Thread thread_;
+        Scheduler scheduler_;
+
+        // Messages sent to the isolate, see fn_sendToIsolate.
+        Channel inbox_;
+
+        // Isolates that messages can be sent to, including this one at index_.
+        IsolateVec const* peers_;
+        uword index_;
+
+    private:
+        pthread_t osThread_;
+        bool started_;
+
+        EntryFn entry_;
+        void* arg_;
+
+        // Message of an exception that escaped the entry function.
+        std::string error_;
+
+        static void* main(void* isolate);
+
+        Isolate(Isolate const&);
+        Isolate& operator=(Isolate const&);
+
+    public:
+        /**
+         * @pre peers is filled before any isolate in it is started
+         */
+        Isolate(HeapPolicy const& policy, IsolateVec const* peers, uword index);
+
+        /**
+         * Waits for the OS thread of the isolate if it was started.
+         */
+        ~Isolate();
+
+        /**
+         * Runs the entry function on a new OS thread.
+         */
+        void start(EntryFn entry, void* arg);
+
+        /**
+         * Waits for the entry function to return. An exception thrown by it is rethrown as a
+         * std::runtime_error.
+         */
+        void join();
+    };
+
+/**
+ * Sends a copy of a message to an isolate, see Parcel. Returns zero, or 1 if the calling
+ * thread is not run by an isolate or the index is not valid.
+ *
+ * @message must be an object array of the format: [isolate index, message]
+ */
+void fn_sendToIsolate(atom::Thread* thread, int resultTmp, atom::Ref message);
+
+/**
+ * Returns the first message in the inbox of the isolate of the calling thread in a one element
+ * object array, or zero if there is none. Never waits, threads polling for messages should
+ * yield in between. The message is ignored.
+ */
+void fn_receiveMessage(atom::Thread* thread, int resultTmp, atom::Ref message);
+
+} // namespace atom
+
+#endif /* ATOM_ISOLATE_HPP_INCLUDED */
@@ -0,0 +1,93 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "LargeObjectSpace.hpp"
+#include "Exceptions.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace atom;
+
+namespace
+{
+    uword pageAlign(uword size)
+    {
+        static const uword pageSize = sysconf(_SC_PAGESIZE);
+
+        return (size + pageSize - 1) & ~(pageSize - 1);
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    LargeObjectSpace::~LargeObjectSpace()
+    {
+        for(BlockSet::iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+        {
+            munmap(*it, (*it)->mappedSize);
+        }
+    }
+
+    Ref* LargeObjectSpace::alloc(word slotCount)
+    {
+        const uword mappedSize = pageAlign(sizeof(Block) + slotCount * sizeof(Ref));
+        void* mapping = mmap(0, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(mapping == MAP_FAILED)
+        {
+            throw memory_exhausted_error();
+        }
+
+        Block* block = (Block*) mapping;
+        block->mappedSize = mappedSize;
+        block->marked = 0;
+        block->owner = owner_;
+
+        Ref* result = (Ref*) block->object();
+
+        for(word i = 0; i < slotCount; ++i)
+        {
+            result[i] = zeroRef();
+        }
+
+        ((ObjectBase*) result)->header_.large = 1;
+
+        blocks_.insert(block);
+        slots_ += slotCount;
+        allocatedSlots_ += slotCount;
+
+        return result;
+    }
+
+    void LargeObjectSpace::sweep()
+    {
+        for(BlockSet::iterator it = blocks_.begin(); it != blocks_.end(); )
+        {
+            Block* block = *it;
+            const word size = block->object()->header_.size;
+
+            if(block->marked)
+            {
+                block->marked = 0;
+                savedSlots_ += size;
+                ++it;
+            }
+            else
+            {
+                slots_ -= size;
+                blocks_.erase(it++);
+                munmap(block, block->mappedSize);
+            }
+        }
+
+        allocatedSlots_ = 0;
+    }
+} // namespace atom
@@ -0,0 +1,128 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_LARGE_OBJECT_SPACE_HPP_INCLUDED
+#define ATOM_LARGE_OBJECT_SPACE_HPP_INCLUDED
+
+#include "Ref.hpp"
+#include "ObjectHeader.hpp"
+#include "Object.hpp"
+
+#include <set>
+#include <vector>
+
+namespace atom
+{
+    struct Memory;
+
+    /**
+     * Non-moving space for objects too large to be copied by every collection. Each object
+     * has its own page granular mapping starting with a Block and keeps its address until it
+     * is freed. Major collections mark the reached objects instead of moving them, scan the
+     * slots of the marked ones and unmap the rest, see Memory::collectOld. Large objects are
+     * old objects, minor collections reach their nursery children through the remembered set.
+     */
+    struct LargeObjectSpace
+    {
+        struct Block
+        {
+            // Size of the mapping in bytes.
+            uword mappedSize;
+
+            // Set when the major collection in progress reaches the object.
+            uword marked;
+
+            // Memory of the space the object is allocated in.
+            Memory* owner;
+
+            inline ObjectBase* object()
+            {
+                return (ObjectBase*) (this + 1);
+            }
+        };
+
+        typedef std::set<Block*> BlockSet;
+        typedef std::vector<ObjectBase*> ObjectPtrVec;
+
+        // Memory this space belongs to.
+        Memory* owner_;
+
+        BlockSet blocks_;
+
+        // Marked objects whose slots are not scanned yet.
+        ObjectPtrVec gray_;
+
+        // Slots of the objects in the space.
+        word slots_;
+
+        // Slots allocated since the last sweep.
+        word allocatedSlots_;
+
+        // Slots of the large objects that survived major collections, the copying those
+        // collections did not do.
+        long savedSlots_;
+
+        explicit LargeObjectSpace(Memory* owner)
+        : owner_(owner), slots_(0), allocatedSlots_(0), savedSlots_(0)
+        {
+        }
+
+        ~LargeObjectSpace();
+
+        static inline Block* blockOf(void* object)
+        {
+            return ((Block*) object) - 1;
+        }
+
+        /**
+         * Maps a new object of the given number of slots, all zero initialized except for
+         * the large bit of the header.
+         *
+         * @throw memory_exhausted_error if the mapping fails
+         */
+        Ref* alloc(word slotCount);
+
+        inline bool contains(void* p) const
+        {
+            return blocks_.find(blockOf(p)) != blocks_.end();
+        }
+
+        inline bool isMarked(void* object) const
+        {
+            return blockOf(object)->marked != 0;
+        }
+
+        /**
+         * Marks the object and queues it for scanning if it is not marked yet.
+         */
+        inline void mark(ObjectBase* object)
+        {
+            Block* block = blockOf(object);
+
+            if(!block->marked)
+            {
+                block->marked = 1;
+                gray_.push_back(object);
+            }
+        }
+
+        /**
+         * Unmaps the unmarked objects and clears the marks of the others.
+         */
+        void sweep();
+
+        inline word objectCount() const
+        {
+            return blocks_.size();
+        }
+    };
+} // namespace atom
+
+#endif /* ATOM_LARGE_OBJECT_SPACE_HPP_INCLUDED */
@@ -10,17 +10,116 @@
 
 #include "Memory.hpp"
 #include "Thread.hpp"
+#include "FrameStack.hpp"
 #include "SharedLibrary.hpp"
+#include "Scheduler.hpp"
+#include "Isolate.hpp"
+#include "Profiler.hpp"
 #include "Exceptions.hpp"
 
 #include <cstring>
 #include <stdexcept>
 #include <iostream>
 
+#include <pthread.h>
+
 using namespace atom;
 
 namespace
 {
+    // Memory the write barrier of the calling OS thread checks first, see
+    // CurrentMemoryScope.
+    __thread Memory* currentMemory = 0;
+
+    typedef std::vector<MemSpace*> MemSpaceVec;
+
+    // Old spaces of all memories. Isolates create and resize their spaces on their own OS
+    // threads, so the list is only used while holding oldSpacesLock.
+    MemSpaceVec oldSpaces;
+    pthread_mutex_t oldSpacesLock = PTHREAD_MUTEX_INITIALIZER;
+
+    /**
+     * Holds oldSpacesLock while in scope.
+     */
+    struct OldSpacesLock
+    {
+        OldSpacesLock()
+        {
+            pthread_mutex_lock(&oldSpacesLock);
+        }
+
+        ~OldSpacesLock()
+        {
+            pthread_mutex_unlock(&oldSpacesLock);
+        }
+    };
+
+    // Large object space of the memory running a major collection on the calling OS thread,
+    // 0 outside of major collections. Evacuation marks the large objects it reaches in this
+    // space.
+    __thread LargeObjectSpace* tracedLarge = 0;
+
+    /**
+     * Removes the entries residing in the given space from the remembered set.
+     */
+    void forgetIn(ObjectPtrVec& remembered, MemSpace* space)
+    {
+        ObjectPtrVec::iterator out = remembered.begin();
+
+        for(ObjectPtrVec::iterator it = remembered.begin(); it != remembered.end(); ++it)
+        {
+            if(!space->containsPtr(*it))
+            {
+                *out++ = *it;
+            }
+        }
+
+        remembered.erase(out, remembered.end());
+    }
+
+    /**
+     * Removes the entries of the large objects about to be swept from the remembered set.
+     */
+    void forgetUnmarked(ObjectPtrVec& remembered, LargeObjectSpace const& large)
+    {
+        ObjectPtrVec::iterator out = remembered.begin();
+
+        for(ObjectPtrVec::iterator it = remembered.begin(); it != remembered.end(); ++it)
+        {
+            if(!large.contains(*it) || large.isMarked(*it))
+            {
+                *out++ = *it;
+            }
+        }
+
+        remembered.erase(out, remembered.end());
+    }
+
+    /**
+     * Tells the profiler of a memory, if any, that a collection runs while in scope.
+     */
+    struct CollectionScope
+    {
+        Profiler* profiler_;
+
+        CollectionScope(Profiler* profiler)
+        : profiler_(profiler)
+        {
+            if(profiler_ != 0)
+            {
+                profiler_->enterCollection();
+            }
+        }
+
+        ~CollectionScope()
+        {
+            if(profiler_ != 0)
+            {
+                profiler_->leaveCollection();
+            }
+        }
+    };
+
     void dumpRef(Ref r)
     {
         std::cerr << "ref: {is_int=" << r.is_int_ << ", arr_acc=" << r.arr_acc_;
@@ -41,107 +140,204 @@ namespace
 
 namespace atom
 {
-    Ref MemSpace::copy(Ref p, RefHandleList& externalRefs, PtrHandleList& externalPtrs)
+    void rememberObject(ObjectBase* holder)
+    {
+        Memory* mem = currentMemory;
+
+        // Objects changed by a running thread are almost always in its memory.
+        if(mem == 0 || !mem->toSpace_->containsPtr(holder))
+        {
+            mem = Memory::owner(holder);
+
+            if(mem == 0)
+            {
+                throw std::logic_error("write barrier: object not in any memory");
+            }
+        }
+
+        holder->header_.remembered = 1;
+        mem->remembered_.push_back(holder);
+    }
+
+    MemSpace::MemSpace(word size, Memory* owner)
+    : owner_(owner)
+    {
+        start_ = free_ = new Ref[size];
+        end_ = start_ + size;
+
+        if(owner_ != 0)
+        {
+            OldSpacesLock lock;
+            oldSpaces.push_back(this);
+        }
+    }
+
+    MemSpace::~MemSpace()
+    {
+        if(owner_ != 0)
+        {
+            OldSpacesLock lock;
+            oldSpaces.erase(std::find(oldSpaces.begin(), oldSpaces.end(), this));
+        }
+
+        delete[] start_;
+    }
+
+    CurrentMemoryScope::CurrentMemoryScope(Memory* memory)
+    : previous_(currentMemory)
     {
-        if(is_int(p))
+        currentMemory = memory;
+    }
+
+    CurrentMemoryScope::~CurrentMemoryScope()
+    {
+        currentMemory = previous_;
+    }
+
+    Memory::~Memory()
+    {
+        for(ByteArrayVec::iterator it = externalPayloads_.begin(); it != externalPayloads_.end(); ++it)
+        {
+            delete[] (*it)->data();
+        }
+
+        delete nursery_;
+        delete toSpace_;
+        delete fromSpace_;
+    }
+
+    Memory* Memory::current()
+    {
+        return currentMemory;
+    }
+
+    Memory* Memory::owner(ObjectBase* ob)
+    {
+        // Large objects are not moved, their blocks know their memory.
+        if(ob->header_.large)
+        {
+            return LargeObjectSpace::blockOf(ob)->owner;
+        }
+
+        OldSpacesLock lock;
+
+        for(MemSpaceVec::const_iterator it = oldSpaces.begin(); it != oldSpaces.end(); ++it)
+        {
+            if((*it)->containsPtr(ob))
+            {
+                return (*it)->owner_;
+            }
+        }
+
+        return 0;
+    }
+
+    Ref MemSpace::evacuate(Ref p, bool young, bool hierarchical)
+    {
+        if(is_immediate(p))
         {
             return p;
         }
         
-        int type = obj_type(p);
+        if(!needsEvacuation(p, young))
+        {
+            ForwardedObjectHeader* foh = cast<ForwardedObjectHeader>(p);
+
+            if(foh->isForwarded())
+            {
+                return ptr2ref(foh->getRealPtr(), array_access(p));
+            }
+
+            if(!young && tracedLarge != 0 && cast<ObjectBase>(p)->header_.large)
+            {
+                tracedLarge->mark(cast<ObjectBase>(p));
+            }
+
+            return p;
+        }
         
-        ForwardedObjectHeader* foh = cast<ForwardedObjectHeader>(p);
-        bool forwarded = foh->isForwarded();
+        Ref result;
+        Ref* slot = &result;
         
-        if(!forwarded)
-        {            
-            ObjectBase* pptr = cast<ObjectBase>(p);
+        // Each iteration moves one object and, in hierarchical mode, continues with its
+        // first child that still needs to be moved.
+        while(true)
+        {
+            Ref* oldP = (Ref*) ptr_val(p);
             Ref* newP = allocSame(p);
+            const int n = ((ObjectBase*) newP)->header_.size;
             
-            foh->forward(newP);
-            
-            if(type == ObjectType::BYTE_ARRAY || type == ObjectType::NATIVE_FUNCTION)
+            for(int i = 1; i < n; ++i)
             {
-                ((PrimDataObject*) newP)->copy((PrimDataObject*) pptr);
+                newP[i] = oldP[i];
             }
-            else if(type == ObjectType::FLOAT)
+            
+            // Inline contents move with the array.
+            if(((ObjectBase*) newP)->header_.objtype == ObjectType::BYTE_ARRAY && ((ByteArray*) oldP)->hasInlineData())
             {
-                ((FloatObject*) newP)->copy((FloatObject*) pptr);
+                ((ByteArray*) newP)->data_ = ((ByteArray*) newP)->inlineData();
             }
-            else
+            
+            cast<ForwardedObjectHeader>(p)->forward(newP);
+            *slot = ptr2ref(newP, array_access(p));
+            
+            if(!hierarchical || !ObjectType::containsSlots(((ObjectBase*) newP)->header_.objtype))
             {
-                const int n = ((ObjectBase*) newP)->header_.size;
-                
-                for(int i = 1; i < n; ++i)
-                {
-                    newP[i] = copy(((Ref*) pptr)[i], externalRefs, externalPtrs);
-                }
+                break;
             }
-        }
-        
-        Ref newRef = ptr2ref(foh->getRealPtr(), array_access(p));
-        
-        if(!forwarded)
-        {
-            for(RefHandleList::iterator it = externalRefs.begin(); it != externalRefs.end(); ++it)
+            
+            int i = 1;
+            
+            while(i < n && !needsEvacuation(newP[i], young))
             {
-                RefHandle* rh = *it;
-                
-                if(rh->ref() == p)
-                {
-                    rh->ref(newRef);
-                }
+                ++i;
             }
             
-            for(PtrHandleList::iterator it = externalPtrs.begin(); it != externalPtrs.end(); ++it)
+            if(i == n)
             {
-                PtrHandleBase* ph = *it;
-                
-                if(ph->ptr_ == ptr_val(p))
-                {
-                    ph->ptr(ptr_val(newRef));
-                }
+                break;
             }
-        }        
+            
+            slot = &newP[i];
+            p = newP[i];
+        }
         
-        return newRef;
+        return result;
     }
     
-    void MemSpace::reset()
+    void MemSpace::scan(Ref* from, bool young, bool hierarchical)
     {
-        Ref* current = start_;
-
-        while(current != free_)
+        // Evacuated objects are appended at free_, so scanning ends when it catches up with it.
+        while(from < free_)
         {
-            ObjectHeader* oh = (ObjectHeader*) current;
+            ObjectBase* ob = (ObjectBase*) from;
+            const int n = ob->header_.size;
             
-            if(!oh->isMarked() && oh->objtype == ObjectType::BYTE_ARRAY)
+            if(ObjectType::containsSlots(ob->header_.objtype))
             {
-                ByteArray* ba = (ByteArray*) oh;
-                
-                if(ba->managed_)
+                for(int i = 1; i < n; ++i)
                 {
-                    delete[] ba->data();
+                    Ref r = evacuate(from[i], young, hierarchical);
+                    
+                    // Nursery objects stay in place during major collections, so moved
+                    // objects referring to them must be remembered again.
+                    if(!young && !is_immediate(r) && cast<ObjectBase>(r)->header_.young && !ob->header_.remembered)
+                    {
+                        rememberObject(ob);
+                    }
+                    
+                    from[i] = r;
                 }
             }
             
-            if(oh->isMarked())
-            {
-                current += ((ObjectHeader*) ((ForwardedObjectHeader*) oh)->getRealPtr())->size;
-            }
-            else
-            {
-                current += oh->size;
-            }
+            from += n;
         }
-
-        free_ = start_;
     }
-
+    
     RefHandle::RefHandle(Ref ref, Memory* mem)
-    : ref_(ref), mem_(mem)
+    : ref_(ref), mem_(mem), slot_(-1)
     {
-        if(!is_int(ref_))
+        if(!is_immediate(ref_))
         {
             mem_->registerRefHandle(this);
         }
@@ -149,7 +345,7 @@ namespace atom
         
     RefHandle::~RefHandle()
     {
-        if(!is_int(ref_))
+        if(slot_ != -1)
         {
             mem_->unregisterRefHandle(this);
         }
@@ -157,7 +353,7 @@ namespace atom
        
     void RefHandle::ref(const atom::Ref& ref)
     {
-        if(is_int(ref_) && !is_int(ref))
+        if(slot_ == -1 && !is_immediate(ref))
         {
             mem_->registerRefHandle(this);
         }
@@ -166,9 +362,9 @@ namespace atom
     }
 
     RefHandle::RefHandle(RefHandle const& other)
-    : ref_(other.ref_), mem_(other.mem_)
+    : ref_(other.ref_), mem_(other.mem_), slot_(-1)
     {
-        if(!is_int(ref_))
+        if(!is_immediate(ref_))
         {
             mem_->registerRefHandle(this);            
         }
@@ -176,15 +372,15 @@ namespace atom
         
     RefHandle& RefHandle::operator=(RefHandle const& other)
     {
-        if(!is_int(ref_))
+        if(slot_ != -1 && mem_ != other.mem_)
         {
             mem_->unregisterRefHandle(this);
         }
         
-        ref_ = other.ref();
+        ref_ = other.ref_;
         mem_ = other.mem_;
         
-        if(!is_int(ref_))
+        if(slot_ == -1 && !is_immediate(ref_))
         {
             mem_->registerRefHandle(this);            
         }
@@ -193,7 +389,7 @@ namespace atom
     }
     
     PtrHandleBase::PtrHandleBase(void* ptr, Memory* mem)
-    : ptr_(ptr), mem_(mem)
+    : ptr_(ptr), mem_(mem), slot_(-1)
     {
         if(ptr_ != 0)
         {
@@ -203,7 +399,7 @@ namespace atom
     
     PtrHandleBase::~PtrHandleBase()
     {
-        if(ptr_ != 0)
+        if(slot_ != -1)
         {
             mem_->unregisterPtrHandle(this);
         }
@@ -211,12 +407,7 @@ namespace atom
     
     void PtrHandleBase::ptr(void* ptr)
     {
-        if(ptr_ != 0 && ptr == 0)        
-        {
-            mem_->unregisterPtrHandle(this);
-        }
-        
-        if(ptr_ == 0 && ptr != 0)
+        if(slot_ == -1 && ptr != 0)
         {
             mem_->registerPtrHandle(this);
         }
@@ -225,7 +416,7 @@ namespace atom
     }
 
     PtrHandleBase::PtrHandleBase(PtrHandleBase const& other)
-    : ptr_(other.ptr_), mem_(other.mem_)
+    : ptr_(other.ptr_), mem_(other.mem_), slot_(-1)
     {
         if(ptr_ != 0)
         {
@@ -235,12 +426,19 @@ namespace atom
     
     PtrHandleBase& PtrHandleBase::operator=(PtrHandleBase const& other)
     {
-        if(ptr_ == 0 && other.ptr_ != 0)
+        if(slot_ != -1 && mem_ != other.mem_)
         {
-            mem_->registerPtrHandle(this);
+            mem_->unregisterPtrHandle(this);
         }
         
         ptr_ = other.ptr_;
+        mem_ = other.mem_;
+        
+        if(slot_ == -1 && ptr_ != 0)
+        {
+            mem_->registerPtrHandle(this);
+        }
+        
         return *this;
     }
     
@@ -248,73 +446,328 @@ namespace atom
     {
         PrimDataObject* pr = (PrimDataObject*) alloc(sizeof(PrimDataObject) / sizeof(Ref));
 
-        pr->header_.init(type, sizeof(PrimDataObject) / sizeof(Ref));
+        initHeader(&pr->header_, type, sizeof(PrimDataObject) / sizeof(Ref));
 
         pr->managed_ = managed;
         pr->size_ = size;
         pr->data_ = ptr;
 
+        if(managed && type == ObjectType::BYTE_ARRAY)
+        {
+            registerExternalPayload((ByteArray*) pr);
+        }
+
         return ptr2ref(pr);
     }
 
+    Ref Memory::createManagedByteArray(word size)
+    {
+        if(size > ByteArray::MAX_INLINE_SIZE)
+        {
+            return createManagedPrim(ObjectType::BYTE_ARRAY, new byte[size], size);
+        }
+
+        const word slots = ByteArray::heapSlots(size);
+        ByteArray* ba = (ByteArray*) alloc(slots);
+
+        initHeader(&ba->header_, ObjectType::BYTE_ARRAY, slots);
+
+        ba->managed_ = true;
+        ba->size_ = size;
+        ba->data_ = ba->inlineData();
+
+        return ptr2ref(ba);
+    }
+
     Ref* Memory::alloc(int slotCount)
+    {
+        ++allocations_;
+
+        if(policy_.largeSize > 0 && slotCount >= policy_.largeSize)
+        {
+            return allocLarge(slotCount);
+        }
+
+        // Objects that would occupy more than half of the nursery are allocated directly
+        // in the old space.
+        if(nursery_ == 0 || slotCount > nursery_->size() / 2)
+        {
+            return allocOld(slotCount);
+        }
+
+        if(!nursery_->canAllocate(slotCount))
+        {
+            collectNursery();
+        }
+
+        return nursery_->alloc(slotCount);
+    }
+
+    Ref* Memory::allocOld(int slotCount)
     {
         if(!toSpace_->canAllocate(slotCount))
         {
             DEBUG("Memory full, running garbage collection.\n");
             
-            flipSpaces();
-            
-            if(!toSpace_->canAllocate(slotCount))
-            {
-                throw memory_exhausted_error();
-            }            
+            collectOld(slotCount);
         }
 
         return toSpace_->alloc(slotCount);
     }
 
+    Ref* Memory::allocLarge(int slotCount)
+    {
+        // Only major collections free large objects, one runs whenever the large objects
+        // allocated since the previous one would fill the old space.
+        if(large_.allocatedSlots_ + slotCount > toSpace_->size())
+        {
+            DEBUG("Large object space grown by " << large_.allocatedSlots_ << " slots, running garbage collection.\n");
+
+            collectOld(0);
+        }
+
+        return large_.alloc(slotCount);
+    }
+
+    void Memory::collectNursery()
+    {
+        CollectionScope scope(profiler_);
+
+        // Promoted objects must fit into the old space even if every nursery object survives.
+        if(!toSpace_->canAllocate(nursery_->freeSize()))
+        {
+            collectOld(nursery_->freeSize());
+        }
+
+        ++minorCollections_;
+
+        Ref* scanStart = toSpace_->free_;
+
+        evacuateRoots(toSpace_, true);
+
+        // Slots of the remembered old objects are the only other references into the nursery.
+        ObjectPtrVec remembered;
+        remembered.swap(remembered_);
+
+        for(ObjectPtrVec::iterator it = remembered.begin(); it != remembered.end(); ++it)
+        {
+            (*it)->header_.remembered = 0;
+            evacuateSlots(*it, true);
+        }
+
+        toSpace_->scan(scanStart, true, hierarchicalCopy_);
+        codeCache_.update(nursery_);
+        updateExternalPayloads(nursery_);
+        nursery_->reset();
+    }
+
+    void Memory::collectOld(word required)
+    {
+        CollectionScope scope(profiler_);
+
+        // Scans remember moved holders of nursery objects in this memory.
+        CurrentMemoryScope current(this);
+
+        // Semispaces are resized after a collection, so the following collection may need
+        // two passes: one to move the survivors into the resized space and one to reclaim it.
+        for(int pass = 0; pass < 2; ++pass)
+        {
+            ++majorCollections_;
+
+            // After a shrink from space may be smaller than the objects in to space.
+            if(fromSpace_->size() <= toSpace_->freeSize())
+            {
+                delete fromSpace_;
+                fromSpace_ = new MemSpace(toSpace_->size(), this);
+            }
+
+            MemSpace* tmp = fromSpace_;
+            fromSpace_ = toSpace_;
+            toSpace_ = tmp;
+
+            tracedLarge = &large_;
+            evacuateRoots(toSpace_, false);
+
+            if(nursery_ != 0)
+            {
+                for(Ref* current = nursery_->start_; current < nursery_->free_; current += ((ObjectBase*) current)->header_.size)
+                {
+                    evacuateSlots((ObjectBase*) current, false);
+                }
+            }
+
+            scanOld(toSpace_->start_);
+            tracedLarge = 0;
+
+            codeCache_.update(fromSpace_);
+            codeCache_.update(large_);
+            updateExternalPayloads(fromSpace_);
+
+            // Surviving holders are remembered again by the scan, the entries are stale.
+            // Large objects do not move, so their entries stay valid while they live.
+            forgetIn(remembered_, fromSpace_);
+            forgetUnmarked(remembered_, large_);
+
+            fromSpace_->reset();
+            large_.sweep();
+
+            word target = policy_.targetSize(toSpace_->freeSize() + required, toSpace_->size());
+
+            if(target != fromSpace_->size())
+            {
+                DEBUG("Resizing heap from " << toSpace_->size() << " to " << target << " slots.\n");
+
+                delete fromSpace_;
+                fromSpace_ = new MemSpace(target, this);
+            }
+
+            if(toSpace_->canAllocate(required))
+            {
+                return;
+            }
+
+            // Survivors and the request do not fit in to space, they might fit into the
+            // grown from space.
+            if(fromSpace_->size() <= toSpace_->freeSize() + required)
+            {
+                break;
+            }
+        }
+
+        throw memory_exhausted_error();
+    }
+
     void Memory::flipSpaces()
     {
-        MemSpace* tmp = fromSpace_;
-        fromSpace_ = toSpace_;
-        toSpace_ = tmp;
+        collectOld(0);
 
-        std::vector<Ref> roots;
-                
-        for(RefHandleList::iterator it = refHandles_.begin(); it != refHandles_.end(); ++it)
+        if(nursery_ != 0)
+        {
+            collectNursery();
+        }
+    }
+
+    void Memory::scanOld(Ref* from)
+    {
+        do
+        {
+            toSpace_->scan(from, false, hierarchicalCopy_);
+            from = toSpace_->free_;
+
+            // Large objects keep their remembered bit, they need not be remembered again.
+            while(!large_.gray_.empty())
+            {
+                ObjectBase* ob = large_.gray_.back();
+
+                large_.gray_.pop_back();
+                evacuateSlots(ob, false);
+            }
+        }
+        while(from != toSpace_->free_);
+    }
+
+    void Memory::evacuateSlots(ObjectBase* holder, bool young)
+    {
+        if(!ObjectType::containsSlots(holder->header_.objtype))
         {
-            roots.push_back((*it)->ref());
+            return;
+        }
+
+        Ref* slots = (Ref*) holder;
+        const int n = holder->header_.size;
+
+        for(int i = 1; i < n; ++i)
+        {
+            slots[i] = toSpace_->evacuate(slots[i], young, hierarchicalCopy_);
+        }
+    }
+
+    void Memory::updateExternalPayloads(MemSpace* space)
+    {
+        ByteArrayVec::iterator live = externalPayloads_.begin();
+
+        for(ByteArrayVec::iterator it = externalPayloads_.begin(); it != externalPayloads_.end(); ++it)
+        {
+            ByteArray* ba = *it;
+
+            if(space->containsPtr(ba))
+            {
+                ForwardedObjectHeader* foh = (ForwardedObjectHeader*) ba;
+
+                if(!foh->isForwarded())
+                {
+                    delete[] ba->data();
+                    continue;
+                }
+
+                ba = (ByteArray*) foh->getRealPtr();
+            }
+
+            *live++ = ba;
+        }
+
+        externalPayloads_.erase(live, externalPayloads_.end());
+    }
+
+    void Memory::evacuateRoots(MemSpace* space, bool young)
+    {
+        // Objects reached through several handles are moved once and the rest of the
+        // handles receive the forwarding address.
+        for(RefHandleVec::iterator it = refHandles_.begin(); it != refHandles_.end(); ++it)
+        {
+            RefHandle* rh = *it;
+            rh->ref_ = space->evacuate(rh->ref_, young, hierarchicalCopy_);
         }
         
-        for(PtrHandleList::iterator it = ptrHandles_.begin(); it != ptrHandles_.end(); ++it)
+        for(PtrHandleVec::iterator it = ptrHandles_.begin(); it != ptrHandles_.end(); ++it)
         {
-            void* ptr = (*it)->ptr_;
+            PtrHandleBase* ph = *it;
             
-            if(ptr != 0)
+            if(ph->ptr_ != 0)
             {
-                roots.push_back(ptr2ref(ptr));
+                ph->ptr_ = ptr_val(space->evacuate(ptr2ref(ph->ptr_), young, hierarchicalCopy_));
             }
         }
         
-        for(std::vector<Ref>::const_iterator it = roots.begin(); it != roots.end(); ++it)
+        for(FrameStackVec::iterator it = frameStacks_.begin(); it != frameStacks_.end(); ++it)
         {
-            toSpace_->copy(*it, refHandles_, ptrHandles_);
+            FrameStack* frames = *it;
+            
+            for(size_t i = 0; i <= frames->current_; ++i)
+            {
+                FrameStack::Segment& segment = frames->segments_[i];
+                
+                for(Ref* current = segment.start_; current < segment.free_; current += ((ObjectBase*) current)->header_.size)
+                {
+                    evacuateSlots((ObjectBase*) current, young);
+                }
+            }
+        }
+
+        // Loaders allocate in the old space, minor collections never move their objects.
+        if(loader_ != 0 && !young)
+        {
+            loader_->evacuateRoots(space, hierarchicalCopy_);
         }
-        
-        fromSpace_->reset();
     }
 
     Ref Memory::createObject(uword size, int type)
     {
         Ref* result = alloc(size);
 
-        ((ObjectHeader*) result)->init(type, size);
+        initHeader((ObjectHeader*) result, type, size);
         return ptr2ref(result);
     }
 
     Ref Memory::createFloat(double d)
     {
+        Ref immediate;
+
+        if(double2ref(d, immediate))
+        {
+            return immediate;
+        }
+
         FloatObject* result = createObject<FloatObject>();
 
         result->value_ = d;
@@ -323,13 +776,34 @@ namespace atom
 
     Ref Memory::createStartupMessage(Ref printStringFn)
     {
-        PtrHandle<ObjectArray> message(createObjectArray(5), this);
-
-        message->atPut(0, createOpaqueNativeHandle(this));
-        message->atPut(1, createNativeFunction(&memoryControllerFn));
-        message->atPut(2, printStringFn);
-        message->atPut(3, createNativeFunction(&fn_loadLibrary));
-        message->atPut(4, createNativeFunction(&fn_resolveFunction));
+        // Any allocation may move the objects, so all elements are kept in handles until
+        // the message is filled.
+        RefHandle printString(printStringFn, this);
+        RefHandle memoryHandle(createOpaqueNativeHandle(this), this);
+        RefHandle controller(createNativeFunction(&memoryControllerFn), this);
+        RefHandle loadLibrary(createNativeFunction(&fn_loadLibrary), this);
+        RefHandle resolveFunction(createNativeFunction(&fn_resolveFunction), this);
+        RefHandle resolveAllFunctions(createNativeFunction(&fn_resolveAllFunctions), this);
+        RefHandle spawnThread(createNativeFunction(&fn_spawnThread), this);
+        RefHandle yieldThread(createNativeFunction(&fn_yieldThread), this);
+        RefHandle joinThread(createNativeFunction(&fn_joinThread), this);
+        RefHandle sendToIsolate(createNativeFunction(&fn_sendToIsolate), this);
+        RefHandle receiveMessage(createNativeFunction(&fn_receiveMessage), this);
+        PtrHandle<ObjectArray> message(createObjectArray(13), this);
+
+        message->atPut(0, memoryHandle.ref());
+        message->atPut(1, controller.ref());
+        message->atPut(2, printString.ref());
+        message->atPut(3, loadLibrary.ref());
+        message->atPut(4, resolveFunction.ref());
+        message->atPut(5, resolveAllFunctions.ref());
+        message->atPut(6, spawnThread.ref());
+        message->atPut(7, yieldThread.ref());
+        message->atPut(8, joinThread.ref());
+        message->atPut(9, sendToIsolate.ref());
+        message->atPut(10, receiveMessage.ref());
+        message->atPut(11, word2ref(isolate_ != 0 ? (word) isolate_->index_ : 0));
+        message->atPut(12, word2ref(isolate_ != 0 ? (word) isolate_->peers_->size() : 1));
 
         return ptr2ref(message.ptr(), true);
     }
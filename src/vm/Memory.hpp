@@ -14,8 +14,11 @@
 #include "Ref.hpp"
 #include "ObjectHeader.hpp"
 #include "Object.hpp"
+#include "HeapPolicy.hpp"
+#include "DecodedCode.hpp"
+#include "LargeObjectSpace.hpp"
+#include "SymbolCache.hpp"
 
-#include <list>
 #include <vector>
 #include <algorithm>
 #include <iostream>
@@ -26,42 +29,52 @@ namespace atom
     struct RefHandle;
     struct PtrHandleBase;
     struct Memory;
+    struct FrameStack;
+    class Isolate;
+    class Profiler;
     
-    typedef std::list<RefHandle*> RefHandleList;
-    typedef std::list<PtrHandleBase*> PtrHandleList;
+    typedef std::vector<RefHandle*> RefHandleVec;
+    typedef std::vector<PtrHandleBase*> PtrHandleVec;
+    typedef std::vector<FrameStack*> FrameStackVec;
+    typedef std::vector<ByteArray*> ByteArrayVec;
+    typedef std::vector<ObjectBase*> ObjectPtrVec;
     
     struct MemSpace
     {
         Ref* start_;
         Ref* free_;
         Ref* end_;
+
+        // Memory whose old space this is, 0 for nurseries. Old spaces are registered while
+        // they exist, so the write barrier can find the memory owning an object.
+        Memory* owner_;
         
-        MemSpace(word size)
-        {
-            start_ = free_ = new Ref[size];
-            end_ = start_ + size;
-        }
-    
-        ~MemSpace()
-        {
-            reset();
-            delete[] start_;
-        }
+        MemSpace(word size, Memory* owner = 0);
+        ~MemSpace();
         
         /**
-         * Returns the space to empty status. Frees garbage-collected byte arrays.
+         * Returns the space to empty status. Payloads of dead byte arrays are freed by
+         * Memory::updateExternalPayloads, the objects themselves need no sweep.
          */
-        void reset();
+        inline void reset()
+        {
+            free_ = start_;
+        }
         
         inline bool contains(Ref r)
         {
-            if(is_int(r))
+            if(is_immediate(r))
             {
                 return false;
             }
             
-            Ref* rp = (Ref*) ptr_val(r);
-            return rp >= start_ && rp < end_;            
+            return containsPtr(ptr_val(r));
+        }
+
+        inline bool containsPtr(void* p) const
+        {
+            Ref* rp = (Ref*) p;
+            return rp >= start_ && rp < end_;
         }
         
         inline bool canAllocate(int slotCount) const
@@ -97,11 +110,58 @@ namespace atom
             ObjectBase* newBase = (ObjectBase*) alloc(origBase->header_.size);
             
             newBase->header_ = origBase->header_;
+            newBase->header_.young = 0;
+            newBase->header_.remembered = 0;
             
             return (Ref*) newBase;
         }
         
-        Ref copy(Ref r, RefHandleList& externalRefs, PtrHandleList& externalPtrs);
+        /**
+         * Returns true if r refers to an object that must be moved into this space by
+         * the collection in progress. Minor collections (young set) move nursery objects,
+         * major collections move old objects only. Large objects are never moved.
+         */
+        inline bool needsEvacuation(Ref r, bool young) const
+        {
+            if(is_immediate(r) || containsPtr(ptr_val(r)) || cast<ForwardedObjectHeader>(r)->isForwarded() || cast<ObjectBase>(r)->header_.frame || cast<ObjectBase>(r)->header_.large)
+            {
+                return false;
+            }
+            
+            return cast<ObjectBase>(r)->header_.young == young;
+        }
+        
+        /**
+         * Moves the object referenced by r (but not its children) into this space, leaving
+         * a forwarding pointer behind, and returns its new location. Objects that are already
+         * moved or that do not need to be moved are returned as is, large objects reached by
+         * a major collection are marked.
+         *
+         * When hierarchical is set the first unmoved child of the object is moved right after
+         * it, and so on down the chain, so that linked structures end up adjacent in memory.
+         */
+        Ref evacuate(Ref r, bool young, bool hierarchical);
+        
+        /**
+         * Scans the objects of this space starting at the given position (Cheney scan) and
+         * evacuates the objects referenced from their slots until no new object is moved.
+         * During major collections objects still referring to nursery objects are remembered.
+         */
+        void scan(Ref* from, bool young, bool hierarchical);
+        
+        /**
+         * Copies the object graph reachable from r into this space and returns the new location
+         * of r. When young is set only nursery objects are copied (promoted), otherwise only old
+         * objects are copied. Handles are not touched, see Memory::evacuateRoots.
+         */
+        inline Ref copy(Ref r, bool young = false, bool hierarchical = false)
+        {
+            Ref* scanStart = free_;
+            Ref result = evacuate(r, young, hierarchical);
+            
+            scan(scanStart, young, hierarchical);
+            return result;
+        }
         
         inline int size() const
         {
@@ -119,6 +179,9 @@ namespace atom
         void* ptr_;
         Memory* mem_;
         
+        // Index of this handle in memory's root table, -1 if not registered.
+        int slot_;
+        
         void ptr(void* ptr);
         
         explicit PtrHandleBase(void* ptr, Memory* mem);      
@@ -150,14 +213,87 @@ namespace atom
         }
     };
 
+    /**
+     * Source of the contents of stub objects. A stub has the type and size of the object it
+     * stands for, so it can be referenced, typed and measured like the object, but its slots
+     * are not filled. The loader fills a stub in place the first time its contents are
+     * needed, see Memory::resolve. Stubs and the objects created by loaders are allocated in
+     * the old space.
+     */
+    struct LazyLoader
+    {
+        virtual ~LazyLoader()
+        {
+        }
+
+        /**
+         * Fills the stub and returns its location, which changes if loading collects.
+         */
+        virtual Ref load(Ref stub) = 0;
+
+        /**
+         * Called by major collections to evacuate the objects known to the loader.
+         */
+        virtual void evacuateRoots(MemSpace* space, bool hierarchical) = 0;
+    };
+
     struct Memory
     {
+        HeapPolicy policy_;
+        
+        // Objects are bump allocated in the nursery (if any) and promoted to the
+        // old space semispaces by minor collections.
+        MemSpace* nursery_;
         MemSpace* toSpace_;
         MemSpace* fromSpace_;
-        RefHandleList refHandles_;
-        PtrHandleList ptrHandles_;
         
+        // Root tables. Each registered handle knows its own index so that registering and
+        // unregistering are constant time operations.
+        RefHandleVec refHandles_;
+        PtrHandleVec ptrHandles_;
+        
+        // Frame stacks of the threads, their objects are updated like roots.
+        FrameStackVec frameStacks_;
+
+        // Old objects recorded by the write barrier since the last minor collection, their
+        // slots are roots of the next one. See rememberObject.
+        ObjectPtrVec remembered_;
+
+        // Objects of at least policy_.largeSize slots, they are marked and swept by major
+        // collections instead of being copied.
+        LargeObjectSpace large_;
+
+        // Managed byte arrays whose contents are allocated outside of the heap, the contents
+        // are freed when a collection finds the array dead.
+        ByteArrayVec externalPayloads_;
+
+        long minorCollections_;
+        long majorCollections_;
+
+        // Number of objects allocated in the heap, frames are not counted.
+        long allocations_;
+        
+        // If set, collections copy objects in approximately depth first order instead of
+        // breadth first order, see MemSpace::evacuate.
+        bool hierarchicalCopy_;
+        
+        // Decoded form of the verified bytecodes in this memory, see Thread::run.
+        CodeCache codeCache_;
+
+        // Native functions resolved from shared libraries, see fn_resolveFunction.
+        SymbolCache symbolCache_;
+        
+        // Running thread, a scheduler sets it to each thread it switches to.
         Thread* thread_;
+
+        // Isolate owning the memory, 0 if the memory is not run by an isolate.
+        Isolate* isolate_;
+
+        // Loader of the stubs in this memory, 0 if there are none.
+        LazyLoader* loader_;
+
+        // Profiler sampling the threads of this memory, 0 if they are not profiled.
+        Profiler* profiler_;
         
         // Metaobjects of known object types.
         RefHandle objectArrayMo_;
@@ -165,21 +301,46 @@ namespace atom
         RefHandle byteArrayMo_;
         RefHandle floatMo_;
 
-        Memory(word size)
-        : toSpace_(new MemSpace(size)), fromSpace_(new MemSpace(size)), thread_(0)
+        /**
+         * Creates a memory whose old space semispaces contain size slots each. If nurserySize
+         * is non-zero, new objects are allocated in a nursery of that many slots.
+         */
+        Memory(word size, word nurserySize = 0)
+        : policy_(size, nurserySize), nursery_(nurserySize > 0 ? new MemSpace(nurserySize) : 0), toSpace_(new MemSpace(size, this)),
+          fromSpace_(new MemSpace(size, this)), large_(this), minorCollections_(0), majorCollections_(0), allocations_(0), hierarchicalCopy_(false), thread_(0),
+          isolate_(0), loader_(0), profiler_(0)
         {
         }
-
-        ~Memory()
+        
+        /**
+         * Creates a memory whose semispaces start at the initial size of the policy and are
+         * resized after major collections as the policy dictates.
+         */
+        explicit Memory(HeapPolicy const& policy)
+        : policy_(policy), nursery_(policy.nurserySize > 0 ? new MemSpace(policy.nurserySize) : 0),
+          toSpace_(new MemSpace(policy.initialSize, this)), fromSpace_(new MemSpace(policy.initialSize, this)), large_(this),
+          minorCollections_(0), majorCollections_(0), allocations_(0), hierarchicalCopy_(false), thread_(0), isolate_(0), loader_(0), profiler_(0)
         {
-            delete toSpace_;
-            delete fromSpace_;
         }
+
+        ~Memory();
+
+        /**
+         * Returns the current memory of the calling OS thread, 0 if there is none. See
+         * CurrentMemoryScope.
+         */
+        static Memory* current();
+
+        /**
+         * Returns the memory whose old space or large object space contains the object, 0 if
+         * there is none.
+         */
+        static Memory* owner(ObjectBase* ob);
         
         template <typename T>
         T* ptrcopy(T* t)
         {
-            return cast<T>(toSpace_->copy(ptr2ref(t), refHandles_, ptrHandles_));
+            return cast<T>(toSpace_->copy(ptr2ref(t), false, hierarchicalCopy_));
         }
 
         inline Ref findMetaObject(Ref target)
@@ -189,6 +350,11 @@ namespace atom
                 return integerMo_.ref();
             }
 
+            if(is_immediate_float(target))
+            {
+                return floatMo_.ref();
+            }
+
             switch(obj_type(target))
             {
                 case ObjectType::OBJECT: return cast<Object>(target)->metaObject_;
@@ -201,10 +367,93 @@ namespace atom
             return target;
         }
 
+        /**
+         * Loads the contents of r if it refers to a stub and returns its location. Loading
+         * may collect, so other references held across the call must be handles.
+         */
+        inline Ref resolve(Ref r)
+        {
+            return is_stub(r) ? loader_->load(r) : r;
+        }
+
+        /**
+         * Allocates the slots of a single object, in the nursery if there is one unless the
+         * object is large.
+         */
         Ref* alloc(int slotCount);
+        Ref* allocOld(int slotCount);
+        Ref* allocLarge(int slotCount);
+        
+        /**
+         * Runs a full collection, afterwards all live objects reside in to space.
+         */
         void flipSpaces();
         
+        /**
+         * Promotes the live nursery objects into the old space.
+         */
+        void collectNursery();
+        
+        /**
+         * Collects the old space, nursery objects are treated as roots and are not moved.
+         * Resizes the semispaces according to the heap policy and makes sure that at least
+         * required slots can be allocated afterwards.
+         *
+         * @throw memory_exhausted_error if required slots are not available even at maximum heap size
+         */
+        void collectOld(word required);
+        
+        /**
+         * Scans to space from the given position and the slots of the marked large objects
+         * until no more objects are moved or marked.
+         */
+        void scanOld(Ref* from);
+
+        /**
+         * Evacuates the objects referenced from the slots of the given object.
+         */
+        void evacuateSlots(ObjectBase* holder, bool young);
+        
+        /**
+         * Evacuates the objects referenced by the registered handles and frame stacks into the
+         * given space and updates the handles, frames and loader with the new locations. The children of the evacuated objects
+         * are moved by a following MemSpace::scan.
+         */
+        void evacuateRoots(MemSpace* space, bool young);
+
+        /**
+         * Called by a collection after the live objects of the given space are evacuated.
+         * Follows the moved arrays with external payloads and frees the payloads of the dead ones.
+         */
+        void updateExternalPayloads(MemSpace* space);
+
+        inline void registerExternalPayload(ByteArray* ba)
+        {
+            externalPayloads_.push_back(ba);
+        }
+
+        inline void initHeader(ObjectHeader* oh, int type, uword size)
+        {
+            // Set by the large object space when the slots are allocated.
+            const bool large = oh->large;
+
+            oh->init(type, size);
+            oh->young = nursery_ != 0 && nursery_->containsPtr(oh);
+            oh->large = large;
+        }
+
+        /**
+         * Returns true if the object is allocated in nursery.
+         */
+        inline bool isYoung(Ref r) const
+        {
+            return nursery_ != 0 && nursery_->contains(r);
+        }
+        
         Ref createPrim(int type, void* ptr, uword size, bool managed);
+        /**
+         * Returns d as an immediate float if it fits, otherwise in a new FloatObject.
+         */
         Ref createFloat(double d);
         Ref createObject(uword size, int type);
 
@@ -230,6 +479,14 @@ namespace atom
             return createUnmanagedPrim(ObjectType::NATIVE_FUNCTION, (void*) ptr, 0);
         }
 
+        /**
+         * @param signature encoded by NativeSignature::parse
+         */
+        inline Ref createDirectNativeFunction(NativeFunction::DirectFunT ptr, uword signature)
+        {
+            return createPrim(ObjectType::NATIVE_FUNCTION, (void*) ptr, signature, false);
+        }
+
         inline Ref createUnmanagedPrim(int type, void* ptr, int size)
         {
             return createPrim(type, ptr, size, false);
@@ -261,11 +518,11 @@ namespace atom
             return oa;
         }
     
-        inline Ref createManagedByteArray(word size)
-        {
-            byte* b = new byte[size];
-            return createManagedPrim(ObjectType::BYTE_ARRAY, b, size);
-        }
+        /**
+         * Creates a byte array owning its contents. Contents of up to MAX_INLINE_SIZE bytes
+         * are allocated together with the array, larger ones separately.
+         */
+        Ref createManagedByteArray(word size);
 
         inline Ref createUnmanagedByteArray(byte* data, word size)
         {
@@ -302,24 +559,60 @@ namespace atom
         
         void registerRefHandle(RefHandle* refHandle)
         {
+            refHandle->slot_ = refHandles_.size();
             refHandles_.push_back(refHandle);
         }
         
         void unregisterRefHandle(RefHandle* refHandle)
         {
-            refHandles_.remove(refHandle);
+            RefHandle* last = refHandles_.back();
+            
+            refHandles_[refHandle->slot_] = last;
+            last->slot_ = refHandle->slot_;
+            refHandles_.pop_back();
+            refHandle->slot_ = -1;
         }
         
         void registerPtrHandle(PtrHandleBase* ptrHandle)
         {
+            ptrHandle->slot_ = ptrHandles_.size();
             ptrHandles_.push_back(ptrHandle);
         }
         
         void unregisterPtrHandle(PtrHandleBase* ptrHandle)
         {
-            ptrHandles_.remove(ptrHandle);
+            PtrHandleBase* last = ptrHandles_.back();
+            
+            ptrHandles_[ptrHandle->slot_] = last;
+            last->slot_ = ptrHandle->slot_;
+            ptrHandles_.pop_back();
+            ptrHandle->slot_ = -1;
+        }
+        
+        void registerFrameStack(FrameStack* frames)
+        {
+            frameStacks_.push_back(frames);
+        }
+        
+        void unregisterFrameStack(FrameStack* frames)
+        {
+            frameStacks_.erase(std::find(frameStacks_.begin(), frameStacks_.end(), frames));
         }
     };    
+
+    /**
+     * Makes a memory the current memory of the calling OS thread while in scope and restores
+     * the previous one afterwards. The write barrier looks for the owner of an object in the
+     * current memory before searching the others. A memory is current while one of its
+     * threads runs, while its isolate runs and while it is collected.
+     */
+    struct CurrentMemoryScope
+    {
+        Memory* previous_;
+
+        explicit CurrentMemoryScope(Memory* memory);
+        ~CurrentMemoryScope();
+    };
 }
 
 #endif /* ATOM_MEMORY_HPP_INCLUDED */
@@ -23,6 +23,55 @@ namespace atom
         ObjectHeader header_;
     };
 
+    /**
+     * Records an old object that has been made to point to a nursery object, so the
+     * next minor collection treats its slots as roots. Defined in Memory.cpp.
+     */
+    void rememberObject(ObjectBase* holder);
+
+    /**
+     * Generational write barrier. Must be executed for every reference stored into
+     * a slot of a heap object.
+     */
+    inline void writeBarrier(ObjectBase* holder, Ref ref)
+    {
+        if(holder->header_.young || holder->header_.remembered || is_immediate(ref))
+        {
+            return;
+        }
+
+        ObjectBase* target = cast<ObjectBase>(ref);
+
+        if(target != 0 && target->header_.young)
+        {
+            rememberObject(holder);
+        }
+    }
+
+    /**
+     * Must be executed whenever a slot of an object is changed. A function needs to be
+     * verified again after any of its slots change, see Verifier.hpp.
+     */
+    inline void slotsChanged(ObjectBase* ob)
+    {
+        ob->header_.verified = 0;
+        ob->header_.unverifiable = 0;
+    }
+
+    /**
+     * Must be executed whenever the contents of a byte array change. Functions verified
+     * against the previous contents of verified bytecodes cannot be found from the byte
+     * array, so such bytecodes are never trusted again.
+     */
+    inline void bytesChanged(ObjectBase* ob)
+    {
+        if(ob->header_.verified)
+        {
+            ob->header_.verified = 0;
+            ob->header_.unverifiable = 1;
+        }
+    }
+
     struct PrimDataObject : public ObjectBase
     {
 #if defined ATOM_VM_64BITS
@@ -70,7 +119,11 @@ namespace atom
 
         inline void atPut(int idx, Ref ref)
         {
-            *(refAt(idx)) = ref;
+            Ref* slot = refAt(idx);
+
+            writeBarrier(this, ref);
+            slotsChanged(this);
+            *slot = ref;
         }
 
         inline Ref at(int idx)
@@ -78,11 +131,28 @@ namespace atom
             return *(refAt(idx));
         }
 
+        /**
+         * Returns the first element without any bounds checking.
+         */
+        inline Ref* elements()
+        {
+            return ((Ref*) this) + sizeof(ObjectHeader) / sizeof(Ref);
+        }
+
+        /**
+         * Stores ref into one of the named slots of this object.
+         */
+        inline void setSlot(Ref& slot, Ref ref)
+        {
+            writeBarrier(this, ref);
+            slot = ref;
+        }
+
     private:
         inline Ref* refAt(int idx)
         {
             checkArrayIndex(this, idx);
-            return ((Ref*) this) + sizeof(ObjectHeader) / sizeof(Ref) + idx;
+            return elements() + idx;
         }
     };
 
@@ -123,22 +193,45 @@ namespace atom
     };
 
     /**
-     * @warning Assumes ref is a float.
+     * @warning Assumes ref is a float, immediate or boxed.
      */
     inline double float_val(Ref ref)
     {
-        return cast<FloatObject>(ref)->value_;
+        return is_immediate_float(ref) ? immediate_float_val(ref) : cast<FloatObject>(ref)->value_;
     }
 
     struct ByteArray : public PrimDataObject
     {
         static const int type = ObjectType::BYTE_ARRAY;
 
+        // Managed byte arrays of at most this many bytes keep their contents in the heap
+        // right after the array, see Memory::createManagedByteArray.
+        static const word MAX_INLINE_SIZE = 1024;
+
+        /**
+         * Returns the slot count of a managed byte array of the given size.
+         */
+        static inline word heapSlots(word size)
+        {
+            const word slots = sizeof(PrimDataObject) / sizeof(Ref);
+            return size > MAX_INLINE_SIZE ? slots : slots + (size + sizeof(Ref) - 1) / sizeof(Ref);
+        }
+
         inline byte* data() const
         {
             return (byte*) data_;
         }
 
+        inline byte* inlineData()
+        {
+            return (byte*) (this + 1);
+        }
+
+        inline bool hasInlineData()
+        {
+            return managed_ && data_ == inlineData();
+        }
+
         inline Ref at(int idx)
         {
             checkArrayIndex(this, idx);
@@ -154,6 +247,7 @@ namespace atom
                 throw invalid_bytearray_element_error();
             }
 
+            bytesChanged(this);
             data()[idx] = int_val(byteVal);
         }
     };
@@ -161,20 +255,144 @@ namespace atom
     class Thread;
 
     /**
-     * The function pointed by the funaddr_ must have the signature:
+     * Signature of a direct native, one that receives its arguments instead of a message.
+     * It is written as a string with a character for the type of each argument:
+     *
+     * 'r' any reference, 'i' integer, 'f' float, 'b' byte array, 'a' object array
      *
-     * Ref fun(Ref, Ref)
+     * and is encoded into the size field of the native. Bit 0 marks a direct native, the
+     * next 3 bits hold the argument count and each argument type takes 3 bits after them.
+     */
+    namespace NativeSignature
+    {
+        enum
+        {
+            ANY,
+            INTEGER,
+            FLOAT,
+            BYTE_ARRAY,
+            OBJECT_ARRAY
+        };
+
+        enum
+        {
+            MAX_ARGS = 6
+        };
+
+        /**
+         * Encodes a signature string, returns false if it is not valid.
+         */
+        inline bool parse(char const* str, uword& signature)
+        {
+            int count = 0;
+
+            signature = 1;
+
+            for(; str[count] != '\0'; ++count)
+            {
+                uword type;
+
+                switch(str[count])
+                {
+                    case 'r': type = ANY; break;
+                    case 'i': type = INTEGER; break;
+                    case 'f': type = FLOAT; break;
+                    case 'b': type = BYTE_ARRAY; break;
+                    case 'a': type = OBJECT_ARRAY; break;
+                    default: return false;
+                }
+
+                if(count == MAX_ARGS)
+                {
+                    return false;
+                }
+
+                signature |= type << (4 + 3 * count);
+            }
+
+            signature |= (uword) count << 1;
+            return true;
+        }
+
+        inline int arity(uword signature)
+        {
+            return (signature >> 1) & 7;
+        }
+
+        inline int argType(uword signature, int idx)
+        {
+            return (signature >> (4 + 3 * idx)) & 7;
+        }
+
+        inline bool accepts(int type, Ref arg)
+        {
+            switch(type)
+            {
+                case INTEGER: return is_int(arg);
+                case FLOAT: return is_float(arg);
+                case BYTE_ARRAY: return is_byte_array(arg);
+                case OBJECT_ARRAY: return is_object_array(arg);
+            }
+
+            return true;
+        }
+    }
+
+    /**
+     * The function pointed by data_ is called with the thread, the temp receiving the result
+     * or -1, and the message. Direct natives are called with their arguments instead, see
+     * NativeSignature and Thread::callNative.
      */
     struct NativeFunction : public PrimDataObject
     {
         static const int type = ObjectType::NATIVE_FUNCTION;
 
         typedef void (*FunT)(Thread*, int resultTmp, Ref);
+        typedef void (*DirectFunT)(Thread*, int resultTmp, Ref const* args);
 
         inline void call(Thread* thread, int resultTmp, Ref message) const
         {
             ((FunT) data_)(thread, resultTmp, message);
         }
+
+        inline bool isDirect() const
+        {
+            return size_ != 0;
+        }
+
+        /**
+         * Returns the argument count of a direct native, -1 for other natives.
+         */
+        inline int arity() const
+        {
+            return isDirect() ? NativeSignature::arity(size_) : -1;
+        }
+
+        /**
+         * @pre isDirect() and args holds arity() arguments
+         */
+        inline bool accepts(Ref const* args) const
+        {
+            const int count = arity();
+
+            for(int i = 0; i < count; ++i)
+            {
+                if(!NativeSignature::accepts(NativeSignature::argType(size_, i), args[i]))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * @pre accepts(args)
+         */
+        inline void callDirect(Thread* thread, int resultTmp, Ref const* args) const
+        {
+            ((DirectFunT) data_)(thread, resultTmp, args);
+        }
     };
 
     struct CallContext : public RefArrayObjectBase<ObjectType::OBJECT_ARRAY>
@@ -189,9 +407,9 @@ namespace atom
         
         inline CallContext* initNew(RefHandle const& parent, RefHandle const& exceptionHandler, RefHandle const& exceptionObject)
         {
-            parent_ = parent.ref();
-            exceptionHandler_ = exceptionHandler.ref();
-            exceptionObject_ = exceptionObject.ref();
+            setSlot(parent_, parent.ref());
+            setSlot(exceptionHandler_, exceptionHandler.ref());
+            setSlot(exceptionObject_, exceptionObject.ref());
             
             return this;
         }
@@ -203,8 +421,8 @@ namespace atom
                 throw invalid_bytecodes_ref_error();
             }
             
-            bytecodes_ = bytecodes;
-            temps_ = ptr2ref(temps);
+            setSlot(bytecodes_, bytecodes);
+            setSlot(temps_, ptr2ref(temps));
             ip_ = word2ref(ip);
             
             return this;
@@ -17,11 +17,11 @@
 namespace atom
 {
 #if defined ATOM_VM_64BITS
-#define SIZE_BITS 60
+#define SIZE_BITS 53
 #endif
 
 #if defined ATOM_VM_32BITS
-#define SIZE_BITS 28
+#define SIZE_BITS 21
 #endif
 
 #if defined ATOM_LITTLE_ENDIAN
@@ -29,7 +29,7 @@ namespace atom
     struct ForwardedObjectHeader
     {
         atom_uint64_t mark    : 1;
-        atom_uint64_t realPtr : SIZE_BITS + 3;
+        atom_uint64_t realPtr : SIZE_BITS + 10;
 
         inline bool isForwarded() const
         {
@@ -50,9 +50,16 @@ namespace atom
 
     struct ObjectHeader
     {
-        atom_uint64_t mark    : 1;
-        atom_uint64_t objtype : 3;
-        atom_uint64_t size    : SIZE_BITS;
+        atom_uint64_t mark         : 1;
+        atom_uint64_t objtype      : 3;
+        atom_uint64_t young        : 1;  // Object resides in the nursery.
+        atom_uint64_t remembered   : 1;  // Object is recorded in the remembered set.
+        atom_uint64_t verified     : 1;  // Code passed verification, see Verifier.hpp.
+        atom_uint64_t unverifiable : 1;  // Verification must not be attempted (again).
+        atom_uint64_t frame        : 1;  // Object resides in a frame stack, see FrameStack.hpp.
+        atom_uint64_t stub         : 1;  // Contents are not loaded yet, see LazyLoader.
+        atom_uint64_t large        : 1;  // Object resides in the large object space.
+        atom_uint64_t size         : SIZE_BITS;
 
         inline bool isMarked() const
         {
@@ -72,6 +79,13 @@ namespace atom
         inline void init(int ty, int sz)
         {
             clearMark();
+            young = 0;
+            remembered = 0;
+            verified = 0;
+            unverifiable = 0;
+            frame = 0;
+            stub = 0;
+            large = 0;
             objtype = ty;
             size = sz;
         }
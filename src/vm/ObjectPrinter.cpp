@@ -81,6 +81,10 @@ void dumpObject(Ref ref, RefVec& dumped)
     {
         std::cout << int_val(ref);
     }
+    else if(is_immediate_float(ref))
+    {
+        std::cout << "float: " << float_val(ref);
+    }
     else
     {
         if(isDumped(dumped, ref))
@@ -35,7 +35,17 @@ namespace atom
             RAISE_EXCEPTION           = 13, // raise t                 format: opcode, exceptionobject
             JUMP                      = 14, // jmp t                   format: opcode, newiptmp
             SET_LOCAL                 = 15, // set t t                 format: opcode, targettmp, srctmp
-            MAX_OPCODE                = 15, // -- marker --
+            META_ARGS                 = 16, // margs t t               format: opcode, targettmp, realmsgtmp
+            ADD                       = 17, // add t t with t > t      format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            SUBTRACT                  = 18, // sub t t with t > t      format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            MULTIPLY                  = 19, // mul t t with t > t      format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            DIVIDE                    = 20, // div t t with t > t      format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            MODULO                    = 21, // mod t t with t > t      format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            LESS_THAN                 = 22, // lt t t with t > t       format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            GREATER_THAN              = 23, // gt t t with t > t       format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            EQUAL                     = 24, // eq t t with t > t       format: opcode, lhstmp, rhstmp, handlertmp, resulttmp
+            CALL_NATIVE               = 25, // call t ([t]) > t        format: opcode, argcount, fntmp, arg0, arg1, ..., argn, resulttmp
+            MAX_OPCODE                = 25, // -- marker --
         };
 
         inline bool isValid(int opcode)
@@ -45,7 +55,7 @@ namespace atom
 
         inline bool isVariableLength(int opcode)
         {
-            return opcode == CREATE_OBJECT_ARRAY || opcode == CREATE_OBJECT;
+            return opcode == CREATE_OBJECT_ARRAY || opcode == CREATE_OBJECT || opcode == CALL_NATIVE;
         }
 
         inline bool isConditional(int opcode)
@@ -57,6 +67,26 @@ namespace atom
         {
             return opcode == RETURN || opcode == RETURN_RESULT;
         }
+
+        /**
+         * Arithmetic and comparison instructions compute their result directly when both
+         * operands are integers and the result is an integer too. Otherwise they send an
+         * object array of the two operands to the handler, like a send with a result does.
+         */
+        inline bool isArithmetic(int opcode)
+        {
+            return opcode >= ADD && opcode <= EQUAL;
+        }
+
+        /**
+         * A native call passes its arguments to a direct native (see NativeSignature) that
+         * takes as many arguments without creating a message. Otherwise the arguments are sent
+         * to the function, the argument itself if there is one, an object array of them if not.
+         */
+        inline bool isNativeCall(int opcode)
+        {
+            return opcode == CALL_NATIVE;
+        }
         
         /*
          * @pre isValid(opcode) == true
@@ -81,6 +111,16 @@ namespace atom
                 case RAISE_EXCEPTION             : return 2;
                 case JUMP                        : return 2;
                 case SET_LOCAL                   : return 3;
+                case META_ARGS                   : return 3;
+                case ADD                         : return 5;
+                case SUBTRACT                    : return 5;
+                case MULTIPLY                    : return 5;
+                case DIVIDE                      : return 5;
+                case MODULO                      : return 5;
+                case LESS_THAN                   : return 5;
+                case GREATER_THAN                : return 5;
+                case EQUAL                       : return 5;
+                case CALL_NATIVE                 : return 4 + byte1;
             }
 
             throw invalid_opcode_error();
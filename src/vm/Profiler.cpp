@@ -0,0 +1,293 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "Profiler.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <sstream>
+#include <stdexcept>
+
+// Older C libraries do not name the thread id of a signal event.
+#if !defined sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+using namespace atom;
+
+namespace
+{
+    // Profiler sampling the OS thread that receives a SIGPROF.
+    __thread Profiler* activeProfiler = 0;
+
+    // Frame name of samples without any function context.
+    char const* const VM_FRAME = "[vm]";
+
+    // Frame name of a context pushed for a function whose code is not set yet.
+    char const* const ENTER_FRAME = "[enter]";
+} // namespace <anonymous>
+
+namespace atom
+{
+    Profiler::Profiler(Memory* memory, int rate, bool ips)
+    : samples_(0), dropped_(0), memory_(memory), rate_(rate), ips_(ips), head_(0), tail_(0),
+      ring_(new Sample[RING_SIZE]), collecting_(0), running_(false)
+    {
+        memory_->profiler_ = this;
+    }
+
+    Profiler::~Profiler()
+    {
+        stop();
+        memory_->profiler_ = 0;
+        delete[] ring_;
+    }
+
+    void Profiler::name(RefHandle fn, std::string const& name)
+    {
+        names_.push_back(std::make_pair(fn, name));
+    }
+
+    void Profiler::start()
+    {
+        if(running_)
+        {
+            return;
+        }
+
+        struct sigaction action;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &Profiler::handleSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+
+        if(sigaction(SIGPROF, &action, 0) != 0)
+        {
+            throw std::runtime_error("cannot install the profiler signal handler");
+        }
+
+        // The timer measures and interrupts the calling OS thread only, so each isolate
+        // can be profiled separately.
+        struct sigevent event;
+
+        memset(&event, 0, sizeof(event));
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+        event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+        if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer_) != 0)
+        {
+            throw std::runtime_error(std::string("cannot create the profiler timer: ") + strerror(errno));
+        }
+
+        activeProfiler = this;
+
+        struct itimerspec interval;
+        const long period = 1000000000L / rate_;
+
+        interval.it_interval.tv_sec = period / 1000000000L;
+        interval.it_interval.tv_nsec = period % 1000000000L;
+        interval.it_value = interval.it_interval;
+
+        if(timer_settime(timer_, 0, &interval, 0) != 0)
+        {
+            activeProfiler = 0;
+            timer_delete(timer_);
+            throw std::runtime_error(std::string("cannot start the profiler timer: ") + strerror(errno));
+        }
+
+        running_ = true;
+    }
+
+    void Profiler::stop()
+    {
+        if(!running_)
+        {
+            return;
+        }
+
+        timer_delete(timer_);
+        running_ = false;
+
+        if(activeProfiler == this)
+        {
+            activeProfiler = 0;
+        }
+
+        drain();
+    }
+
+    void Profiler::handleSignal(int signal, siginfo_t* info, void* context)
+    {
+        const int savedErrno = errno;
+
+        if(activeProfiler != 0)
+        {
+            activeProfiler->sample();
+        }
+
+        errno = savedErrno;
+    }
+
+    void Profiler::sample()
+    {
+        const uword head = head_;
+
+        if(head - __atomic_load_n(&tail_, __ATOMIC_ACQUIRE) >= RING_SIZE)
+        {
+            ++dropped_;
+            return;
+        }
+
+        Sample& sample = ring_[head & (RING_SIZE - 1)];
+        Thread* thread = memory_->thread_;
+
+        sample.depth = 0;
+
+        if(collecting_ != 0)
+        {
+            sample.depth = -1;
+        }
+        else if(thread != 0 && thread->cc_ != 0)
+        {
+            CallContext* cc = thread->cc_;
+            Ref end = thread->nullArray_.ref();
+
+            // The outermost context runs the initial send of the thread and is left out.
+            // Contexts are only followed while they are frames, a context being pushed
+            // or popped may be seen half done.
+            while(sample.depth < MAX_DEPTH && cc->parent_ != end)
+            {
+                Ref parent = cc->parent_;
+
+                sample.bytecodes[sample.depth] = cc->bytecodes_;
+                sample.ips[sample.depth] = cc->ip_;
+                ++sample.depth;
+
+                if(is_immediate(parent) || !cast<ObjectBase>(parent)->header_.frame)
+                {
+                    break;
+                }
+
+                cc = cast<CallContext>(parent);
+            }
+        }
+
+        __atomic_store_n(&head_, head + 1, __ATOMIC_RELEASE);
+    }
+
+    void Profiler::drain()
+    {
+        const uword head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+        uword tail = tail_;
+
+        if(tail == head)
+        {
+            return;
+        }
+
+        // Functions are found by the current addresses of their bytecodes.
+        std::map<void*, std::string> functions;
+
+        for(NameVec::const_iterator it = names_.begin(); it != names_.end(); ++it)
+        {
+            Ref fn = it->first.ref();
+
+            if(is_simple_fn(fn) && !is_stub(fn))
+            {
+                functions[ptr_val(cast<SimpleFunction>(fn)->bytecodes_)] = it->second;
+            }
+        }
+
+        for(; tail != head; ++tail)
+        {
+            Sample const& sample = ring_[tail & (RING_SIZE - 1)];
+            std::ostringstream stack;
+
+            if(sample.depth == -1)
+            {
+                stack << "[gc]";
+            }
+            else if(sample.depth == 0)
+            {
+                stack << VM_FRAME;
+            }
+
+            for(int i = sample.depth - 1; i >= 0; --i)
+            {
+                std::map<void*, std::string>::const_iterator found = functions.find(ptr_val(sample.bytecodes[i]));
+
+                if(i != sample.depth - 1)
+                {
+                    stack << ';';
+                }
+
+                if(found != functions.end())
+                {
+                    stack << found->second;
+                }
+                else if(sample.bytecodes[i] == zeroRef())
+                {
+                    stack << ENTER_FRAME;
+                }
+                else
+                {
+                    stack << "code@" << ptr_val(sample.bytecodes[i]);
+                }
+
+                if(ips_ && is_int(sample.ips[i]))
+                {
+                    stack << ':' << int_val(sample.ips[i]);
+                }
+            }
+
+            ++stacks_[stack.str()];
+            ++samples_;
+        }
+
+        __atomic_store_n(&tail_, tail, __ATOMIC_RELEASE);
+    }
+
+    void Profiler::enterCollection()
+    {
+        if(collecting_++ == 0)
+        {
+            drain();
+        }
+    }
+
+    void Profiler::leaveCollection()
+    {
+        --collecting_;
+    }
+
+    void Profiler::add(Profiler const& other)
+    {
+        for(StackMap::const_iterator it = other.stacks_.begin(); it != other.stacks_.end(); ++it)
+        {
+            stacks_[it->first] += it->second;
+        }
+
+        samples_ += other.samples_;
+        dropped_ += other.dropped_;
+    }
+
+    void Profiler::writeCollapsed(std::ostream& os) const
+    {
+        for(StackMap::const_iterator it = stacks_.begin(); it != stacks_.end(); ++it)
+        {
+            os << it->first << ' ' << it->second << '\n';
+        }
+    }
+} // namespace atom
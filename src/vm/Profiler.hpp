@@ -0,0 +1,159 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_PROFILER_HPP_INCLUDED
+#define ATOM_PROFILER_HPP_INCLUDED
+
+#include "Thread.hpp"
+
+#include <signal.h>
+#include <time.h>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace atom
+{
+    /**
+     * Sampling profiler of the threads of a memory. A timer measuring the CPU time of the OS
+     * thread that started the profiler raises SIGPROF at a fixed rate and the signal handler
+     * records the chain of call contexts of the running thread into a ring buffer.
+     *
+     * A sample holds the bytecodes and the instruction pointer of each context. Objects move
+     * during collections, so the samples are resolved to function names before each
+     * collection and at the end of each time slice of a scheduler (see drain()), which are
+     * the only places that read the buffer. Samples taken during a collection are recorded
+     * as [gc] and contexts being entered, before their code is set, as [enter].
+     *
+     * The instruction pointer of the innermost context is the one saved by its last send,
+     * return or allocation, Thread::run keeps the current one in a local.
+     */
+    class Profiler
+    {
+    public:
+        enum
+        {
+            // Contexts recorded per sample, deeper ones are left out.
+            MAX_DEPTH = 64,
+
+            // Samples the buffer holds, a power of two.
+            RING_SIZE = 1024,
+
+            DEFAULT_RATE = 1000
+        };
+
+        struct Sample
+        {
+            // Number of contexts, innermost first, -1 for samples taken during a collection.
+            int depth;
+            Ref bytecodes[MAX_DEPTH];
+            Ref ips[MAX_DEPTH];
+        };
+
+        // Samples resolved to collapsed stacks and dropped because the buffer was full.
+        long samples_;
+        long dropped_;
+
+    private:
+        typedef std::vector<std::pair<RefHandle, std::string> > NameVec;
+        typedef std::map<std::string, long> StackMap;
+
+        Memory* memory_;
+        int rate_;
+
+        // Set to write frames with their instruction pointers.
+        bool ips_;
+
+        // Written by the signal handler only, the next sample to write.
+        uword head_;
+
+        // Written by drain() only, the next sample to resolve.
+        uword tail_;
+
+        Sample* ring_;
+
+        // Nesting depth of collections.
+        volatile sig_atomic_t collecting_;
+
+        bool running_;
+        timer_t timer_;
+
+        NameVec names_;
+        StackMap stacks_;
+
+        static void handleSignal(int signal, siginfo_t* info, void* context);
+
+        Profiler(Profiler const&);
+        Profiler& operator=(Profiler const&);
+
+    public:
+        /**
+         * Creates a profiler for the threads of the memory and sets it as its profiler.
+         *
+         * @param rate samples per second of CPU time
+         * @param ips whether frames are written as name:ip instead of name
+         */
+        Profiler(Memory* memory, int rate = DEFAULT_RATE, bool ips = false);
+
+        /**
+         * Stops the profiler and unsets it as the profiler of the memory.
+         */
+        ~Profiler();
+
+        /**
+         * Names the given simple function in the stacks.
+         */
+        void name(RefHandle fn, std::string const& name);
+
+        /**
+         * Starts sampling the threads of the memory run by the calling OS thread.
+         */
+        void start();
+
+        /**
+         * Stops sampling and resolves the remaining samples.
+         */
+        void stop();
+
+        /**
+         * Records the contexts of the running thread. Called by the signal handler, must
+         * only be called from the OS thread running the memory.
+         */
+        void sample();
+
+        /**
+         * Resolves the recorded samples to stacks of function names. Functions that are not
+         * named are written as the address of their bytecodes at the time of the drain.
+         */
+        void drain();
+
+        /**
+         * Called by Memory when a collection starts and finishes.
+         */
+        void enterCollection();
+        void leaveCollection();
+
+        /**
+         * Adds the stacks of another profiler to these.
+         */
+        void add(Profiler const& other);
+
+        /**
+         * Writes a line for each distinct stack, its frames from the outermost function to
+         * the innermost separated by semicolons and followed by the number of samples, the
+         * input format of flame graph tools.
+         */
+        void writeCollapsed(std::ostream& os) const;
+    };
+} // namespace atom
+
+#endif /* ATOM_PROFILER_HPP_INCLUDED */
@@ -18,6 +18,7 @@
 #include "Exceptions.hpp"
 
 #include <cassert>
+#include <cstring>
 
 namespace atom
 {
@@ -42,6 +43,11 @@ typedef atom_uint32_t uword;
 
 #endif // defined ATOM_VM_32BITS
 
+/**
+ * A reference is either a pointer to an object (is_int_ clear) or an immediate value
+ * (is_int_ set). Immediate values with arr_acc_ clear are integers and ones with arr_acc_
+ * set are floats, see double2ref.
+ */
 struct Ref
 {
     uword is_int_  : 1;
@@ -53,7 +59,8 @@ struct Ref
 
 inline bool operator==(Ref const& lhs, Ref const& rhs)
 {
-    return lhs.is_int_ == rhs.is_int_ && lhs.data_ == rhs.data_;
+    // The array access bit of a pointer does not change the object it refers to.
+    return lhs.is_int_ == rhs.is_int_ && lhs.data_ == rhs.data_ && (lhs.is_int_ == 0 || lhs.arr_acc_ == rhs.arr_acc_);
 }
 
 inline bool operator!=(Ref const& lhs, Ref const& rhs)
@@ -84,7 +91,7 @@ inline word int_val(Ref ref)
 
 inline bool array_access(Ref ref)
 {
-    return ref.arr_acc_ == 1;
+    return ref.is_int_ == 0 && ref.arr_acc_ == 1;
 }
 
 inline Ref set_array_access(Ref ref)
@@ -114,10 +121,99 @@ inline void* ptr_val(Ref ref)
 }
 
 inline bool is_int(Ref ref)
+{
+    return ref.is_int_ == 1 && ref.arr_acc_ == 0;
+}
+
+/**
+ * Returns true if ref holds its value instead of referring to an object. Collections,
+ * handles and object stores leave these refs as they are.
+ */
+inline bool is_immediate(Ref ref)
 {
     return ref.is_int_ == 1;
 }
 
+inline bool is_immediate_float(Ref ref)
+{
+    return ref.is_int_ == 1 && ref.arr_acc_ == 1;
+}
+
+#if defined ATOM_VM_64BITS
+
+namespace ImmediateFloat
+{
+    // Doubles whose biased exponent is above MIN_EXPONENT and below MIN_EXPONENT + 512
+    // (magnitudes between 2^-255 and 2^256) and zeros fit in the 62 data bits: the double is
+    // rotated to bring the sign to the lowest bit and the exponent is rebased to 9 bits.
+    // Other values, including infinities, NaNs and denormals, are boxed in FloatObjects.
+    static const atom_uint64_t MIN_EXPONENT = 1023 - 256;
+    static const atom_uint64_t EXPONENT_BASE = MIN_EXPONENT << 53;
+}
+
+/**
+ * Encodes d as an immediate float if its magnitude fits, returns false otherwise.
+ */
+inline bool double2ref(double d, Ref& ref)
+{
+    atom_uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+
+    const atom_uint64_t rotated = (bits << 1) | (bits >> 63);
+    const atom_uint64_t exponent = rotated >> 53;
+    atom_uint64_t payload;
+
+    if(rotated <= 1)
+    {
+        payload = rotated;
+    }
+    else if(exponent > ImmediateFloat::MIN_EXPONENT && exponent < ImmediateFloat::MIN_EXPONENT + 512)
+    {
+        payload = rotated - ImmediateFloat::EXPONENT_BASE;
+    }
+    else
+    {
+        return false;
+    }
+
+    ref.is_int_ = 1;
+    ref.arr_acc_ = 1;
+    ref.data_ = payload;
+
+    return true;
+}
+
+/**
+ * @warning Assumes ref is an immediate float.
+ */
+inline double immediate_float_val(Ref ref)
+{
+    // The data bits are sign extended, the payload is not signed.
+    const atom_uint64_t payload = ((atom_uint64_t) ref.data_) & ((((atom_uint64_t) 1) << 62) - 1);
+    const atom_uint64_t rotated = payload <= 1 ? payload : payload + ImmediateFloat::EXPONENT_BASE;
+    const atom_uint64_t bits = (rotated >> 1) | (rotated << 63);
+
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+
+    return d;
+}
+
+#else
+
+// Immediate floats need the data bits of a 64 bit ref, every float is boxed.
+inline bool double2ref(double, Ref&)
+{
+    return false;
+}
+
+inline double immediate_float_val(Ref)
+{
+    return 0;
+}
+
+#endif // defined ATOM_VM_64BITS
+
 inline Ref clear_array_access(Ref ref)
 {    
     if(array_access(ref))
@@ -153,32 +249,43 @@ inline int obj_type(Ref ref)
 
 inline bool is_native_fn(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::NATIVE_FUNCTION;
+    return !is_immediate(ref) && obj_type(ref) == ObjectType::NATIVE_FUNCTION;
 }
 
 inline bool is_simple_fn(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::SIMPLE_FUNCTION;
+    return !is_immediate(ref) && obj_type(ref) == ObjectType::SIMPLE_FUNCTION;
 }
 
 inline bool is_object(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::OBJECT;
+    return !is_immediate(ref) && obj_type(ref) == ObjectType::OBJECT;
 }
 
 inline bool is_object_array(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::OBJECT_ARRAY;
+    return !is_immediate(ref) && obj_type(ref) == ObjectType::OBJECT_ARRAY;
 }
 
 inline bool is_byte_array(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::BYTE_ARRAY;
+    return !is_immediate(ref) && obj_type(ref) == ObjectType::BYTE_ARRAY;
 }
 
+/**
+ * Returns true for both immediate and boxed floats.
+ */
 inline bool is_float(Ref ref)
 {
-    return !is_int(ref) && obj_type(ref) == ObjectType::FLOAT;
+    return is_immediate_float(ref) || (!is_immediate(ref) && obj_type(ref) == ObjectType::FLOAT);
+}
+
+/**
+ * Returns true if ref refers to an object whose contents are not loaded yet, see LazyLoader.
+ */
+inline bool is_stub(Ref ref)
+{
+    return !is_immediate(ref) && ((ObjectHeader*) ptr_val(ref))->stub;
 }
 
 struct Memory;
@@ -192,7 +299,11 @@ struct RefHandle
     Ref ref_;
     Memory* mem_;
     
+    // Index of this handle in memory's root table, -1 if not registered.
+    int slot_;
+    
     RefHandle()
+    : mem_(0), slot_(-1)
     {
         ref_ = zeroRef();
     }
@@ -0,0 +1,263 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "Scheduler.hpp"
+#include "Profiler.hpp"
+
+#include <climits>
+
+using namespace atom;
+
+namespace
+{
+    /**
+     * Returns $0 of the initial context of a thread.
+     */
+    Ref initialResult(Thread* thread)
+    {
+        CallContext* cc = thread->cc_;
+
+        while(cc->parent_ != thread->nullArray_.ref())
+        {
+            cc = cc->parent();
+        }
+
+        return cc->temps()->at(0);
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    Scheduler::Scheduler(Memory* memory, long quantum)
+    : memory_(memory), quantum_(quantum), nextId_(1), current_(0)
+    {
+    }
+
+    Scheduler::~Scheduler()
+    {
+        for(TaskMap::iterator it = tasks_.begin(); it != tasks_.end(); ++it)
+        {
+            Task* task = it->second;
+
+            if(task->thread != 0)
+            {
+                if(task->owned)
+                {
+                    delete task->thread;
+                }
+                else
+                {
+                    task->thread->scheduler_ = 0;
+                }
+            }
+
+            delete task;
+        }
+    }
+
+    long Scheduler::addTask(Thread* thread, bool owned, bool detached)
+    {
+        Task* task = new Task();
+
+        task->id = nextId_++;
+        task->thread = thread;
+        task->owned = owned;
+        task->detached = detached;
+        task->blocked = false;
+
+        thread->scheduler_ = this;
+        tasks_[task->id] = task;
+        ready_.push_back(task);
+
+        return task->id;
+    }
+
+    long Scheduler::add(Thread* thread)
+    {
+        return addTask(thread, false, false);
+    }
+
+    long Scheduler::spawn(RefHandle target, RefHandle message, bool detached)
+    {
+        // Spawned threads are many and mostly shallow, their stacks start small.
+        Thread* thread = new Thread(memory_, FrameStack::SMALL_SEGMENT_SIZE);
+
+        thread->prepareInitialSend(target, message);
+
+        return addTask(thread, true, detached);
+    }
+
+    void Scheduler::run()
+    {
+        while(!ready_.empty())
+        {
+            Task* task = ready_.front();
+            Thread* thread = task->thread;
+
+            ready_.pop_front();
+
+            current_ = task;
+            memory_->setThread(thread);
+
+            thread->preemptAt_ = thread->bytecodeCount_ + quantum_;
+            thread->execute();
+            thread->preemptAt_ = LONG_MAX;
+
+            // Segments left by deeper calls are not kept while the thread waits.
+            thread->frames_.trim();
+
+            // Samples are resolved between time slices, while the objects they refer to
+            // have not moved.
+            if(memory_->profiler_ != 0)
+            {
+                memory_->profiler_->drain();
+            }
+
+            current_ = 0;
+
+            if(thread->halted())
+            {
+                finish(task);
+            }
+            else if(!task->blocked)
+            {
+                ready_.push_back(task);
+            }
+        }
+    }
+
+    void Scheduler::finish(Task* task)
+    {
+        RefHandle result(initialResult(task->thread), memory_);
+
+        for(size_t i = 0; i < task->joiners.size(); ++i)
+        {
+            Task* joiner = task->joiners[i].first;
+
+            joiner->thread->setResult(task->joiners[i].second, result.ref());
+            joiner->blocked = false;
+            ready_.push_back(joiner);
+        }
+
+        if(task->owned)
+        {
+            // A profiler may sample the running thread of the memory at any time.
+            if(memory_->thread_ == task->thread)
+            {
+                memory_->setThread(0);
+            }
+
+            delete task->thread;
+        }
+        else
+        {
+            task->thread->scheduler_ = 0;
+        }
+
+        task->thread = 0;
+
+        // Results are kept for a later join only.
+        if(task->detached || !task->joiners.empty())
+        {
+            tasks_.erase(task->id);
+            delete task;
+        }
+        else
+        {
+            task->result = result;
+        }
+    }
+
+    void Scheduler::yield()
+    {
+        current_->thread->preemptAt_ = 0;
+    }
+
+    bool Scheduler::join(long id, int resultTmp)
+    {
+        TaskMap::iterator it = tasks_.find(id);
+
+        if(it == tasks_.end() || it->second == current_ || it->second->detached)
+        {
+            return false;
+        }
+
+        Task* task = it->second;
+
+        if(task->thread == 0)
+        {
+            current_->thread->setResult(resultTmp, task->result.ref());
+
+            tasks_.erase(it);
+            delete task;
+
+            return true;
+        }
+
+        task->joiners.push_back(std::make_pair(current_, resultTmp));
+
+        current_->blocked = true;
+        current_->thread->preemptAt_ = 0;
+
+        return true;
+    }
+
+    uword Scheduler::threadCount() const
+    {
+        uword count = 0;
+
+        for(TaskMap::const_iterator it = tasks_.begin(); it != tasks_.end(); ++it)
+        {
+            if(it->second->thread != 0)
+            {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+void fn_spawnThread(Thread* thread, int resultTmp, Ref message)
+{
+    if(thread->scheduler_ == 0 || !is_object_array(message) || cast<ObjectArray>(message)->size() < 2)
+    {
+        DEBUG("spawnThread: message must be an object array of a target and a message sent by a scheduled thread\n");
+        thread->setResult(resultTmp, zeroRef());
+        return;
+    }
+
+    ObjectArray* oa = cast<ObjectArray>(message);
+    bool detached = oa->size() > 2 && oa->at(2) == word2ref(1L);
+    RefHandle target(oa->at(0), thread->memory_);
+    RefHandle msg(oa->at(1), thread->memory_);
+
+    thread->setResult(resultTmp, word2ref(thread->scheduler_->spawn(target, msg, detached)));
+}
+
+void fn_yieldThread(Thread* thread, int resultTmp, Ref message)
+{
+    if(thread->scheduler_ != 0)
+    {
+        thread->scheduler_->yield();
+    }
+
+    thread->setResult(resultTmp, zeroRef());
+}
+
+void fn_joinThread(Thread* thread, int resultTmp, Ref message)
+{
+    if(thread->scheduler_ == 0 || !is_int(message) || !thread->scheduler_->join(int_val(message), resultTmp))
+    {
+        DEBUG("joinThread: message must be the id of a thread that can be joined\n");
+        thread->setResult(resultTmp, zeroRef());
+    }
+}
+
+} // namespace atom
@@ -0,0 +1,141 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_SCHEDULER_HPP_INCLUDED
+#define ATOM_SCHEDULER_HPP_INCLUDED
+
+#include "Thread.hpp"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace atom
+{
+    /**
+     * Runs green threads: threads sharing a memory which take turns on the OS thread calling
+     * run(). A thread runs until it halts, blocks in a join or has executed a quantum of
+     * bytecodes, then the next ready thread runs. Threads are preempted at sends, returns and
+     * jumps, see Thread::preemptAt_. The contexts and handles of every thread are roots of the
+     * shared memory.
+     *
+     * Threads are identified by positive integers. The result of a thread is $0 of its initial
+     * context, the result of the initial send once it returned. It is kept until the thread is
+     * joined unless the thread is detached.
+     */
+    class Scheduler
+    {
+        struct Task
+        {
+            long id;
+
+            // Zero once the thread halted.
+            Thread* thread;
+
+            // Owned threads are created by spawn() and deleted when they halt.
+            bool owned;
+            bool detached;
+            bool blocked;
+
+            RefHandle result;
+
+            // Tasks waiting for this one to halt and the temps receiving its result.
+            std::vector<std::pair<Task*, int> > joiners;
+        };
+
+        typedef std::map<long, Task*> TaskMap;
+
+        Memory* memory_;
+        long quantum_;
+        long nextId_;
+        TaskMap tasks_;
+        std::deque<Task*> ready_;
+        Task* current_;
+
+        long addTask(Thread* thread, bool owned, bool detached);
+        void finish(Task* task);
+
+    public:
+        // Bytecodes a thread executes before the next one runs.
+        static const long DEFAULT_QUANTUM = 10000;
+
+        Scheduler(Memory* memory, long quantum = DEFAULT_QUANTUM);
+
+        /**
+         * Deletes the threads created by spawn(), including the ones blocked forever.
+         */
+        ~Scheduler();
+
+        /**
+         * Schedules a thread owned by the caller and prepared with prepareInitialSend, returns
+         * its id.
+         */
+        long add(Thread* thread);
+
+        /**
+         * Creates a thread sending message to target and schedules it, returns its id.
+         */
+        long spawn(RefHandle target, RefHandle message, bool detached = false);
+
+        /**
+         * Runs the ready threads until none is left. Threads joining each other are left
+         * blocked.
+         */
+        void run();
+
+        /**
+         * Ends the quantum of the running thread.
+         */
+        void yield();
+
+        /**
+         * Sets the given temp of the running thread to the result of the thread with the given
+         * id. If that thread has not halted yet, the running thread is blocked until it does.
+         * Returns false if the id is not of a thread that can be joined: an unknown, detached or
+         * already joined thread or the running thread itself.
+         */
+        bool join(long id, int resultTmp);
+
+        /**
+         * Returns the running thread, zero outside of run().
+         */
+        inline Thread* current() const
+        {
+            return current_ != 0 ? current_->thread : 0;
+        }
+
+        /**
+         * Returns the number of threads that have not halted.
+         */
+        uword threadCount() const;
+    };
+
+/**
+ * Spawns a thread of the scheduler of the calling thread and returns its id, or zero if the
+ * calling thread is not run by a scheduler. The thread is detached if the third element is 1.
+ *
+ * @message must be an object array of the format: [target, message] or [target, message, detached]
+ */
+void fn_spawnThread(atom::Thread* thread, int resultTmp, atom::Ref message);
+
+/**
+ * Ends the quantum of the calling thread, the message is ignored.
+ */
+void fn_yieldThread(atom::Thread* thread, int resultTmp, atom::Ref message);
+
+/**
+ * Returns the result of the thread whose id is the message, waiting for the thread to halt.
+ * Returns zero if the thread cannot be joined, see Scheduler::join.
+ */
+void fn_joinThread(atom::Thread* thread, int resultTmp, atom::Ref message);
+
+} // namespace atom
+
+#endif /* ATOM_SCHEDULER_HPP_INCLUDED */
@@ -1,13 +1,21 @@
 #include "SharedLibrary.hpp"
 
 #include <dlfcn.h>
+#include <link.h>
 #include <memory.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 using namespace atom;
 
 namespace
 {
 
+typedef std::vector<std::string> StringVec;
+
 inline bool checkTwoByteArrayInAObjectArray(Ref message)
 {
     if(!is_object_array(message))
@@ -25,10 +33,177 @@ inline bool checkTwoByteArrayInAObjectArray(Ref message)
     return is_byte_array(oa->at(0)) && is_byte_array(oa->at(1));
 }
 
-inline void byteArrayInfoBuf(ByteArray* ba, char* buf)
+/**
+ * Length of the C string in a byte array, contents after a NUL byte are ignored.
+ */
+inline uword byteArrayStringLength(ByteArray* ba)
+{
+    void const* nul = memchr(ba->data(), '\0', ba->size());
+    return nul == 0 ? ba->size() : (char const*) nul - (char const*) ba->data();
+}
+
+inline std::string byteArrayString(ByteArray* ba)
+{
+    return std::string((char const*) ba->data(), byteArrayStringLength(ba));
+}
+
+/**
+ * Returns the native function of a symbol from the symbol cache, resolving and caching it on a
+ * miss. Returns false if the symbol cannot be resolved.
+ */
+bool resolveCached(Memory* memory, void* library, char const* name, uword length, Ref& function)
+{
+    SymbolCache& cache = memory->symbolCache_;
+
+    if(cache.find(library, name, length, function))
+    {
+        return true;
+    }
+
+    // Name may be inside of a byte array which moves on allocation.
+    std::string symbol(name, length);
+
+    // Clear any previous errors.
+    dlerror();
+
+    void* ptr = dlsym(library, symbol.c_str());
+    char* errStr = dlerror();
+
+    if(errStr != 0)
+    {
+        DEBUG("resolveSymbol: error occurred while resolving symbol: " << errStr << '\n');
+        return false;
+    }
+    else
+    {
+        DEBUG("resolvedSymbol: " << symbol << "\n");
+    }
+
+    if(ptr == 0)
+    {
+        DEBUG("resolveSymbol: error, symbol\'s value is NULL: " << symbol << '\n');
+        return false;
+    }
+
+    // Direct natives export their signatures next to them.
+    char const* signatureStr = (char const*) dlsym(library, (symbol + "_signature").c_str());
+    uword signature = 0;
+
+    if(signatureStr != 0 && !NativeSignature::parse(signatureStr, signature))
+    {
+        DEBUG("resolveSymbol: error, invalid signature: " << signatureStr << '\n');
+        return false;
+    }
+
+    RefHandle handle(signature != 0 ? memory->createDirectNativeFunction((NativeFunction::DirectFunT) ptr, signature)
+                                    : memory->createNativeFunction((NativeFunction::FunT) ptr), memory);
+    cache.insert(library, symbol.data(), symbol.size(), handle);
+    function = handle.ref();
+
+    return true;
+}
+
+/**
+ * Number of symbols in a GNU hash table, one past the last symbol in its chains.
+ */
+uword gnuHashSymbolCount(atom_uint32_t const* table)
+{
+    const atom_uint32_t bucketCount = table[0];
+    const atom_uint32_t symbolOffset = table[1];
+    const atom_uint32_t bloomSize = table[2];
+    atom_uint32_t const* buckets = table + 4 + bloomSize * (sizeof(ElfW(Addr)) / sizeof(atom_uint32_t));
+    atom_uint32_t const* chains = buckets + bucketCount;
+    atom_uint32_t last = 0;
+
+    for(atom_uint32_t i = 0; i < bucketCount; ++i)
+    {
+        last = std::max(last, buckets[i]);
+    }
+
+    if(last < symbolOffset)
+    {
+        return symbolOffset;
+    }
+
+    // Last chain ends with an entry whose lowest bit is set.
+    while((chains[last - symbolOffset] & 1) == 0)
+    {
+        ++last;
+    }
+
+    return last + 1;
+}
+
+/**
+ * Collects the names of the functions defined by a library from its dynamic symbol table.
+ * Returns false if the table cannot be found.
+ */
+bool exportedFunctions(void* library, char const* prefix, uword prefixLength, StringVec& names)
 {
-    memcpy(buf, ba->data(), ba->size());
-    buf[ba->size()] = '\0';
+    link_map* map = 0;
+
+    if(dlinfo(library, RTLD_DI_LINKMAP, &map) != 0 || map == 0)
+    {
+        return false;
+    }
+
+    ElfW(Sym) const* symbols = 0;
+    char const* strings = 0;
+    atom_uint32_t const* hash = 0;
+    atom_uint32_t const* gnuHash = 0;
+
+    for(ElfW(Dyn) const* dyn = map->l_ld; dyn->d_tag != DT_NULL; ++dyn)
+    {
+        // Dynamic section entries are relocated by glibc, but not by every loader.
+        ElfW(Addr) addr = dyn->d_un.d_ptr;
+
+        if(addr < map->l_addr)
+        {
+            addr += map->l_addr;
+        }
+
+        switch(dyn->d_tag)
+        {
+        case DT_SYMTAB:
+            symbols = (ElfW(Sym) const*) addr;
+            break;
+        case DT_STRTAB:
+            strings = (char const*) addr;
+            break;
+        case DT_HASH:
+            hash = (atom_uint32_t const*) addr;
+            break;
+        case DT_GNU_HASH:
+            gnuHash = (atom_uint32_t const*) addr;
+            break;
+        }
+    }
+
+    if(symbols == 0 || strings == 0 || (hash == 0 && gnuHash == 0))
+    {
+        return false;
+    }
+
+    const uword count = hash != 0 ? hash[1] : gnuHashSymbolCount(gnuHash);
+
+    for(uword i = 0; i < count; ++i)
+    {
+        ElfW(Sym) const& symbol = symbols[i];
+        // Both ELF classes encode the symbol type the same way.
+        const int type = ELF32_ST_TYPE(symbol.st_info);
+        char const* name = strings + symbol.st_name;
+
+        if((type == STT_FUNC || type == STT_GNU_IFUNC) && symbol.st_shndx != SHN_UNDEF && strncmp(name, prefix, prefixLength) == 0)
+        {
+            names.push_back(name);
+        }
+    }
+
+    // Versioned symbols may appear more than once.
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    return true;
 }
 
 } // namespace <unnamed>
@@ -45,20 +220,19 @@ void fn_loadLibrary(Thread* thread, int resultTmp, Ref message)
         return;
     }
 
-    char buf[400];
-    byteArrayInfoBuf(cast<ByteArray>(message), buf);
-    void* handle = dlopen(buf, RTLD_LAZY);
+    std::string name = byteArrayString(cast<ByteArray>(message));
+    void* handle = dlopen(name.c_str(), RTLD_LAZY);
 
     if(handle == 0)
     {
-        DEBUG("loadLibrary: cannot load library: " << buf << '\n');
+        DEBUG("loadLibrary: cannot load library: " << name << '\n');
         thread->setResult(resultTmp, word2ref(1L));
         return;
     }
 
     thread->setResult(resultTmp, thread->memory_->createOpaqueNativeHandle(handle));
 
-    DEBUG("loadLibrary: shared library loaded successfully: " << buf << '\n');
+    DEBUG("loadLibrary: shared library loaded successfully: " << name << '\n');
 }
 
 void fn_resolveFunction(Thread* thread, int resultTmp, Ref message)
@@ -72,34 +246,65 @@ void fn_resolveFunction(Thread* thread, int resultTmp, Ref message)
 
     ObjectArray* oa = cast<ObjectArray>(message);
     void* handle = (void*) cast<ByteArray>(oa->at(0))->data();
-    char buf[400];
-    byteArrayInfoBuf(cast<ByteArray>(oa->at(1)), buf);
-
-    // Clear any previous errors.
-    dlerror();
+    ByteArray* name = cast<ByteArray>(oa->at(1));
+    Ref function;
 
-    void* ptr = dlsym(handle, buf);
-    char* errStr = dlerror();
-
-    if(errStr != 0)
+    if(!resolveCached(thread->memory_, handle, (char const*) name->data(), byteArrayStringLength(name), function))
     {
-        DEBUG("resolveSymbol: error occurred while resolving symbol: " << errStr << '\n');
         thread->setResult(resultTmp, word2ref(1L));
         return;
     }
-    else
+
+    thread->setResult(resultTmp, function);
+}
+
+void fn_resolveAllFunctions(Thread* thread, int resultTmp, Ref message)
+{
+    if(!checkTwoByteArrayInAObjectArray(message))
     {
-        DEBUG("resolvedSymbol: " << buf << "\n");
+        DEBUG("resolveAllFunctions: message must be an object array containing two byte arrays\n");
+        thread->setResult(resultTmp, word2ref(1L));
+        return;
     }
-    
-    if(ptr == 0)
+
+    Memory* memory = thread->memory_;
+    ObjectArray* oa = cast<ObjectArray>(message);
+    void* handle = (void*) cast<ByteArray>(oa->at(0))->data();
+    std::string prefix = byteArrayString(cast<ByteArray>(oa->at(1)));
+    StringVec names;
+
+    if(!exportedFunctions(handle, prefix.data(), prefix.size(), names))
     {
-        DEBUG("resolveSymbol: error, symbol\'s value is NULL: " << buf << '\n');
+        DEBUG("resolveAllFunctions: cannot read the dynamic symbol table\n");
         thread->setResult(resultTmp, word2ref(1L));
         return;
     }
 
-    thread->setResult(resultTmp, thread->memory_->createNativeFunction((NativeFunction::FunT) ptr));
+    // Functions stay in the cache, so they are found again without allocation while the
+    // table is filled.
+    StringVec resolved;
+    Ref function;
+
+    for(StringVec::const_iterator it = names.begin(); it != names.end(); ++it)
+    {
+        if(resolveCached(memory, handle, it->data(), it->size(), function))
+        {
+            resolved.push_back(*it);
+        }
+    }
+
+    PtrHandle<ObjectArray> table(memory->createObjectArray(2 * resolved.size()), memory);
+
+    for(uword i = 0; i < resolved.size(); ++i)
+    {
+        Ref name = memory->createByteArrayFromString(resolved[i].c_str());
+
+        memory->symbolCache_.find(handle, resolved[i].data(), resolved[i].size(), function);
+        table->atPut(2 * i, name);
+        table->atPut(2 * i + 1, function);
+    }
+
+    thread->setResult(resultTmp, ptr2ref(table.ptr(), true));
 }
 
 } // namespace atom
@@ -14,12 +14,26 @@ void fn_loadLibrary(atom::Thread* thread, int resultTmp, atom::Ref message);
 
 /**
  * Resolves a symbol and returns it as a NativeFunction. Assumes that the symbol corresponds to a "C"
- * function with the required signature of a NativeFunction.
+ * function with the required signature of a NativeFunction. If the library also exports a string
+ * named after the function with a "_signature" suffix, the function is a direct native taking the
+ * arguments the string describes, see NativeSignature.
  *
  * @message must be an object array of the format: [library handle returned from fn_loadLibrary, function name byte array]
  */
 void fn_resolveFunction(atom::Thread* thread, int resultTmp, atom::Ref message);
 
+/**
+ * Resolves every function a library exports whose name starts with the given prefix, "fn_" for the
+ * primitive libraries, and returns them as a dispatch table. The table is an object array of name
+ * and NativeFunction pairs sorted by name: [name0, function0, name1, function1, ...].
+ *
+ * Resolved functions are cached by the memory, so resolving a symbol again with fn_resolveFunction
+ * or this function does not look it up and returns the same NativeFunction.
+ *
+ * @message must be an object array of the format: [library handle returned from fn_loadLibrary, prefix byte array]
+ */
+void fn_resolveAllFunctions(atom::Thread* thread, int resultTmp, atom::Ref message);
+
 }
 
 #endif /* ATOM_SHARED_LIBRARY_HPP_INCLUDED */
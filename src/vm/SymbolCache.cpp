@@ -0,0 +1,105 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "SymbolCache.hpp"
+
+#include <string.h>
+
+namespace atom
+{
+    SymbolCache::SymbolCache()
+    : entries_(16), count_(0)
+    {
+        for(EntryVec::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            it->library = 0;
+        }
+    }
+
+    uword SymbolCache::hash(void* library, char const* name, uword length)
+    {
+        // FNV-1a over the name, seeded with the library handle.
+        uword h = 2166136261UL ^ (((uword) library) >> 4);
+
+        for(uword i = 0; i < length; ++i)
+        {
+            h = (h ^ (byte) name[i]) * 16777619UL;
+        }
+
+        return h;
+    }
+
+    uword SymbolCache::slotFor(void* library, char const* name, uword length) const
+    {
+        uword mask = entries_.size() - 1;
+        uword slot = hash(library, name, length) & mask;
+
+        while(entries_[slot].library != 0)
+        {
+            Entry const& entry = entries_[slot];
+
+            if(entry.library == library && entry.name.size() == length && memcmp(entry.name.data(), name, length) == 0)
+            {
+                break;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+
+        return slot;
+    }
+
+    bool SymbolCache::find(void* library, char const* name, uword length, Ref& function) const
+    {
+        Entry const& entry = entries_[slotFor(library, name, length)];
+
+        if(entry.library == 0)
+        {
+            return false;
+        }
+
+        function = entry.function.ref();
+        return true;
+    }
+
+    void SymbolCache::insert(void* library, char const* name, uword length, RefHandle const& function)
+    {
+        if(2 * (count_ + 1) > entries_.size())
+        {
+            grow();
+        }
+
+        Entry& entry = entries_[slotFor(library, name, length)];
+        entry.library = library;
+        entry.name.assign(name, length);
+        entry.function = function;
+
+        ++count_;
+    }
+
+    void SymbolCache::grow()
+    {
+        EntryVec old(entries_.size() * 2);
+        old.swap(entries_);
+
+        for(EntryVec::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            it->library = 0;
+        }
+
+        for(EntryVec::const_iterator it = old.begin(); it != old.end(); ++it)
+        {
+            if(it->library != 0)
+            {
+                entries_[slotFor(it->library, it->name.data(), it->name.size())] = *it;
+            }
+        }
+    }
+} // namespace atom
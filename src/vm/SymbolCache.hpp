@@ -0,0 +1,68 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_SYMBOL_CACHE_HPP_INCLUDED
+#define ATOM_SYMBOL_CACHE_HPP_INCLUDED
+
+#include "Ref.hpp"
+
+#include <string>
+#include <vector>
+
+namespace atom
+{
+    /**
+     * Native functions resolved from shared libraries, keyed by the library handle and the
+     * symbol name, see fn_resolveFunction. An open addressing hash table like ObjectIndexMap.
+     * The functions are held by handles, so they stay alive and follow the collections.
+     * Libraries are never unloaded, entries are never removed.
+     */
+    class SymbolCache
+    {
+        struct Entry
+        {
+            void* library;
+            std::string name;
+            RefHandle function;
+        };
+
+        typedef std::vector<Entry> EntryVec;
+
+        // Capacity is a power of two and at least twice the count.
+        EntryVec entries_;
+        uword count_;
+
+        static uword hash(void* library, char const* name, uword length);
+
+        uword slotFor(void* library, char const* name, uword length) const;
+
+        void grow();
+
+    public:
+        SymbolCache();
+
+        /**
+         * Returns true and sets function if the symbol of the library is in the cache.
+         */
+        bool find(void* library, char const* name, uword length, Ref& function) const;
+
+        /**
+         * @pre the symbol is not in the cache
+         */
+        void insert(void* library, char const* name, uword length, RefHandle const& function);
+
+        inline uword size() const
+        {
+            return count_;
+        }
+    };
+} // namespace atom
+
+#endif /* ATOM_SYMBOL_CACHE_HPP_INCLUDED */
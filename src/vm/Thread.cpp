@@ -10,7 +10,9 @@
 
 #include "Thread.hpp"
 #include "Opcode.hpp"
+#include "Verifier.hpp"
 
+#include <climits>
 #include <stdexcept>
 #include <signal.h>
 
@@ -22,24 +24,118 @@ namespace
 // send $0 to $1 > $0
 const byte startBallRollingBytecodesBytes[] = {Opcode::SEND_VAL_TO_VAL_WRES, 0, 1, 0};
 
+/**
+ * Computes an arithmetic or comparison instruction for integer operands, comparisons give
+ * 1 or 0. Returns false if the divisor is zero or the result does not fit an integer.
+ */
+inline bool intArithmetic(int opcode, word lhs, word rhs, Ref& result)
+{
+    word value;
+
+    switch(opcode)
+    {
+        case Opcode::ADD:
+            value = lhs + rhs;
+            break;
+
+        case Opcode::SUBTRACT:
+            value = lhs - rhs;
+            break;
+
+        case Opcode::MULTIPLY:
+            // Integers are narrower than words but their product may not fit a word either,
+            // a wrapped product is detected by dividing it back.
+            value = (word) ((uword) lhs * (uword) rhs);
+
+            if(lhs != 0 && value / lhs != rhs)
+            {
+                return false;
+            }
+
+            break;
+
+        case Opcode::DIVIDE:
+        case Opcode::MODULO:
+            if(rhs == 0)
+            {
+                return false;
+            }
+
+            value = opcode == Opcode::DIVIDE ? lhs / rhs : lhs % rhs;
+            break;
+
+        case Opcode::LESS_THAN:
+            value = lhs < rhs ? 1 : 0;
+            break;
+
+        case Opcode::GREATER_THAN:
+            value = lhs > rhs ? 1 : 0;
+            break;
+
+        default:
+            value = lhs == rhs ? 1 : 0;
+            break;
+    }
+
+    result = word2ref(value);
+    return int_val(result) == value;
+}
+
+#if defined ATOM_STATS
+
+/**
+ * Ends the cycle measurement of the last instruction when the thread stops executing.
+ */
+struct StatsStopper
+{
+    ThreadStats& stats_;
+
+    StatsStopper(ThreadStats& stats)
+    : stats_(stats)
+    {
+    }
+
+    ~StatsStopper()
+    {
+        stats_.stop();
+    }
+};
+
+#endif
+
 } // namespace <anonymous>
 
 namespace atom
 {
-    Thread::Thread(Memory* memory)
-    : memory_(memory), halt_(false), cc_(PtrHandle<CallContext>(0, memory_)), sendCount_(0), bytecodeCount_(0)
+    Thread::Thread(Memory* memory, word stackSegmentSize)
+    : memory_(memory), halt_(false), sendCount_(0), bytecodeCount_(0), frames_(memory->policy_.stackSize, stackSegmentSize), cc_(0), preemptAt_(LONG_MAX),
+      scheduler_(0)
     {
+        memory_->registerFrameStack(&frames_);
+
         startBallRollingBytecodes_ = RefHandle(memory_->createUnmanagedByteArray((byte*) startBallRollingBytecodesBytes, sizeof(startBallRollingBytecodesBytes)), memory_);
         nullArray_ = RefHandle(ptr2ref(memory_->createObjectArray(0)), memory_);
         execErrorBa_ = RefHandle(memory_->createByteArrayFromString("execError"), memory_);
         processExceptionBa_ = RefHandle(memory_->createByteArrayFromString("processException"), memory_);
     }
 
+    Thread::~Thread()
+    {
+        memory_->unregisterFrameStack(&frames_);
+    }
+
     void Thread::prepareInitialSend(RefHandle firstTarget, RefHandle firstMessage)
     {
-        cc_ = PtrHandle<CallContext>(memory_->createObject<CallContext>(), memory_);
+        // Contexts of a previous execution are abandoned.
+        frames_.clear();
+
+        ObjectArray* temps = frames_.allocObjectArray(2);
+        temps->atPut(0, firstMessage.ref());
+        temps->atPut(1, firstTarget.ref());
+
+        cc_ = frames_.alloc<CallContext>();
         cc_->initNew(nullArray_, nullArray_, nullArray_);
-        cc_->initBytecodesTemps(startBallRollingBytecodes_.ref(), memory_->createObjectArray(firstMessage, firstTarget));
+        cc_->initBytecodesTemps(startBallRollingBytecodes_.ref(), temps);
     }
 
     bool Thread::checkConditional()
@@ -69,6 +165,8 @@ namespace atom
 
     RefHandle Thread::createMetaMessage(RefHandle msg, RefHandle target)
     {
+        ATOM_STAT(++stats_.metaMessages_);
+
         PtrHandle<ObjectArray> metaMessage(memory_->createObjectArray(3), memory_);
 
         metaMessage->atPut(MetaMessageElements::ZERO, zeroRef());
@@ -227,6 +325,8 @@ namespace atom
         byte opcode = cc_->nextbytecode();        
         RefHandle arrayRef = extractArrayLikeFromTemps();
 
+        memory_->resolve(arrayRef.ref());
+
         if(is_byte_array(arrayRef.ref()))
         {
             handleArrayAtOrAtPut(opcode, cast<ByteArray>(arrayRef.ref()));
@@ -264,6 +364,8 @@ namespace atom
 
     void Thread::raiseError(RefHandle excObj)
     {
+        ATOM_STAT(++stats_.exceptions_);
+
         while(true)
         {
             if(cc_->exceptionHandler_ == nullArray_.ref())
@@ -284,7 +386,7 @@ namespace atom
             {   
                 if(cc_->exceptionObject_ == nullArray_.ref())
                 {
-                    cc_->exceptionObject_ = excObj.ref();
+                    cc_->setSlot(cc_->exceptionObject_, excObj.ref());
                     
                     try
                     {
@@ -312,19 +414,26 @@ namespace atom
 
     void Thread::sendToSimpleFunction(RefHandle msg, RefHandle target, int resultTmp)
     {
-        PtrHandle<ObjectArray> fn(cast<ObjectArray>(target.ref()), memory_);
-        const int size = fn->size();
+        SimpleFunction* fn = cast<SimpleFunction>(target.ref());
 
-        if(size < 2 || !is_byte_array(fn->at(0)) || !is_int(fn->at(1)))
+        if(fn->size() < 2 || !is_byte_array(fn->at(0)) || !is_int(fn->at(1)))
         {
             throw invalid_simple_function_structure_error();
         }
     
-        const word tempCount = int_val(fn->at(1));
-        
-        PtrHandle<ObjectArray> temps(memory_->createObjectArray(size + tempCount), memory_);
+        enterSimpleFunction(msg.ref(), fn, ensureVerified(fn), resultTmp);
+    }
+
+    void Thread::enterSimpleFunction(Ref msg, SimpleFunction* fn, bool verified, int resultTmp)
+    {
+        const int size = fn->size();
+
+        // Frames are not allocated in the heap, so fn does not move from here on.
+        pushNewContext(resultTmp);
 
-        temps->atPut(0, msg.ref());
+        ObjectArray* temps = frames_.allocObjectArray(size + int_val(fn->tempCount_));
+
+        temps->atPut(0, msg);
         temps->atPut(1, zeroRef()); // Always a temp present.
 
         for(int i = 2; i < size; ++i)
@@ -332,28 +441,81 @@ namespace atom
             temps->atPut(i, fn->at(i));
         }
 
-        pushNewContext(resultTmp);
-        cc_->initBytecodesTemps(fn->at(0), temps.ptr());
+        cc_->initBytecodesTemps(fn->bytecodes_, temps);
+        
+        // The verified bit of a context tells that it runs the verified code of a function.
+        cc_->header_.verified = verified;
+    }
+
+    void Thread::enterMetaFunction(Ref target, Ref msg, SimpleFunction* fn, int resultTmp)
+    {
+        enterSimpleFunction(zeroRef(), fn, true, resultTmp);
+
+        byte const* code = cc_->bytecodes()->data();
+
+        // Same values the meta message would hold, see createMetaMessage.
+        cc_->setTemp(code[1], is_int(target) ? target : set_array_access(target));
+        cc_->setTemp(code[2], msg);
+        cc_->ip(Opcode::instructionSize(Opcode::META_ARGS, 0));
+    }
+
+    void Thread::handleMetaArgs()
+    {
+        cc_->skipBytecodes(1);
+
+        int targetTmp = cc_->nextbytecode();
+        int msgTmp = cc_->nextbytecode();
+        Ref metaMessage = memory_->resolve(cc_->temps()->at(0));
+
+        if(!is_object_array(metaMessage) || !array_access(metaMessage) || cast<ObjectArray>(metaMessage)->size() <= MetaMessageElements::REALMSG)
+        {
+            throw invalid_meta_message_error();
+        }
+
+        ObjectArray* elements = cast<ObjectArray>(metaMessage);
+
+        cc_->setTemp(targetTmp, elements->at(MetaMessageElements::TARGET));
+        cc_->setTemp(msgTmp, elements->at(MetaMessageElements::REALMSG));
     }
 
     void Thread::sendMessage(RefHandle msg, RefHandle target, int resultTmp)
     {
+        memory_->resolve(target.ref());
+
         if(is_native_fn(target.ref()))
         {
-            cast<NativeFunction>(target.ref())->call(this, resultTmp, msg.ref());
+            ATOM_STAT(++stats_.nativeSends_);
+
+            Ref resolvedMsg = resolveMessage(msg);
+            callNative(cast<NativeFunction>(target.ref()), resultTmp, resolvedMsg);
         }
         else if(is_simple_fn(target.ref()))
         {
+            ATOM_STAT(++stats_.simpleFunctionSends_);
             sendToSimpleFunction(msg, target, resultTmp);
         }
         else
         {
+            ATOM_STAT(++stats_.metaObjectSends_);
+
             RefHandle metaObject(memory_->findMetaObject(target.ref()), memory_);
-            
+            memory_->resolve(metaObject.ref());
+
             if(metaObject.ref() == target.ref())
             {
                 throw recursive_metaobject_error();
             }
+
+            if(is_simple_fn(metaObject.ref()))
+            {
+                SimpleFunction* fn = cast<SimpleFunction>(metaObject.ref());
+
+                if(ensureVerified(fn) && takesMetaArgs(fn))
+                {
+                    enterMetaFunction(target.ref(), msg.ref(), fn, resultTmp);
+                    return;
+                }
+            }
             
             sendMessage(createMetaMessage(msg, target), metaObject, resultTmp);
         }
@@ -369,10 +531,217 @@ namespace atom
         sendMessage(msg, target, resultTmp);
     }
 
+    void Thread::handleArithmetic()
+    {
+        byte opcode = cc_->nextbytecode();
+        RefHandle lhs(cc_->nextTempFromBytecode(), memory_);
+        RefHandle rhs(cc_->nextTempFromBytecode(), memory_);
+        RefHandle handler(cc_->nextTempFromBytecode(), memory_);
+        int resultTmp = cc_->nextbytecode();
+        Ref result;
+
+        if(is_int(lhs.ref()) && is_int(rhs.ref()) && intArithmetic(opcode, int_val(lhs.ref()), int_val(rhs.ref()), result))
+        {
+            cc_->temps()->atPut(resultTmp, result);
+            return;
+        }
+
+        ++sendCount_;
+        sendMessage(RefHandle(ptr2ref(memory_->createObjectArray(lhs, rhs), true), memory_), handler, resultTmp);
+    }
+
+    void Thread::handleCallNative()
+    {
+        cc_->skipBytecodes(1);
+
+        const int count = cc_->nextbytecode();
+        RefHandle fn(cc_->nextTempFromBytecode(), memory_);
+
+        memory_->resolve(fn.ref());
+
+        // Stub arguments must be loaded, which the message send does.
+        if(is_native_fn(fn.ref()) && cast<NativeFunction>(fn.ref())->arity() == count && memory_->loader_ == 0)
+        {
+            Ref args[NativeSignature::MAX_ARGS];
+
+            for(int i = 0; i < count; ++i)
+            {
+                args[i] = cc_->nextTempFromBytecode();
+            }
+
+            int resultTmp = cc_->nextbytecode();
+            NativeFunction* native = cast<NativeFunction>(fn.ref());
+
+            if(!native->accepts(args))
+            {
+                throw invalid_native_arguments_error();
+            }
+
+            ATOM_STAT(++stats_.nativeSends_);
+            native->callDirect(this, resultTmp, args);
+            return;
+        }
+
+        RefHandle msg = count == 1 ? RefHandle(cc_->nextTempFromBytecode(), memory_) : createObjectArrayFromBytecodes(count);
+        int resultTmp = cc_->nextbytecode();
+
+        sendMessage(msg, fn, resultTmp);
+    }
+
+    void Thread::callNative(NativeFunction* fn, int resultTmp, Ref msg)
+    {
+        if(!fn->isDirect())
+        {
+            fn->call(this, resultTmp, msg);
+            return;
+        }
+
+        const int count = fn->arity();
+        Ref args[NativeSignature::MAX_ARGS];
+
+        if(count == 1)
+        {
+            args[0] = msg;
+        }
+        else
+        {
+            if((!is_object_array(msg) && !is_object(msg)) || cast<ObjectArray>(msg)->size() != count)
+            {
+                throw invalid_native_arguments_error();
+            }
+
+            for(int i = 0; i < count; ++i)
+            {
+                args[i] = cast<ObjectArray>(msg)->at(i);
+            }
+        }
+
+        if(!fn->accepts(args))
+        {
+            throw invalid_native_arguments_error();
+        }
+
+        fn->callDirect(this, resultTmp, args);
+    }
+
+    void Thread::handleCachedSend(SendCache& cache)
+    {
+        RefHandle msg;
+        RefHandle target;
+        int resultTmp;
+
+        decodeSend(msg, target, resultTmp);
+        sendCached(cache, msg, target, resultTmp);
+    }
+
+    void Thread::sendCached(SendCache& cache, RefHandle msg, RefHandle target, int resultTmp)
+    {
+        memory_->resolve(target.ref());
+
+        const bool isFunction = is_native_fn(target.ref()) || is_simple_fn(target.ref());
+        Ref handler = memory_->resolve(isFunction ? target.ref() : memory_->findMetaObject(target.ref()));
+        SendCache::Entry const* entry = cache.find(handler);
+
+        // Only verified functions are cached, modified ones must be checked again.
+        if(entry != 0 && entry->kind != SendCache::NATIVE_FUNCTION && !isVerified(cast<SimpleFunction>(handler)))
+        {
+            cache.remove(handler);
+            entry = 0;
+        }
+
+        if(entry == 0)
+        {
+            ++cache.misses_;
+
+            if(is_native_fn(handler))
+            {
+                cache.add(handler, SendCache::NATIVE_FUNCTION);
+            }
+            else if(is_simple_fn(handler))
+            {
+                SimpleFunction* fn = cast<SimpleFunction>(handler);
+
+                if(ensureVerified(fn))
+                {
+                    cache.add(handler, takesMetaArgs(fn) ? SendCache::META_ARGS_FUNCTION : SendCache::SIMPLE_FUNCTION);
+                }
+            }
+
+            sendMessage(msg, target, resultTmp);
+            return;
+        }
+
+        ++cache.hits_;
+
+        const int kind = entry->kind;
+
+        if(isFunction)
+        {
+            callCachedHandler(kind, handler, msg.ref(), resultTmp);
+        }
+        else if(kind == SendCache::META_ARGS_FUNCTION)
+        {
+            ATOM_STAT(++stats_.metaObjectSends_);
+            enterMetaFunction(target.ref(), msg.ref(), cast<SimpleFunction>(handler), resultTmp);
+        }
+        else
+        {
+            ATOM_STAT(++stats_.metaObjectSends_);
+
+            // Creating the meta message may move the handler.
+            RefHandle handlerHandle(handler, memory_);
+            RefHandle metaMessage(createMetaMessage(msg, target));
+
+            callCachedHandler(kind, handlerHandle.ref(), metaMessage.ref(), resultTmp);
+        }
+    }
+
+    inline void Thread::callCachedHandler(int kind, Ref handler, Ref msg, int resultTmp)
+    {
+        if(kind == SendCache::NATIVE_FUNCTION)
+        {
+            ATOM_STAT(++stats_.nativeSends_);
+
+            if(memory_->loader_ != 0)
+            {
+                RefHandle handlerHandle(handler, memory_);
+                msg = resolveMessage(RefHandle(msg, memory_));
+                handler = handlerHandle.ref();
+            }
+
+            callNative(cast<NativeFunction>(handler), resultTmp, msg);
+        }
+        else
+        {
+            ATOM_STAT(++stats_.simpleFunctionSends_);
+            enterSimpleFunction(msg, cast<SimpleFunction>(handler), true, resultTmp);
+        }
+    }
+
+    Ref Thread::resolveMessage(RefHandle msg)
+    {
+        if(memory_->loader_ == 0)
+        {
+            return msg.ref();
+        }
+
+        memory_->resolve(msg.ref());
+
+        if(!is_immediate(msg.ref()) && ObjectType::containsSlots(obj_type(msg.ref())))
+        {
+            for(word i = 0; i < cast<ObjectArray>(msg.ref())->size(); ++i)
+            {
+                memory_->resolve(cast<ObjectArray>(msg.ref())->at(i));
+            }
+        }
+
+        return msg.ref();
+    }
+
     void Thread::handleInstallExHandler()
     {
         cc_->skipBytecodes(1);
-        cc_->exceptionHandler_ = cc_->nextTempFromBytecode();
+        cc_->setSlot(cc_->exceptionHandler_, cc_->nextTempFromBytecode());
     }
 
     void Thread::handleRaiseException()
@@ -413,6 +782,9 @@ namespace atom
     
     void Thread::step()
     {
+        ATOM_STAT(StatsStopper stopper(stats_));
+
+        CurrentMemoryScope current(memory_);
         ++bytecodeCount_;
         
         if(halt_)
@@ -427,7 +799,9 @@ namespace atom
         }
         
         byte opcode = peekbytecode();
-        
+
+        ATOM_STAT(stats_.dispatch(opcode));
+
         if(Opcode::HALT == opcode)
         {
             cc_->skipBytecodes(1);
@@ -435,13 +809,23 @@ namespace atom
             return;
         }
 
-        checkInstruction(opcode);
+        // Verified code is known to be valid, see Verifier.hpp.
+        const bool verified = cc_->header_.verified && cc_->bytecodes()->header_.verified;
+
+        if(!verified)
+        {
+            checkInstruction(opcode);
+        }
 
         if(Opcode::isConditional(opcode))
         {
             bool condTrue = checkConditional();
             opcode = peekbytecode();
-            checkInstruction(opcode);
+            
+            if(!verified)
+            {
+                checkInstruction(opcode);
+            }
             
             if(Opcode::isConditional(opcode))
             {
@@ -453,11 +837,16 @@ namespace atom
                 cc_->skipBytecodes(Opcode::instructionSize(opcode, peekbytecode(1)));
                 return;
             }
+
+            ATOM_STAT(stats_.dispatch(opcode));
         }
 
         opcode = peekbytecode();
         
-        checkTempIndexes(opcode);
+        if(!verified)
+        {
+            checkTempIndexes(opcode);
+        }
 
         if(Opcode::isReturn(opcode))
         {
@@ -495,17 +884,479 @@ namespace atom
         {
             handleSet();
         }
+        else if(Opcode::META_ARGS == opcode)
+        {
+            handleMetaArgs();
+        }
         else if(Opcode::SEND_VAL_TO_VAL == opcode || Opcode::SEND_VAL_TO_VAL_WRES  == opcode)
         {
             ++sendCount_;
             handleSend();
         }
+        else if(Opcode::isArithmetic(opcode))
+        {
+            handleArithmetic();
+        }
+        else if(Opcode::isNativeCall(opcode))
+        {
+            ++sendCount_;
+            handleCallNative();
+        }
         else
         {
             throw std::runtime_error("must not reach here");
         }
     }
     
+// Writes the locals of Thread::run back into the current context.
+#define ATOM_SAVE_CONTEXT()                                     \
+    do                                                          \
+    {                                                           \
+        cc->ip(inst->ip);                                       \
+        bytecodeCount_ += count;                                \
+        count = 0;                                              \
+    } while(false)
+
+#define ATOM_FAIL(error)                                        \
+    do                                                          \
+    {                                                           \
+        ATOM_SAVE_CONTEXT();                                    \
+        throw error;                                            \
+    } while(false)
+
+#define ATOM_SET_TEMP(idx, value)                               \
+    do                                                          \
+    {                                                           \
+        Ref v_ = (value);                                       \
+        writeBarrier(tempsObj, v_);                             \
+        temps[idx] = v_;                                        \
+    } while(false)
+
+// Executes a handler written in terms of cc_, the instruction is left unconsumed.
+#define ATOM_SLOW_PATH(call)                                    \
+    do                                                          \
+    {                                                           \
+        ATOM_SAVE_CONTEXT();                                    \
+        call;                                                   \
+                                                                \
+        if(halt_)                                               \
+        {                                                       \
+            return;                                             \
+        }                                                       \
+                                                                \
+        goto enter;                                             \
+    } while(false)
+
+#if defined ATOM_DISPATCH_THREADED
+
+#define ATOM_OPCODE(name) op_##name:
+#define ATOM_END_OF_CODE() op_END_OF_CODE:
+
+// Each handler ends with its own copy of the dispatch jump, which the branch predictor
+// tracks separately.
+#define ATOM_NEXT()                                             \
+    do                                                          \
+    {                                                           \
+        ++count;                                                \
+        ATOM_STAT(stats_.dispatch(inst->opcode));               \
+        goto *inst->handler;                                    \
+    } while(false)
+
+#else
+
+#define ATOM_OPCODE(name) case Opcode::name:
+#define ATOM_END_OF_CODE() case DecodedInstruction::END_OF_CODE:
+#define ATOM_NEXT() goto next
+
+#endif
+
+    void Thread::run()
+    {
+        CallContext* cc;
+        ByteArray* codeArray;
+        DecodedCode* decoded;
+        DecodedInstruction const* inst;
+        ObjectArray* tempsObj;
+        Ref* temps;
+        long count = 0;
+
+        ATOM_STAT(StatsStopper stopper(stats_));
+
+#if defined ATOM_DISPATCH_THREADED
+        static void* const dispatchTable[] = {
+            &&op_SEND_VAL_TO_VAL,
+            &&op_SEND_VAL_TO_VAL_WRES,
+            &&op_CONDITIONAL_ONE,
+            &&op_CONDITIONAL_NOT_ONE,
+            &&op_RETURN,
+            &&op_RETURN_RESULT,
+            &&op_ARRAY_AT,
+            &&op_ARRAY_AT_PUT,
+            &&op_ARRAY_LENGTH,
+            &&op_CREATE_OBJECT,
+            &&op_CREATE_OBJECT_ARRAY,
+            &&op_HALT,
+            &&op_INSTALL_EXCEPTION_HANDLER,
+            &&op_RAISE_EXCEPTION,
+            &&op_JUMP,
+            &&op_SET_LOCAL,
+            &&op_META_ARGS,
+            &&op_ADD,
+            &&op_SUBTRACT,
+            &&op_MULTIPLY,
+            &&op_DIVIDE,
+            &&op_MODULO,
+            &&op_LESS_THAN,
+            &&op_GREATER_THAN,
+            &&op_EQUAL,
+            &&op_CALL_NATIVE,
+            &&op_END_OF_CODE
+        };
+
+        void* const* handlers = dispatchTable;
+#else
+        void* const* handlers = 0;
+#endif
+
+        if(halt_)
+        {
+            throw vm_was_halted_error();
+        }
+
+        CurrentMemoryScope current(memory_);
+
+    enter:
+        if(preempted())
+        {
+            return;
+        }
+
+        cc = cc_;
+
+        // Only verified code is executed from its decoded form, the rest is left to the
+        // checks of step().
+        if(!cc->header_.verified || !cc->bytecodes()->header_.verified)
+        {
+            step();
+
+            if(halt_)
+            {
+                return;
+            }
+
+            goto enter;
+        }
+
+        codeArray = cc->bytecodes();
+        decoded = memory_->codeCache_.get(codeArray, handlers);
+        inst = decoded->at(cc->ip());
+        tempsObj = cc->temps();
+        temps = tempsObj->elements();
+
+#if !defined ATOM_DISPATCH_THREADED
+    next:
+#endif
+        ++count;
+
+    dispatch:
+        ATOM_STAT(stats_.dispatch(inst->opcode));
+
+#if defined ATOM_DISPATCH_THREADED
+        goto *inst->handler;
+#else
+        switch(inst->opcode)
+        {
+#endif
+
+        ATOM_OPCODE(SET_LOCAL)
+        {
+            ATOM_SET_TEMP(inst->operands[0], temps[inst->operands[1]]);
+            ++inst;
+            ATOM_NEXT();
+        }
+
+        ATOM_OPCODE(JUMP)
+        {
+            // The verifier made sure that the target is an instruction.
+            inst = decoded->at(int_val(temps[inst->operands[0]]));
+
+            // Loops are preempted here, sends and returns at enter.
+            if(bytecodeCount_ + count >= preemptAt_)
+            {
+                ATOM_SAVE_CONTEXT();
+                return;
+            }
+
+            ATOM_NEXT();
+        }
+
+        ATOM_OPCODE(CONDITIONAL_ONE)
+        ATOM_OPCODE(CONDITIONAL_NOT_ONE)
+        {
+            Ref cond = temps[inst->operands[0]];
+            bool isOne = is_int(cond) && int_val(cond) == 1;
+            bool condTrue = (inst->opcode == Opcode::CONDITIONAL_ONE) == isOne;
+
+            if(condTrue)
+            {
+                // The conditional and its instruction are counted as a single step.
+                ++inst;
+                goto dispatch;
+            }
+
+            inst += 2;
+            ATOM_NEXT();
+        }
+
+        ATOM_OPCODE(ARRAY_AT)
+        ATOM_OPCODE(ARRAY_AT_PUT)
+        {
+            Ref arrayRef = temps[inst->operands[0]];
+            Ref indexRef = temps[inst->operands[1]];
+
+            if(!array_access(arrayRef))
+            {
+                ATOM_FAIL(array_access_disabled_error());
+            }
+
+            if(!is_byte_array(arrayRef) && !ObjectType::containsSlots(obj_type(arrayRef)))
+            {
+                ATOM_FAIL(non_indexable_object_error());
+            }
+
+            if(!is_int(indexRef))
+            {
+                ATOM_FAIL(non_integer_array_index_error());
+            }
+
+            word index = int_val(indexRef);
+
+            if(is_byte_array(arrayRef))
+            {
+                ByteArray* arr = cast<ByteArray>(arrayRef);
+
+                if(index < 0 || index >= arr->size())
+                {
+                    ATOM_FAIL(array_out_of_bounds_error());
+                }
+
+                if(inst->opcode == Opcode::ARRAY_AT)
+                {
+                    ATOM_SET_TEMP(inst->operands[2], word2ref(arr->data()[index]));
+                }
+                else
+                {
+                    Ref value = temps[inst->operands[2]];
+
+                    if(!is_int(value))
+                    {
+                        ATOM_FAIL(invalid_bytearray_element_error());
+                    }
+
+                    bytesChanged(arr);
+                    arr->data()[index] = int_val(value);
+
+                    // The code modified itself, the decoded form is stale.
+                    if(!codeArray->header_.verified)
+                    {
+                        ++inst;
+                        ATOM_SAVE_CONTEXT();
+                        goto enter;
+                    }
+                }
+            }
+            else
+            {
+                ObjectArray* arr = cast<ObjectArray>(arrayRef);
+
+                // Loading the contents of a stub may collect.
+                if(arr->header_.stub)
+                {
+                    ATOM_SLOW_PATH(handleArrayAtOrAtPut());
+                }
+
+                if(index < 0 || index >= arr->size())
+                {
+                    ATOM_FAIL(array_out_of_bounds_error());
+                }
+
+                if(inst->opcode == Opcode::ARRAY_AT)
+                {
+                    ATOM_SET_TEMP(inst->operands[2], arr->elements()[index]);
+                }
+                else
+                {
+                    Ref value = temps[inst->operands[2]];
+
+                    writeBarrier(arr, value);
+                    slotsChanged(arr);
+                    arr->elements()[index] = value;
+                }
+            }
+
+            ++inst;
+            ATOM_NEXT();
+        }
+
+        ATOM_OPCODE(ARRAY_LENGTH)
+        {
+            Ref arrayRef = temps[inst->operands[0]];
+
+            if(!array_access(arrayRef))
+            {
+                ATOM_FAIL(array_access_disabled_error());
+            }
+
+            if(is_byte_array(arrayRef))
+            {
+                ATOM_SET_TEMP(inst->operands[1], word2ref(cast<ByteArray>(arrayRef)->size()));
+            }
+            else
+            {
+                ATOM_SET_TEMP(inst->operands[1], word2ref(cast<ObjectArray>(arrayRef)->size()));
+            }
+
+            ++inst;
+            ATOM_NEXT();
+        }
+
+        ATOM_OPCODE(ADD)
+        ATOM_OPCODE(SUBTRACT)
+        ATOM_OPCODE(MULTIPLY)
+        ATOM_OPCODE(DIVIDE)
+        ATOM_OPCODE(MODULO)
+        ATOM_OPCODE(LESS_THAN)
+        ATOM_OPCODE(GREATER_THAN)
+        ATOM_OPCODE(EQUAL)
+        {
+            Ref lhs = temps[inst->operands[0]];
+            Ref rhs = temps[inst->operands[1]];
+            Ref result;
+
+            if(is_int(lhs) && is_int(rhs) && intArithmetic(inst->opcode, int_val(lhs), int_val(rhs), result))
+            {
+                // Integers need no write barrier.
+                temps[inst->operands[3]] = result;
+                ++inst;
+                ATOM_NEXT();
+            }
+
+            ATOM_SLOW_PATH(handleArithmetic());
+        }
+
+        ATOM_OPCODE(CALL_NATIVE)
+        {
+            // Variable length, the operands are read from the bytecodes.
+            byte const* code = codeArray->data() + inst->ip;
+            const int argCount = code[1];
+            Ref fnRef = temps[code[2]];
+
+            ++sendCount_;
+
+            if(is_native_fn(fnRef) && cast<NativeFunction>(fnRef)->arity() == argCount && memory_->loader_ == 0)
+            {
+                NativeFunction* fn = cast<NativeFunction>(fnRef);
+                Ref args[NativeSignature::MAX_ARGS];
+
+                for(int i = 0; i < argCount; ++i)
+                {
+                    args[i] = temps[code[3 + i]];
+                }
+
+                if(!fn->accepts(args))
+                {
+                    ATOM_FAIL(invalid_native_arguments_error());
+                }
+
+                const int resultTmp = code[3 + argCount];
+
+                ATOM_STAT(++stats_.nativeSends_);
+                ++inst;
+                ATOM_SAVE_CONTEXT();
+                fn->callDirect(this, resultTmp, args);
+
+                if(halt_)
+                {
+                    return;
+                }
+
+                // The native may have raised an error, modified the code, collected, which
+                // drops the last decoded code of the cache, or yielded.
+                if(cc_ != cc || memory_->codeCache_.lastKey_ != codeArray || !codeArray->header_.verified || preempted())
+                {
+                    goto enter;
+                }
+
+                ATOM_NEXT();
+            }
+
+            ATOM_SLOW_PATH(handleCallNative());
+        }
+
+        ATOM_OPCODE(SEND_VAL_TO_VAL)
+        ATOM_OPCODE(SEND_VAL_TO_VAL_WRES)
+        {
+            ++sendCount_;
+            ATOM_SLOW_PATH(handleCachedSend(decoded->sendCaches_[inst->cache]));
+        }
+
+        ATOM_OPCODE(RETURN)
+        ATOM_OPCODE(RETURN_RESULT)
+        {
+            ATOM_SLOW_PATH(handleReturn());
+        }
+
+        ATOM_OPCODE(CREATE_OBJECT)
+        {
+            ATOM_SLOW_PATH(handleCreateObject());
+        }
+
+        ATOM_OPCODE(CREATE_OBJECT_ARRAY)
+        {
+            ATOM_SLOW_PATH(handleCreateObjectArray());
+        }
+
+        ATOM_OPCODE(META_ARGS)
+        {
+            ATOM_SLOW_PATH(handleMetaArgs());
+        }
+
+        ATOM_OPCODE(INSTALL_EXCEPTION_HANDLER)
+        {
+            ATOM_SLOW_PATH(handleInstallExHandler());
+        }
+
+        ATOM_OPCODE(RAISE_EXCEPTION)
+        {
+            ATOM_SLOW_PATH(handleRaiseException());
+        }
+
+        ATOM_OPCODE(HALT)
+        {
+            ++inst;
+            ATOM_SAVE_CONTEXT();
+            halt_ = true;
+            return;
+        }
+
+        ATOM_END_OF_CODE()
+        {
+            ATOM_SLOW_PATH(doReturn(RefHandle(zeroRef(), memory_), false));
+        }
+
+#if !defined ATOM_DISPATCH_THREADED
+        }
+#endif
+    }
+
+#undef ATOM_SAVE_CONTEXT
+#undef ATOM_FAIL
+#undef ATOM_SET_TEMP
+#undef ATOM_SLOW_PATH
+#undef ATOM_OPCODE
+#undef ATOM_END_OF_CODE
+#undef ATOM_NEXT
+
     void Thread::execute()
     {
         if(halted())
@@ -514,11 +1365,11 @@ namespace atom
         }
         else
         {
-            while(!halted())
+            while(!halted() && !preempted())
             {
                 try
                 {
-                    step();
+                    run();
                 }
                 catch(memory_exhausted_error const& ex)
                 {
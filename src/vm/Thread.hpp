@@ -13,7 +13,9 @@
 
 #include "Object.hpp"
 #include "Memory.hpp"
+#include "FrameStack.hpp"
 #include "Opcode.hpp"
+#include "ThreadStats.hpp"
 #include <stdexcept>
 
 namespace atom
@@ -28,6 +30,8 @@ namespace atom
         };
     }
 
+    class Scheduler;
+
     struct Thread
     {
         Memory* memory_;
@@ -35,6 +39,9 @@ namespace atom
 
         long sendCount_;
         long bytecodeCount_;
+
+        // Detailed counters, collected only when the VM is built with ATOM_STATS.
+        ThreadStats stats_;
         
         // Static thread state.
         RefHandle startBallRollingBytecodes_;
@@ -44,9 +51,23 @@ namespace atom
         // An object to represent missing objects.
         RefHandle nullArray_;
         
-        PtrHandle<CallContext> cc_;
+        // Contexts and temps of the running functions, cc_ is the innermost context.
+        FrameStack frames_;
+        CallContext* cc_;
+
+        // run() returns at the first send, return or jump once bytecodeCount_ reaches
+        // preemptAt_, which lets a scheduler switch threads.
+        long preemptAt_;
 
-        Thread(Memory* memory);
+        // Scheduler running the thread, zero if the thread is run by itself.
+        Scheduler* scheduler_;
+
+        /**
+         * Creates a thread whose frame stack starts with a segment of the given number of
+         * slots, it grows as calls need.
+         */
+        Thread(Memory* memory, word stackSegmentSize = FrameStack::SEGMENT_SIZE);
+        ~Thread();
 
         void prepareInitialSend(RefHandle firstTarget, RefHandle firstMessage);
         
@@ -77,24 +98,97 @@ namespace atom
         void handleInstallExHandler();
         void handleRaiseException();
         void sendToSimpleFunction(RefHandle msg, RefHandle target, int resultTmp);
+        
+        /**
+         * Pushes a context running the given function.
+         *
+         * @pre the function has a valid structure
+         */
+        void enterSimpleFunction(Ref msg, SimpleFunction* fn, bool verified, int resultTmp);
+
+        /**
+         * Pushes a context running the given metaobject for a message sent to target without
+         * creating the meta message. The function starts with a META_ARGS instruction, whose
+         * temps receive the target and the real message directly and which is skipped, $0 is
+         * zero. A function that needs the meta message itself creates it with croa.
+         *
+         * @pre takesMetaArgs(fn) == true
+         */
+        void enterMetaFunction(Ref target, Ref msg, SimpleFunction* fn, int resultTmp);
+
+        /**
+         * Executes a META_ARGS instruction of a function that received the meta message in $0,
+         * which happens when the function is sent a message without going through a metaobject
+         * send or when it is not verified.
+         */
+        void handleMetaArgs();
         void handleSend();
         void sendMessage(RefHandle msg, RefHandle target, int resultTmp);
+
+        /**
+         * Executes an arithmetic or comparison instruction. Operands that are not integers or
+         * a result that does not fit an integer turn the instruction into a send of the
+         * operands to its handler, see Opcode::isArithmetic.
+         */
+        void handleArithmetic();
+
+        /**
+         * Executes a native call instruction, see Opcode::isNativeCall.
+         */
+        void handleCallNative();
+
+        /**
+         * Calls a native with a message. A direct native receives the message itself if it
+         * takes a single argument and the elements of the message otherwise.
+         */
+        void callNative(NativeFunction* fn, int resultTmp, Ref msg);
+        
+        /**
+         * Same as handleSend() but resolves the target through the inline cache of the send.
+         */
+        void handleCachedSend(SendCache& cache);
+        void sendCached(SendCache& cache, RefHandle msg, RefHandle target, int resultTmp);
+        void callCachedHandler(int kind, Ref handler, Ref msg, int resultTmp);
+
+        /**
+         * Natives read their messages directly, so the stubs among a message and its elements
+         * are loaded before it is passed to a native. Returns the location of the message.
+         */
+        Ref resolveMessage(RefHandle msg);
         void step();
+        
+        /**
+         * Executes bytecodes until the thread halts, is preempted or an error is thrown. Equivalent to
+         * calling step() repeatedly but executes verified code from its decoded form (see
+         * DecodedCode.hpp) and only writes the instruction pointer back to the context for
+         * sends, returns and allocations. Unverified code is executed by step().
+         */
+        void run();
         RefHandle createMetaMessage(RefHandle msg, RefHandle target);        
         void raiseExecError(int code);
         void raiseError(RefHandle excObj);
         
+        /**
+         * Runs the thread until it halts or is preempted, errors are raised in the thread.
+         */
         void execute();
 
         inline void pushNewContext(int resultTmp)
         {
+            ATOM_STAT(++stats_.contexts_);
             cc_->resultTmp_ = word2ref(resultTmp);            
-            cc_ = PtrHandle<CallContext>(memory_->createObject<CallContext>()->initNew(RefHandle(ptr2ref(cc_.ptr()), memory_), nullArray_, nullArray_), memory_);
+            cc_ = frames_.alloc<CallContext>()->initNew(RefHandle(ptr2ref(cc_), memory_), nullArray_, nullArray_);
         }
 
+        /**
+         * Discards the current context together with the frames allocated after it.
+         */
         inline void popContext()
         {
-            cc_ = PtrHandle<CallContext>(cc_->parent(), memory_);
+            CallContext* parent = cc_->parent();
+
+            frames_.release(cc_);
+            cc_ = parent;
         }
 
         inline void popContext(RefHandle returnValue)
@@ -156,6 +250,11 @@ namespace atom
         inline bool halted() const
         {
             return halt_;
+        }
+
+        inline bool preempted() const
+        {
+            return bytecodeCount_ >= preemptAt_;
         }            
     };
 } // namespace atom
@@ -0,0 +1,144 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "ThreadStats.hpp"
+
+using namespace atom;
+
+namespace
+{
+    char const* const opcodeNames[ThreadStats::OPCODE_COUNT] = {
+        "SEND_VAL_TO_VAL",
+        "SEND_VAL_TO_VAL_WRES",
+        "CONDITIONAL_ONE",
+        "CONDITIONAL_NOT_ONE",
+        "RETURN",
+        "RETURN_RESULT",
+        "ARRAY_AT",
+        "ARRAY_AT_PUT",
+        "ARRAY_LENGTH",
+        "CREATE_OBJECT",
+        "CREATE_OBJECT_ARRAY",
+        "HALT",
+        "INSTALL_EXCEPTION_HANDLER",
+        "RAISE_EXCEPTION",
+        "JUMP",
+        "SET_LOCAL",
+        "META_ARGS",
+        "ADD",
+        "SUBTRACT",
+        "MULTIPLY",
+        "DIVIDE",
+        "MODULO",
+        "LESS_THAN",
+        "GREATER_THAN",
+        "EQUAL",
+        "CALL_NATIVE"
+    };
+} // namespace <anonymous>
+
+namespace atom
+{
+    ThreadStats::ThreadStats()
+    {
+        reset();
+    }
+
+    void ThreadStats::reset()
+    {
+        for(int i = 0; i < OPCODE_COUNT; ++i)
+        {
+            opcodes_[i] = 0;
+            cycles_[i] = 0;
+        }
+
+        nativeSends_ = 0;
+        simpleFunctionSends_ = 0;
+        metaObjectSends_ = 0;
+        contexts_ = 0;
+        metaMessages_ = 0;
+        exceptions_ = 0;
+        current_ = -1;
+        since_ = 0;
+    }
+
+    void ThreadStats::add(ThreadStats const& other)
+    {
+        for(int i = 0; i < OPCODE_COUNT; ++i)
+        {
+            opcodes_[i] += other.opcodes_[i];
+            cycles_[i] += other.cycles_[i];
+        }
+
+        nativeSends_ += other.nativeSends_;
+        simpleFunctionSends_ += other.simpleFunctionSends_;
+        metaObjectSends_ += other.metaObjectSends_;
+        contexts_ += other.contexts_;
+        metaMessages_ += other.metaMessages_;
+        exceptions_ += other.exceptions_;
+    }
+
+    void ThreadStats::print(std::ostream& os) const
+    {
+        if(!enabled())
+        {
+            os << "Statistics are not collected, build with ATOM_STATS.\n";
+            return;
+        }
+
+        for(int i = 0; i < OPCODE_COUNT; ++i)
+        {
+            if(opcodes_[i] != 0)
+            {
+                os << opcodeNames[i] << ": " << opcodes_[i] << " executed, " << cycles_[i] << " cycles, "
+                   << cycles_[i] / (double) opcodes_[i] << " cycles each\n";
+            }
+        }
+
+        os << "sends to natives: " << nativeSends_ << "\n"
+           << "sends to simple functions: " << simpleFunctionSends_ << "\n"
+           << "sends to metaobjects: " << metaObjectSends_ << "\n"
+           << "contexts: " << contexts_ << "\n"
+           << "meta messages: " << metaMessages_ << "\n"
+           << "exceptions: " << exceptions_ << "\n";
+    }
+
+    void ThreadStats::printJson(std::ostream& os) const
+    {
+        os << "{\"enabled\": " << (enabled() ? "true" : "false") << ", \"opcodes\": {";
+
+        for(int i = 0, printed = 0; i < OPCODE_COUNT; ++i)
+        {
+            if(opcodes_[i] != 0)
+            {
+                os << (printed++ > 0 ? ", " : "") << "\"" << opcodeNames[i] << "\": {\"count\": " << opcodes_[i]
+                   << ", \"cycles\": " << cycles_[i] << "}";
+            }
+        }
+
+        os << "}, \"sends\": {\"native\": " << nativeSends_ << ", \"simpleFunction\": " << simpleFunctionSends_
+           << ", \"metaObject\": " << metaObjectSends_ << "}, \"contexts\": " << contexts_
+           << ", \"metaMessages\": " << metaMessages_ << ", \"exceptions\": " << exceptions_ << "}";
+    }
+
+    bool ThreadStats::enabled()
+    {
+#if defined ATOM_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    char const* ThreadStats::opcodeName(int opcode)
+    {
+        return opcode >= 0 && opcode < OPCODE_COUNT ? opcodeNames[opcode] : "END_OF_CODE";
+    }
+} // namespace atom
@@ -0,0 +1,144 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_THREADSTATS_HPP_INCLUDED
+#define ATOM_THREADSTATS_HPP_INCLUDED
+
+#include "Config.hpp"
+#include "Opcode.hpp"
+
+#include <ostream>
+
+#if defined ATOM_STATS && !defined __i386__ && !defined __x86_64__
+#include <time.h>
+#endif
+
+// Statements that update the statistics of a thread, compiled in only when ATOM_STATS is
+// defined, see Config.hpp.
+#if defined ATOM_STATS
+#define ATOM_STAT(statement) statement
+#else
+#define ATOM_STAT(statement)
+#endif
+
+namespace atom
+{
+    /**
+     * Execution statistics of a thread. The counters stay zero unless the VM is built with
+     * ATOM_STATS, so the instrumentation costs nothing otherwise.
+     *
+     * Each executed instruction is counted, a conditional and the instruction it guards
+     * separately. The cycles between the dispatch of an instruction and the dispatch of the
+     * next one, natives and collections included, are added to the total of the instruction.
+     */
+    struct ThreadStats
+    {
+        enum
+        {
+            OPCODE_COUNT = Opcode::MAX_OPCODE + 1
+        };
+
+        long opcodes_[OPCODE_COUNT];
+        unsigned long long cycles_[OPCODE_COUNT];
+
+        // Sends by the kind of their target. A send to an object with a metaobject counts
+        // as a metaobject send and, unless the metaobject takes its arguments with META_ARGS,
+        // also as the send of the meta message to the metaobject.
+        long nativeSends_;
+        long simpleFunctionSends_;
+        long metaObjectSends_;
+
+        long contexts_;
+        long metaMessages_;
+        long exceptions_;
+
+        // Instruction whose cycles are being measured, -1 if none, and its dispatch time.
+        int current_;
+        unsigned long long since_;
+
+        ThreadStats();
+
+        void reset();
+
+        /**
+         * Adds the counters of another thread to these.
+         */
+        void add(ThreadStats const& other);
+
+        /**
+         * Prints the nonzero counters, one per line.
+         */
+        void print(std::ostream& os) const;
+
+        /**
+         * Prints the counters as a JSON object.
+         */
+        void printJson(std::ostream& os) const;
+
+        /**
+         * Returns true if the VM was built with ATOM_STATS.
+         */
+        static bool enabled();
+
+        static char const* opcodeName(int opcode);
+
+        /**
+         * Returns a time stamp in processor cycles where the processor has a cycle counter,
+         * in nanoseconds otherwise.
+         */
+        static inline unsigned long long cycles()
+        {
+#if defined __i386__ || defined __x86_64__
+            return __builtin_ia32_rdtsc();
+#elif defined ATOM_STATS
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+            return 0;
+#endif
+        }
+
+        /**
+         * Called at the dispatch of an instruction. Opcodes beyond MAX_OPCODE stand for the
+         * end of the code and are not counted.
+         */
+        inline void dispatch(int opcode)
+        {
+            const unsigned long long now = cycles();
+
+            if(current_ != -1)
+            {
+                cycles_[current_] += now - since_;
+            }
+
+            if(opcode <= Opcode::MAX_OPCODE)
+            {
+                ++opcodes_[opcode];
+                current_ = opcode;
+                since_ = now;
+            }
+            else
+            {
+                current_ = -1;
+            }
+        }
+
+        /**
+         * Called when the thread stops executing instructions.
+         */
+        inline void stop()
+        {
+            dispatch(OPCODE_COUNT);
+        }
+    };
+} // namespace atom
+
+#endif /* ATOM_THREADSTATS_HPP_INCLUDED */
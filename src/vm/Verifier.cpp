@@ -0,0 +1,188 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include "Verifier.hpp"
+#include "Opcode.hpp"
+
+#include <vector>
+
+using namespace atom;
+
+namespace
+{
+    /**
+     * Marks the temps the instruction at ip writes to.
+     */
+    void markWrittenTemps(byte const* code, word ip, word isize, std::vector<bool>& written)
+    {
+        switch(code[ip])
+        {
+            case Opcode::SEND_VAL_TO_VAL_WRES:
+            case Opcode::ARRAY_AT:
+            case Opcode::ARRAY_LENGTH:
+            case Opcode::CREATE_OBJECT:
+            case Opcode::CREATE_OBJECT_ARRAY:
+            case Opcode::ADD:
+            case Opcode::SUBTRACT:
+            case Opcode::MULTIPLY:
+            case Opcode::DIVIDE:
+            case Opcode::MODULO:
+            case Opcode::LESS_THAN:
+            case Opcode::GREATER_THAN:
+            case Opcode::EQUAL:
+            case Opcode::CALL_NATIVE:
+                written[code[ip + isize - 1]] = true;
+                break;
+
+            case Opcode::SET_LOCAL:
+                written[code[ip + 1]] = true;
+                break;
+
+            case Opcode::META_ARGS:
+                written[code[ip + 1]] = true;
+                written[code[ip + 2]] = true;
+                break;
+        }
+    }
+
+    bool verify(SimpleFunction* fn)
+    {
+        const word size = fn->size();
+
+        if(size < 2 || !is_byte_array(fn->bytecodes_) || !is_int(fn->tempCount_) || int_val(fn->tempCount_) < 0)
+        {
+            return false;
+        }
+
+        ByteArray* ba = cast<ByteArray>(fn->bytecodes_);
+
+        if(ba->header_.unverifiable)
+        {
+            return false;
+        }
+
+        const byte* code = ba->data();
+        const word codeSize = ba->size();
+        const word tempCount = size + int_val(fn->tempCount_);
+
+        std::vector<bool> instructionStart(codeSize, false);
+        std::vector<bool> written(tempCount, false);
+        std::vector<int> jumpTemps;
+        bool afterConditional = false;
+
+        for(word ip = 0; ip < codeSize; )
+        {
+            byte opcode = code[ip];
+
+            if(!Opcode::isValid(opcode))
+            {
+                return false;
+            }
+
+            word isize;
+            int firstTemp = 1;
+
+            if(Opcode::isVariableLength(opcode))
+            {
+                if(ip + 1 >= codeSize)
+                {
+                    return false;
+                }
+
+                isize = Opcode::instructionSize(opcode, code[ip + 1]);
+                firstTemp = 2;
+            }
+            else
+            {
+                isize = Opcode::instructionSize(opcode, 0);
+            }
+
+            if(ip + isize > codeSize)
+            {
+                return false;
+            }
+
+            for(int i = firstTemp; i < isize; ++i)
+            {
+                if(code[ip + i] >= tempCount)
+                {
+                    return false;
+                }
+            }
+
+            if(Opcode::isConditional(opcode))
+            {
+                if(afterConditional)
+                {
+                    return false;
+                }
+
+                afterConditional = true;
+            }
+            else
+            {
+                afterConditional = false;
+            }
+
+            markWrittenTemps(code, ip, isize, written);
+
+            if(opcode == Opcode::JUMP)
+            {
+                jumpTemps.push_back(code[ip + 1]);
+            }
+
+            instructionStart[ip] = true;
+            ip += isize;
+        }
+
+        // A conditional must have an instruction to guard.
+        if(afterConditional)
+        {
+            return false;
+        }
+
+        // Temps 0 and 1 hold the message and zero, known objects start at index 2.
+        for(std::vector<int>::const_iterator it = jumpTemps.begin(); it != jumpTemps.end(); ++it)
+        {
+            if(*it < 2 || *it >= size || written[*it])
+            {
+                return false;
+            }
+
+            Ref target = fn->at(*it);
+
+            if(!is_int(target) || int_val(target) < 0 || int_val(target) >= codeSize || !instructionStart[int_val(target)])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+} // namespace <anonymous>
+
+namespace atom
+{
+    bool verifySimpleFunction(SimpleFunction* fn)
+    {
+        if(verify(fn))
+        {
+            fn->header_.verified = 1;
+            cast<ByteArray>(fn->bytecodes_)->header_.verified = 1;
+
+            return true;
+        }
+
+        fn->header_.verified = 0;
+        fn->header_.unverifiable = 1;
+
+        return false;
+    }
+} // namespace atom
@@ -0,0 +1,69 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#ifndef ATOM_VERIFIER_HPP_INCLUDED
+#define ATOM_VERIFIER_HPP_INCLUDED
+
+#include "Object.hpp"
+#include "Opcode.hpp"
+
+namespace atom
+{
+    /**
+     * Returns true if the function and its bytecodes passed verification and have not been
+     * modified since.
+     */
+    inline bool isVerified(SimpleFunction* fn)
+    {
+        return fn->header_.verified && is_byte_array(fn->bytecodes_) && cast<ByteArray>(fn->bytecodes_)->header_.verified;
+    }
+
+    /**
+     * Verifies that the bytecodes of a simple function can be executed without any runtime
+     * checks when they run with the temps created by Thread::sendToSimpleFunction:
+     *
+     * - every instruction is valid and completely contained in the bytecodes,
+     * - every temp index is less than the temp count of the function,
+     * - every conditional is followed by a non-conditional instruction,
+     * - every jump goes through a known object slot of the function holding an integer that is
+     *   the offset of an instruction, and no instruction of the function writes to that slot.
+     *
+     * On success the verified flag of both the function and its bytecodes is set. Otherwise
+     * the function is marked unverifiable and executed with the checked code path, which raises
+     * the appropriate error if the code actually misbehaves. A function that is modified later
+     * is verified again, bytecodes that are modified after verification are never trusted again.
+     *
+     * @return true if the function is verified
+     */
+    bool verifySimpleFunction(SimpleFunction* fn);
+
+    /**
+     * Returns true if the function is verified, verifying it if it was not tried before.
+     */
+    inline bool ensureVerified(SimpleFunction* fn)
+    {
+        return isVerified(fn) || (!fn->header_.unverifiable && verifySimpleFunction(fn));
+    }
+
+    /**
+     * Returns true if the function takes the target and the real message of a meta message in
+     * temps, that is if its bytecodes start with a META_ARGS instruction. Such a function is
+     * entered by Thread::enterMetaFunction when it handles a message as a metaobject.
+     *
+     * @pre isVerified(fn) == true
+     */
+    inline bool takesMetaArgs(SimpleFunction* fn)
+    {
+        ByteArray* bytecodes = cast<ByteArray>(fn->bytecodes_);
+        return bytecodes->size() > 0 && bytecodes->data()[0] == Opcode::META_ARGS;
+    }
+} // namespace atom
+
+#endif /* ATOM_VERIFIER_HPP_INCLUDED */
@@ -12,6 +12,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
 #include <assembler/Lexer.hpp>
@@ -203,3 +204,81 @@ TEST(AssemblerTest, VarDef)
     ASSERT_FLOAT_EQ(3.14, float_val(oa->at(1)));
     */
 }
+
+TEST(AssemblerTest, Arithmetic)
+{
+    std::istringstream in(
+        "main: !simplefn\n"
+        "{\n"
+        "    !var:0 msg\n"
+        "    !var:1 tmp\n"
+        "    !var:2 handler\n"
+        "\n"
+        "    !mul msg 3 !with handler > tmp\n"
+        "    !lt tmp msg !with handler > tmp\n"
+        "    !retres tmp\n"
+        "}\n");
+
+    Lexer lexer(in, std::string("-"));
+    Parser parser(lexer);
+    parser.parse();
+
+    Memory mem(10240);
+    Assembler as(mem, parser.toplevelNodes());
+    as.assemble();
+
+    ASSERT_TRUE(is_simple_fn(as.result()->at(0)));
+    SimpleFunction* fn = cast<SimpleFunction>(as.result()->at(0));
+    ByteArray* ba = cast<ByteArray>(fn->bytecodes_);
+
+    ASSERT_EQ(12, ba->size());
+    ASSERT_EQ(Opcode::MULTIPLY, ba->data()[0]);
+    ASSERT_EQ(0, ba->data()[1]);
+    ASSERT_EQ(3, int_val(fn->at(ba->data()[2])));
+    ASSERT_EQ(2, ba->data()[3]);
+    ASSERT_EQ(1, ba->data()[4]);
+
+    ASSERT_EQ(Opcode::LESS_THAN, ba->data()[5]);
+    ASSERT_EQ(1, ba->data()[6]);
+    ASSERT_EQ(0, ba->data()[7]);
+    ASSERT_EQ(2, ba->data()[8]);
+    ASSERT_EQ(1, ba->data()[9]);
+
+    ASSERT_EQ(Opcode::RETURN_RESULT, ba->data()[10]);
+}
+
+TEST(AssemblerTest, Call)
+{
+    std::istringstream in(
+        "main: !simplefn\n"
+        "{\n"
+        "    !var:0 msg\n"
+        "    !var:1 tmp\n"
+        "    !var:2 native\n"
+        "\n"
+        "    !call native [msg, 3] > tmp\n"
+        "    !retres tmp\n"
+        "}\n");
+
+    Lexer lexer(in, std::string("-"));
+    Parser parser(lexer);
+    parser.parse();
+
+    Memory mem(10240);
+    Assembler as(mem, parser.toplevelNodes());
+    as.assemble();
+
+    ASSERT_TRUE(is_simple_fn(as.result()->at(0)));
+    SimpleFunction* fn = cast<SimpleFunction>(as.result()->at(0));
+    ByteArray* ba = cast<ByteArray>(fn->bytecodes_);
+
+    ASSERT_EQ(8, ba->size());
+    ASSERT_EQ(Opcode::CALL_NATIVE, ba->data()[0]);
+    ASSERT_EQ(2, ba->data()[1]);
+    ASSERT_EQ(2, ba->data()[2]);
+    ASSERT_EQ(0, ba->data()[3]);
+    ASSERT_EQ(3, int_val(fn->at(ba->data()[4])));
+    ASSERT_EQ(1, ba->data()[5]);
+
+    ASSERT_EQ(Opcode::RETURN_RESULT, ba->data()[6]);
+}
@@ -0,0 +1,199 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vm/Thread.hpp>
+#include <debugger/ImageSaver.hpp>
+#include <debugger/ImageLoader.hpp>
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace atom;
+using namespace atom::debugger;
+
+namespace
+{
+    /**
+     * Metaobject storing the second element of an [index, value] message into the slot of
+     * its target at index.
+     */
+    void atPutMetaobject(Thread* thread, int resultTmp, Ref metaMessage)
+    {
+        ObjectArray* mm = cast<ObjectArray>(metaMessage);
+        Object* target = cast<Object>(mm->at(MetaMessageElements::TARGET));
+        ObjectArray* msg = cast<ObjectArray>(mm->at(MetaMessageElements::REALMSG));
+
+        target->atPut(int_val(msg->at(0)), msg->at(1));
+    }
+}
+
+class ImageTest : public ::testing::Test
+{
+protected:
+    Memory* mem;
+    Thread* thread;
+
+    virtual void SetUp()
+    {
+        mem = new Memory(1024, 256);
+        thread = new Thread(mem);
+        mem->setThread(thread);
+    }
+
+    virtual void TearDown()
+    {
+        delete thread;
+        delete mem;
+        remove("test.img");
+    }
+
+    void writeFile(void const* data, size_t size)
+    {
+        FILE* file = fopen("test.img", "wb");
+        fwrite(data, size, 1, file);
+        fclose(file);
+    }
+};
+
+TEST_F(ImageTest, RoundTrip)
+{
+    PtrHandle<Object> target(mem->createObject<Object>(4), mem);
+    target->atPut(0, mem->createNativeFunction(&atPutMetaobject));
+
+    Ref value = mem->createFloat(2.5);
+    target->atPut(1, value);
+
+    value = mem->createByteArrayFromString("image");
+    target->atPut(2, value);
+
+    RefHandle message(ptr2ref(mem->createObjectArray(RefHandle(word2ref(2), mem), RefHandle(word2ref(7), mem))), mem);
+    mem->integerMo_ = RefHandle(ptr2ref(target.ptr()), mem);
+
+    thread->prepareInitialSend(RefHandle(ptr2ref(target.ptr()), mem), message);
+    thread->sendCount_ = 3;
+
+    ImageSaver saver(thread);
+    saver.nameNative((void*) &atPutMetaobject, "atPutMetaobject");
+    saver.addRoot(ptr2ref(target.ptr(), true));
+    saver.addRoot(word2ref(42));
+    saver.save("test.img");
+
+    Memory loadMem(1024, 256);
+    Thread loadThread(&loadMem);
+    loadMem.setThread(&loadThread);
+
+    ImageLoader loader(&loadThread);
+    loader.nameNative("atPutMetaobject", (void*) &atPutMetaobject);
+    loader.load("test.img");
+
+    ASSERT_EQ(2U, loader.rootCount());
+    ASSERT_EQ(word2ref(42), loader.rootAt(1));
+    ASSERT_TRUE(array_access(loader.rootAt(0)));
+    ASSERT_EQ(loader.rootAt(0), loadMem.integerMo_.ref());
+    ASSERT_TRUE(loadMem.toSpace_->contains(loader.rootAt(0)));
+
+    Object* loaded = cast<Object>(loader.rootAt(0));
+    ASSERT_TRUE(is_native_fn(loaded->at(0)));
+    ASSERT_EQ(2.5, float_val(loaded->at(1)));
+    ASSERT_EQ(0, memcmp("image", cast<ByteArray>(loaded->at(2))->data(), 5));
+    ASSERT_EQ(3, loadThread.sendCount_);
+    ASSERT_FALSE(loadThread.halt_);
+
+    // The restored thread resumes the prepared send.
+    ASSERT_NE((CallContext*) 0, loadThread.cc_);
+    ASSERT_TRUE(loadThread.cc_->header_.frame);
+    loadThread.execute();
+
+    loaded = cast<Object>(loader.rootAt(0));
+    ASSERT_EQ(7, int_val(loaded->at(2)));
+
+    // The source VM is unchanged by saving.
+    ASSERT_TRUE(is_byte_array(target->at(2)));
+    thread->execute();
+    ASSERT_EQ(7, int_val(target->at(2)));
+}
+
+TEST_F(ImageTest, LargeObjects)
+{
+    PtrHandle<ObjectArray> large(mem->createObjectArray(2000), mem);
+    large->atPut(1999, mem->createByteArrayFromString("large"));
+    ASSERT_TRUE(large->header_.large);
+
+    ImageSaver saver(thread);
+    saver.addRoot(ptr2ref(large.ptr()));
+    saver.save("test.img");
+
+    Memory loadMem(8192, 256);
+    Thread loadThread(&loadMem);
+    loadMem.setThread(&loadThread);
+
+    ImageLoader loader(&loadThread);
+    loader.load("test.img");
+
+    ObjectArray* loaded = cast<ObjectArray>(loader.rootAt(0));
+
+    ASSERT_EQ(2000, loaded->size());
+    ASSERT_FALSE(loaded->header_.large);
+    ASSERT_EQ(0, memcmp("large", cast<ByteArray>(loaded->at(1999))->data(), 5));
+}
+
+TEST_F(ImageTest, UnknownNative)
+{
+    RefHandle fn(mem->createNativeFunction(&atPutMetaobject), mem);
+
+    ImageSaver saver(thread);
+    saver.nameNative((void*) &atPutMetaobject, "atPutMetaobject");
+    saver.addRoot(fn.ref());
+    saver.save("test.img");
+
+    Ref before = thread->nullArray_.ref();
+
+    ImageLoader loader(thread);
+    ASSERT_THROW(loader.load("test.img"), std::runtime_error);
+    ASSERT_EQ(before, thread->nullArray_.ref());
+}
+
+TEST_F(ImageTest, InvalidImages)
+{
+    ImageSaver saver(thread);
+    saver.addRoot(ptr2ref(mem->createObjectArray(1)));
+    saver.save("test.img");
+
+    FILE* file = fopen("test.img", "rb");
+    std::vector<char> image(65536);
+    image.resize(fread(&image[0], 1, image.size(), file));
+    fclose(file);
+
+    ImageLoader loader(thread);
+
+    // Truncated.
+    writeFile(&image[0], image.size() - sizeof(Ref));
+    ASSERT_THROW(loader.load("test.img"), std::runtime_error);
+
+    // The user root refers to the middle of an object.
+    std::vector<char> corrupt(image);
+    ImageFormat::ImageHeader const* header = (ImageFormat::ImageHeader const*) &corrupt[0];
+    Ref* userRoot = (Ref*) &corrupt[sizeof(ImageFormat::ImageHeader) + header->nativesSize + ImageFormat::FIXED_ROOT_COUNT * sizeof(Ref)];
+    userRoot->data_ += 1;
+
+    writeFile(&corrupt[0], corrupt.size());
+    ASSERT_THROW(loader.load("test.img"), std::runtime_error);
+
+    writeFile("ATOMSTOR", 8);
+    ASSERT_THROW(loader.load("test.img"), std::runtime_error);
+
+    writeFile(&image[0], image.size());
+    loader.load("test.img");
+    ASSERT_TRUE(is_object_array(loader.rootAt(0)));
+}
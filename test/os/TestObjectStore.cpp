@@ -8,7 +8,9 @@
  * the Free Software Foundation with the exceptions specified in COPYING file.
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <vm/Object.hpp>
 #include <vm/Thread.hpp>
@@ -32,8 +34,8 @@ protected:
 
     virtual void TearDown()
     {
-        delete mem;
         delete thread;
+        delete mem;
     }
     
     RefHandle intRef(word w)
@@ -159,3 +161,345 @@ TEST_F(ObjectStoreTest, ObjectStoreLoad)
     ASSERT_EQ(0, strncmp((char const*) ba2->data(), "\xc\xa\xf\xe\xd", ba2->size()));
     */
 }
+
+TEST_F(ObjectStoreTest, SharedObjectIsStoredOnce)
+{
+    ObjectArray* child = mem->createObjectArray(intRef(1), intRef(2));
+    ObjectArray* parent = mem->createObjectArray(2);
+    parent->atPut(0, ptr2ref(child));
+    parent->atPut(1, ptr2ref(child, true));
+
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(parent));
+        osw.flush();
+    }
+
+    ObjectStoreReader osr("test3.os", mem);
+    Object* all = osr.readAll();
+
+    ASSERT_EQ(2L, all->size());
+
+    ObjectArray* loaded = cast<ObjectArray>(all->at(0));
+    ASSERT_EQ(all->at(1), loaded->at(0));
+    ASSERT_EQ(set_array_access(all->at(1)), loaded->at(1));
+}
+
+TEST_F(ObjectStoreTest, DeepList)
+{
+    const int length = 100000;
+
+    delete thread;
+    delete mem;
+
+    mem = new Memory(8 * length);
+    thread = new Thread(mem);
+
+    RefHandle list(zeroRef(), mem);
+
+    for(int i = 0; i < length; ++i)
+    {
+        list = RefHandle(ptr2ref(mem->createObjectArray(intRef(i), list)), mem);
+    }
+
+    {
+        ObjectStoreWriter osw("test4.os");
+        osw.addObject(list.ref());
+        osw.flush();
+    }
+
+    list = RefHandle(zeroRef(), mem);
+
+    ObjectStoreReader osr("test4.os", mem);
+    Object* all = osr.readAll();
+
+    ASSERT_EQ(length, all->size());
+
+    Ref node = all->at(0);
+
+    for(int i = length - 1; i >= 0; --i)
+    {
+        ASSERT_EQ(i, int_val(cast<ObjectArray>(node)->at(0)));
+        node = cast<ObjectArray>(node)->at(1);
+    }
+
+    ASSERT_TRUE(is_int(node));
+}
+
+TEST_F(ObjectStoreTest, TruncatedStore)
+{
+    RefHandle bytes(mem->createByteArrayFromString("truncated"), mem);
+    ObjectArray* oa = mem->createObjectArray(intRef(1), bytes);
+
+    {
+        ObjectStoreWriter osw("test5.os");
+        osw.addObject(ptr2ref(oa));
+        osw.flush();
+    }
+
+    ASSERT_EQ(2L, ObjectStoreReader("test5.os", mem).readAll()->size());
+
+    ASSERT_EQ(0, truncate("test5.os", 3 * sizeof(Ref)));
+    ASSERT_THROW(ObjectStoreReader("test5.os", mem).readAll(), std::runtime_error);
+
+    ASSERT_EQ(0, truncate("test5.os", 0));
+    ASSERT_EQ(0L, ObjectStoreReader("test5.os", mem).readAll()->size());
+}
+
+TEST_F(ObjectStoreTest, VersionedStore)
+{
+    RefHandle bytes(mem->createByteArrayFromString("payload"), mem);
+    RefHandle shared(ptr2ref(mem->createObjectArray(intRef(7), bytes)), mem);
+    ObjectArray* first = mem->createObjectArray(intRef(1), shared);
+
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(first));
+        osw.addObject(shared.ref());
+        osw.addObject(word2ref(42));
+        osw.flush();
+    }
+
+    FILE* file = fopen("test3.os", "rb");
+    ObjectStoreFormat::StoreHeader header;
+    ASSERT_EQ(1U, fread(&header, sizeof(header), 1, file));
+    fclose(file);
+
+    ASSERT_EQ(0, memcmp(header.magic, "ATOMSTOR", sizeof(header.magic)));
+    ASSERT_EQ((atom_uint32_t) ObjectStoreFormat::VERSION, header.version);
+    ASSERT_EQ(3U, header.objectCount);
+
+    ObjectStoreReader osr("test3.os", mem);
+    Object* all = osr.readAll();
+
+    ASSERT_EQ(3L, all->size());
+    ASSERT_EQ(3U, osr.rootCount());
+    ASSERT_EQ(all->at(0), osr.rootAt(all, 0));
+    ASSERT_EQ(42, int_val(osr.rootAt(all, 2)));
+
+    ObjectArray* loaded = cast<ObjectArray>(osr.rootAt(all, 1));
+    ASSERT_EQ(ptr_val(cast<ObjectArray>(all->at(0))->at(1)), loaded);
+
+    ByteArray* ba = cast<ByteArray>(loaded->at(1));
+    ASSERT_EQ(7L, ba->size());
+    ASSERT_EQ(0, memcmp(ba->data(), "payload", 7));
+    ASSERT_TRUE(ba->hasInlineData());
+}
+
+TEST_F(ObjectStoreTest, RootNames)
+{
+    RefHandle first(ptr2ref(mem->createObjectArray(intRef(1), intRef(2))), mem);
+
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(first.ref(), "first");
+        osw.addObject(word2ref(42));
+        osw.addObject(set_array_access(first.ref()), "firstArray");
+        osw.flush();
+    }
+
+    ObjectStoreFormat::StoreHeader header;
+    FILE* file = fopen("test3.os", "rb");
+    ASSERT_EQ(1U, fread(&header, sizeof(header), 1, file));
+    fclose(file);
+
+    ASSERT_EQ(5U, header.sectionCount);
+
+    ObjectStoreReader osr("test3.os", mem);
+    RefHandle root(osr.readObject(0), mem);
+
+    ASSERT_EQ(3U, osr.rootCount());
+    ASSERT_EQ("first", osr.rootName(0));
+    ASSERT_EQ("", osr.rootName(1));
+    ASSERT_EQ("firstArray", osr.rootName(2));
+
+    ASSERT_EQ(root.ref(), osr.readRoot(0));
+    ASSERT_EQ(42, int_val(osr.readRoot(1)));
+    ASSERT_EQ(set_array_access(root.ref()), osr.readRoot(2));
+
+    // Stores without names have no symbols section.
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(first.ref());
+        osw.flush();
+    }
+
+    file = fopen("test3.os", "rb");
+    ASSERT_EQ(1U, fread(&header, sizeof(header), 1, file));
+    fclose(file);
+
+    ASSERT_EQ(4U, header.sectionCount);
+
+    ObjectStoreReader unnamed("test3.os", mem);
+    unnamed.readAll();
+
+    ASSERT_EQ(1U, unnamed.rootCount());
+    ASSERT_EQ("", unnamed.rootName(0));
+}
+
+TEST_F(ObjectStoreTest, LegacyStore)
+{
+    // An object array referring to the byte array stored after it.
+    ObjectStoreFormat::RecordHeader oh;
+    oh.mark = 0;
+    oh.objtype = ObjectType::OBJECT_ARRAY;
+    oh.size = 3;
+    Ref slots[2] = {word2ref(5), ptr2ref((void*) (1 << 2))};
+
+    ObjectStoreFormat::RecordHeader bh;
+    bh.mark = 0;
+    bh.objtype = ObjectType::BYTE_ARRAY;
+    bh.size = 3;
+    Ref contents = zeroRef();
+    memcpy(&contents, "old", 3);
+
+    FILE* file = fopen("test3.os", "wb");
+    fwrite(&oh, sizeof(oh), 1, file);
+    fwrite(slots, sizeof(slots), 1, file);
+    fwrite(&bh, sizeof(bh), 1, file);
+    fwrite(&contents, sizeof(contents), 1, file);
+    fclose(file);
+
+    ObjectStoreReader osr("test3.os", mem);
+    Object* all = osr.readAll();
+
+    ASSERT_EQ(2L, all->size());
+    ASSERT_EQ(0U, osr.rootCount());
+
+    ObjectArray* oa = cast<ObjectArray>(all->at(0));
+    ASSERT_EQ(5, int_val(oa->at(0)));
+    ASSERT_EQ(all->at(1), oa->at(1));
+
+    ByteArray* ba = cast<ByteArray>(all->at(1));
+    ASSERT_EQ(3L, ba->size());
+    ASSERT_EQ(0, memcmp(ba->data(), "old", 3));
+}
+
+TEST_F(ObjectStoreTest, UnsupportedVersion)
+{
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(mem->createObjectArray(intRef(1), intRef(2))));
+        osw.flush();
+    }
+
+    ObjectStoreFormat::StoreHeader header;
+    FILE* file = fopen("test3.os", "r+b");
+    ASSERT_EQ(1U, fread(&header, sizeof(header), 1, file));
+    header.version = ObjectStoreFormat::VERSION + 1;
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+
+    ASSERT_THROW(ObjectStoreReader("test3.os", mem).readAll(), std::runtime_error);
+}
+
+TEST_F(ObjectStoreTest, CorruptRootCount)
+{
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(mem->createObjectArray(intRef(1), intRef(2))));
+        osw.flush();
+    }
+
+    ObjectStoreFormat::StoreHeader header;
+    FILE* file = fopen("test3.os", "r+b");
+    ASSERT_EQ(1U, fread(&header, sizeof(header), 1, file));
+
+    std::vector<ObjectStoreFormat::SectionEntry> sections(header.sectionCount);
+    ASSERT_EQ(sections.size(), fread(&sections[0], sizeof(sections[0]), sections.size(), file));
+
+    // A count whose size in bytes wraps to zero.
+    const uword count = (uword) 1 << (sizeof(uword) * 8 - 3);
+
+    for(size_t i = 0; i < sections.size(); ++i)
+    {
+        if(sections[i].type == ObjectStoreFormat::ROOTS_SECTION)
+        {
+            fseek(file, sections[i].offset, SEEK_SET);
+            fwrite(&count, sizeof(count), 1, file);
+        }
+    }
+
+    fclose(file);
+
+    ASSERT_THROW(ObjectStoreReader("test3.os", mem).readAll(), std::runtime_error);
+}
+
+TEST_F(ObjectStoreTest, LazyLoad)
+{
+    RefHandle bytes(mem->createByteArrayFromString("lazy"), mem);
+    RefHandle child(ptr2ref(mem->createObjectArray(2)), mem);
+    ObjectArray* root = mem->createObjectArray(4);
+
+    root->atPut(0, word2ref(1));
+    root->atPut(1, child.ref());
+    root->atPut(2, bytes.ref());
+    root->atPut(3, set_array_access(child.ref()));
+    cast<ObjectArray>(child.ref())->atPut(0, word2ref(2));
+    cast<ObjectArray>(child.ref())->atPut(1, ptr2ref(root));
+
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(root));
+        osw.flush();
+    }
+
+    ObjectStoreReader osr("test3.os", mem);
+    Ref* heapTop = mem->toSpace_->free_;
+
+    RefHandle loaded(osr.readObject(0), mem);
+
+    // Only the stub of the root is created.
+    ASSERT_TRUE(is_stub(loaded.ref()));
+    ASSERT_EQ(heapTop + 5, mem->toSpace_->free_);
+    ASSERT_EQ(4L, cast<ObjectArray>(loaded.ref())->size());
+
+    mem->resolve(loaded.ref());
+    ObjectArray* oa = cast<ObjectArray>(loaded.ref());
+
+    ASSERT_FALSE(is_stub(loaded.ref()));
+    ASSERT_EQ(1, int_val(oa->at(0)));
+    ASSERT_TRUE(is_stub(oa->at(1)));
+    ASSERT_EQ(set_array_access(oa->at(1)), oa->at(3));
+    ASSERT_FALSE(is_stub(oa->at(2)));
+    ASSERT_EQ(0, memcmp(cast<ByteArray>(oa->at(2))->data(), "lazy", 4));
+
+    mem->flipSpaces();
+
+    Ref loadedChild = mem->resolve(cast<ObjectArray>(loaded.ref())->at(1));
+
+    ASSERT_EQ(loadedChild, cast<ObjectArray>(loaded.ref())->at(1));
+    ASSERT_EQ(2, int_val(cast<ObjectArray>(loadedChild)->at(0)));
+    ASSERT_EQ(loaded.ref(), cast<ObjectArray>(loadedChild)->at(1));
+    ASSERT_EQ(loaded.ref(), osr.readObject(0));
+}
+
+TEST_F(ObjectStoreTest, LazyRun)
+{
+    // Temps: $2 array, $3 0, $4 local.
+    const byte bytes[] = {
+        Opcode::ARRAY_AT, 2, 3, 4,          //  0: aat $2 $3 > $4
+        Opcode::HALT                        //  4: halt
+    };
+
+    PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 4), mem);
+    fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, sizeof(bytes)));
+    fn->atPut(1, word2ref(1));
+    fn->atPut(2, ptr2ref(mem->createObjectArray(intRef(42), intRef(43)), true));
+    fn->atPut(3, word2ref(0));
+
+    {
+        ObjectStoreWriter osw("test3.os");
+        osw.addObject(ptr2ref(fn.ptr()));
+        osw.flush();
+    }
+
+    ObjectStoreReader osr("test3.os", mem);
+
+    thread->prepareInitialSend(RefHandle(osr.readObject(0), mem), RefHandle(zeroRef(), mem));
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+    ASSERT_EQ(42, int_val(thread->cc_->temps()->at(4)));
+}
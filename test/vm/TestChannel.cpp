@@ -0,0 +1,261 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Isolate.hpp>
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <vector>
+
+using namespace atom;
+
+namespace
+{
+    void nop(Thread* thread, int resultTmp, Ref message)
+    {
+    }
+
+    /**
+     * Creates [[1, 2.5, "abc", large], nop, memory handle, self, boxed float], the inner array
+     * appearing twice.
+     */
+    Ref createGraph(Memory* mem, word largeSize)
+    {
+        PtrHandle<ObjectArray> outer(mem->createObjectArray(6), mem);
+        PtrHandle<ObjectArray> inner(mem->createObjectArray(4), mem);
+
+        inner->atPut(0, word2ref(1));
+        inner->atPut(1, mem->createFloat(2.5));
+        inner->atPut(2, mem->createByteArrayFromString("abc"));
+
+        Ref large = mem->createManagedByteArray(largeSize);
+        memset(cast<ByteArray>(large)->data(), 7, largeSize);
+        inner->atPut(3, large);
+
+        outer->atPut(0, ptr2ref(inner.ptr(), true));
+        outer->atPut(1, mem->createNativeFunction(&nop));
+        outer->atPut(2, mem->createOpaqueNativeHandle(mem));
+        outer->atPut(3, ptr2ref(outer.ptr(), true));
+        outer->atPut(4, ptr2ref(inner.ptr()));
+        outer->atPut(5, mem->createFloat(1e300));
+
+        return ptr2ref(outer.ptr(), true);
+    }
+
+    struct ProducerArgs
+    {
+        Channel* channel;
+        int producer;
+        int count;
+    };
+
+    void* produce(void* arg)
+    {
+        ProducerArgs* args = (ProducerArgs*) arg;
+        Memory mem(1 << 16);
+
+        for(int i = 0; i < args->count; ++i)
+        {
+            RefHandle message(ptr2ref(mem.createObjectArray(RefHandle(word2ref(args->producer), &mem), RefHandle(word2ref(i), &mem)), true), &mem);
+            args->channel->send(Parcel::pack(&mem, message));
+        }
+
+        return 0;
+    }
+
+    // Temps: $2 sendToIsolate, $3 receiveMessage, $4 yieldThread, $5 peer index, $6 9,
+    // $7 message, $8 0, $9 to $12 locals.
+    const byte exchangeBytes[] = {
+        Opcode::CREATE_OBJECT_ARRAY, 2, 5, 7, 9,    //  0: croa [$5, $7] > $9
+        Opcode::SEND_VAL_TO_VAL_WRES, 9, 2, 10,     //  5: send $9 to $2 > $10
+        Opcode::SEND_VAL_TO_VAL, 0, 4,              //  9: send $0 to $4
+        Opcode::SEND_VAL_TO_VAL_WRES, 0, 3, 11,     // 12: send $0 to $3 > $11
+        Opcode::EQUAL, 11, 8, 4, 12,                // 16: eq $11 $8 with $4 > $12
+        Opcode::CONDITIONAL_ONE, 12,                // 21: if1 $12
+        Opcode::JUMP, 6,                            // 23: jmp $6
+        Opcode::RETURN_RESULT, 11                   // 25: retres $11
+    };
+
+    /**
+     * Entry of the isolates of IsolatesExchangeMessages: sends the index of the isolate to
+     * the other one, polls for the message of the other one and stores its index in arg.
+     */
+    void exchange(Isolate* isolate, void* arg)
+    {
+        Memory* mem = &isolate->memory_;
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 9), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) exchangeBytes, sizeof(exchangeBytes)));
+        fn->atPut(1, word2ref(4));
+        fn->atPut(2, mem->createNativeFunction(&fn_sendToIsolate));
+        fn->atPut(3, mem->createNativeFunction(&fn_receiveMessage));
+        fn->atPut(4, mem->createNativeFunction(&fn_yieldThread));
+        fn->atPut(5, word2ref(1 - isolate->index_));
+        fn->atPut(6, word2ref(9));
+        fn->atPut(7, ptr2ref(mem->createObjectArray(RefHandle(word2ref(isolate->index_), mem), RefHandle(mem->createByteArrayFromString("ping"), mem)), true));
+        fn->atPut(8, word2ref(0));
+
+        isolate->thread_.prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+        isolate->scheduler_.add(&isolate->thread_);
+        isolate->scheduler_.run();
+
+        // The result is the one element array holding the message.
+        ObjectArray* message = cast<ObjectArray>(cast<ObjectArray>(isolate->thread_.cc_->temps()->at(0))->at(0));
+        *(Ref*) arg = message->at(0);
+    }
+}
+
+TEST(ChannelTest, ParcelCopiesGraph)
+{
+    Memory source(4096);
+    Memory target(4096);
+    RefHandle graph(createGraph(&source, 5000), &source);
+
+    Parcel* parcel = Parcel::pack(&source, graph);
+    source.flipSpaces();
+
+    Ref copy = parcel->unpack(&target);
+    delete parcel;
+
+    ASSERT_TRUE(is_object_array(copy));
+    ASSERT_TRUE(array_access(copy));
+    ASSERT_TRUE(target.toSpace_->contains(copy));
+
+    ObjectArray* outer = cast<ObjectArray>(copy);
+    ObjectArray* inner = cast<ObjectArray>(outer->at(0));
+
+    ASSERT_EQ(copy, outer->at(3));
+    ASSERT_EQ(ptr_val(outer->at(0)), ptr_val(outer->at(4)));
+    ASSERT_FALSE(array_access(outer->at(4)));
+
+    ASSERT_EQ(1L, int_val(inner->at(0)));
+    ASSERT_EQ(2.5, float_val(inner->at(1)));
+    ASSERT_EQ(1e300, float_val(outer->at(5)));
+    ASSERT_EQ(0, strncmp("abc", (char const*) cast<ByteArray>(inner->at(2))->data(), 3));
+    ASSERT_TRUE(cast<ByteArray>(inner->at(2))->hasInlineData());
+
+    ByteArray* large = cast<ByteArray>(inner->at(3));
+    ASSERT_EQ(5000, large->size());
+    ASSERT_EQ(7, large->data()[4999]);
+
+    ASSERT_EQ((void*) &nop, cast<NativeFunction>(outer->at(1))->data_);
+    ASSERT_EQ((void*) &target, cast<ByteArray>(outer->at(2))->data_);
+
+    // The copy survives collections of the receiving memory.
+    RefHandle copyHandle(copy, &target);
+    target.flipSpaces();
+    ASSERT_EQ(7, cast<ByteArray>(cast<ObjectArray>(cast<ObjectArray>(copyHandle.ref())->at(0))->at(3))->data()[0]);
+}
+
+TEST(ChannelTest, ImmediatesNeedNoSlots)
+{
+    Memory mem(1024);
+    Parcel* parcel = Parcel::pack(&mem, RefHandle(word2ref(42), &mem));
+
+    ASSERT_EQ(0u, parcel->slotCount());
+    ASSERT_EQ(42L, int_val(parcel->unpack(&mem)));
+
+    delete parcel;
+}
+
+TEST(ChannelTest, ReceivesInOrder)
+{
+    Memory mem(1024);
+    Channel channel;
+
+    ASSERT_TRUE(channel.receive() == 0);
+
+    for(int i = 0; i < 3; ++i)
+    {
+        channel.send(Parcel::pack(&mem, RefHandle(word2ref(i), &mem)));
+    }
+
+    for(int i = 0; i < 3; ++i)
+    {
+        Parcel* parcel = channel.receive();
+
+        ASSERT_TRUE(parcel != 0);
+        ASSERT_EQ((long) i, int_val(parcel->unpack(&mem)));
+        delete parcel;
+    }
+
+    ASSERT_TRUE(channel.receive() == 0);
+
+    // Parcels left in the channel are deleted with it.
+    channel.send(Parcel::pack(&mem, RefHandle(word2ref(3), &mem)));
+}
+
+TEST(ChannelTest, ManySenders)
+{
+    const int producers = 4;
+    const int count = 2000;
+
+    Memory mem(1 << 16);
+    Channel channel;
+    pthread_t threads[producers];
+    ProducerArgs args[producers];
+
+    for(int i = 0; i < producers; ++i)
+    {
+        args[i].channel = &channel;
+        args[i].producer = i;
+        args[i].count = count;
+        ASSERT_EQ(0, pthread_create(&threads[i], 0, &produce, &args[i]));
+    }
+
+    // Messages of each sender arrive in the order they were sent.
+    std::vector<int> next(producers, 0);
+    int received = 0;
+
+    while(received < producers * count)
+    {
+        Parcel* parcel = channel.receive();
+
+        if(parcel == 0)
+        {
+            continue;
+        }
+
+        ObjectArray* message = cast<ObjectArray>(parcel->unpack(&mem));
+        int producer = int_val(message->at(0));
+
+        ASSERT_EQ(next[producer], int_val(message->at(1)));
+        ++next[producer];
+        ++received;
+
+        delete parcel;
+    }
+
+    for(int i = 0; i < producers; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    ASSERT_TRUE(channel.receive() == 0);
+}
+
+TEST(ChannelTest, IsolatesExchangeMessages)
+{
+    IsolateVec isolates;
+    Ref received[2] = {zeroRef(), zeroRef()};
+
+    isolates.push_back(new Isolate(HeapPolicy(4096, 0), &isolates, 0));
+    isolates.push_back(new Isolate(HeapPolicy(4096, 0), &isolates, 1));
+
+    isolates[0]->start(&exchange, &received[0]);
+    isolates[1]->start(&exchange, &received[1]);
+    isolates[0]->join();
+    isolates[1]->join();
+
+    ASSERT_EQ(1L, int_val(received[0]));
+    ASSERT_EQ(0L, int_val(received[1]));
+
+    delete isolates[0];
+    delete isolates[1];
+}
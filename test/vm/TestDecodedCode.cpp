@@ -0,0 +1,156 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <cstring>
+#include <vm/DecodedCode.hpp>
+#include <vm/Memory.hpp>
+#include <vm/Verifier.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace atom;
+
+namespace
+{
+    const byte loopBytes[] = {
+        Opcode::SET_LOCAL, 4, 2,            // 0: set $4 $2
+        Opcode::CONDITIONAL_NOT_ONE, 4,     // 3: ifnot1 $4
+        Opcode::JUMP, 3,                    // 5: jmp $3
+        Opcode::RETURN_RESULT, 5            // 7: retres $5
+    };
+}
+
+class DecodedCodeTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        mem = new Memory(1024, 256);
+        std::memcpy(bytes, loopBytes, sizeof(loopBytes));
+    }
+
+    virtual void TearDown()
+    {
+        delete mem;
+    }
+
+    /**
+     * Creates a verified function whose bytecodes are a writable copy of loopBytes.
+     */
+    Ref createFunction()
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 4), mem);
+
+        Ref bytecodes = mem->createUnmanagedByteArray(bytes, sizeof(bytes));
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(2));
+        fn->atPut(2, word2ref(0));
+        fn->atPut(3, word2ref(3));
+
+        verifySimpleFunction(fn.ptr());
+        return ptr2ref(fn.ptr());
+    }
+
+    Memory* mem;
+    byte bytes[sizeof(loopBytes)];
+};
+
+TEST_F(DecodedCodeTest, Decode)
+{
+    Ref fn = createFunction();
+    DecodedCode code(cast<ByteArray>(cast<SimpleFunction>(fn)->at(0)), 0);
+
+    ASSERT_EQ(5U, code.instructions_.size());
+
+    ASSERT_EQ(Opcode::SET_LOCAL, code.at(0)->opcode);
+    ASSERT_EQ(4, code.at(0)->operands[0]);
+    ASSERT_EQ(2, code.at(0)->operands[1]);
+
+    ASSERT_EQ(code.at(0) + 1, code.at(3));
+    ASSERT_EQ(code.at(3) + 2, code.at(7));
+    ASSERT_EQ(-1, code.indexes_[4]);
+
+    ASSERT_EQ(5, code.at(7)->operands[0]);
+    ASSERT_EQ(DecodedInstruction::END_OF_CODE, code.at(9)->opcode);
+    ASSERT_EQ(9, code.at(9)->ip);
+}
+
+TEST_F(DecodedCodeTest, CacheFollowsMovedArrays)
+{
+    RefHandle fn(createFunction(), mem);
+    ByteArray* bytecodes = cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0));
+    DecodedCode* code = mem->codeCache_.get(bytecodes, 0);
+
+    ASSERT_EQ(code, mem->codeCache_.get(bytecodes, 0));
+
+    mem->collectNursery();
+    ByteArray* promoted = cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0));
+
+    ASSERT_NE(bytecodes, promoted);
+    ASSERT_EQ(1, mem->codeCache_.size());
+    ASSERT_EQ(code, mem->codeCache_.get(promoted, 0));
+
+    mem->flipSpaces();
+    ByteArray* moved = cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0));
+
+    ASSERT_NE(promoted, moved);
+    ASSERT_EQ(code, mem->codeCache_.get(moved, 0));
+}
+
+TEST_F(DecodedCodeTest, DeadArraysAreDropped)
+{
+    Ref fn = createFunction();
+    mem->codeCache_.get(cast<ByteArray>(cast<SimpleFunction>(fn)->at(0)), 0);
+
+    mem->flipSpaces();
+    ASSERT_EQ(0, mem->codeCache_.size());
+}
+
+TEST_F(DecodedCodeTest, ModifiedArraysAreDropped)
+{
+    RefHandle fn(createFunction(), mem);
+    ByteArray* bytecodes = cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0));
+    mem->codeCache_.get(bytecodes, 0);
+
+    bytecodes->atPut(8, word2ref(4));
+
+    mem->flipSpaces();
+    ASSERT_EQ(0, mem->codeCache_.size());
+}
+
+TEST_F(DecodedCodeTest, SendCacheFollowsMovedKeys)
+{
+    const byte sendBytes[] = {
+        Opcode::SEND_VAL_TO_VAL, 0, 2,      // 0: send $0 to $2
+        Opcode::RETURN                      // 3: ret
+    };
+
+    std::memcpy(bytes, sendBytes, sizeof(sendBytes));
+
+    RefHandle fn(createFunction(), mem);
+    RefHandle key(ptr2ref(mem->createObjectArray(1)), mem);
+    Ref dead = ptr2ref(mem->createObjectArray(1));
+
+    DecodedCode* code = mem->codeCache_.get(cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0)), 0);
+    ASSERT_EQ(0, code->instructions_[0].cache);
+    ASSERT_EQ(-1, code->instructions_[1].cache);
+
+    SendCache& cache = code->sendCaches_[0];
+    cache.add(key.ref(), SendCache::NATIVE_FUNCTION);
+    cache.add(dead, SendCache::SIMPLE_FUNCTION);
+
+    Ref oldKey = key.ref();
+    mem->flipSpaces();
+
+    ASSERT_NE(oldKey, key.ref());
+    ASSERT_EQ(1, cache.count_);
+    ASSERT_EQ(key.ref(), cache.entries_[0].key);
+    ASSERT_EQ(SendCache::NATIVE_FUNCTION, cache.entries_[0].kind);
+}
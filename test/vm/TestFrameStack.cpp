@@ -0,0 +1,149 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/FrameStack.hpp>
+#include <vm/Thread.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace atom;
+
+TEST(FrameStackTest, AllocAndRelease)
+{
+    FrameStack frames;
+
+    CallContext* cc = frames.alloc<CallContext>();
+    ObjectArray* temps = frames.allocObjectArray(4);
+
+    ASSERT_EQ((void*) (temps), (void*) (((Ref*) cc) + cc->header_.size));
+    ASSERT_EQ(4, temps->size());
+    ASSERT_EQ(zeroRef(), temps->at(3));
+    ASSERT_TRUE(temps->header_.frame);
+    ASSERT_EQ((word) (cc->header_.size + temps->header_.size), frames.usedSize());
+
+    frames.release(temps);
+    ASSERT_EQ((word) cc->header_.size, frames.usedSize());
+
+    ASSERT_EQ((void*) temps, (void*) frames.allocObjectArray(2));
+    frames.release(cc);
+    ASSERT_EQ(0, frames.usedSize());
+}
+
+TEST(FrameStackTest, FramesAreNotRemembered)
+{
+    FrameStack frames;
+    ObjectArray* temps = frames.allocObjectArray(1);
+
+    // The write barrier must not record frames, they are scanned by every collection.
+    ASSERT_TRUE(temps->header_.remembered);
+    ASSERT_FALSE(temps->header_.young);
+}
+
+TEST(FrameStackTest, Segments)
+{
+    FrameStack frames;
+    ObjectArray* first = frames.allocObjectArray(FrameStack::SEGMENT_SIZE / 2);
+    ObjectArray* second = frames.allocObjectArray(FrameStack::SEGMENT_SIZE / 2);
+
+    ASSERT_EQ(1U, frames.current_);
+
+    ObjectArray* large = frames.allocObjectArray(FrameStack::SEGMENT_SIZE * 2);
+    ASSERT_EQ(2U, frames.current_);
+    ASSERT_EQ(FrameStack::SEGMENT_SIZE * 2, large->size());
+
+    frames.release(second);
+    ASSERT_EQ(1U, frames.current_);
+    ASSERT_EQ((word) first->header_.size, frames.usedSize());
+
+    // Released segments are reused and grown if necessary.
+    ObjectArray* larger = frames.allocObjectArray(FrameStack::SEGMENT_SIZE * 3);
+    ASSERT_EQ(2U, frames.current_);
+    ASSERT_EQ(3U, frames.segments_.size());
+    ASSERT_TRUE(frames.segments_[2].containsPtr(larger));
+
+    frames.release(first);
+    ASSERT_EQ(0U, frames.current_);
+    ASSERT_EQ(0, frames.usedSize());
+}
+
+TEST(FrameStackTest, MaximumSize)
+{
+    FrameStack frames(FrameStack::SEGMENT_SIZE + 100);
+    ObjectArray* first = frames.allocObjectArray(FrameStack::SEGMENT_SIZE - 16);
+
+    // The last segment is cut to the slots left.
+    ObjectArray* last = frames.allocObjectArray(50);
+    ASSERT_EQ(1U, frames.current_);
+    ASSERT_EQ(FrameStack::SEGMENT_SIZE + 100, frames.reservedSize_);
+
+    ASSERT_THROW(frames.allocObjectArray(100), memory_exhausted_error);
+    ASSERT_EQ(1U, frames.current_);
+    ASSERT_TRUE(frames.segments_[1].containsPtr(last));
+
+    frames.release(first);
+    ASSERT_THROW(frames.allocObjectArray(FrameStack::SEGMENT_SIZE * 2), memory_exhausted_error);
+    ASSERT_EQ(0U, frames.current_);
+    ASSERT_EQ(0, frames.usedSize());
+}
+
+TEST(FrameStackTest, SmallSegmentsGrow)
+{
+    FrameStack frames(0, FrameStack::SMALL_SEGMENT_SIZE);
+    ASSERT_EQ(FrameStack::SMALL_SEGMENT_SIZE, frames.reservedSize_);
+
+    // Each new segment is twice the size of the previous one.
+    ObjectArray* first = frames.allocObjectArray(FrameStack::SMALL_SEGMENT_SIZE - 16);
+    frames.allocObjectArray(FrameStack::SMALL_SEGMENT_SIZE * 2 - 16);
+    frames.allocObjectArray(FrameStack::SMALL_SEGMENT_SIZE * 4 - 16);
+
+    ASSERT_EQ(2U, frames.current_);
+    ASSERT_EQ(FrameStack::SMALL_SEGMENT_SIZE * 7, frames.reservedSize_);
+
+    // Idle segments are kept until trimmed.
+    frames.release(first);
+    ASSERT_EQ(3U, frames.segments_.size());
+
+    frames.trim();
+    ASSERT_EQ(1U, frames.segments_.size());
+    ASSERT_EQ(FrameStack::SMALL_SEGMENT_SIZE, frames.reservedSize_);
+    ASSERT_EQ(0, frames.usedSize());
+}
+
+namespace
+{
+    // Temps: $2 the function itself.
+    const byte recurseBytes[] = {
+        Opcode::SEND_VAL_TO_VAL, 0, 2,  // 0: send $0 to $2
+        Opcode::RETURN                  // 3: ret
+    };
+}
+
+TEST(FrameStackTest, RunawayRecursionExhaustsStack)
+{
+    HeapPolicy policy(4096);
+    policy.stackSize = 64 * 1024;
+
+    Memory mem(policy);
+    Thread thread(&mem);
+
+    PtrHandle<SimpleFunction> fn(mem.createObject<SimpleFunction>(1 + 3), &mem);
+    fn->atPut(0, mem.createUnmanagedByteArray((byte*) recurseBytes, sizeof(recurseBytes)));
+    fn->atPut(1, word2ref(0));
+    fn->atPut(2, ptr2ref(fn.ptr()));
+
+    thread.prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), &mem), RefHandle(zeroRef(), &mem));
+    thread.execute();
+
+    // The stack, not the heap, is exhausted.
+    ASSERT_TRUE(thread.halted());
+    ASSERT_EQ(0, mem.majorCollections_);
+    ASSERT_TRUE(thread.frames_.reservedSize_ > policy.stackSize / 2);
+    ASSERT_TRUE(thread.frames_.reservedSize_ <= policy.stackSize);
+}
@@ -0,0 +1,57 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/HeapPolicy.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace atom;
+
+TEST(HeapPolicyTest, Parse)
+{
+    HeapPolicy policy;
+
+    ASSERT_TRUE(policy.parse("initial=64K,max=2M,nursery=1000,large=2K,stack=256K,grow=0.6,shrink=0.1"));
+    ASSERT_EQ(65536, policy.initialSize);
+    ASSERT_EQ(2097152, policy.maxSize);
+    ASSERT_EQ(1000, policy.nurserySize);
+    ASSERT_EQ(2048, policy.largeSize);
+    ASSERT_EQ(262144, policy.stackSize);
+    ASSERT_DOUBLE_EQ(0.6, policy.growRatio);
+    ASSERT_DOUBLE_EQ(0.1, policy.shrinkRatio);
+    ASSERT_TRUE(policy.valid());
+}
+
+TEST(HeapPolicyTest, ParseInvalid)
+{
+    HeapPolicy policy;
+
+    ASSERT_FALSE(policy.parse("initial=64X"));
+    ASSERT_FALSE(policy.parse("size=1"));
+    ASSERT_FALSE(policy.parse("max"));
+    ASSERT_FALSE(policy.parse("grow=2"));
+
+    ASSERT_TRUE(policy.parse("initial=2M,max=1M"));
+    ASSERT_FALSE(policy.valid());
+}
+
+TEST(HeapPolicyTest, TargetSize)
+{
+    HeapPolicy policy(1024);
+    policy.maxSize = 8192;
+
+    ASSERT_EQ(1024, policy.targetSize(100, 1024));
+    ASSERT_EQ(2048, policy.targetSize(600, 1024));
+    ASSERT_EQ(8192, policy.targetSize(4000, 1024));
+    ASSERT_EQ(8192, policy.targetSize(100000, 1024));
+    ASSERT_EQ(4096, policy.targetSize(1000, 8192));
+    ASSERT_EQ(2048, policy.targetSize(400, 8192));
+    ASSERT_EQ(1024, policy.targetSize(10, 8192));
+}
@@ -8,6 +8,7 @@
  * the Free Software Foundation with the exceptions specified in COPYING file.
  */
 
+#include <cstring>
 #include <vm/Memory.hpp>
 #include <vm/Object.hpp>
 
@@ -78,10 +79,461 @@ TEST(ObjectTest, CreateFloat)
     Memory mem(1024);
 
     ASSERT_EQ(mem.toSpace_->free_, mem.toSpace_->start_);
-    Ref r = mem.createFloat(678.344);
+    // Too large to be immediate.
+    Ref r = mem.createFloat(678.344e300);
     ASSERT_EQ(mem.toSpace_->free_, mem.toSpace_->start_ + 2);
 
     ASSERT_TRUE(is_float(r));
     ASSERT_FALSE(is_int(r));
-    ASSERT_DOUBLE_EQ(678.344, float_val(r));
+    ASSERT_DOUBLE_EQ(678.344e300, float_val(r));
+}
+
+TEST(MemoryTest, NurseryAllocation)
+{
+    Memory mem(1024, 128);
+
+    ObjectArray* oa = mem.createObjectArray(2);
+
+    ASSERT_TRUE(mem.isYoung(ptr2ref(oa)));
+    ASSERT_EQ(1, oa->header_.young);
+    ASSERT_EQ(mem.toSpace_->start_, mem.toSpace_->free_);
+}
+
+TEST(MemoryTest, MinorCollectionPromotesSurvivors)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ObjectArray> survivor(mem.createObjectArray(1), &mem);
+    survivor->atPut(0, word2ref(42));
+    mem.createObjectArray(10);
+
+    mem.collectNursery();
+
+    ASSERT_EQ(1, mem.minorCollections_);
+    ASSERT_EQ(0, mem.majorCollections_);
+    ASSERT_FALSE(mem.isYoung(ptr2ref(survivor.ptr())));
+    ASSERT_TRUE(mem.toSpace_->containsPtr(survivor.ptr()));
+    ASSERT_EQ(mem.nursery_->start_, mem.nursery_->free_);
+    ASSERT_EQ(2, mem.toSpace_->freeSize());
+    ASSERT_EQ(42, int_val(survivor->at(0)));
+}
+
+TEST(MemoryTest, WriteBarrierRemembersOldObject)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ObjectArray> old(mem.createObjectArray(1), &mem);
+    mem.collectNursery();
+
+    ObjectArray* young = mem.createObjectArray(1);
+    young->atPut(0, word2ref(7));
+    old->atPut(0, ptr2ref(young));
+
+    ASSERT_EQ(1, old->header_.remembered);
+    mem.collectNursery();
+    ASSERT_EQ(0, old->header_.remembered);
+
+    ObjectArray* promoted = cast<ObjectArray>(old->at(0));
+
+    ASSERT_TRUE(mem.toSpace_->containsPtr(promoted));
+    ASSERT_EQ(7, int_val(promoted->at(0)));
+}
+
+TEST(MemoryTest, RememberedSetsBelongToTheirMemory)
+{
+    // A memory destroyed with remembered objects must not leave them to the memories
+    // created after it, which may reuse the same addresses.
+    for(int round = 0; round < 8; ++round)
+    {
+        Memory* mem = new Memory(1024, 128);
+
+        ASSERT_EQ(0, Memory::current());
+        ASSERT_TRUE(mem->remembered_.empty());
+
+        PtrHandle<ObjectArray>* old = new PtrHandle<ObjectArray>(mem->createObjectArray(1), mem);
+        mem->collectNursery();
+        (*old)->atPut(0, ptr2ref(mem->createObjectArray(1)));
+
+        ASSERT_EQ(mem, Memory::owner((ObjectBase*) old->ptr()));
+        ASSERT_EQ(1U, mem->remembered_.size());
+        mem->collectNursery();
+        (*old)->atPut(0, ptr2ref(mem->createObjectArray(1)));
+
+        delete old;
+        delete mem;
+    }
+
+    // The barrier records into the memory owning the object, even while another memory
+    // is current.
+    HeapPolicy policy(1024, 128);
+    policy.largeSize = 64;
+
+    Memory first(policy);
+    PtrHandle<ObjectArray> old(first.createObjectArray(1), &first);
+    PtrHandle<ObjectArray> large(first.createObjectArray(100), &first);
+    first.collectNursery();
+
+    ASSERT_EQ(1, large->header_.large);
+
+    Memory second(1024, 128);
+    CurrentMemoryScope current(&second);
+
+    old->atPut(0, ptr2ref(first.createObjectArray(1)));
+    large->atPut(0, ptr2ref(first.createObjectArray(1)));
+
+    ASSERT_EQ(&first, Memory::owner((ObjectBase*) large.ptr()));
+    ASSERT_EQ(2U, first.remembered_.size());
+    ASSERT_TRUE(second.remembered_.empty());
+}
+
+TEST(MemoryTest, AllocationTriggersMinorCollection)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ObjectArray> survivor(mem.createObjectArray(1), &mem);
+
+    for(int i = 0; i < 100; ++i)
+    {
+        mem.createObjectArray(10);
+    }
+
+    ASSERT_LT(0, mem.minorCollections_);
+    ASSERT_EQ(0, mem.majorCollections_);
+    ASSERT_TRUE(mem.toSpace_->containsPtr(survivor.ptr()));
+}
+
+TEST(MemoryTest, UnregisteringHandleKeepsOtherRoots)
+{
+    Memory mem(1024);
+
+    RefHandle first(ptr2ref(mem.createObjectArray(1)), &mem);
+    RefHandle* middle = new RefHandle(ptr2ref(mem.createObjectArray(2)), &mem);
+    RefHandle last(ptr2ref(mem.createObjectArray(3)), &mem);
+
+    ASSERT_EQ(3U, mem.refHandles_.size());
+    delete middle;
+    ASSERT_EQ(2U, mem.refHandles_.size());
+    ASSERT_EQ(1, last.slot_);
+
+    mem.flipSpaces();
+
+    ASSERT_TRUE(mem.toSpace_->contains(first.ref()));
+    ASSERT_TRUE(mem.toSpace_->contains(last.ref()));
+    ASSERT_EQ(1, cast<ObjectArray>(first.ref())->size());
+    ASSERT_EQ(3, cast<ObjectArray>(last.ref())->size());
+}
+
+TEST(MemoryTest, SharedRootIsCopiedOnce)
+{
+    Memory mem(1024);
+
+    RefHandle a(ptr2ref(mem.createObjectArray(1)), &mem);
+    RefHandle b(a);
+    PtrHandle<ObjectArray> c(cast<ObjectArray>(a.ref()), &mem);
+
+    mem.flipSpaces();
+
+    ASSERT_EQ(a.ref(), b.ref());
+    ASSERT_EQ(ptr_val(a.ref()), (void*) c.ptr());
+    ASSERT_EQ(2, mem.toSpace_->freeSize());
+}
+
+namespace
+{
+    /**
+     * Creates a linked list of [index, next] object arrays, returns its head.
+     */
+    Ref createChain(Memory& mem, int length)
+    {
+        RefHandle head(zeroRef(), &mem);
+        
+        for(int i = length - 1; i >= 0; --i)
+        {
+            ObjectArray* node = mem.createObjectArray(2);
+            
+            node->atPut(0, word2ref(i));
+            node->atPut(1, head.ref());
+            head.ref(ptr2ref(node));
+        }
+        
+        return head.ref();
+    }
+}
+
+TEST(MemoryTest, DeepChainDoesNotRecurse)
+{
+    const int length = 200000;
+    Memory mem(length * 4 + 16);
+    
+    RefHandle head(createChain(mem, length), &mem);
+    mem.flipSpaces();
+    
+    Ref current = head.ref();
+    
+    for(int i = 0; i < length; ++i)
+    {
+        ASSERT_TRUE(mem.toSpace_->contains(current));
+        ASSERT_EQ(i, int_val(cast<ObjectArray>(current)->at(0)));
+        current = cast<ObjectArray>(current)->at(1);
+    }
+    
+    ASSERT_EQ(zeroRef(), current);
+}
+
+TEST(MemoryTest, BreadthFirstCopyOrder)
+{
+    Memory mem(1024);
+    
+    PtrHandle<ObjectArray> root(mem.createObjectArray(2), &mem);
+    root->atPut(0, createChain(mem, 2));
+    root->atPut(1, createChain(mem, 2));
+    
+    mem.flipSpaces();
+    
+    Ref* start = mem.toSpace_->start_;
+    
+    // root, then both heads, then the second nodes.
+    ASSERT_EQ((void*) start, (void*) root.ptr());
+    ASSERT_EQ((void*) (start + 3), ptr_val(root->at(0)));
+    ASSERT_EQ((void*) (start + 6), ptr_val(root->at(1)));
+}
+
+TEST(MemoryTest, HierarchicalCopyOrder)
+{
+    Memory mem(1024);
+    mem.hierarchicalCopy_ = true;
+    
+    PtrHandle<ObjectArray> root(mem.createObjectArray(2), &mem);
+    root->atPut(0, createChain(mem, 2));
+    root->atPut(1, createChain(mem, 2));
+    
+    mem.flipSpaces();
+    
+    Ref* start = mem.toSpace_->start_;
+    ObjectArray* first = cast<ObjectArray>(root->at(0));
+    
+    // root, then the first list node by node, then the second list.
+    ASSERT_EQ((void*) start, (void*) root.ptr());
+    ASSERT_EQ((void*) (start + 3), (void*) first);
+    ASSERT_EQ((void*) (start + 6), ptr_val(first->at(1)));
+    ASSERT_EQ((void*) (start + 9), ptr_val(root->at(1)));
+    ASSERT_EQ(1, int_val(cast<ObjectArray>(cast<ObjectArray>(root->at(1))->at(1))->at(0)));
+}
+
+namespace
+{
+    void fillWithArrays(Memory& mem, PtrHandle<ObjectArray>& list)
+    {
+        for(int i = 0; i < list->size(); ++i)
+        {
+            // Allocation may move the list, so it is dereferenced afterwards.
+            Ref item = ptr2ref(mem.createObjectArray(1));
+            list->atPut(i, item);
+        }
+    }
+}
+
+TEST(MemoryTest, HeapGrowsUnderPressure)
+{
+    HeapPolicy policy(256);
+    policy.maxSize = 8192;
+
+    Memory mem(policy);
+    PtrHandle<ObjectArray> list(mem.createObjectArray(1000), &mem);
+
+    fillWithArrays(mem, list);
+
+    ASSERT_LT(256, mem.toSpace_->size());
+    ASSERT_GE(8192, mem.toSpace_->size());
+    ASSERT_TRUE(mem.toSpace_->containsPtr(cast<ObjectArray>(list->at(999))));
+}
+
+TEST(MemoryTest, HeapShrinksAfterBurst)
+{
+    HeapPolicy policy(256);
+    policy.maxSize = 8192;
+
+    // The burst must occupy the semispaces.
+    policy.largeSize = 0;
+
+    Memory mem(policy);
+
+    {
+        PtrHandle<ObjectArray> burst(mem.createObjectArray(2000), &mem);
+        mem.flipSpaces();
+        ASSERT_LT(2048, mem.toSpace_->size());
+    }
+
+    mem.flipSpaces();
+    mem.flipSpaces();
+
+    ASSERT_EQ(256, mem.toSpace_->size());
+}
+
+TEST(MemoryTest, FixedHeapIsExhausted)
+{
+    Memory mem(256);
+    PtrHandle<ObjectArray> list(mem.createObjectArray(100), &mem);
+
+    ASSERT_THROW(fillWithArrays(mem, list), memory_exhausted_error);
+}
+
+TEST(MemoryTest, MajorCollectionKeepsNurseryObjects)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ObjectArray> old(mem.createObjectArray(1), &mem);
+    mem.collectNursery();
+
+    ObjectArray* young = mem.createObjectArray(1);
+    young->atPut(0, ptr2ref(old.ptr()));
+    old->atPut(0, ptr2ref(young));
+
+    mem.collectOld(0);
+
+    ASSERT_EQ(young, cast<ObjectArray>(old->at(0)));
+    ASSERT_EQ(old.ptr(), cast<ObjectArray>(young->at(0)));
+    ASSERT_EQ(1, old->header_.remembered);
+
+    mem.collectNursery();
+
+    ObjectArray* promoted = cast<ObjectArray>(old->at(0));
+
+    ASSERT_TRUE(mem.toSpace_->containsPtr(promoted));
+    ASSERT_EQ(old.ptr(), cast<ObjectArray>(promoted->at(0)));
+}
+
+TEST(MemoryTest, SmallByteArraysAreInline)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ByteArray> ba(cast<ByteArray>(mem.createManagedByteArray(10)), &mem);
+    memcpy(ba->data(), "0123456789", 10);
+
+    ASSERT_TRUE(ba->hasInlineData());
+    ASSERT_EQ(ByteArray::heapSlots(10), ba->header_.size);
+    ASSERT_TRUE(mem.externalPayloads_.empty());
+
+    mem.collectNursery();
+    ASSERT_TRUE(ba->hasInlineData());
+    ASSERT_EQ(0, memcmp("0123456789", ba->data(), 10));
+
+    mem.flipSpaces();
+    ASSERT_TRUE(mem.toSpace_->containsPtr(ba->data()));
+    ASSERT_EQ(0, memcmp("0123456789", ba->data(), 10));
+}
+
+TEST(MemoryTest, LargeByteArraysAreExternal)
+{
+    Memory mem(1024, 128);
+
+    PtrHandle<ByteArray> live(cast<ByteArray>(mem.createManagedByteArray(ByteArray::MAX_INLINE_SIZE + 1)), &mem);
+    mem.createManagedByteArray(ByteArray::MAX_INLINE_SIZE + 1);
+    live->data()[ByteArray::MAX_INLINE_SIZE] = 7;
+
+    ASSERT_FALSE(live->hasInlineData());
+    ASSERT_EQ(2U, mem.externalPayloads_.size());
+
+    mem.collectNursery();
+    ASSERT_EQ(1U, mem.externalPayloads_.size());
+    ASSERT_EQ(live.ptr(), mem.externalPayloads_[0]);
+
+    mem.flipSpaces();
+    ASSERT_EQ(live.ptr(), mem.externalPayloads_[0]);
+    ASSERT_EQ(7, live->data()[ByteArray::MAX_INLINE_SIZE]);
+}
+
+TEST(MemoryTest, LargeObjectsAreNotMoved)
+{
+    Memory mem(4096, 256);
+
+    PtrHandle<ObjectArray> large(mem.createObjectArray(2000), &mem);
+    ObjectArray* address = large.ptr();
+
+    ASSERT_TRUE(large->header_.large);
+    ASSERT_FALSE(large->header_.young);
+    ASSERT_TRUE(mem.large_.contains(address));
+
+    large->atPut(0, ptr2ref(mem.createObjectArray(1)));
+    large->atPut(1999, ptr2ref(mem.createObjectArray(1)));
+
+    mem.flipSpaces();
+    mem.flipSpaces();
+
+    ASSERT_EQ(address, large.ptr());
+    ASSERT_TRUE(mem.toSpace_->contains(large->at(0)));
+    ASSERT_TRUE(mem.toSpace_->contains(large->at(1999)));
+    ASSERT_EQ(2 * (2000 + 1), mem.large_.savedSlots_);
+}
+
+TEST(MemoryTest, DeadLargeObjectsAreFreed)
+{
+    Memory mem(4096, 256);
+
+    PtrHandle<ObjectArray> holder(mem.createObjectArray(1), &mem);
+    holder->atPut(0, ptr2ref(mem.createObjectArray(2000)));
+    mem.createObjectArray(3000);
+
+    ASSERT_EQ(2U, (uword) mem.large_.objectCount());
+
+    mem.flipSpaces();
+    ASSERT_EQ(1U, (uword) mem.large_.objectCount());
+    ASSERT_EQ(2000 + 1, mem.large_.slots_);
+
+    // Reached only through an old object.
+    ASSERT_EQ(2000, cast<ObjectArray>(holder->at(0))->size());
+
+    holder->atPut(0, word2ref(0));
+    mem.flipSpaces();
+    ASSERT_EQ(0U, (uword) mem.large_.objectCount());
+    ASSERT_EQ(0, mem.large_.slots_);
+}
+
+TEST(MemoryTest, LargeObjectsKeepNurseryObjects)
+{
+    Memory mem(4096, 256);
+
+    PtrHandle<ObjectArray> large(mem.createObjectArray(2000), &mem);
+    ObjectArray* young = mem.createObjectArray(1);
+
+    young->atPut(0, word2ref(5));
+    large->atPut(1000, ptr2ref(young));
+    ASSERT_TRUE(large->header_.remembered);
+
+    // The major collection leaves the nursery object in place, the minor one promotes it.
+    mem.collectOld(0);
+    ASSERT_EQ(young, cast<ObjectArray>(large->at(1000)));
+
+    mem.collectNursery();
+
+    ObjectArray* promoted = cast<ObjectArray>(large->at(1000));
+
+    ASSERT_TRUE(mem.toSpace_->containsPtr(promoted));
+    ASSERT_EQ(5, int_val(promoted->at(0)));
+    ASSERT_FALSE(large->header_.remembered);
+}
+
+TEST(MemoryTest, FloatsAreImmediate)
+{
+    Memory mem(1024, 128);
+    const long allocations = mem.allocations_;
+
+    Ref immediate = mem.createFloat(1.5);
+
+    ASSERT_TRUE(is_immediate_float(immediate));
+    ASSERT_EQ(allocations, mem.allocations_);
+    ASSERT_EQ(mem.floatMo_.ref(), mem.findMetaObject(immediate));
+
+    PtrHandle<ObjectArray> holder(mem.createObjectArray(2), &mem);
+    holder->atPut(0, immediate);
+    holder->atPut(1, mem.createFloat(1e300));
+
+    ASSERT_FALSE(is_immediate(holder->at(1)));
+    ASSERT_TRUE(is_float(holder->at(1)));
+
+    mem.flipSpaces();
+
+    ASSERT_EQ(immediate, holder->at(0));
+    ASSERT_EQ(1.5, float_val(holder->at(0)));
+    ASSERT_EQ(1e300, float_val(holder->at(1)));
 }
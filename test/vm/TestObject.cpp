@@ -71,3 +71,28 @@ TEST(ObjectTest, ByteArray)
     ASSERT_EQ(222, data[1]);
     ASSERT_EQ(76, data[2]);
 }
+
+TEST(ObjectTest, NativeSignature)
+{
+    uword signature;
+
+    ASSERT_TRUE(NativeSignature::parse("rifba", signature));
+    ASSERT_EQ(5, NativeSignature::arity(signature));
+    ASSERT_EQ((int) NativeSignature::ANY, NativeSignature::argType(signature, 0));
+    ASSERT_EQ((int) NativeSignature::INTEGER, NativeSignature::argType(signature, 1));
+    ASSERT_EQ((int) NativeSignature::FLOAT, NativeSignature::argType(signature, 2));
+    ASSERT_EQ((int) NativeSignature::BYTE_ARRAY, NativeSignature::argType(signature, 3));
+    ASSERT_EQ((int) NativeSignature::OBJECT_ARRAY, NativeSignature::argType(signature, 4));
+
+    // Direct natives without arguments have a signature too.
+    ASSERT_TRUE(NativeSignature::parse("", signature));
+    ASSERT_NE(0U, signature);
+    ASSERT_EQ(0, NativeSignature::arity(signature));
+
+    ASSERT_FALSE(NativeSignature::parse("ix", signature));
+    ASSERT_FALSE(NativeSignature::parse("iiiiiii", signature));
+
+    ASSERT_TRUE(NativeSignature::accepts(NativeSignature::INTEGER, word2ref(1)));
+    ASSERT_TRUE(NativeSignature::accepts(NativeSignature::ANY, word2ref(1)));
+    ASSERT_FALSE(NativeSignature::accepts(NativeSignature::BYTE_ARRAY, word2ref(1)));
+}
@@ -0,0 +1,143 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Profiler.hpp>
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace atom;
+
+namespace
+{
+    Profiler* testProfiler = 0;
+
+    void sampleNow(Thread* thread, int resultTmp, Ref message)
+    {
+        testProfiler->sample();
+        thread->setResult(resultTmp, message);
+    }
+
+    void add1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) + 1));
+    }
+
+    // Temps: $2 target, $3 result.
+    const byte forwardBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 0, 2, 3,  // 0: send $0 to $2 > $3
+        Opcode::RETURN_RESULT, 3                // 4: retres $3
+    };
+
+    // Temps: $2 add1, $4 limit, $5 loop ip, $7 counter, $8 condition.
+    const byte loopBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 7, 2, 7,  //  0: send $7 to $2 > $7
+        Opcode::LESS_THAN, 7, 4, 2, 8,          //  4: lt $7 $4 with $2 > $8
+        Opcode::CONDITIONAL_ONE, 8,             //  9: if1 $8
+        Opcode::JUMP, 5,                        // 11: jmp $5
+        Opcode::RETURN_RESULT, 7                // 13: retres $7
+    };
+
+    Ref createForward(Memory* mem, Ref target)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 3), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) forwardBytes, sizeof(forwardBytes)));
+        fn->atPut(1, word2ref(1));
+        fn->atPut(2, target);
+
+        return ptr2ref(fn.ptr());
+    }
+
+    Ref createLoop(Memory* mem, word limit)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 8), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+        fn->atPut(1, word2ref(2));
+        fn->atPut(2, mem->createNativeFunction(&add1));
+        fn->atPut(3, word2ref(0));
+        fn->atPut(4, word2ref(limit));
+        fn->atPut(5, word2ref(0));
+        fn->atPut(6, word2ref(0));
+        fn->atPut(7, word2ref(0));
+
+        return ptr2ref(fn.ptr());
+    }
+}
+
+TEST(ProfilerTest, SampleRecordsNamedFunctions)
+{
+    Memory mem(4096);
+    Thread thread(&mem);
+    mem.setThread(&thread);
+
+    Profiler profiler(&mem);
+    testProfiler = &profiler;
+
+    RefHandle inner(createForward(&mem, mem.createNativeFunction(&sampleNow)), &mem);
+    RefHandle outer(createForward(&mem, inner.ref()), &mem);
+
+    profiler.name(inner, "inner");
+    profiler.name(outer, "outer");
+
+    thread.prepareInitialSend(outer, RefHandle(word2ref(7), &mem));
+    thread.execute();
+
+    ASSERT_EQ(7L, int_val(thread.cc_->temps()->at(0)));
+
+    // A sample without a running thread belongs to the VM.
+    mem.setThread(0);
+    profiler.sample();
+    profiler.drain();
+
+    std::ostringstream oss;
+    profiler.writeCollapsed(oss);
+
+    ASSERT_EQ(2L, profiler.samples_);
+    ASSERT_EQ(0L, profiler.dropped_);
+    ASSERT_EQ("[vm] 1\nouter;inner 1\n", oss.str());
+
+    testProfiler = 0;
+}
+
+TEST(ProfilerTest, TimerSamplesRunningCode)
+{
+    Memory mem(4096);
+    Thread thread(&mem);
+    mem.setThread(&thread);
+
+    Profiler profiler(&mem, 5000);
+    RefHandle loop(createLoop(&mem, 3000000), &mem);
+
+    profiler.name(loop, "loop");
+    thread.prepareInitialSend(loop, RefHandle(zeroRef(), &mem));
+
+    profiler.start();
+    thread.execute();
+    profiler.stop();
+
+    ASSERT_EQ(3000000L, int_val(thread.cc_->temps()->at(0)));
+
+#if defined __SANITIZE_THREAD__
+    // ThreadSanitizer delays signals until the next library call, the loop makes none.
+    return;
+#endif
+
+    ASSERT_TRUE(profiler.samples_ > 0);
+
+    std::ostringstream oss;
+    profiler.writeCollapsed(oss);
+
+    ASSERT_NE(std::string::npos, oss.str().find("loop "));
+
+    Profiler total(&mem);
+    total.add(profiler);
+
+    ASSERT_EQ(profiler.samples_, total.samples_);
+}
@@ -8,6 +8,8 @@
  * the Free Software Foundation with the exceptions specified in COPYING file.
  */
 
+#include <math.h>
+
 #include <vm/Ref.hpp>
 #include <vm/Object.hpp>
 
@@ -52,10 +54,16 @@ TEST(RefTest, FieldValues)
     ASSERT_TRUE(is_int(ref));
     ASSERT_EQ(0, int_val(ref));
 
-    ref = ptrAsRef(3);
+    ref = ptrAsRef(5);
     ASSERT_TRUE(is_int(ref));
     ASSERT_EQ(1, int_val(ref));
 
+    // Immediate refs with the array access bit set are floats.
+    ref = ptrAsRef(3);
+    ASSERT_FALSE(is_int(ref));
+    ASSERT_TRUE(is_immediate_float(ref));
+    ASSERT_FALSE(array_access(ref));
+
     ref = ptrAsRef(0xFFFFFFFFFFFFFFFC);
     ASSERT_FALSE(is_int(ref));
     ASSERT_EQ((void*) 0xFFFFFFFFFFFFFFFC, ptr_val(ref));
@@ -78,7 +86,7 @@ TEST(RefTest, FieldValues)
     ASSERT_EQ((void*) 0x9544343A2FE2433C, ptr_val(ref));
 
 
-    ref = ptrAsRef(0x3FFFFFFFFFFFFFFF);
+    ref = ptrAsRef(0x7FFFFFFFFFFFFFFD);
     ASSERT_TRUE(is_int(ref));
     ASSERT_EQ(0x1FFFFFFFFFFFFFFF, int_val(ref));
 #endif
@@ -87,3 +95,35 @@ TEST(RefTest, FieldValues)
 #error Write the test!!!!
 #endif
 }
+
+TEST(RefTest, ImmediateFloats)
+{
+#ifdef ATOM_VM_64BITS
+    double const values[] = {0.0, -0.0, 1.0, -2.5, 3.141592653589793, 1e-70, -1e70, ldexp(1.0, -255), ldexp(2.0 - ldexp(1.0, -52), 255)};
+
+    for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        Ref ref;
+
+        ASSERT_TRUE(double2ref(values[i], ref));
+        ASSERT_TRUE(is_immediate(ref));
+        ASSERT_TRUE(is_float(ref));
+        ASSERT_FALSE(is_int(ref));
+        ASSERT_EQ(values[i], float_val(ref));
+        ASSERT_EQ(signbit(values[i]), signbit(float_val(ref)));
+    }
+
+    Ref one;
+    double2ref(1.0, one);
+    ASSERT_NE(word2ref(int_val(one)), one);
+
+    // Values out of the exponent range are boxed.
+    Ref ref;
+    ASSERT_FALSE(double2ref(ldexp(1.0, -256), ref));
+    ASSERT_FALSE(double2ref(ldexp(1.0, 256), ref));
+    ASSERT_FALSE(double2ref(1e300, ref));
+    ASSERT_FALSE(double2ref(HUGE_VAL, ref));
+    ASSERT_FALSE(double2ref(sqrt(-1.0), ref));
+    ASSERT_FALSE(double2ref(4.9e-324, ref));
+#endif
+}
@@ -0,0 +1,280 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Scheduler.hpp>
+
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace atom;
+
+namespace
+{
+    std::vector<Thread*> recordedThreads;
+
+    void recordThread(Thread* thread, int resultTmp, Ref message)
+    {
+        recordedThreads.push_back(thread);
+        thread->setResult(resultTmp, zeroRef());
+    }
+
+    void add1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) + 1));
+    }
+
+    void collectGarbage(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->memory_->flipSpaces();
+    }
+
+    // Temps: $2 counter, $3 1, $4 limit, $5 jump target, $6 recordThread, $7 condition.
+    const byte loopBytes[] = {
+        Opcode::SEND_VAL_TO_VAL, 2, 6,      //  0: send $2 to $6
+        Opcode::ADD, 2, 3, 6, 2,            //  3: add $2 $3 with $6 > $2
+        Opcode::LESS_THAN, 2, 4, 6, 7,      //  8: lt $2 $4 with $6 > $7
+        Opcode::CONDITIONAL_ONE, 7,         // 13: if1 $7
+        Opcode::JUMP, 5,                    // 15: jmp $5
+        Opcode::RETURN_RESULT, 2            // 17: retres $2
+    };
+
+    Ref createLoopFunction(Memory* mem, word limit)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 8), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+        fn->atPut(1, word2ref(0));
+        fn->atPut(2, word2ref(0));
+        fn->atPut(3, word2ref(1));
+        fn->atPut(4, word2ref(limit));
+        fn->atPut(5, word2ref(0));
+        fn->atPut(6, mem->createNativeFunction(&recordThread));
+        fn->atPut(7, word2ref(0));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    // Temps: $2 spawnThread, $3 joinThread, $4 child, $5 child message, $6 detached,
+    // $7 yieldThread, $8 to $10 locals.
+    const byte spawnJoinBytes[] = {
+        Opcode::CREATE_OBJECT_ARRAY, 3, 4, 5, 6, 8, //  0: croa [$4, $5, $6] > $8
+        Opcode::SEND_VAL_TO_VAL_WRES, 8, 2, 9,      //  6: send $8 to $2 > $9
+        Opcode::SEND_VAL_TO_VAL, 0, 7,              // 10: send $0 to $7
+        Opcode::SEND_VAL_TO_VAL_WRES, 9, 3, 10,     // 13: send $9 to $3 > $10
+        Opcode::RETURN_RESULT, 10                   // 17: retres $10
+    };
+
+    Ref createSpawnJoinFunction(Memory* mem, Ref child, word detached)
+    {
+        RefHandle childHandle(child, mem);
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 8), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) spawnJoinBytes, sizeof(spawnJoinBytes)));
+        fn->atPut(1, word2ref(3));
+        fn->atPut(2, mem->createNativeFunction(&fn_spawnThread));
+        fn->atPut(3, mem->createNativeFunction(&fn_joinThread));
+        fn->atPut(4, childHandle.ref());
+        fn->atPut(5, word2ref(41));
+        fn->atPut(6, word2ref(detached));
+        fn->atPut(7, mem->createNativeFunction(&fn_yieldThread));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    // Temps: $2 yieldThread, $3 collectGarbage, $4 value, $5 local.
+    const byte yieldBytes[] = {
+        Opcode::CREATE_OBJECT_ARRAY, 1, 4, 5,   //  0: croa [$4] > $5
+        Opcode::SEND_VAL_TO_VAL, 0, 2,          //  4: send $0 to $2
+        Opcode::SEND_VAL_TO_VAL, 0, 3,          //  7: send $0 to $3
+        Opcode::RETURN_RESULT, 5                // 10: retres $5
+    };
+
+    Ref createYieldFunction(Memory* mem, word value)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 5), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) yieldBytes, sizeof(yieldBytes)));
+        fn->atPut(1, word2ref(1));
+        fn->atPut(2, mem->createNativeFunction(&fn_yieldThread));
+        fn->atPut(3, mem->createNativeFunction(&collectGarbage));
+        fn->atPut(4, word2ref(value));
+
+        return ptr2ref(fn.ptr());
+    }
+}
+
+class SchedulerTest : public ::testing::Test
+{
+protected:
+    Memory* mem;
+
+    virtual void SetUp()
+    {
+        mem = new Memory(4096);
+        recordedThreads.clear();
+    }
+
+    virtual void TearDown()
+    {
+        delete mem;
+    }
+};
+
+TEST_F(SchedulerTest, ThreadsArePreempted)
+{
+    Thread plain(mem);
+    plain.prepareInitialSend(RefHandle(createLoopFunction(mem, 100), mem), RefHandle(zeroRef(), mem));
+    plain.execute();
+
+    Thread first(mem);
+    Thread second(mem);
+    first.prepareInitialSend(RefHandle(createLoopFunction(mem, 100), mem), RefHandle(zeroRef(), mem));
+    second.prepareInitialSend(RefHandle(createLoopFunction(mem, 100), mem), RefHandle(zeroRef(), mem));
+
+    Scheduler scheduler(mem, 50);
+    scheduler.add(&first);
+    scheduler.add(&second);
+    recordedThreads.clear();
+    scheduler.run();
+
+    ASSERT_TRUE(first.halted());
+    ASSERT_TRUE(second.halted());
+    ASSERT_EQ(100L, int_val(first.cc_->temps()->at(0)));
+    ASSERT_EQ(100L, int_val(second.cc_->temps()->at(0)));
+
+    // Preemption does not change what the threads execute.
+    ASSERT_EQ(plain.bytecodeCount_, first.bytecodeCount_);
+    ASSERT_EQ(plain.sendCount_, second.sendCount_);
+    ASSERT_EQ(0u, scheduler.threadCount());
+
+    int switches = 0;
+
+    for(size_t i = 1; i < recordedThreads.size(); ++i)
+    {
+        switches += recordedThreads[i] != recordedThreads[i - 1];
+    }
+
+    ASSERT_EQ(200u, recordedThreads.size());
+    ASSERT_LT(4, switches);
+}
+
+TEST_F(SchedulerTest, JoinWaitsForRunningThread)
+{
+    Thread main(mem);
+    main.prepareInitialSend(RefHandle(createSpawnJoinFunction(mem, createLoopFunction(mem, 100), 0), mem), RefHandle(zeroRef(), mem));
+
+    // The spawned thread is preempted before main joins it.
+    Scheduler scheduler(mem, 50);
+    scheduler.add(&main);
+    scheduler.run();
+
+    ASSERT_TRUE(main.halted());
+    ASSERT_EQ(100L, int_val(main.cc_->temps()->at(0)));
+    ASSERT_EQ(0u, scheduler.threadCount());
+}
+
+TEST_F(SchedulerTest, JoinReturnsResultOfHaltedThread)
+{
+    Thread main(mem);
+    main.prepareInitialSend(RefHandle(createSpawnJoinFunction(mem, mem->createNativeFunction(&add1), 0), mem), RefHandle(zeroRef(), mem));
+
+    // The spawned thread halts while main yields.
+    Scheduler scheduler(mem);
+    scheduler.add(&main);
+    scheduler.run();
+
+    ASSERT_TRUE(main.halted());
+    ASSERT_EQ(42L, int_val(main.cc_->temps()->at(0)));
+    ASSERT_EQ(0u, scheduler.threadCount());
+}
+
+TEST_F(SchedulerTest, DetachedThreadsCannotBeJoined)
+{
+    Thread main(mem);
+    main.prepareInitialSend(RefHandle(createSpawnJoinFunction(mem, mem->createNativeFunction(&add1), 1), mem), RefHandle(zeroRef(), mem));
+
+    Scheduler scheduler(mem);
+    scheduler.add(&main);
+    scheduler.run();
+
+    ASSERT_TRUE(main.halted());
+    ASSERT_EQ(zeroRef(), main.cc_->temps()->at(0));
+    ASSERT_EQ(0u, scheduler.threadCount());
+}
+
+TEST_F(SchedulerTest, SpawnNeedsScheduler)
+{
+    Thread main(mem);
+    main.prepareInitialSend(RefHandle(createSpawnJoinFunction(mem, mem->createNativeFunction(&add1), 0), mem), RefHandle(zeroRef(), mem));
+    main.execute();
+
+    ASSERT_TRUE(main.halted());
+    ASSERT_EQ(zeroRef(), main.cc_->temps()->at(0));
+}
+
+TEST_F(SchedulerTest, FramesOfAllThreadsAreRoots)
+{
+    Thread first(mem);
+    Thread second(mem);
+    Thread third(mem);
+    Thread* threads[] = {&first, &second, &third};
+    Scheduler scheduler(mem);
+
+    // Each thread collects while the arrays of the others are only in their frames.
+    for(int i = 0; i < 3; ++i)
+    {
+        threads[i]->prepareInitialSend(RefHandle(createYieldFunction(mem, i), mem), RefHandle(zeroRef(), mem));
+        scheduler.add(threads[i]);
+    }
+
+    ASSERT_EQ(3u, scheduler.threadCount());
+
+    scheduler.run();
+
+    ASSERT_EQ(0u, scheduler.threadCount());
+
+    for(int i = 0; i < 3; ++i)
+    {
+        Ref array = threads[i]->cc_->temps()->at(0);
+
+        ASSERT_TRUE(threads[i]->halted());
+        ASSERT_TRUE(mem->toSpace_->contains(array));
+        ASSERT_EQ((long) i, int_val(cast<ObjectArray>(array)->at(0)));
+    }
+}
+
+TEST_F(SchedulerTest, SpawnedThreadsAreDeleted)
+{
+    Scheduler scheduler(mem);
+
+    scheduler.spawn(RefHandle(createYieldFunction(mem, 1), mem), RefHandle(zeroRef(), mem));
+    scheduler.spawn(RefHandle(createYieldFunction(mem, 2), mem), RefHandle(zeroRef(), mem), true);
+
+    ASSERT_EQ(2u, scheduler.threadCount());
+    ASSERT_EQ(2u, mem->frameStacks_.size());
+
+    scheduler.run();
+
+    ASSERT_EQ(0u, scheduler.threadCount());
+    ASSERT_EQ(0u, mem->frameStacks_.size());
+}
+
+TEST_F(SchedulerTest, SpawnedThreadsStartWithSmallStacks)
+{
+    Scheduler scheduler(mem);
+
+    scheduler.spawn(RefHandle(createYieldFunction(mem, 1), mem), RefHandle(zeroRef(), mem));
+    scheduler.spawn(RefHandle(createYieldFunction(mem, 2), mem), RefHandle(zeroRef(), mem));
+
+    for(size_t i = 0; i < mem->frameStacks_.size(); ++i)
+    {
+        ASSERT_EQ(FrameStack::SMALL_SEGMENT_SIZE, mem->frameStacks_[i]->reservedSize_);
+    }
+
+    scheduler.run();
+    ASSERT_EQ(0u, mem->frameStacks_.size());
+}
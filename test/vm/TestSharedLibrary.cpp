@@ -0,0 +1,155 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <string.h>
+
+#include <string>
+
+#include <vm/SharedLibrary.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace atom;
+
+class SharedLibraryTest : public ::testing::Test
+{
+protected:
+    Memory* mem;
+    Thread* thread;
+
+    virtual void SetUp()
+    {
+        mem = new Memory(1024);
+        thread = new Thread(mem);
+        thread->prepareInitialSend(RefHandle(zeroRef(), mem), RefHandle(zeroRef(), mem));
+    }
+
+    virtual void TearDown()
+    {
+        delete thread;
+        delete mem;
+    }
+
+    /**
+     * Calls the native with the message and returns its result.
+     */
+    Ref call(NativeFunction::FunT fn, Ref message)
+    {
+        thread->cc_->temps()->atPut(0, zeroRef());
+        fn(thread, 0, message);
+        return thread->cc_->temps()->at(0);
+    }
+
+    Ref loadLibrary(char const* name)
+    {
+        return call(&fn_loadLibrary, mem->createByteArrayFromString(name));
+    }
+
+    /**
+     * Sends [library, name] to the native.
+     */
+    Ref callWithName(NativeFunction::FunT fn, Ref library, char const* name)
+    {
+        RefHandle libraryHandle(library, mem);
+        RefHandle nameHandle(mem->createByteArrayFromString(name), mem);
+
+        return call(fn, ptr2ref(mem->createObjectArray(libraryHandle, nameHandle)));
+    }
+
+    std::string byteArrayString(Ref ref)
+    {
+        ByteArray* ba = cast<ByteArray>(ref);
+        return std::string((char const*) ba->data(), ba->size());
+    }
+};
+
+TEST_F(SharedLibraryTest, ResolvedFunctionsAreCached)
+{
+    RefHandle libm(loadLibrary("libm.so.6"), mem);
+    ASSERT_TRUE(is_byte_array(libm.ref()));
+
+    RefHandle cosFn(callWithName(&fn_resolveFunction, libm.ref(), "cos"), mem);
+    ASSERT_TRUE(is_native_fn(cosFn.ref()));
+    ASSERT_EQ(1U, mem->symbolCache_.size());
+
+    // Cached functions are roots and follow the collections.
+    mem->flipSpaces();
+
+    Ref again = callWithName(&fn_resolveFunction, libm.ref(), "cos");
+    ASSERT_EQ(cosFn.ref().data_, again.data_);
+    ASSERT_EQ(1U, mem->symbolCache_.size());
+
+    void* handle = (void*) cast<ByteArray>(libm.ref())->data();
+    ASSERT_EQ(dlsym(handle, "cos"), cast<NativeFunction>(again)->data_);
+
+    ASSERT_EQ(1, int_val(callWithName(&fn_resolveFunction, libm.ref(), "noSuchFunction")));
+    ASSERT_EQ(1U, mem->symbolCache_.size());
+}
+
+TEST_F(SharedLibraryTest, CacheGrows)
+{
+    RefHandle libm(loadLibrary("libm.so.6"), mem);
+    char const* names[] = {"cos", "sin", "tan", "acos", "asin", "atan", "cosh", "sinh", "tanh", "exp", "log", "sqrt", "floor", "ceil", "fabs", "pow", "fmod"};
+    const int count = sizeof(names) / sizeof(names[0]);
+
+    for(int i = 0; i < count; ++i)
+    {
+        ASSERT_TRUE(is_native_fn(callWithName(&fn_resolveFunction, libm.ref(), names[i])));
+    }
+
+    ASSERT_EQ((uword) count, mem->symbolCache_.size());
+
+    void* handle = (void*) cast<ByteArray>(libm.ref())->data();
+
+    for(int i = 0; i < count; ++i)
+    {
+        Ref fn;
+
+        ASSERT_TRUE(mem->symbolCache_.find(handle, names[i], strlen(names[i]), fn));
+        ASSERT_EQ(dlsym(handle, names[i]), cast<NativeFunction>(fn)->data_);
+    }
+}
+
+TEST_F(SharedLibraryTest, ResolveAllFunctions)
+{
+    RefHandle libm(loadLibrary("libm.so.6"), mem);
+    RefHandle cosFn(callWithName(&fn_resolveFunction, libm.ref(), "cos"), mem);
+    Ref tableRef = callWithName(&fn_resolveAllFunctions, libm.ref(), "cos");
+
+    ASSERT_TRUE(is_object_array(tableRef));
+    ASSERT_TRUE(array_access(tableRef));
+
+    ObjectArray* table = cast<ObjectArray>(tableRef);
+    void* handle = (void*) cast<ByteArray>(libm.ref())->data();
+    bool foundCos = false;
+
+    ASSERT_TRUE(table->size() >= 2);
+    ASSERT_EQ(0, table->size() % 2);
+
+    for(int i = 0; i < table->size(); i += 2)
+    {
+        std::string name = byteArrayString(table->at(i));
+
+        ASSERT_EQ(0U, name.find("cos"));
+        ASSERT_TRUE(i == 0 || byteArrayString(table->at(i - 2)) < name);
+        ASSERT_EQ(dlsym(handle, name.c_str()), cast<NativeFunction>(table->at(i + 1))->data_);
+
+        if(name == "cos")
+        {
+            foundCos = true;
+            ASSERT_EQ(cosFn.ref().data_, table->at(i + 1).data_);
+        }
+    }
+
+    ASSERT_TRUE(foundCos);
+    ASSERT_EQ((uword) table->size() / 2, mem->symbolCache_.size());
+}
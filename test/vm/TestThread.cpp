@@ -111,8 +111,8 @@ protected:
         delete[] bytes3101;
         delete[] bytes1234;
         delete[] bytes0123;
-        delete mem;
         delete thread;
+        delete mem;
     }
 };
 
@@ -292,6 +292,671 @@ TEST_F(ThreadTest, CreateByteArray)
 }
 
 
+namespace
+{
+    // Temps: $2 array, $3 1, $4 0, $5 jump target, $6 and $7 locals.
+    const byte runTestBytes[] = {
+        Opcode::ARRAY_AT_PUT, 2, 4, 3,      //  0: aput $2 $4 $3
+        Opcode::ARRAY_AT, 2, 4, 6,          //  4: aat $2 $4 > $6
+        Opcode::ARRAY_LENGTH, 2, 7,         //  8: alen $2 > $7
+        Opcode::CONDITIONAL_NOT_ONE, 6,     // 11: ifnot1 $6
+        Opcode::SET_LOCAL, 7, 4,            // 13: set $7 $4
+        Opcode::CONDITIONAL_ONE, 6,         // 16: if1 $6
+        Opcode::JUMP, 5,                    // 18: jmp $5
+        Opcode::HALT,                       // 20: halt
+        Opcode::RETURN_RESULT, 7            // 21: retres $7
+    };
+
+    const byte invalidTempBytes[] = {
+        Opcode::SET_LOCAL, 2, 9             //  0: set $2 $9
+    };
+
+    Ref createRunTestFunction(Memory* mem, byte const* bytes, int size)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 6), mem);
+
+        Ref bytecodes = mem->createUnmanagedByteArray((byte*) bytes, size);
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(2));
+
+        Ref array = ptr2ref(mem->createObjectArray(2), true);
+        fn->atPut(2, array);
+        fn->atPut(3, word2ref(1));
+        fn->atPut(4, word2ref(0));
+        fn->atPut(5, word2ref(21));
+
+        return ptr2ref(fn.ptr());
+    }
+}
+
+TEST_F(ThreadTest, RunMatchesStep)
+{
+    thread->prepareInitialSend(RefHandle(createRunTestFunction(mem, runTestBytes, sizeof(runTestBytes)), mem), RefHandle(zeroRef(), mem));
+
+    while(!thread->halted())
+    {
+        thread->step();
+    }
+
+    long steppedBytecodes = thread->bytecodeCount_;
+    ASSERT_EQ(2L, int_val(thread->cc_->temps()->at(0)));
+
+    Thread runThread(mem);
+    runThread.prepareInitialSend(RefHandle(createRunTestFunction(mem, runTestBytes, sizeof(runTestBytes)), mem), RefHandle(zeroRef(), mem));
+    runThread.execute();
+
+    ASSERT_TRUE(runThread.halted());
+    ASSERT_EQ(2L, int_val(runThread.cc_->temps()->at(0)));
+    ASSERT_EQ(steppedBytecodes, runThread.bytecodeCount_);
+}
+
+TEST_F(ThreadTest, RunValidatesTempIndexes)
+{
+    thread->prepareInitialSend(RefHandle(createRunTestFunction(mem, invalidTempBytes, sizeof(invalidTempBytes)), mem), RefHandle(zeroRef(), mem));
+    thread->step();
+
+    ASSERT_THROW(thread->run(), invalid_temp_index_error);
+    ASSERT_EQ(0, thread->cc_->ip());
+}
+
+namespace
+{
+    void collectGarbage(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->memory_->flipSpaces();
+    }
+
+    const byte identityBytes[] = {
+        Opcode::RETURN_RESULT, 0            //  0: retres $0
+    };
+
+    // Temps: $2 identity function, $3 collectGarbage, $4 42, $5 to $7 locals.
+    const byte framesBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 4, 2, 5,  //  0: send $4 to $2 > $5
+        Opcode::CREATE_OBJECT_ARRAY, 1, 5, 6,   //  4: croa [$5] > $6
+        Opcode::SEND_VAL_TO_VAL, 0, 3,          //  8: send $0 to $3
+        Opcode::SEND_VAL_TO_VAL_WRES, 6, 2, 7,  // 11: send $6 to $2 > $7
+        Opcode::HALT                            // 15: halt
+    };
+
+    Ref createFramesTestFunction(Memory* mem, byte const* bytes, int size)
+    {
+        PtrHandle<SimpleFunction> identity(mem->createObject<SimpleFunction>(1 + 2), mem);
+        identity->atPut(0, mem->createUnmanagedByteArray((byte*) identityBytes, sizeof(identityBytes)));
+        identity->atPut(1, word2ref(0));
+
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 5), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, size));
+        fn->atPut(1, word2ref(3));
+        fn->atPut(2, ptr2ref(identity.ptr()));
+        fn->atPut(3, mem->createNativeFunction(&collectGarbage));
+        fn->atPut(4, word2ref(42));
+
+        return ptr2ref(fn.ptr());
+    }
+}
+
+TEST_F(ThreadTest, SendsDoNotAllocateContexts)
+{
+    const byte sendBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 4, 2, 5,  //  0: send $4 to $2 > $5
+        Opcode::SEND_VAL_TO_VAL_WRES, 5, 2, 6,  //  4: send $5 to $2 > $6
+        Opcode::HALT                            //  8: halt
+    };
+
+    thread->prepareInitialSend(RefHandle(createFramesTestFunction(mem, sendBytes, sizeof(sendBytes)), mem), RefHandle(zeroRef(), mem));
+    thread->step();
+
+    Ref* heapTop = mem->toSpace_->free_;
+    word framesSize = thread->frames_.usedSize();
+
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+    ASSERT_EQ(42L, int_val(thread->cc_->temps()->at(6)));
+    ASSERT_EQ(heapTop, mem->toSpace_->free_);
+    ASSERT_EQ(framesSize, thread->frames_.usedSize());
+}
+
+TEST_F(ThreadTest, FramesAreRoots)
+{
+    thread->prepareInitialSend(RefHandle(createFramesTestFunction(mem, framesBytes, sizeof(framesBytes)), mem), RefHandle(zeroRef(), mem));
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+
+    Ref array = thread->cc_->temps()->at(7);
+    ASSERT_TRUE(mem->toSpace_->contains(array));
+    ASSERT_EQ(42L, int_val(cast<ObjectArray>(array)->at(0)));
+    ASSERT_EQ(array, thread->cc_->temps()->at(6));
+}
+
+namespace
+{
+    int countdown;
+
+    void countdownMetaobject(Thread* thread, int resultTmp, Ref metaMessage)
+    {
+        --countdown;
+        thread->setResult(resultTmp, word2ref(countdown > 0 ? 1 : 0));
+    }
+
+    // Temps: $2 object, $3 0, $4 and $5 locals.
+    const byte cachedSendBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 0, 2, 4,  //  0: send $0 to $2 > $4
+        Opcode::CONDITIONAL_ONE, 4,             //  4: if1 $4
+        Opcode::JUMP, 3,                        //  6: jmp $3
+        Opcode::HALT                            //  8: halt
+    };
+}
+
+TEST_F(ThreadTest, SendCacheHits)
+{
+    Object* target = mem->createObject<Object>(2);
+    target->atPut(0, mem->createNativeFunction(&countdownMetaobject));
+
+    PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 4), mem);
+    fn->atPut(0, mem->createUnmanagedByteArray((byte*) cachedSendBytes, sizeof(cachedSendBytes)));
+    fn->atPut(1, word2ref(2));
+    fn->atPut(2, ptr2ref(target));
+    fn->atPut(3, word2ref(0));
+
+    countdown = 5;
+    thread->prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+    ASSERT_EQ(0, countdown);
+
+    SendCache& cache = mem->codeCache_.get(cast<ByteArray>(fn->at(0)), 0)->sendCaches_[0];
+    ASSERT_EQ(1L, cache.misses_);
+    ASSERT_EQ(4L, cache.hits_);
+    ASSERT_EQ(1, cache.count_);
+    ASSERT_EQ(SendCache::NATIVE_FUNCTION, cache.entries_[0].kind);
+    ASSERT_EQ(target->metaObject_, cache.entries_[0].key);
+}
+
+TEST_F(ThreadTest, SendCacheChecksModifiedFunctions)
+{
+    const byte sendBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 4, 2, 5,  //  0: send $4 to $2 > $5
+        Opcode::HALT                            //  4: halt
+    };
+
+    RefHandle fn(createFramesTestFunction(mem, sendBytes, sizeof(sendBytes)), mem);
+
+    for(int i = 0; i < 2; ++i)
+    {
+        thread->prepareInitialSend(fn, RefHandle(zeroRef(), mem));
+        thread->halt_ = false;
+        thread->execute();
+    }
+
+    SimpleFunction* identity = cast<SimpleFunction>(cast<SimpleFunction>(fn.ref())->at(2));
+    SendCache& cache = mem->codeCache_.get(cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0)), 0)->sendCaches_[0];
+
+    ASSERT_EQ(1L, cache.misses_);
+    ASSERT_EQ(1L, cache.hits_);
+    ASSERT_EQ(SendCache::SIMPLE_FUNCTION, cache.entries_[0].kind);
+
+    // A modified function is verified again instead of being trusted by the cache.
+    identity->atPut(1, word2ref(1));
+
+    thread->prepareInitialSend(fn, RefHandle(zeroRef(), mem));
+    thread->halt_ = false;
+    thread->execute();
+
+    ASSERT_EQ(2L, cache.misses_);
+    ASSERT_EQ(1, cache.count_);
+    ASSERT_EQ(42L, int_val(thread->cc_->temps()->at(5)));
+}
+
+namespace
+{
+    const byte returnRealMsgBytes[] = {
+        Opcode::META_ARGS, 2, 3,            //  0: margs $2 $3
+        Opcode::RETURN_RESULT, 3            //  3: retres $3
+    };
+
+    const byte returnTargetBytes[] = {
+        Opcode::META_ARGS, 2, 3,            //  0: margs $2 $3
+        Opcode::RETURN_RESULT, 2            //  3: retres $2
+    };
+
+    Ref createMetaArgsFunction(Memory* mem, byte const* bytes, int size)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 2), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, size));
+        fn->atPut(1, word2ref(2));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    // Temps: $2 object, $3 42, $4 metaobject of the object, $5 to $7 locals.
+    const byte metaSendBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 3, 2, 5,  //  0: send $3 to $2 > $5
+        Opcode::HALT                            //  4: halt
+    };
+
+    const byte explicitMetaMessageBytes[] = {
+        Opcode::CREATE_OBJECT_ARRAY, 3, 1, 2, 3, 5, //  0: croa [$1, $2, $3] > $5
+        Opcode::SEND_VAL_TO_VAL_WRES, 5, 4, 6,      //  6: send $5 to $4 > $6
+        Opcode::SEND_VAL_TO_VAL_WRES, 3, 2, 7,      // 10: send $3 to $2 > $7
+        Opcode::HALT                                // 14: halt
+    };
+
+    Ref createMetaSendTestFunction(Memory* mem, Ref metaObject, byte const* bytes, int size)
+    {
+        RefHandle mo(metaObject, mem);
+
+        PtrHandle<Object> target(mem->createObject<Object>(2), mem);
+        target->atPut(0, mo.ref());
+
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 5), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, size));
+        fn->atPut(1, word2ref(3));
+        fn->atPut(2, ptr2ref(target.ptr()));
+        fn->atPut(3, word2ref(42));
+        fn->atPut(4, mo.ref());
+
+        return ptr2ref(fn.ptr());
+    }
+}
+
+TEST_F(ThreadTest, MetaArgsSendsDoNotAllocate)
+{
+    Ref mo = createMetaArgsFunction(mem, returnRealMsgBytes, sizeof(returnRealMsgBytes));
+    RefHandle fn(createMetaSendTestFunction(mem, mo, metaSendBytes, sizeof(metaSendBytes)), mem);
+    long allocations = mem->allocations_;
+
+    // The first send goes through the cache miss path, the second one hits the cache.
+    for(int i = 0; i < 2; ++i)
+    {
+        thread->prepareInitialSend(fn, RefHandle(zeroRef(), mem));
+        thread->halt_ = false;
+        thread->execute();
+
+        ASSERT_TRUE(thread->halted());
+        ASSERT_EQ(42L, int_val(thread->cc_->temps()->at(5)));
+    }
+
+    ASSERT_EQ(allocations, mem->allocations_);
+
+    SendCache& cache = mem->codeCache_.get(cast<ByteArray>(cast<SimpleFunction>(fn.ref())->at(0)), 0)->sendCaches_[0];
+    ASSERT_EQ(1L, cache.hits_);
+    ASSERT_EQ(SendCache::META_ARGS_FUNCTION, cache.entries_[0].kind);
+}
+
+TEST_F(ThreadTest, MetaArgsFromMetaMessage)
+{
+    Ref mo = createMetaArgsFunction(mem, returnTargetBytes, sizeof(returnTargetBytes));
+    RefHandle fn(createMetaSendTestFunction(mem, mo, explicitMetaMessageBytes, sizeof(explicitMetaMessageBytes)), mem);
+
+    thread->prepareInitialSend(fn, RefHandle(zeroRef(), mem));
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+
+    // Both conventions deliver the same target.
+    Ref target = cast<SimpleFunction>(fn.ref())->at(2);
+    ASSERT_EQ(target, thread->cc_->temps()->at(6));
+    ASSERT_EQ(set_array_access(target), thread->cc_->temps()->at(7));
+}
+
+TEST_F(ThreadTest, MetaArgsRequiresMetaMessage)
+{
+    RefHandle mo(createMetaArgsFunction(mem, returnTargetBytes, sizeof(returnTargetBytes)), mem);
+
+    thread->prepareInitialSend(mo, RefHandle(word2ref(42), mem));
+    thread->step();
+
+    ASSERT_THROW(thread->run(), invalid_meta_message_error);
+}
+
+namespace
+{
+    int arithmeticHandlerCalls;
+
+    void arithmeticHandler(Thread* thread, int resultTmp, Ref message)
+    {
+        ++arithmeticHandlerCalls;
+
+        ASSERT_TRUE(is_object_array(message));
+        ASSERT_TRUE(array_access(message));
+        ASSERT_EQ((word) 2, cast<ObjectArray>(message)->size());
+
+        thread->setResult(resultTmp, word2ref(-1));
+    }
+
+    /**
+     * Runs "op $2 $3 with $4 > $5" on the operands, either with step() or with run(), and
+     * returns the result. Unless another handler is given the handler answers -1.
+     */
+    Ref runArithmetic(Memory* mem, byte opcode, Ref lhs, Ref rhs, bool stepped, Ref handler = zeroRef())
+    {
+        const byte bytes[] = {
+            opcode, 2, 3, 4, 5,             //  0: op $2 $3 with $4 > $5
+            Opcode::HALT                    //  5: halt
+        };
+
+        RefHandle lhsHandle(lhs, mem);
+        RefHandle rhsHandle(rhs, mem);
+        RefHandle handlerHandle(handler, mem);
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 5), mem);
+
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, sizeof(bytes)));
+        fn->atPut(1, word2ref(1));
+        fn->atPut(2, lhsHandle.ref());
+        fn->atPut(3, rhsHandle.ref());
+        fn->atPut(4, handlerHandle.ref() == zeroRef() ? mem->createNativeFunction(&arithmeticHandler) : handlerHandle.ref());
+
+        Thread thread(mem);
+        thread.prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+
+        while(!thread.halted())
+        {
+            if(stepped)
+            {
+                thread.step();
+            }
+            else
+            {
+                thread.run();
+            }
+        }
+
+        return thread.cc_->temps()->at(5);
+    }
+
+    struct ArithmeticCase
+    {
+        byte opcode;
+        word lhs;
+        word rhs;
+        word result;
+    };
+
+    const word maxInt = ((word) 1 << 61) - 1;
+
+    // A result of -1 comes from the handler.
+    const ArithmeticCase arithmeticCases[] = {
+        {Opcode::ADD, 7, 3, 10},
+        {Opcode::SUBTRACT, 7, 3, 4},
+        {Opcode::MULTIPLY, 7, -3, -21},
+        {Opcode::DIVIDE, -7, 2, -3},
+        {Opcode::MODULO, -7, 4, -3},
+        {Opcode::LESS_THAN, 7, 3, 0},
+        {Opcode::GREATER_THAN, 7, 3, 1},
+        {Opcode::EQUAL, 7, 7, 1},
+        {Opcode::ADD, maxInt, 1, -1},
+        {Opcode::SUBTRACT, -maxInt - 1, 1, -1},
+        {Opcode::MULTIPLY, (word) 1 << 40, (word) 1 << 40, -1},
+        {Opcode::MULTIPLY, maxInt, maxInt, -1},
+        {Opcode::DIVIDE, 7, 0, -1},
+        {Opcode::DIVIDE, -maxInt - 1, -1, -1},
+        {Opcode::MODULO, 7, 0, -1}
+    };
+}
+
+TEST_F(ThreadTest, ArithmeticOnIntegers)
+{
+    for(size_t i = 0; i < sizeof(arithmeticCases) / sizeof(arithmeticCases[0]); ++i)
+    {
+        ArithmeticCase const& c = arithmeticCases[i];
+
+        for(int stepped = 0; stepped < 2; ++stepped)
+        {
+            arithmeticHandlerCalls = 0;
+
+            Ref result = runArithmetic(mem, c.opcode, word2ref(c.lhs), word2ref(c.rhs), stepped);
+
+            ASSERT_TRUE(is_int(result)) << "case " << i;
+            ASSERT_EQ(c.result, int_val(result)) << "case " << i;
+            ASSERT_EQ(c.result == -1 ? 1 : 0, arithmeticHandlerCalls) << "case " << i;
+        }
+    }
+}
+
+TEST_F(ThreadTest, ArithmeticSendsOtherOperandsToHandler)
+{
+    for(int stepped = 0; stepped < 2; ++stepped)
+    {
+        arithmeticHandlerCalls = 0;
+
+        Ref result = runArithmetic(mem, Opcode::ADD, mem->createByteArrayFromString("one"), word2ref(1), stepped);
+        ASSERT_EQ(-1L, int_val(result));
+
+        result = runArithmetic(mem, Opcode::LESS_THAN, word2ref(1), mem->createFloat(2.5), stepped);
+        ASSERT_EQ(-1L, int_val(result));
+
+        ASSERT_EQ(2, arithmeticHandlerCalls);
+    }
+}
+
+TEST_F(ThreadTest, ArithmeticDoesNotAllocate)
+{
+    // Temps: $2 counter, $3 1, $4 limit, $5 jump target, $6 handler, $7 condition.
+    const byte loopBytes[] = {
+        Opcode::ADD, 2, 3, 6, 2,            //  0: add $2 $3 with $6 > $2
+        Opcode::LESS_THAN, 2, 4, 6, 7,      //  5: lt $2 $4 with $6 > $7
+        Opcode::CONDITIONAL_ONE, 7,         // 10: if1 $7
+        Opcode::JUMP, 5,                    // 12: jmp $5
+        Opcode::RETURN_RESULT, 2            // 14: retres $2
+    };
+
+    PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 7), mem);
+    fn->atPut(0, mem->createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+    fn->atPut(1, word2ref(1));
+    fn->atPut(2, word2ref(0));
+    fn->atPut(3, word2ref(1));
+    fn->atPut(4, word2ref(1000));
+    fn->atPut(5, word2ref(0));
+    fn->atPut(6, mem->createNativeFunction(&arithmeticHandler));
+
+    thread->prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+    thread->step();
+
+    long allocations = mem->allocations_;
+    arithmeticHandlerCalls = 0;
+
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+    ASSERT_EQ(1000L, int_val(thread->cc_->temps()->at(0)));
+    ASSERT_EQ(allocations, mem->allocations_);
+    ASSERT_EQ(0, arithmeticHandlerCalls);
+    ASSERT_EQ(1L, thread->sendCount_);
+}
+
+namespace
+{
+    int directNativeCalls;
+
+    void subtractDirect(Thread* thread, int resultTmp, Ref const* args)
+    {
+        ++directNativeCalls;
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) - int_val(args[1])));
+    }
+
+    void addDirect(Thread* thread, int resultTmp, Ref const* args)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(args[0]) + int_val(args[1])));
+    }
+
+    void messageSize(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(is_object_array(message) ? cast<ObjectArray>(message)->size() : -1));
+    }
+
+    void arraySizeDirect(Thread* thread, int resultTmp, Ref const* args)
+    {
+        ++directNativeCalls;
+        thread->setResult(resultTmp, word2ref(cast<ObjectArray>(args[0])->size()));
+    }
+
+    Ref createDirectNative(Memory* mem, NativeFunction::DirectFunT fn, char const* signature)
+    {
+        uword sig;
+
+        EXPECT_TRUE(NativeSignature::parse(signature, sig));
+        return mem->createDirectNativeFunction(fn, sig);
+    }
+
+    /**
+     * Runs "call $2 [$3, $4] > $5" either with step() or with run() and returns the result.
+     */
+    Ref runCallNative(Memory* mem, Ref native, Ref lhs, Ref rhs, bool stepped)
+    {
+        const byte bytes[] = {
+            Opcode::CALL_NATIVE, 2, 2, 3, 4, 5, //  0: call $2 [$3, $4] > $5
+            Opcode::HALT                        //  6: halt
+        };
+
+        RefHandle nativeHandle(native, mem);
+        RefHandle lhsHandle(lhs, mem);
+        RefHandle rhsHandle(rhs, mem);
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 5), mem);
+
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) bytes, sizeof(bytes)));
+        fn->atPut(1, word2ref(1));
+        fn->atPut(2, nativeHandle.ref());
+        fn->atPut(3, lhsHandle.ref());
+        fn->atPut(4, rhsHandle.ref());
+
+        Thread thread(mem);
+        thread.prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+
+        while(!thread.halted())
+        {
+            if(stepped)
+            {
+                thread.step();
+            }
+            else
+            {
+                thread.run();
+            }
+        }
+
+        return thread.cc_->temps()->at(5);
+    }
+}
+
+TEST_F(ThreadTest, CallNativeCallsDirectNatives)
+{
+    for(int stepped = 0; stepped < 2; ++stepped)
+    {
+        directNativeCalls = 0;
+
+        Ref result = runCallNative(mem, createDirectNative(mem, &subtractDirect, "ii"), word2ref(7), word2ref(3), stepped);
+
+        ASSERT_EQ(4L, int_val(result));
+        ASSERT_EQ(1, directNativeCalls);
+    }
+}
+
+TEST_F(ThreadTest, CallNativeChecksSignature)
+{
+    for(int stepped = 0; stepped < 2; ++stepped)
+    {
+        directNativeCalls = 0;
+
+        ASSERT_THROW(runCallNative(mem, createDirectNative(mem, &subtractDirect, "ii"), word2ref(7), mem->createFloat(2.5), stepped), invalid_native_arguments_error);
+        ASSERT_EQ(0, directNativeCalls);
+    }
+}
+
+TEST_F(ThreadTest, CallNativeSendsArgumentsToOtherFunctions)
+{
+    for(int stepped = 0; stepped < 2; ++stepped)
+    {
+        Ref result = runCallNative(mem, mem->createNativeFunction(&messageSize), word2ref(7), word2ref(3), stepped);
+        ASSERT_EQ(2L, int_val(result));
+
+        // A direct native taking another number of arguments receives them as a message.
+        directNativeCalls = 0;
+        result = runCallNative(mem, createDirectNative(mem, &arraySizeDirect, "a"), word2ref(7), word2ref(3), stepped);
+
+        ASSERT_EQ(2L, int_val(result));
+        ASSERT_EQ(1, directNativeCalls);
+    }
+}
+
+extern "C"
+{
+    extern char const fn_divInt_signature[];
+    extern char const fn_modInt_signature[];
+
+    void fn_divInt(Thread* thread, int resultTmp, Ref const* args);
+    void fn_modInt(Thread* thread, int resultTmp, Ref const* args);
+}
+
+TEST_F(ThreadTest, IntegerPrimitivesRejectZeroDivisor)
+{
+    RefHandle divInt(createDirectNative(mem, &fn_divInt, fn_divInt_signature), mem);
+    RefHandle modInt(createDirectNative(mem, &fn_modInt, fn_modInt_signature), mem);
+
+    for(int stepped = 0; stepped < 2; ++stepped)
+    {
+        // The opcodes send a zero divisor to their handler.
+        ASSERT_EQ(zeroRef(), runArithmetic(mem, Opcode::DIVIDE, word2ref(7), word2ref(0), stepped, divInt.ref()));
+        ASSERT_EQ(zeroRef(), runArithmetic(mem, Opcode::MODULO, word2ref(7), word2ref(0), stepped, modInt.ref()));
+
+        ASSERT_EQ(zeroRef(), runCallNative(mem, divInt.ref(), word2ref(7), word2ref(0), stepped));
+        ASSERT_EQ(zeroRef(), runCallNative(mem, modInt.ref(), word2ref(7), word2ref(0), stepped));
+
+        ASSERT_EQ(-3L, int_val(runCallNative(mem, divInt.ref(), word2ref(-7), word2ref(2), stepped)));
+        ASSERT_EQ(-3L, int_val(runCallNative(mem, modInt.ref(), word2ref(-7), word2ref(4), stepped)));
+    }
+}
+
+TEST_F(ThreadTest, DirectNativesReceiveMessageElements)
+{
+    RefHandle native(createDirectNative(mem, &subtractDirect, "ii"), mem);
+
+    thread->prepareInitialSend(native, RefHandle(ptr2ref(mem->createObjectArray(RefHandle(word2ref(7), mem), RefHandle(word2ref(3), mem)), true), mem));
+    thread->step();
+    ASSERT_EQ(4L, int_val(thread->cc_->temps()->at(0)));
+
+    thread->prepareInitialSend(native, RefHandle(word2ref(7), mem));
+    ASSERT_THROW(thread->step(), invalid_native_arguments_error);
+}
+
+TEST_F(ThreadTest, CallNativeDoesNotAllocate)
+{
+    // Temps: $2 counter, $3 1, $4 limit, $5 jump target, $6 add, $7 condition, $8 handler.
+    const byte loopBytes[] = {
+        Opcode::CALL_NATIVE, 2, 6, 2, 3, 2, //  0: call $6 [$2, $3] > $2
+        Opcode::LESS_THAN, 2, 4, 8, 7,      //  6: lt $2 $4 with $8 > $7
+        Opcode::CONDITIONAL_ONE, 7,         // 11: if1 $7
+        Opcode::JUMP, 5,                    // 13: jmp $5
+        Opcode::RETURN_RESULT, 2            // 15: retres $2
+    };
+
+    PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 9), mem);
+    fn->atPut(0, mem->createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+    fn->atPut(1, word2ref(1));
+    fn->atPut(2, word2ref(0));
+    fn->atPut(3, word2ref(1));
+    fn->atPut(4, word2ref(1000));
+    fn->atPut(5, word2ref(0));
+    fn->atPut(6, createDirectNative(mem, &addDirect, "ii"));
+    fn->atPut(7, word2ref(0));
+    fn->atPut(8, mem->createNativeFunction(&arithmeticHandler));
+
+    thread->prepareInitialSend(RefHandle(ptr2ref(fn.ptr()), mem), RefHandle(zeroRef(), mem));
+    thread->step();
+
+    long allocations = mem->allocations_;
+
+    thread->execute();
+
+    ASSERT_TRUE(thread->halted());
+    ASSERT_EQ(1000L, int_val(thread->cc_->temps()->at(0)));
+    ASSERT_EQ(allocations, mem->allocations_);
+    ASSERT_EQ(1001L, thread->sendCount_);
+}
+
 TEST_F(ThreadTest, ContinuationCall)
 {
     // TODO: Write test for Continuation::call
@@ -0,0 +1,152 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <vm/Thread.hpp>
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace atom;
+
+namespace
+{
+    void add1(Thread* thread, int resultTmp, Ref message)
+    {
+        thread->setResult(resultTmp, word2ref(int_val(message) + 1));
+    }
+
+    // Temps: $2 add1, $3 identity, $4 limit, $5 loop ip, $6 object with identity as its
+    // metaobject, $7 counter, $8 condition, $9 local.
+    const byte loopBytes[] = {
+        Opcode::SEND_VAL_TO_VAL_WRES, 7, 2, 7,  //  0: send $7 to $2 > $7
+        Opcode::SEND_VAL_TO_VAL_WRES, 7, 3, 9,  //  4: send $7 to $3 > $9
+        Opcode::LESS_THAN, 7, 4, 2, 8,          //  8: lt $7 $4 with $2 > $8
+        Opcode::CONDITIONAL_ONE, 8,             // 13: if1 $8
+        Opcode::JUMP, 5,                        // 15: jmp $5
+        Opcode::SEND_VAL_TO_VAL_WRES, 7, 6, 9,  // 17: send $7 to $6 > $9
+        Opcode::RETURN_RESULT, 7                // 21: retres $7
+    };
+
+    const byte identityBytes[] = {
+        Opcode::RETURN_RESULT, 0                // 0: retres $0
+    };
+
+    Ref createLoop(Memory* mem, word limit)
+    {
+        PtrHandle<SimpleFunction> identity(mem->createObject<SimpleFunction>(1 + 2), mem);
+        identity->atPut(0, mem->createUnmanagedByteArray((byte*) identityBytes, sizeof(identityBytes)));
+        identity->atPut(1, word2ref(0));
+
+        PtrHandle<Object> object(mem->createObject<Object>(2), mem);
+        object->atPut(0, ptr2ref(identity.ptr()));
+
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 8), mem);
+        fn->atPut(0, mem->createUnmanagedByteArray((byte*) loopBytes, sizeof(loopBytes)));
+        fn->atPut(1, word2ref(2));
+        fn->atPut(2, mem->createNativeFunction(&add1));
+        fn->atPut(3, ptr2ref(identity.ptr()));
+        fn->atPut(4, word2ref(limit));
+        fn->atPut(5, word2ref(0));
+        fn->atPut(6, ptr2ref(object.ptr()));
+        fn->atPut(7, word2ref(0));
+
+        return ptr2ref(fn.ptr());
+    }
+
+    void runLoop(Memory* mem, Thread* thread, bool stepwise)
+    {
+        thread->prepareInitialSend(RefHandle(createLoop(mem, 10), mem), RefHandle(zeroRef(), mem));
+
+        if(stepwise)
+        {
+            while(!thread->halted())
+            {
+                thread->step();
+            }
+        }
+        else
+        {
+            thread->execute();
+        }
+
+        ASSERT_EQ(10L, int_val(thread->cc_->temps()->at(0)));
+    }
+}
+
+TEST(ThreadStatsTest, CountsInstructionsAndSends)
+{
+    Memory mem(4096);
+    Thread thread(&mem);
+    mem.setThread(&thread);
+
+    runLoop(&mem, &thread, false);
+
+    ThreadStats const& stats = thread.stats_;
+
+    if(!ThreadStats::enabled())
+    {
+        std::ostringstream oss;
+        stats.printJson(oss);
+
+        ASSERT_EQ(0L, stats.opcodes_[Opcode::LESS_THAN]);
+        ASSERT_EQ(0L, stats.contexts_);
+        ASSERT_EQ(0u, oss.str().find("{\"enabled\": false, \"opcodes\": {}"));
+        return;
+    }
+
+    // The loop runs ten times, the initial send and the meta send are sent once.
+    ASSERT_EQ(22L, stats.opcodes_[Opcode::SEND_VAL_TO_VAL_WRES]);
+    ASSERT_EQ(10L, stats.opcodes_[Opcode::LESS_THAN]);
+    ASSERT_EQ(10L, stats.opcodes_[Opcode::CONDITIONAL_ONE]);
+    ASSERT_EQ(9L, stats.opcodes_[Opcode::JUMP]);
+    ASSERT_EQ(12L, stats.opcodes_[Opcode::RETURN_RESULT]);
+    ASSERT_EQ(0L, stats.opcodes_[Opcode::ADD]);
+    ASSERT_TRUE(stats.cycles_[Opcode::SEND_VAL_TO_VAL_WRES] > 0);
+
+    ASSERT_EQ(10L, stats.nativeSends_);
+    ASSERT_EQ(12L, stats.simpleFunctionSends_);
+    ASSERT_EQ(1L, stats.metaObjectSends_);
+    ASSERT_EQ(12L, stats.contexts_);
+    ASSERT_EQ(1L, stats.metaMessages_);
+    ASSERT_EQ(0L, stats.exceptions_);
+    ASSERT_EQ(-1, stats.current_);
+}
+
+TEST(ThreadStatsTest, StepCountsLikeRun)
+{
+    Memory mem(4096);
+    Thread stepped(&mem);
+    Thread run(&mem);
+
+    mem.setThread(&stepped);
+    runLoop(&mem, &stepped, true);
+
+    mem.setThread(&run);
+    runLoop(&mem, &run, false);
+
+    for(int i = 0; i < ThreadStats::OPCODE_COUNT; ++i)
+    {
+        ASSERT_EQ(run.stats_.opcodes_[i], stepped.stats_.opcodes_[i]) << ThreadStats::opcodeName(i);
+    }
+
+    ASSERT_EQ(run.stats_.nativeSends_, stepped.stats_.nativeSends_);
+    ASSERT_EQ(run.stats_.simpleFunctionSends_, stepped.stats_.simpleFunctionSends_);
+    ASSERT_EQ(run.stats_.metaObjectSends_, stepped.stats_.metaObjectSends_);
+    ASSERT_EQ(run.stats_.contexts_, stepped.stats_.contexts_);
+
+    ThreadStats total;
+    total.add(run.stats_);
+    total.add(stepped.stats_);
+
+    ASSERT_EQ(2 * run.stats_.opcodes_[Opcode::JUMP], total.opcodes_[Opcode::JUMP]);
+
+    total.reset();
+    ASSERT_EQ(0L, total.opcodes_[Opcode::JUMP]);
+}
@@ -0,0 +1,173 @@
+/**
+ * This file is part of the Atom VM.
+ *
+ * Copyright (C) 2010, Emir Uner
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License v2 as published by
+ * the Free Software Foundation with the exceptions specified in COPYING file.
+ */
+
+#include <cstring>
+#include <vm/Verifier.hpp>
+#include <vm/Memory.hpp>
+#include <vm/Opcode.hpp>
+
+#include <gtest/gtest.h>
+
+using namespace atom;
+
+class VerifierTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        mem = new Memory(1024);
+    }
+
+    virtual void TearDown()
+    {
+        delete mem;
+    }
+
+    /**
+     * Creates a function with the given bytecodes, two extra temps and the known objects
+     * $2 = 0, $3 = jump target.
+     */
+    SimpleFunction* createFunction(byte const* bytes, int size, word jumpTarget)
+    {
+        PtrHandle<SimpleFunction> fn(mem->createObject<SimpleFunction>(1 + 4), mem);
+
+        Ref bytecodes = mem->createUnmanagedByteArray((byte*) bytes, size);
+        fn->atPut(0, bytecodes);
+        fn->atPut(1, word2ref(2));
+        fn->atPut(2, word2ref(0));
+        fn->atPut(3, word2ref(jumpTarget));
+
+        return fn.ptr();
+    }
+
+    Memory* mem;
+};
+
+namespace
+{
+    const byte loopBytes[] = {
+        Opcode::SET_LOCAL, 4, 2,            // 0: set $4 $2
+        Opcode::CONDITIONAL_NOT_ONE, 4,     // 3: ifnot1 $4
+        Opcode::JUMP, 3,                    // 5: jmp $3
+        Opcode::RETURN_RESULT, 5            // 7: retres $5
+    };
+
+    const byte badTempBytes[] = {
+        Opcode::SET_LOCAL, 4, 6             // 0: set $4 $6
+    };
+
+    const byte trailingConditionalBytes[] = {
+        Opcode::SET_LOCAL, 4, 2,            // 0: set $4 $2
+        Opcode::CONDITIONAL_NOT_ONE, 4      // 3: ifnot1 $4
+    };
+
+    const byte writtenJumpTempBytes[] = {
+        Opcode::SET_LOCAL, 3, 2,            // 0: set $3 $2
+        Opcode::JUMP, 3                     // 3: jmp $3
+    };
+
+    const byte dynamicJumpBytes[] = {
+        Opcode::JUMP, 4                     // 0: jmp $4
+    };
+
+    const byte metaArgsJumpTempBytes[] = {
+        Opcode::META_ARGS, 4, 3,            // 0: margs $4 $3
+        Opcode::JUMP, 3                     // 3: jmp $3
+    };
+
+    const byte arithmeticJumpTempBytes[] = {
+        Opcode::ADD, 2, 2, 4, 3,            // 0: add $2 $2 with $4 > $3
+        Opcode::JUMP, 3                     // 5: jmp $3
+    };
+
+    const byte callJumpTempBytes[] = {
+        Opcode::CALL_NATIVE, 1, 4, 2, 3,    // 0: call $4 [$2] > $3
+        Opcode::JUMP, 3                     // 5: jmp $3
+    };
+
+    const byte truncatedCallBytes[] = {
+        Opcode::CALL_NATIVE, 2, 4, 2        // 0: call $4 [$2, ...
+    };
+}
+
+TEST_F(VerifierTest, ValidFunction)
+{
+    SimpleFunction* fn = createFunction(loopBytes, sizeof(loopBytes), 3);
+
+    ASSERT_FALSE(isVerified(fn));
+    ASSERT_TRUE(verifySimpleFunction(fn));
+    ASSERT_TRUE(isVerified(fn));
+    ASSERT_FALSE(fn->header_.unverifiable);
+}
+
+TEST_F(VerifierTest, RejectsInvalidCode)
+{
+    SimpleFunction* fn = createFunction(badTempBytes, sizeof(badTempBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+    ASSERT_TRUE(fn->header_.unverifiable);
+
+    fn = createFunction(trailingConditionalBytes, sizeof(trailingConditionalBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(writtenJumpTempBytes, sizeof(writtenJumpTempBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(dynamicJumpBytes, sizeof(dynamicJumpBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(metaArgsJumpTempBytes, sizeof(metaArgsJumpTempBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(arithmeticJumpTempBytes, sizeof(arithmeticJumpTempBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(callJumpTempBytes, sizeof(callJumpTempBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn = createFunction(truncatedCallBytes, sizeof(truncatedCallBytes), 0);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+}
+
+TEST_F(VerifierTest, RejectsJumpIntoInstruction)
+{
+    SimpleFunction* fn = createFunction(loopBytes, sizeof(loopBytes), 4);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+    ASSERT_FALSE(isVerified(fn));
+}
+
+TEST_F(VerifierTest, ModifyingFunctionClearsVerification)
+{
+    SimpleFunction* fn = createFunction(loopBytes, sizeof(loopBytes), 3);
+    ASSERT_TRUE(verifySimpleFunction(fn));
+
+    fn->atPut(3, word2ref(4));
+    ASSERT_FALSE(isVerified(fn));
+    ASSERT_FALSE(verifySimpleFunction(fn));
+
+    fn->atPut(3, word2ref(3));
+    ASSERT_FALSE(fn->header_.unverifiable);
+    ASSERT_TRUE(verifySimpleFunction(fn));
+}
+
+TEST_F(VerifierTest, ModifiedBytecodesAreNotTrusted)
+{
+    byte bytes[sizeof(loopBytes)];
+    std::memcpy(bytes, loopBytes, sizeof(loopBytes));
+
+    SimpleFunction* fn = createFunction(bytes, sizeof(bytes), 3);
+    ASSERT_TRUE(verifySimpleFunction(fn));
+
+    ByteArray* bytecodes = cast<ByteArray>(fn->at(0));
+    bytecodes->atPut(8, word2ref(4));
+
+    ASSERT_FALSE(isVerified(fn));
+    ASSERT_TRUE(bytecodes->header_.unverifiable);
+    ASSERT_FALSE(verifySimpleFunction(fn));
+}